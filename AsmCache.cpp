@@ -0,0 +1,304 @@
+//
+//		Implementation of the AsmCache class.
+//
+#include "stdafx.h"
+#include <chrono>
+#include <filesystem>
+#include "AsmCache.h"
+#include "Binary.h"
+#include "FileAccess.h"
+#include "Hash.h"
+#include "MappedFile.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    const uint32_t CACHE_MAGIC = 0x43414b51;    // "QKAC"
+    const uint32_t CACHE_FORMAT = 2;            // Layout version of an entry file.
+    const uint64_t DIGEST_SEED = 0x9e3779b97f4a7c15ULL;     // Sets the digest apart from the key.
+    const char* const ENTRY_EXTENSION = ".qac";
+    const char* const TEMP_EXTENSION = ".tmp";
+}
+
+// Constructor for the cache.  The directory is created if it does not exist.
+AsmCache::AsmCache(const string& a_dir, long long a_limit) : m_dir(a_dir), m_limit(a_limit)
+{
+    error_code ec;
+    fs::create_directories(m_dir, ec);
+}
+
+/*
+NAME
+
+    AsmCache::ComputeKey - computes the key of a source program
+
+SYNOPSIS
+
+    uint64_t AsmCache::ComputeKey(const string& a_source, const string& a_version);
+    a_source -> the bytes of the source program
+    a_version -> the version of the assembler
+
+DESCRIPTION
+
+    This function hashes the version of the assembler followed by the
+    source program, so that a new assembler never reuses translations
+    made by an older one.
+
+RETURNS
+
+    The key of the translation
+
+*/
+uint64_t AsmCache::ComputeKey(const string& a_source, const string& a_version)
+{
+    uint64_t key = Hash::Fnv1a(a_version.data(), a_version.size());
+    key = Hash::Fnv1a("\0", 1, key);
+    return Hash::Fnv1a(a_source.data(), a_source.size(), key);
+}
+
+/*
+NAME
+
+    AsmCache::ComputeDigest - computes the digest of a source program
+
+SYNOPSIS
+
+    uint64_t AsmCache::ComputeDigest(const string& a_source);
+    a_source -> the bytes of the source program
+
+DESCRIPTION
+
+    This function hashes the source program again, starting from a seed
+    made from its length rather than from the key's starting value, and
+    scrambles the result.  Two sources whose keys collide would also
+    need the same length and the same digest to be taken for each other.
+
+RETURNS
+
+    The digest of the source program
+
+*/
+uint64_t AsmCache::ComputeDigest(const string& a_source)
+{
+    uint64_t seed = Hash::Mix(a_source.size() ^ DIGEST_SEED);
+    return Hash::Mix(Hash::Fnv1a(a_source.data(), a_source.size(), seed));
+}
+
+/*
+NAME
+
+    AsmCache::Lookup - finds a cached translation
+
+SYNOPSIS
+
+    bool AsmCache::Lookup(uint64_t a_key, uint64_t a_digest, Entry& a_entry);
+    a_key -> the key of the translation
+    a_digest -> the digest of the source program
+    a_entry -> the storage for the translation that was found
+
+DESCRIPTION
+
+    This function maps the entry file for the key and decodes it.  An
+    entry that is missing, was written by another format, fails its
+    checksum or was made from a source with another digest is treated
+    as a miss.  A hit marks the entry as recently
+    used by updating its modification time.
+
+RETURNS
+
+    Whether a usable translation was found
+
+*/
+bool AsmCache::Lookup(uint64_t a_key, uint64_t a_digest, Entry& a_entry)
+{
+    string path = EntryPath(a_key);
+
+    // Another assembler may evict the entry at any time; failing to map it is a miss.
+    MappedFile file;
+    if (!file.Open(path) || file.GetSize() < 2 * sizeof(uint64_t)) {
+        return false;
+    }
+
+    // The checksum covers everything before it.
+    size_t payload = file.GetSize() - sizeof(uint64_t);
+    uint64_t checksum;
+    memcpy(&checksum, file.GetData() + payload, sizeof(checksum));
+    if (checksum != Hash::Fnv1a(file.GetData(), payload)) {
+        return false;
+    }
+
+    BinaryReader in(file.GetData(), payload);
+    if (in.GetUInt32() != CACHE_MAGIC || in.GetUInt32() != CACHE_FORMAT || in.GetUInt64() != a_key
+        || in.GetUInt64() != a_digest) {
+        return false;
+    }
+
+    a_entry = Entry();
+    uint32_t count = in.GetUInt32();
+    for (uint32_t i = 0; i < count && !in.Failed(); i++) {
+        string symbol = in.GetString();
+        a_entry.m_symbols[symbol] = in.GetInt32();
+    }
+    count = in.GetUInt32();
+    for (uint32_t i = 0; i < count && !in.Failed(); i++) {
+        int loc = in.GetInt32();
+        int contents = in.GetInt32();
+        a_entry.m_image.AddWord(loc, contents, in.GetByte() != 0);
+    }
+    count = in.GetUInt32();
+    for (uint32_t i = 0; i < count && !in.Failed(); i++) {
+        a_entry.m_diagnostics.push_back(in.GetString());
+    }
+    a_entry.m_listing = in.GetString();
+    if (in.Failed()) {
+        return false;
+    }
+
+    // Mark the entry as recently used for eviction.
+    error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    return true;
+}
+
+/*
+NAME
+
+    AsmCache::Store - records a translation
+
+SYNOPSIS
+
+    void AsmCache::Store(uint64_t a_key, uint64_t a_digest, const Entry& a_entry);
+    a_key -> the key of the translation
+    a_digest -> the digest of the source program
+    a_entry -> the translation to be recorded
+
+DESCRIPTION
+
+    This function writes the entry to a uniquely named temporary file
+    and then renames it into place, so other assemblers sharing the
+    directory see either the complete entry or none at all.  Failing
+    to write to the cache is not an error; the translation is simply
+    not cached.
+
+*/
+void AsmCache::Store(uint64_t a_key, uint64_t a_digest, const Entry& a_entry)
+{
+    BinaryWriter out;
+    out.PutUInt32(CACHE_MAGIC);
+    out.PutUInt32(CACHE_FORMAT);
+    out.PutUInt64(a_key);
+    out.PutUInt64(a_digest);
+
+    out.PutUInt32((uint32_t)a_entry.m_symbols.size());
+    for (const auto& symbol : a_entry.m_symbols) {
+        out.PutString(symbol.first);
+        out.PutInt32(symbol.second);
+    }
+    out.PutUInt32((uint32_t)a_entry.m_image.GetWords().size());
+    for (const MemoryImage::Word& word : a_entry.m_image.GetWords()) {
+        out.PutInt32(word.m_loc);
+        out.PutInt32(word.m_contents);
+        out.PutByte(word.m_isCode ? 1 : 0);
+    }
+    out.PutUInt32((uint32_t)a_entry.m_diagnostics.size());
+    for (const string& message : a_entry.m_diagnostics) {
+        out.PutString(message);
+    }
+    out.PutString(a_entry.m_listing);
+    out.PutUInt64(Hash::Fnv1a(out.GetBytes().data(), out.GetBytes().size()));
+
+    if (!FileAccess::WriteAtomically(EntryPath(a_key), out.GetBytes())) {
+        return;
+    }
+
+    Evict();
+}
+
+/*
+NAME
+
+    AsmCache::Evict - enforces the size limit of the cache
+
+SYNOPSIS
+
+    void AsmCache::Evict();
+
+DESCRIPTION
+
+    This function removes the least recently used entries until the
+    total size of the entries is within the limit.  Temporary files
+    abandoned by assemblers that terminated while writing are removed
+    once they are an hour old.  Entries removed by another process
+    in the meantime are skipped.
+
+*/
+void AsmCache::Evict()
+{
+    struct Candidate {
+        fs::path m_path;
+        fs::file_time_type m_used;
+        uintmax_t m_size;
+    };
+    vector<Candidate> entries;
+    uintmax_t total = 0;
+    fs::file_time_type stale = fs::file_time_type::clock::now() - chrono::hours(1);
+
+    error_code ec;
+    for (fs::directory_iterator it(m_dir, ec), end; !ec && it != end; it.increment(ec)) {
+        const fs::path& path = it->path();
+        error_code ignore;
+        fs::file_time_type used = fs::last_write_time(path, ignore);
+        if (ignore) {
+            continue;
+        }
+        if (path.extension() == TEMP_EXTENSION) {
+            if (used < stale) {
+                fs::remove(path, ignore);
+            }
+            continue;
+        }
+        if (path.extension() != ENTRY_EXTENSION) {
+            continue;
+        }
+        uintmax_t size = fs::file_size(path, ignore);
+        if (ignore) {
+            continue;
+        }
+        entries.push_back({ path, used, size });
+        total += size;
+    }
+
+    if (total <= (uintmax_t)m_limit) {
+        return;
+    }
+
+    sort(entries.begin(), entries.end(), [](const Candidate& a, const Candidate& b) { return a.m_used < b.m_used; });
+    for (const Candidate& entry : entries) {
+        if (total <= (uintmax_t)m_limit) {
+            break;
+        }
+        error_code ignore;
+        fs::remove(entry.m_path, ignore);
+        total -= entry.m_size;
+    }
+}
+
+/*
+NAME
+
+    AsmCache::EntryPath - names the file of an entry
+
+SYNOPSIS
+
+    string AsmCache::EntryPath(uint64_t a_key) const;
+    a_key -> the key of the translation
+
+RETURNS
+
+    The path of the entry file within the cache directory
+
+*/
+string AsmCache::EntryPath(uint64_t a_key) const
+{
+    return (fs::path(m_dir) / (Hash::ToHex(a_key) + ENTRY_EXTENSION)).string();
+}
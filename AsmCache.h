@@ -0,0 +1,81 @@
+//
+//		Class to manage an on-disk cache of translations keyed by the content
+//		of the source program.  Several assemblers may share one cache directory.
+//
+#pragma once
+
+#include <stdint.h>
+#include <streambuf>
+#include "MemoryImage.h"
+
+class AsmCache {
+
+public:
+
+    // A cached translation.
+    struct Entry {
+        map<string, int> m_symbols;     // The symbol table.
+        MemoryImage m_image;            // The translated program.
+        vector<string> m_diagnostics;   // The error messages of the translation.
+        string m_listing;               // The listing displayed while translating.
+    };
+
+    AsmCache(const string& a_dir, long long a_limit);
+    ~AsmCache() {};
+
+    // Computes the key of a source program for a given version of the assembler.
+    static uint64_t ComputeKey(const string& a_source, const string& a_version);
+
+    // Computes a second hash of a source program, independent of its key, that tells
+    // apart sources whose keys collide.
+    static uint64_t ComputeDigest(const string& a_source);
+
+    // Looks up a translation.  Returns false if there is no usable entry.
+    bool Lookup(uint64_t a_key, uint64_t a_digest, Entry& a_entry);
+
+    // Records a translation, evicting the least recently used entries if the cache is full.
+    void Store(uint64_t a_key, uint64_t a_digest, const Entry& a_entry);
+
+private:
+
+    // Returns the name of the file holding an entry.
+    string EntryPath(uint64_t a_key) const;
+
+    // Removes entries until the cache is within its size limit.
+    void Evict();
+
+    string m_dir;           // The cache directory.
+    long long m_limit;      // The size limit of the cache in bytes.
+};
+
+// Stream buffer that copies everything written through it to a second buffer,
+// so that the listing can be displayed and captured at the same time.
+class OutputTee : public streambuf {
+
+public:
+
+    OutputTee(streambuf* a_display, string& a_capture) : m_display(a_display), m_capture(a_capture) {};
+    ~OutputTee() {};
+
+protected:
+
+    int overflow(int a_ch) override {
+        if (a_ch != EOF) {
+            m_capture.push_back((char)a_ch);
+            return m_display->sputc((char)a_ch);
+        }
+        return 0;
+    }
+
+    streamsize xsputn(const char* a_str, streamsize a_count) override {
+        m_capture.append(a_str, (size_t)a_count);
+        return m_display->sputn(a_str, a_count);
+    }
+
+    int sync() override { return m_display->pubsync(); }
+
+private:
+
+    streambuf* m_display;   // Where the output is displayed.
+    string& m_capture;      // Where the output is captured.
+};
@@ -9,19 +9,76 @@
 int main(int argc, char* argv[]) {
     Assembler assem(argc, argv);
 
-    // Establish the location of the labels:
-    assem.PassI();
+    // Sources are packed into an archive instead of being run.
+    if (assem.IsPacking()) {
+        int status = assem.Pack() ? 0 : 1;
+        assem.ReportStats();
+        return status;
+    }
 
-    // Display the symbol table.
-    assem.DisplaySymbolTable();
+    // Object files are linked instead of assembling a source.
+    if (assem.IsLinking()) {
+        if (!assem.Link()) {
+            assem.ReportStats();
+            return 1;
+        }
+    }
+    // A program packed in an archive is loaded instead of assembling a source.
+    else if (assem.IsLoadingFromArchive()) {
+        if (!assem.LoadFromArchive()) {
+            assem.ReportStats();
+            return 1;
+        }
+    }
+    // A source that can only be read once, such as a pipe, is translated in one pass.
+    else if (assem.IsStreaming()) {
+        assem.PassII();
+    }
+    // The passes are only needed if this source has not been translated before.
+    else if (!assem.LoadCachedTranslation()) {
 
-    // Output the symbol table and the translation.
-    assem.PassII();
+        // Establish the location of the labels:
+        assem.PassI();
 
-    // Run the emulator on the Quack3200 program that was generated in Pass II.
-    assem.RunProgramInEmulator();
+        // Display the symbol table.
+        assem.DisplaySymbolTable();
 
-    // Terminate indicating all is well.  If there is an unrecoverable error, the 
+        // Output the symbol table and the translation.
+        assem.PassII();
+
+        // Keep the translation for the next time this source is assembled.
+        assem.StoreCachedTranslation();
+    }
+
+    // Write a relocatable module instead of running the program, if asked to.
+    if (assem.IsWritingObject()) {
+        int status = assem.WriteObject() ? 0 : 1;
+        assem.ReportStats();
+        return status;
+    }
+
+    // Evaluate what depends only on the fixed input, if asked to.
+    assem.Specialize();
+
+    // Remove redundant instructions, if asked to.
+    assem.Optimize();
+
+    // Write the program as C++ for a native build instead of emulating it, if asked to.
+    int status = 0;
+    if (assem.IsTranslatingToCpp()) {
+        status = assem.TranslateToCpp() ? 0 : 1;
+    }
+    else {
+        // Run the emulator on the Quack3200 program that was generated in Pass II.
+        // Report an illegal or faulting emulated program in the exit status.
+        emulator::RunResult result = assem.RunProgramInEmulator();
+        status = result == emulator::RR_IllegalOpcode || result == emulator::RR_Fault ? 1 : 0;
+    }
+
+    // Write the timings and counters, if asked to.
+    assem.ReportStats();
+
+    // Terminate indicating whether all is well.  If there is an unrecoverable error, the
     // program will terminate at the point that it occurred with an exit(1) call.
-    return 0;
+    return status;
 }
\ No newline at end of file
@@ -3,10 +3,38 @@
 //
 #include "stdafx.h"
 #include "Assembler.h"
+#include "AsmCache.h"
+#include "Checkpoint.h"
+#include "Debugger.h"
 #include "Errors.h"
-
-// Constructor for the assembler.  Note: we are passing argc and argv to the file access constructor.
-Assembler::Assembler(int argc, char* argv[]) : m_facc(argc, argv) {}
+#include "ImageArchive.h"
+#include "Linker.h"
+#include "LoopDetector.h"
+#include "Optimizer.h"
+#include "PerfCounters.h"
+#include "Profiler.h"
+#include "MultiCore.h"
+#include "RunMemo.h"
+#include "Scheduler.h"
+#include "Specializer.h"
+#include "Translator.h"
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+// Constructor for the assembler.  Note: we are passing argc and argv to the options parser.
+Assembler::Assembler(int argc, char* argv[]) : m_opts(argc, argv), m_facc(m_opts.GetSourceFile(), m_opts.GetStream()), m_source(m_facc) {}
+
+// Constructor for an assembler given its options, such as one packing a source into an archive.
+Assembler::Assembler(const Options& a_opts) : m_opts(a_opts), m_facc(m_opts.GetSourceFile(), m_opts.GetStream()), m_source(m_facc) {}
+
+// Destructor for the assembler.  Make sure cout is not left writing to the capture buffer.
+Assembler::~Assembler()
+{
+    if (m_coutBuf != nullptr) {
+        cout.rdbuf(m_coutBuf);
+    }
+}
 
 
 /*
@@ -22,42 +50,91 @@ DESCRIPTION
 
     This function will iterate through every line of the given
     assembly language program, establishing the locations of
-    all labels, and storing them in a symbol table. 
+    all labels, and storing them in a symbol table.  The labels
+    of an included file are placed where it is included.
 
 */
 void Assembler::PassI() {
+    Stats::Phase phase("Pass I");
     int loc = 0;        // Tracks the location of the instructions to be generated.
 
     // Successively process each line of source code.
     while (true) {
 
-        // Read the next line from the source file.
+        // Read and parse the next statement, expanding macros.
         string line;
-        if (!m_facc.GetNextLine(line)) {
+        Instruction::InstructionType st;
+        if (!m_source.GetNextStatement(m_inst, line, st)) {
             return;
         }
 
-        // Parse the line and get the instruction type.
-        Instruction::InstructionType st = m_inst.ParseInstruction(line);
-
         // If this is an end statement, there is nothing left to do in pass I.
         if (st == Instruction::ST_End) return;
 
-        // Labels can only be on machine language and assembler language
-        // instructions.  So, skip other instruction types.
-        if (st != Instruction::ST_MachineLanguage && st != Instruction::ST_AssemblerInstr) {
-            continue;
-        }
+        loc = DefineLabels(st, loc);
+    }
+}
+
+/*
+NAME
+
+    Assembler::DefineLabels - records the labels a statement defines
+
+SYNOPSIS
+
+    int Assembler::DefineLabels(Instruction::InstructionType a_type, int a_loc);
+    a_type -> the type of the statement
+    a_loc -> the location of the statement
 
-        // If the instruction has a label, record it and its location in the
-        // symbol table.
+DESCRIPTION
+
+    This function is a helper function for Pass I, and for a single
+    pass, which records each label as it meets it.  An included file is
+    laid out where it is included, and its labels are recorded relative
+    to that location.  Imported labels are numbered in the order they
+    are declared.
+
+RETURNS
+
+    The location of the next statement
+
+*/
+int Assembler::DefineLabels(Instruction::InstructionType a_type, int a_loc)
+{
+    if (a_type == Instruction::ST_Include) {
         if (m_inst.isLabel()) {
-            m_symtab.AddSymbol(m_inst.GetLabel(), loc);
+            m_symtab.AddSymbol(m_inst.GetLabel(), a_loc);
+        }
+        shared_ptr<const Library> library = IncludeLibrary();
+        if (library) {
+            for (const auto& symbol : library->GetSymbols()) {
+                string name = symbol.first;
+                m_symtab.AddSymbol(name, a_loc + symbol.second);
+            }
+            a_loc += library->GetSize();
         }
+        return a_loc;
+    }
 
-        // Compute the location of the next instruction.
-        loc = m_inst.LocationNextInstruction(loc);
+    // Labels can only be on machine language and assembler language
+    // instructions.  So, skip other instruction types.
+    if (a_type != Instruction::ST_MachineLanguage && a_type != Instruction::ST_AssemblerInstr) {
+        return a_loc;
+    }
+
+    if (m_inst.GetOpCode() == "extern" && !m_externs.count(m_inst.GetOperand())) {
+        m_externs[m_inst.GetOperand()] = (int)m_object.m_imports.size();
+        m_object.m_imports.push_back(m_inst.GetOperand());
     }
+
+    // If the instruction has a label, record it and its location in the
+    // symbol table.
+    if (m_inst.isLabel()) {
+        m_symtab.AddSymbol(m_inst.GetLabel(), a_loc);
+    }
+
+    // Compute the location of the next instruction.
+    return m_inst.LocationNextInstruction(a_loc);
 }
 
 
@@ -76,14 +153,29 @@ DESCRIPTION
     of error checking and translating to machine code. The translations woll
     be stored in the Quack3600's main memory.
 
+    A source that can only be read once, such as standard input or a
+    pipe, is translated by this pass alone, without Pass I.  Each label
+    is recorded as it is met, an instruction whose operand is a label
+    not yet met is translated with location 0 and listed with ?????, and
+    the checks that depend on labels not yet met are left to the END.
+    There they are made, their errors are recorded where the two passes
+    would have recorded them, and the operands are filled in.  So only
+    the symbol table and those checks are kept, not the source, and the
+    error messages are those of the two passes.
+
 */
 void Assembler::PassII() {
+    Stats::Phase phase(IsStreaming() ? "Single pass" : "Pass II");
 
     int loc = 0;        // Tracks the location of the instructions to be generated.
     string message;     // Stores the formatted error message
+    bool stopped = false;   // == true if an error stopped the translation before the END
 
-    // Rewinds the assembly program's source file
-    m_facc.rewind();
+    // Rewinds the assembly program's source file, unless it can only be read once.
+    if (!IsStreaming()) {
+        m_source.rewind();
+    }
+    m_source.SetReporting(true);
 
     cout << "Translation of Program:" << endl << endl;
     cout << "Location " << setw(6) << "  Contents  " << setw(0) << " Original Statement" << endl << endl;
@@ -91,18 +183,20 @@ void Assembler::PassII() {
     // Successively process each line of source code.
     while (true) {
 
-        // Read the next line from the source file.
+        // Read and parse the next statement, expanding macros.
         string line;
-        if (!m_facc.GetNextLine(line)) {
+        Instruction::InstructionType st;
+        if (!m_source.GetNextStatement(m_inst, line, st)) {
 
             // Records an error if there is no END statemtent
+            Errors::SetContext("");
             message = "Program is missing an END statement";
             Errors::RecordError(message);
             break;
         }
 
-        // Parses the line and get the instruction type.
-        Instruction::InstructionType st = m_inst.ParseInstruction(line);
+        // Errors in the statements of a macro are reported at the line that used it.
+        Errors::SetContext(m_source.GetContext());
 
         // Prints and skips the comment instructions
         if (st == Instruction::ST_Comment) {
@@ -110,6 +204,11 @@ void Assembler::PassII() {
             continue;
         }
 
+        // A single pass records the labels of a statement as it meets them.
+        if (IsStreaming()) {
+            DefineLabels(st, loc);
+        }
+
         // Processes a series of formatting and validation error checks
         // Important: this must be done before handeling further instructions
         ErrorProccessing(message);
@@ -126,8 +225,12 @@ void Assembler::PassII() {
             cout << setw(31) << right << line << endl;
 
             // Checks to see if there is an instruction following
-            // the END statement
-            if (m_facc.GetNextLine(line)) {
+            // the END statement.  Blank lines and comments may follow it.
+            while (m_facc.GetNextLine(line)) {
+
+                if (m_inst.ParseInstruction(line) == Instruction::ST_Comment) {
+                    continue;
+                }
 
                 cout << setw(24) << right << line << endl;
 
@@ -136,13 +239,25 @@ void Assembler::PassII() {
                 Errors::RecordError(message);
                 break;
             }
-            else {
+            break;
+        }
 
+
+        // An included file is translated as a whole, from its parsed form.
+        if (st == Instruction::ST_Include) {
+            TranslateLibrary(loc, line);
+            shared_ptr<const Library> library = IncludeLibrary();
+            loc += library ? library->GetSize() : 0;
+            m_object.m_size = max(m_object.m_size, loc);
+            if (loc > m_emul.MEMSZ) {
+                message = "Program location out-of-bound";
+                Errors::RecordError(message);
+                stopped = true;
                 break;
             }
+            continue;
         }
 
-
         int content = 0;         // Contains the machine language translation
         string output = "";       // Printable machine language output
 
@@ -156,8 +271,16 @@ void Assembler::PassII() {
                 Errors::RecordError(message);
             }
 
-            // Formatted translation of OpCode + register + address
-            content = (((m_inst.GetOpCodeNum() * 10) + m_inst.GetRegisterNum()) * m_emul.MEMSZ) + m_symtab.LookupLocation(m_inst.GetOperand());
+            // Formatted translation of OpCode + register + address.  A value or a
+            // register operand is placed in the address field.  Records an error if
+            // the operand is a label that is never defined.
+            size_t deferred = m_deferred.size();
+            int address = m_inst.GetOperandValue();
+            if (m_inst.GetOperandMode() == OpCodes::OM_Memory) {
+                address = OpCodes::IsValidSymbol(m_inst.GetOperand()) ? LocateLabel(m_inst.GetOperand(), loc, "")
+                    : LocateOperand(m_inst.GetOperand(), (int)m_image.GetWords().size());
+            }
+            content = emulator::Encoding::Encode(m_inst.GetOpCodeNum(), m_inst.GetRegisterNum(), address);
 
             // Adds a leading 0 if OpCode is a single digit
             if (to_string(content).length() < 8) {
@@ -167,6 +290,11 @@ void Assembler::PassII() {
                 output = to_string(content);
             }
 
+            // The location of a label a single pass has not yet met is filled in at the END.
+            if (m_deferred.size() > deferred) {
+                output.replace(output.length() - 5, 5, "?????");
+            }
+
             cout << "  " << right << loc << setw(14) << right << output << setw(3) << right << "   " << line << endl;
 
             // Builds up the memory of the emulator
@@ -175,6 +303,7 @@ void Assembler::PassII() {
                 message = "Insufficient memory for translation";
                 Errors::RecordError(message);
             }
+            m_image.AddWord(loc, content, true);
         }
 
         // Prints the translation of assembly language instructions
@@ -191,14 +320,28 @@ void Assembler::PassII() {
                 }
 
                 cout << "  " << right << loc << setw(14) << right << output << setw(3) << right << "   " << line << endl;
+
+                // Constants are part of the translation too
+                if (m_inst.isNumber(m_inst.GetOperand())) {
+
+                    content = m_inst.ConvertToNumeric(m_inst.GetOperand());
+                    if (!m_emul.insertMemory(loc, content)) {
+
+                        message = "Insufficient memory for translation";
+                        Errors::RecordError(message);
+                    }
+                    m_image.AddWord(loc, content, false);
+                }
             }
             else {
                 cout << "  " << right << loc << setw(17) << right << "   " << line << endl;
+                CheckLinkage();
             }
         }
 
         // Computes the location of the next instruction.
         loc = m_inst.LocationNextInstruction(loc);
+        m_object.m_size = max(m_object.m_size, loc);
 
         // Determines if the next location is within the memory limit
         if (loc > m_emul.MEMSZ) {
@@ -206,17 +349,376 @@ void Assembler::PassII() {
             // Records out-of-bound errors
             message = "Program location out-of-bound";
             Errors::RecordError(message);
+            stopped = true;
             break;
         }
     }
 
+    Errors::SetContext("");
+    m_source.SetReporting(false);
+
+    // A single pass knows the labels only at the END, so the symbol table is displayed
+    // now, before the checks left to the END.  The two passes would still have found
+    // the labels after an error that stopped the translation.
+    if (IsStreaming()) {
+        if (stopped) {
+            SkipToEnd(loc);
+        }
+        Stats::AddCounter("lines", m_facc.GetLineCount());
+        cout << endl;
+        DisplaySymbolTable();
+        ResolveDeferred();
+    }
+    Stats::AddCounter("macro_expansions", m_source.GetExpansions());
+    Stats::AddCounter("macro_reuses", m_source.GetReuses());
+
     // Formatted error display
+    m_diagnostics = Errors::GetErrors();
     cout << endl << "__________________________________________________________" << endl;
     Errors::DisplayErrors();
     cout << "__________________________________________________________" << endl << endl << endl;
 
 }
 
+/*
+NAME
+
+    Assembler::TranslateLibrary - translates an included file
+
+SYNOPSIS
+
+    void Assembler::TranslateLibrary(int a_loc, const string& a_line);
+    a_loc -> the location the file is included at
+    a_line -> the INCLUDE statement
+
+DESCRIPTION
+
+    This function is a helper function for PassII.  The parsed form of
+    the library is translated without reading the file again, with its
+    labels relocated to a_loc.  The listing shows the range of locations
+    the library occupies rather than each of its statements.  Errors in
+    the library are reported with its name and line number.
+
+*/
+void Assembler::TranslateLibrary(int a_loc, const string& a_line)
+{
+    string message;
+    shared_ptr<const Library> library = IncludeLibrary();
+    if (!library) {
+        cout << "  " << right << a_loc << setw(17) << right << "   " << a_line << endl;
+        message = "Program includes the unreadable file \"" + m_inst.GetOperand() + "\"";
+        Errors::RecordError(message);
+        return;
+    }
+    string name = filesystem::path(library->GetPath()).filename().string();
+
+    for (const string& error : library->GetErrors()) {
+        message = error;
+        Errors::RecordError(message);
+    }
+    for (const auto& symbol : library->GetSymbols()) {
+        if (m_symtab.CheckMultiplyDefined(symbol.first)) {
+            message = name + ": Program has multiply defined labels";
+            Errors::RecordError(message);
+        }
+        else if (IsStreaming()) {
+            Defer(Deferred::DK_MultiplyDefined, symbol.first, name + ": ");
+        }
+    }
+
+    bool outOfMemory = false;
+    for (const Library::Statement& statement : library->GetStatements()) {
+        int loc = a_loc + statement.m_offset;
+        int content = statement.m_value;
+        if (statement.m_isCode) {
+            int address = statement.m_value;
+            string operand = statement.m_operand;
+            if (!operand.empty()) {
+                address = LocateLabel(operand, loc, name + " line " + to_string(statement.m_line) + ": ");
+            }
+            content = emulator::Encoding::Encode(statement.m_opcode, statement.m_register, address);
+        }
+        if (!m_emul.insertMemory(loc, content) && !outOfMemory) {
+            message = "Insufficient memory for translation";
+            Errors::RecordError(message);
+            outOfMemory = true;
+        }
+        m_image.AddWord(loc, content, statement.m_isCode);
+    }
+
+    string range = library->GetSize() > 0 ? to_string(a_loc) + "-" + to_string(a_loc + library->GetSize() - 1) : to_string(a_loc);
+    cout << "  " << right << range << setw(17) << right << "   " << a_line
+        << "   (" << library->GetStatements().size() << " words)" << endl;
+}
+
+/*
+NAME
+
+    Assembler::LocateOperand - finds the location of a label operand
+
+SYNOPSIS
+
+    int Assembler::LocateOperand(string a_operand, int a_word);
+    a_operand -> the label used by the instruction
+    a_word -> the index of the instruction in the translation
+
+DESCRIPTION
+
+    This function is a helper function for PassII, called just before
+    the instruction is added to the translation, or by a single pass
+    when it fills in the operand at the END.  The instruction is
+    recorded as one the linker must relocate: by the location of the
+    module for a label of this module, or to the location of the label
+    for one imported from another module.
+
+RETURNS
+
+    The location of the label in this module; 0 for an imported label
+
+*/
+int Assembler::LocateOperand(string a_operand, int a_word)
+{
+    if (a_operand.empty()) {
+        return m_symtab.LookupLocation(a_operand);
+    }
+    auto import = m_externs.find(a_operand);
+    if (import != m_externs.end()) {
+        m_object.m_relocations.push_back({ a_word, import->second });
+        return 0;
+    }
+    m_object.m_relocations.push_back({ a_word, -1 });
+    return m_symtab.LookupLocation(a_operand);
+}
+
+/*
+NAME
+
+    Assembler::LocateLabel - finds the location of a label operand, checking it
+
+SYNOPSIS
+
+    int Assembler::LocateLabel(string a_label, int a_loc, const string& a_where);
+    a_label -> the label used by the instruction
+    a_loc -> the location of the instruction
+    a_where -> what is put before the error message, such as the included file
+
+DESCRIPTION
+
+    This function is a helper function for PassII, called just before
+    the instruction is added to the translation.  A label that is
+    neither defined nor imported is reported.  A single pass that has
+    not yet met the label leaves it to the END, which reports it or
+    fills in its location.
+
+RETURNS
+
+    The location of the label; 0 if it is left to the END
+
+*/
+int Assembler::LocateLabel(string a_label, int a_loc, const string& a_where)
+{
+    int word = (int)m_image.GetWords().size();
+    if (!m_symtab.LookupSymbol(a_label) && !m_externs.count(a_label)) {
+        if (IsStreaming()) {
+            Defer(Deferred::DK_Operand, a_label, a_where, a_loc, word);
+            return 0;
+        }
+        Errors::RecordError(a_where + "Program uses the undefined label \"" + a_label + "\"");
+    }
+    return LocateOperand(a_label, word);
+}
+
+/*
+NAME
+
+    Assembler::Defer - leaves a check to the END of a single pass
+
+SYNOPSIS
+
+    void Assembler::Defer(Deferred::Kind a_kind, const string& a_label, const string& a_where, int a_loc, int a_word);
+    a_kind -> what is to be checked
+    a_label -> the label it depends on
+    a_where -> what is put before the error message, after the context
+    a_loc -> for an operand, the location of the instruction
+    a_word -> for an operand, the index of the instruction in the translation
+
+DESCRIPTION
+
+    The check remembers how many errors had been recorded, so that its
+    own error is put among them where the two passes would have
+    recorded it.
+
+*/
+void Assembler::Defer(Deferred::Kind a_kind, const string& a_label, const string& a_where, int a_loc, int a_word)
+{
+    m_deferred.push_back({ a_kind, a_label, Errors::GetContext() + a_where, Errors::GetErrors().size(), a_loc, a_word });
+}
+
+/*
+NAME
+
+    Assembler::ResolveDeferred - makes the checks left to the END
+
+SYNOPSIS
+
+    void Assembler::ResolveDeferred();
+
+DESCRIPTION
+
+    This function is a helper function for a single pass, called when
+    every label is known.  The checks are made in the order they were
+    left, which is the order the two passes make them, so that looking
+    up a label never defined has the same effect on later checks.  The
+    operand of each instruction left is filled in, in the translation
+    and in the emulator's memory, and listed.  The errors are then put
+    among those recorded during the pass, each where it would have been.
+
+*/
+void Assembler::ResolveDeferred()
+{
+    vector<pair<size_t, string>> errors;    // The errors found, with where each belongs.
+    bool listed = false;
+
+    for (Deferred& check : m_deferred) {
+        string& label = check.m_label;
+        switch (check.m_kind) {
+        case Deferred::DK_Operand: {
+            if (!m_symtab.LookupSymbol(label) && !m_externs.count(label)) {
+                errors.push_back({ check.m_position, check.m_context + "Program uses the undefined label \"" + label + "\"" });
+            }
+            MemoryImage::Word& word = m_image.GetWords()[check.m_word];
+            word.m_contents += LocateOperand(label, check.m_word);
+            m_emul.insertMemory(check.m_loc, word.m_contents);
+
+            if (!listed) {
+                cout << "Operands filled in at the END:" << endl << endl;
+                cout << "Location " << setw(6) << "  Contents  " << setw(0) << " Label" << endl << endl;
+                listed = true;
+            }
+            string output = to_string(word.m_contents);
+            if (output.length() < 8) {
+                output = "0" + output;
+            }
+            cout << "  " << right << check.m_loc << setw(14) << right << output << setw(3) << right << "   " << label << endl;
+            break;
+        }
+        case Deferred::DK_Label:
+            if (!m_symtab.LookupSymbol(label)) {
+                errors.push_back({ check.m_position, check.m_context + "Program does not contain the Label \"" + label + "\" in the symbol table" });
+            }
+            if (m_symtab.CheckMultiplyDefined(label)) {
+                errors.push_back({ check.m_position, check.m_context + "Program has multiply defined labels" });
+            }
+            break;
+        case Deferred::DK_MultiplyDefined:
+            if (m_symtab.CheckMultiplyDefined(label)) {
+                errors.push_back({ check.m_position, check.m_context + "Program has multiply defined labels" });
+            }
+            break;
+        case Deferred::DK_Import:
+            if (m_symtab.LookupSymbol(label)) {
+                errors.push_back({ check.m_position, check.m_context + "Program both defines and imports the label \"" + label + "\"" });
+            }
+            break;
+        case Deferred::DK_Export:
+            if (!m_symtab.LookupSymbol(label)) {
+                errors.push_back({ check.m_position, check.m_context + "Program exports the undefined label \"" + label + "\"" });
+            }
+            else {
+                m_object.m_exports[label] = m_symtab.LookupLocation(label);
+            }
+            break;
+        }
+    }
+    m_deferred.clear();
+
+    // The relocations of the operands filled in are in the order the two passes record them.
+    stable_sort(m_object.m_relocations.begin(), m_object.m_relocations.end(),
+        [](const ObjectFile::Relocation& a, const ObjectFile::Relocation& b) { return a.m_word < b.m_word; });
+
+    // Each error goes before the ones recorded after its check was left, and after
+    // any left earlier with the same position; inserting from the last keeps both.
+    for (auto error = errors.rbegin(); error != errors.rend(); ++error) {
+        Errors::InsertError(error->first, error->second);
+    }
+}
+
+/*
+NAME
+
+    Assembler::SkipToEnd - records the labels of the rest of the source
+
+SYNOPSIS
+
+    void Assembler::SkipToEnd(int a_loc);
+    a_loc -> the location of the next statement
+
+DESCRIPTION
+
+    This function is a helper function for a single pass that an error
+    stopped before the END.  The two passes would have recorded the
+    labels of the rest of the source in Pass I, so they are recorded
+    here, and nothing else is done with the statements.
+
+*/
+void Assembler::SkipToEnd(int a_loc)
+{
+    string line;
+    Instruction::InstructionType st;
+    while (m_source.GetNextStatement(m_inst, line, st) && st != Instruction::ST_End) {
+        a_loc = DefineLabels(st, a_loc);
+    }
+}
+
+/*
+NAME
+
+    Assembler::CheckLinkage - checks an EXTERN or ENTRY statement
+
+SYNOPSIS
+
+    void Assembler::CheckLinkage();
+
+DESCRIPTION
+
+    This function is a helper function for PassII.  An imported label
+    must not also be defined here, and only a module can import labels,
+    since only the linker can find them.  An exported label must be
+    defined here; its location is recorded for the object file.  A
+    single pass leaves what depends on labels it has not met to the END.
+
+*/
+void Assembler::CheckLinkage()
+{
+    string message;
+    string& operand = m_inst.GetOperand();
+    if (m_inst.GetOpCode() == "extern") {
+        if (!IsWritingObject()) {
+            message = "Program imports labels, so it must be assembled with --object and linked";
+            Errors::RecordError(message);
+        }
+        else if (m_symtab.LookupSymbol(operand)) {
+            message = "Program both defines and imports the label \"" + operand + "\"";
+            Errors::RecordError(message);
+        }
+        else if (IsStreaming()) {
+            Defer(Deferred::DK_Import, operand);
+        }
+    }
+    else if (m_inst.GetOpCode() == "entry") {
+        if (IsStreaming()) {
+            Defer(Deferred::DK_Export, operand);
+        }
+        else if (!m_symtab.LookupSymbol(operand)) {
+            message = "Program exports the undefined label \"" + operand + "\"";
+            Errors::RecordError(message);
+        }
+        else {
+            m_object.m_exports[operand] = m_symtab.LookupLocation(operand);
+        }
+    }
+}
+
 /*
 NAME
 
@@ -242,17 +744,27 @@ void Assembler::ErrorProccessing(string& a_message) {
         Errors::RecordError(a_message);
     }
 
-    // Verify that an existing label is in the symbol table
-    if (m_inst.isLabel() == true && m_symtab.LookupSymbol(m_inst.GetLabel()) == false) {
-        a_message = "Program does not contain the Label \"" + m_inst.GetLabel() + "\" in the symbol table";
-        Errors::RecordError(a_message);
+    // A single pass has not met every label yet, so it leaves a label it has not met
+    // to the END, and one it has met to be checked there for a later definition.
+    if (IsStreaming() && m_inst.isLabel() && !m_symtab.LookupSymbol(m_inst.GetLabel())) {
+        Defer(Deferred::DK_Label, m_inst.GetLabel());
     }
+    else {
+        // Verify that an existing label is in the symbol table
+        if (m_inst.isLabel() == true && m_symtab.LookupSymbol(m_inst.GetLabel()) == false) {
+            a_message = "Program does not contain the Label \"" + m_inst.GetLabel() + "\" in the symbol table";
+            Errors::RecordError(a_message);
+        }
 
-    // Checks to see if a label is defined multiple times
-    // in a program
-    if (m_symtab.CheckMultiplyDefined(m_inst.GetLabel())) {
-        a_message = "Program has multiply defined labels";
-        Errors::RecordError(a_message);
+        // Checks to see if a label is defined multiple times
+        // in a program
+        if (m_symtab.CheckMultiplyDefined(m_inst.GetLabel())) {
+            a_message = "Program has multiply defined labels";
+            Errors::RecordError(a_message);
+        }
+        else if (IsStreaming() && m_inst.isLabel()) {
+            Defer(Deferred::DK_MultiplyDefined, m_inst.GetLabel());
+        }
     }
 
     // Reports error if the current OpCode is not
@@ -283,4 +795,1039 @@ void Assembler::ErrorProccessing(string& a_message) {
         a_message = "Program has Extra or Missing Operand (This error will also occur if there is whitespace between the register and operand!!)";
         Errors::RecordError(a_message);
     }
-}
\ No newline at end of file
+}
+
+/*
+NAME
+
+    Assembler::RunProgramInEmulator - runs the translation
+
+SYNOPSIS
+
+    emulator::RunResult Assembler::RunProgramInEmulator();
+
+DESCRIPTION
+
+    This function runs the program generated in Pass II.  If an input
+    file was named on the command line, its values are given to the
+    emulator up front; otherwise READ instructions prompt for them.
+    Runs with an input file are looked up in the run memo, if one was
+    named, so that repeated runs are not executed again.
+
+RETURNS
+
+    Why the emulation stopped
+
+*/
+emulator::RunResult Assembler::RunProgramInEmulator()
+{
+    Stats::Phase phase("Emulation");
+    vector<long long> values;
+    if (!m_opts.GetInputFile().empty()) {
+        ifstream input(m_opts.GetInputFile());
+        if (!input) {
+            cerr << "Input file could not be opened, emulation terminated." << endl;
+            exit(1);
+        }
+        long long value;
+        while (input >> value) {
+            values.push_back(value);
+        }
+    }
+
+    if (m_opts.GetGuests() > 0) {
+        return RunGuests(values);
+    }
+    if (m_opts.GetCores() > 0) {
+        return RunMultiCore(values);
+    }
+    if (m_opts.GetMachine() == "small") {
+        return RunOnMachine<SmallEmulator>(values);
+    }
+    if (m_opts.GetMachine() == "large") {
+        return RunOnMachine<LargeEmulator>(values);
+    }
+    if (!m_opts.GetInputFile().empty()) {
+        m_emul.SetInput(values);
+    }
+    if (m_opts.GetDebug()) {
+        SourceMap lines = MapSourceLines();
+        Debugger debugger(m_emul, m_symtab.GetSymbols(), lines);
+        emulator::RunResult result = debugger.Run();
+        CountRun(m_emul);
+        return result;
+    }
+
+    // Only runs whose input is known up front can be memoized, and a checkpointed
+    // run is always executed.
+    if (m_opts.GetMemoDir().empty() || m_opts.GetInputFile().empty() || !m_opts.GetCheckpointFile().empty()) {
+        emulator::RunResult result = Emulate(m_emul);
+        CountRun(m_emul);
+        return result;
+    }
+
+    RunMemo memo(m_opts.GetMemoDir());
+    m_emul.DisplayHeader();
+    emulator::RunResult result = memo.Run(m_emul, m_image.ComputeHash(), m_opts.GetMaxSteps());
+    m_emul.DisplayResult(result);
+    CountRun(m_emul);
+
+    if (m_opts.GetMemoStats()) {
+        cout << endl;
+        memo.DisplayStats();
+    }
+    return result;
+}
+
+/*
+NAME
+
+    Assembler::Emulate - runs the translation with the hooks asked for
+
+SYNOPSIS
+
+    template<typename Machine>
+    emulator::RunResult Assembler::Emulate(Machine& a_machine);
+    a_machine -> the machine holding the translation
+
+DESCRIPTION
+
+    This function runs the program in the machine, watched by the hooks
+    named on the command line.  Each hook that is asked for is chained
+    onto the others in turn.  With no hooks the machine runs at full
+    speed, and with --fast-forward skips the iterations of simple
+    counting loops; hooks see every instruction, so none are skipped
+    with them.
+
+RETURNS
+
+    Why the emulation stopped
+
+*/
+template<typename Machine>
+emulator::RunResult Assembler::Emulate(Machine& a_machine)
+{
+    EmulatorBase::NoHooks hooks;
+    a_machine.SetFastForward(m_opts.GetFastForward());
+    return EmulateCheckpointing(a_machine, hooks);
+}
+
+/*
+NAME
+
+    Assembler::EmulateCheckpointing - adds the checkpointer to the hooks, if asked for
+
+SYNOPSIS
+
+    template<typename Machine, typename Hooks>
+    emulator::RunResult Assembler::EmulateCheckpointing(Machine& a_machine, Hooks& a_hooks);
+    a_machine -> the machine holding the translation
+    a_hooks -> the hooks chained so far
+
+DESCRIPTION
+
+    With --checkpoint or --resume, the run is checkpointed to the file
+    named.  A resumed run first puts the machine in the state of the
+    last checkpoint, which must be of the same translation on the same
+    machine and have read the same input, so it goes on exactly as the
+    run it continues would have.  A checkpoint file that cannot be
+    resumed or written terminates the emulation.
+
+RETURNS
+
+    Why the emulation stopped
+
+*/
+template<typename Machine, typename Hooks>
+emulator::RunResult Assembler::EmulateCheckpointing(Machine& a_machine, Hooks& a_hooks)
+{
+    if (m_opts.GetCheckpointFile().empty()) {
+        return EmulateDetectingLoops(a_machine, a_hooks);
+    }
+    Checkpointer<Machine> checkpointer(m_opts.GetCheckpointFile(), m_image.ComputeHash(), m_opts.GetCheckpointInterval());
+    string error;
+    if (m_opts.GetResume() && !checkpointer.Restore(a_machine, error)) {
+        cerr << "Checkpoint could not be resumed: " << error << ", emulation terminated." << endl;
+        exit(1);
+    }
+    if (!checkpointer.Start(a_machine, error)) {
+        cerr << "Checkpoint could not be started: " << error << ", emulation terminated." << endl;
+        exit(1);
+    }
+
+    EmulatorBase::HookChain<Hooks, Checkpointer<Machine>> hooks(a_hooks, checkpointer);
+    emulator::RunResult result = EmulateDetectingLoops(a_machine, hooks);
+    if (!checkpointer.Finish(a_machine, result)) {
+        cerr << "Checkpoint could not be written." << endl;
+    }
+    Stats::SetCounter("checkpoints", checkpointer.GetWritten());
+    return result;
+}
+
+// Adds the loop detector to the hooks, if asked for.
+template<typename Machine, typename Hooks>
+emulator::RunResult Assembler::EmulateDetectingLoops(Machine& a_machine, Hooks& a_hooks)
+{
+    if (!m_opts.GetDetectLoops()) {
+        return EmulateTiming(a_machine, a_hooks);
+    }
+    LoopDetector<Machine> detector(a_machine);
+    EmulatorBase::HookChain<Hooks, LoopDetector<Machine>> hooks(a_hooks, detector);
+    return EmulateTiming(a_machine, hooks);
+}
+
+/*
+NAME
+
+    Assembler::EmulateTiming - adds the timing model to the hooks, if asked for
+
+SYNOPSIS
+
+    template<typename Machine, typename Hooks>
+    emulator::RunResult Assembler::EmulateTiming(Machine& a_machine, Hooks& a_hooks);
+    a_machine -> the machine holding the translation
+    a_hooks -> the hooks chained so far
+
+DESCRIPTION
+
+    The timing file is read, and the model is made with a cache only if
+    the file describes one, so a run without a cache does not test for
+    one on every access.  A timing file that cannot be used terminates
+    the emulation.
+
+RETURNS
+
+    Why the emulation stopped
+
+*/
+template<typename Machine, typename Hooks>
+emulator::RunResult Assembler::EmulateTiming(Machine& a_machine, Hooks& a_hooks)
+{
+    if (m_opts.GetTimingFile().empty()) {
+        return EmulateProfiling(a_machine, a_hooks);
+    }
+    TimingConfig config;
+    string error;
+    if (!config.Load(m_opts.GetTimingFile(), error)) {
+        cerr << error << ", emulation terminated." << endl;
+        exit(1);
+    }
+    if (config.m_sets == 0) {
+        return EmulateTimed<NoCache>(a_machine, a_hooks, config);
+    }
+    return EmulateTimed<SetAssociativeCache>(a_machine, a_hooks, config);
+}
+
+// Runs the program with a timing model, then displays its estimate.
+template<typename Cache, typename Machine, typename Hooks>
+emulator::RunResult Assembler::EmulateTimed(Machine& a_machine, Hooks& a_hooks, const TimingConfig& a_config)
+{
+    TimingModel<Machine, Cache> model(a_config);
+    EmulatorBase::HookChain<Hooks, TimingModel<Machine, Cache>> hooks(a_hooks, model);
+    emulator::RunResult result = EmulateProfiling(a_machine, hooks);
+    model.DisplayReport(m_symtab.GetSymbols());
+    return result;
+}
+
+// Adds the sampling profiler to the hooks, if asked for.
+template<typename Machine, typename Hooks>
+emulator::RunResult Assembler::EmulateProfiling(Machine& a_machine, Hooks& a_hooks)
+{
+    if (m_opts.GetProfileFile().empty()) {
+        return EmulateCounting(a_machine, a_hooks);
+    }
+    Profiler profiler(Machine::MEMSZ);
+    EmulatorBase::HookChain<Hooks, Profiler> hooks(a_hooks, profiler);
+    if (!profiler.Start()) {
+        cerr << "Profiling timer could not be started." << endl;
+    }
+    emulator::RunResult result = EmulateCounting(a_machine, hooks);
+    profiler.Stop();
+
+    if (!profiler.WriteReport(m_opts.GetProfileFile(), MapSourceLines(), m_symtab.GetSymbols())) {
+        cerr << "Profile could not be written." << endl;
+    }
+    return result;
+}
+
+/*
+NAME
+
+    Assembler::EmulateCounting - runs the program, reading the host's counters
+
+SYNOPSIS
+
+    template<typename Machine, typename Hooks>
+    emulator::RunResult Assembler::EmulateCounting(Machine& a_machine, Hooks& a_hooks);
+    a_machine -> the machine holding the translation
+    a_hooks -> the hooks chained so far
+
+DESCRIPTION
+
+    With --perf, the host's performance counters are read around the
+    run and reported per guest instruction.  When profiling too, the
+    counters are also sampled to break them down by op code; that adds
+    a hook, so the figures include its cost.  Counters the host does
+    not permit are reported as missing, and if there are none at all
+    the program still runs.
+
+RETURNS
+
+    Why the emulation stopped
+
+*/
+template<typename Machine, typename Hooks>
+emulator::RunResult Assembler::EmulateCounting(Machine& a_machine, Hooks& a_hooks)
+{
+    if (!m_opts.GetPerf()) {
+        return a_machine.runProgram(RemainingSteps(a_machine), a_hooks);
+    }
+    PerfCounters counters;
+    if (!counters.Open()) {
+        cerr << "Performance counters could not be opened: " << counters.GetProblem() << endl;
+        return a_machine.runProgram(RemainingSteps(a_machine), a_hooks);
+    }
+
+    emulator::RunResult result;
+    long long steps = a_machine.GetSteps();
+    if (m_opts.GetProfileFile().empty()) {
+        counters.Start();
+        result = a_machine.runProgram(RemainingSteps(a_machine), a_hooks);
+        counters.Stop();
+        counters.DisplayReport(a_machine.GetSteps() - steps);
+        return result;
+    }
+
+    PerfSampler sampler;
+    EmulatorBase::HookChain<Hooks, PerfSampler> hooks(a_hooks, sampler);
+    bool sampling = sampler.Start();
+    counters.Start();
+    result = a_machine.runProgram(RemainingSteps(a_machine), hooks);
+    counters.Stop();
+    sampler.Stop();
+    counters.DisplayReport(a_machine.GetSteps() - steps);
+    if (sampling) {
+        sampler.DisplayReport();
+    }
+    else {
+        cerr << "Performance counters could not be sampled." << endl;
+    }
+    return result;
+}
+
+/*
+NAME
+
+    Assembler::MapSourceLines - finds the statement translated at each location
+
+SYNOPSIS
+
+    SourceMap Assembler::MapSourceLines();
+
+DESCRIPTION
+
+    This function reads the source again, computing locations as Pass I
+    does, and records the line of each machine language instruction and
+    constant.  A statement of a macro is recorded at the line that used
+    it.  It works whether or not the translation came from the
+    cache.  The statements of an included file are recorded with the
+    name of the file.  A source that can only be read once cannot be
+    read again, so it has no lines.
+
+RETURNS
+
+    The source line of each location
+
+*/
+SourceMap Assembler::MapSourceLines()
+{
+    SourceMap lines;
+    int loc = 0;
+    string line;
+    Instruction::InstructionType st;
+
+    if (IsStreaming()) {
+        return lines;
+    }
+    m_source.rewind();
+    while (m_source.GetNextStatement(m_inst, line, st)) {
+        if (st == Instruction::ST_End) {
+            break;
+        }
+        if (st == Instruction::ST_Include) {
+            shared_ptr<const Library> library = IncludeLibrary();
+            if (library) {
+                string name = filesystem::path(library->GetPath()).filename().string();
+                for (const Library::Statement& statement : library->GetStatements()) {
+                    lines[loc + statement.m_offset] = { statement.m_line, name + ": " + statement.m_text };
+                }
+                loc += library->GetSize();
+            }
+            continue;
+        }
+        if (st != Instruction::ST_MachineLanguage && st != Instruction::ST_AssemblerInstr) {
+            continue;
+        }
+        if (st == Instruction::ST_MachineLanguage || m_inst.GetOpCode() == "dc") {
+            lines[loc] = { m_source.GetLineNumber(), line };
+        }
+        loc = m_inst.LocationNextInstruction(loc);
+    }
+    if (m_relocation.empty()) {
+        return lines;
+    }
+
+    // Follow the instructions moved by the optimizer.  A removed instruction maps
+    // to the one after it, whose own line is recorded later and takes precedence.
+    SourceMap moved;
+    for (const auto& entry : lines) {
+        auto relocated = m_relocation.find(entry.first);
+        if (relocated == m_relocation.end()) {
+            moved[entry.first] = entry.second;
+        }
+        else if (relocated->second >= 0) {
+            moved[relocated->second] = entry.second;
+        }
+    }
+    return moved;
+}
+
+/*
+NAME
+
+    Assembler::RunOnMachine - runs the translation on another machine
+
+SYNOPSIS
+
+    template<typename Machine>
+    emulator::RunResult Assembler::RunOnMachine(const vector<long long>& a_input);
+    a_input -> the values for READ instructions, if an input file was named
+
+DESCRIPTION
+
+    This function loads the translation into a machine other than the
+    standard one and runs it there.  The machine is allocated on the
+    heap since the large machine does not fit on the stack.  Runs on
+    other machines are not memoized.
+
+RETURNS
+
+    Why the emulation stopped
+
+*/
+template<typename Machine>
+emulator::RunResult Assembler::RunOnMachine(const vector<long long>& a_input)
+{
+    unique_ptr<Machine> machine(new Machine);
+    if (!m_image.LoadInto(*machine)) {
+        cerr << "Translation does not fit in the memory of the " << m_opts.GetMachine() << " machine, emulation terminated." << endl;
+        exit(1);
+    }
+    if (!m_opts.GetInputFile().empty()) {
+        machine->SetInput(a_input);
+    }
+    emulator::RunResult result = Emulate(*machine);
+    CountRun(*machine);
+    return result;
+}
+
+/*
+NAME
+
+    Assembler::RunGuests - runs copies of the translation under the scheduler
+
+SYNOPSIS
+
+    emulator::RunResult Assembler::RunGuests(const vector<long long>& a_input);
+    a_input -> the values for READ instructions of every copy
+
+DESCRIPTION
+
+    This function runs the number of copies of the program named on the
+    command line, each on its own small machine, multiplexed over the
+    worker threads.  The output of the first copy is displayed, followed
+    by how the copies stopped.
+
+RETURNS
+
+    Why the first copy stopped
+
+*/
+emulator::RunResult Assembler::RunGuests(const vector<long long>& a_input)
+{
+    int workers = m_opts.GetWorkers() > 0 ? m_opts.GetWorkers() : (int)max(thread::hardware_concurrency(), 1u);
+    Scheduler scheduler(workers, m_opts.GetQuantum(), m_opts.GetMaxSteps());
+    for (int i = 0; i < m_opts.GetGuests(); i++) {
+        if (scheduler.AddGuest(m_image, a_input, false) < 0) {
+            cerr << "Translation does not fit in the memory of a guest, emulation terminated." << endl;
+            exit(1);
+        }
+    }
+    scheduler.Run();
+
+    cout << "Results from emulating program :" << endl << endl;
+    cout << scheduler.GetOutput(0);
+    scheduler.GetMachine(0).DisplayResult(scheduler.GetResult(0));
+
+    int counts[EmulatorBase::RR_Fault + 1] = {};
+    long long steps = 0;
+    for (int i = 0; i < scheduler.GetGuestCount(); i++) {
+        counts[scheduler.GetResult(i)]++;
+        steps += scheduler.GetMachine(i).GetSteps();
+    }
+    cout << endl << scheduler.GetGuestCount() << " guests on " << workers << " workers: "
+        << counts[EmulatorBase::RR_Halted] << " halted, "
+        << counts[EmulatorBase::RR_Budget] << " out of instructions, "
+        << counts[EmulatorBase::RR_EndOfInput] << " out of input, "
+        << counts[EmulatorBase::RR_IllegalOpcode] << " illegal, "
+        << counts[EmulatorBase::RR_Fault] << " faulted, "
+        << steps << " instructions in all" << endl;
+
+    Stats::SetCounter("guests", scheduler.GetGuestCount());
+    Stats::SetCounter("guest_instructions", steps);
+    return scheduler.GetResult(0);
+}
+
+/*
+NAME
+
+    Assembler::RunMultiCore - runs the translation on several cores
+
+SYNOPSIS
+
+    emulator::RunResult Assembler::RunMultiCore(const vector<long long>& a_input);
+    a_input -> the values for READ instructions, shared by the cores
+
+DESCRIPTION
+
+    This function loads the translation into a memory shared by the
+    number of cores named on the command line and runs every core from
+    the origin.  The cores tell themselves apart with CORE.
+
+RETURNS
+
+    The most serious reason a core stopped
+
+*/
+emulator::RunResult Assembler::RunMultiCore(const vector<long long>& a_input)
+{
+    unique_ptr<MultiCore> machine(new MultiCore(m_opts.GetCores()));
+    m_image.LoadInto(*machine);
+    machine->SetInput(a_input);
+
+    cout << "Results from emulating program on " << machine->GetCoreCount() << " cores :" << endl << endl;
+    emulator::RunResult result = machine->Run(m_opts.GetMaxSteps());
+    switch (result) {
+    case emulator::RR_Halted:
+        cout << endl << "End of emulation" << endl;
+        break;
+    case emulator::RR_IllegalOpcode:
+        cerr << "Illegal opcode" << endl;
+        break;
+    case emulator::RR_Fault:
+        cout << endl << "Emulation stopped on a core by division by zero or overflow" << endl;
+        break;
+    default:
+        cout << endl << "Emulation stopped on a core after " << (result == emulator::RR_Budget ? "its instruction budget" : "the end of the input") << endl;
+        break;
+    }
+
+    Stats::SetCounter("guest_instructions", machine->GetSteps());
+    Stats::SetCounter("reads", (long long)machine->GetInputPosition());
+    return result;
+}
+
+/*
+NAME
+
+    Assembler::TranslateToCpp - writes the translation as a C++ program
+
+SYNOPSIS
+
+    bool Assembler::TranslateToCpp();
+
+DESCRIPTION
+
+    This function writes the program generated in Pass II as C++ source
+    to the file named on the command line.  Compiled, it displays the
+    same results as running the program in the emulator.
+
+RETURNS
+
+    Whether the C++ source was written
+
+*/
+bool Assembler::TranslateToCpp()
+{
+    Stats::Phase phase("Translate to C++");
+    Translator translator(m_image);
+    if (!translator.EmitSource(m_opts.GetCppFile(), m_opts.GetSourceFile())) {
+        cerr << "C++ file could not be written." << endl;
+        return false;
+    }
+
+    cout << "C++ translation written to " << m_opts.GetCppFile() << endl;
+    if (translator.IsSelfModifying()) {
+        cout << "The program may overwrite its own instructions; those parts are interpreted." << endl;
+    }
+    return true;
+}
+
+/*
+NAME
+
+    Assembler::LoadCachedTranslation - reuses a cached translation
+
+SYNOPSIS
+
+    bool Assembler::LoadCachedTranslation();
+
+DESCRIPTION
+
+    This function looks the source program up in the translation cache
+    named on the command line.  On a hit the cached symbol table and
+    translation replace Pass I and Pass II: the listing is displayed as
+    it was when the translation was made and the program is recorded in
+    the emulator's memory.  On a miss, everything written to cout is
+    also captured until StoreCachedTranslation is called.  A module to
+    be written as an object file is always translated.
+
+RETURNS
+
+    Whether a cached translation was used
+
+*/
+bool Assembler::LoadCachedTranslation()
+{
+    // A module needs the relocations found by Pass II, which are not cached, and a
+    // source that can only be read once is not read in advance to find its key.
+    if (m_opts.GetCacheDir().empty() || IsWritingObject() || IsStreaming()) {
+        return false;
+    }
+    Stats::Phase phase("Cache lookup");
+
+    string source;
+    m_facc.ReadAll(source);
+    // The key covers the included files too, so editing one makes a new translation.
+    source += Library::DescribeIncludes(source, m_opts.GetSourceFile());
+    m_cacheKey = AsmCache::ComputeKey(source, VERSION);
+    m_cacheDigest = AsmCache::ComputeDigest(source);
+
+    AsmCache cache(m_opts.GetCacheDir(), m_opts.GetCacheLimit());
+    AsmCache::Entry entry;
+    if (cache.Lookup(m_cacheKey, m_cacheDigest, entry)) {
+        for (const auto& symbol : entry.m_symbols) {
+            string name = symbol.first;
+            m_symtab.AddSymbol(name, symbol.second);
+        }
+        m_image = entry.m_image;
+        m_image.LoadInto(m_emul);
+        m_diagnostics = entry.m_diagnostics;
+        cout << entry.m_listing;
+        return true;
+    }
+
+    // Capture the listing of the passes so that it can be cached.
+    m_listing.clear();
+    m_coutBuf = cout.rdbuf();
+    m_tee.reset(new OutputTee(m_coutBuf, m_listing));
+    cout.rdbuf(m_tee.get());
+    return false;
+}
+
+/*
+NAME
+
+    Assembler::StoreCachedTranslation - records the translation in the cache
+
+SYNOPSIS
+
+    void Assembler::StoreCachedTranslation();
+
+DESCRIPTION
+
+    This function stops capturing the listing and stores the symbol
+    table, the translation, its error messages and the listing in the
+    translation cache.  It does nothing if caching is not enabled.
+
+*/
+void Assembler::StoreCachedTranslation()
+{
+    if (m_coutBuf == nullptr) {
+        return;
+    }
+    cout.flush();
+    cout.rdbuf(m_coutBuf);
+    m_coutBuf = nullptr;
+    m_tee.reset();
+    Stats::Phase phase("Cache store");
+
+    AsmCache::Entry entry;
+    entry.m_symbols = m_symtab.GetSymbols();
+    entry.m_image = m_image;
+    entry.m_diagnostics = m_diagnostics;
+    entry.m_listing = m_listing;
+
+    AsmCache cache(m_opts.GetCacheDir(), m_opts.GetCacheLimit());
+    cache.Store(m_cacheKey, m_cacheDigest, entry);
+}
+
+/*
+NAME
+
+    Assembler::Optimize - runs the peephole optimizer over the translation
+
+SYNOPSIS
+
+    void Assembler::Optimize();
+
+DESCRIPTION
+
+    If --optimize was given and the translation has no errors, the
+    optimizer rewrites the translation, which is then loaded into the
+    emulator in place of the original.  Labels follow the instructions
+    they name, so the debugger and the profiler see the new locations.
+
+*/
+void Assembler::Optimize()
+{
+    if (!m_opts.GetOptimize() || !m_diagnostics.empty()) {
+        return;
+    }
+    Stats::Phase phase("Optimize");
+
+    MemoryImage original = m_image;
+    Optimizer optimizer(m_image);
+    bool optimized = optimizer.Optimize();
+    optimizer.DisplayReport();
+    if (!optimized) {
+        return;
+    }
+
+    for (const MemoryImage::Word& word : original.GetWords()) {
+        m_emul.insertMemory(word.m_loc, 0);
+    }
+    m_image.LoadInto(m_emul);
+    m_relocation = optimizer.GetRelocation();
+    m_symtab.Relocate(m_relocation);
+    Stats::SetCounter("instructions_eliminated", optimizer.GetEliminated());
+}
+
+/*
+NAME
+
+    Assembler::Specialize - specializes the translation for a fixed input
+
+SYNOPSIS
+
+    void Assembler::Specialize();
+
+DESCRIPTION
+
+    If --specialize was given and the translation has no errors, the
+    values in the file it names are taken as the first values the
+    program reads.  What depends only on them is evaluated, and the
+    specialized translation is loaded into the emulator in place of the
+    original; it reads only the values after them.  Labels are left
+    where they were, since the code the specialized program resumes in
+    does not move.
+
+*/
+void Assembler::Specialize()
+{
+    if (m_opts.GetSpecializeFile().empty() || !m_diagnostics.empty()) {
+        return;
+    }
+    Stats::Phase phase("Specialize");
+
+    ifstream input(m_opts.GetSpecializeFile());
+    if (!input) {
+        cerr << "Fixed input file could not be opened, specialization terminated." << endl;
+        exit(1);
+    }
+    vector<long long> values;
+    long long value;
+    while (input >> value) {
+        values.push_back(value);
+    }
+
+    Specializer specializer(m_image, values);
+    bool specialized = specializer.Specialize(m_opts.GetMaxSteps());
+    specializer.DisplayReport();
+    if (!specialized) {
+        return;
+    }
+
+    for (const MemoryImage::Word& word : m_image.GetWords()) {
+        m_emul.insertMemory(word.m_loc, 0);
+    }
+    m_image = specializer.GetImage();
+    m_image.LoadInto(m_emul);
+    Stats::SetCounter("specialized_instructions", specializer.GetEvaluated());
+}
+
+/*
+NAME
+
+    Assembler::ReportStats - writes the statistics of the run
+
+SYNOPSIS
+
+    void Assembler::ReportStats();
+
+DESCRIPTION
+
+    This function records the counters that describe the translation
+    and writes the JSON summary and the trace timeline, if they were
+    named on the command line.
+
+*/
+void Assembler::ReportStats()
+{
+    if (m_opts.GetStatsFile().empty() && m_opts.GetTraceFile().empty()) {
+        return;
+    }
+    // The sources packed have counted their own symbols and errors.
+    if (!IsPacking()) {
+        Stats::SetCounter("symbols", (long long)m_symtab.GetSymbols().size());
+        Stats::SetCounter("errors", (long long)m_diagnostics.size());
+    }
+
+    if (!m_opts.GetStatsFile().empty() && !Stats::WriteSummary(m_opts.GetStatsFile())) {
+        cerr << "Statistics file could not be written." << endl;
+    }
+    if (!m_opts.GetTraceFile().empty() && !Stats::WriteTrace(m_opts.GetTraceFile())) {
+        cerr << "Trace file could not be written." << endl;
+    }
+}
+
+/*
+NAME
+
+    Assembler::WriteObject - writes the translation as a relocatable module
+
+SYNOPSIS
+
+    bool Assembler::WriteObject();
+
+DESCRIPTION
+
+    This function writes the program generated in Pass II, with the
+    labels it exports and imports and the instructions to be relocated,
+    to the object file named on the command line.  A module with
+    errors is not written.
+
+RETURNS
+
+    Whether the object file was written
+
+*/
+bool Assembler::WriteObject()
+{
+    Stats::Phase phase("Write object");
+    if (!m_diagnostics.empty()) {
+        cerr << "The module has errors, so no object file was written." << endl;
+        return false;
+    }
+
+    m_object.m_image = m_image;
+    if (!ObjectFile::Write(m_opts.GetObjectFile(), m_object)) {
+        cerr << "Object file could not be written." << endl;
+        return false;
+    }
+    cout << "Object file written to " << m_opts.GetObjectFile() << ": " << m_object.m_size << " locations, "
+        << m_object.m_exports.size() << " exported and " << m_object.m_imports.size() << " imported labels, "
+        << m_object.m_relocations.size() << " relocations" << endl;
+    return true;
+}
+
+/*
+NAME
+
+    Assembler::Link - links object files in place of the passes
+
+SYNOPSIS
+
+    bool Assembler::Link();
+
+DESCRIPTION
+
+    This function links the object files named on the command line.
+    The exported labels become the symbol table and the linked modules
+    the translation, which is recorded in the emulator's memory just as
+    one made by the passes is.  The placement of the modules is
+    displayed, and the errors between separators if there are any.
+
+RETURNS
+
+    Whether the modules were linked without errors
+
+*/
+bool Assembler::Link()
+{
+    Stats::Phase phase("Link");
+    Linker linker(m_opts.GetLinkFiles());
+    bool linked = linker.Link();
+
+    for (const auto& symbol : linker.GetSymbols()) {
+        string name = symbol.first;
+        m_symtab.AddSymbol(name, symbol.second);
+    }
+    DisplaySymbolTable();
+    if (linked) {
+        linker.DisplayModuleMap();
+        m_image = linker.GetImage();
+        m_image.LoadInto(m_emul);
+    }
+
+    // The symbol table and module map end with a separator, so only errors need one of their own.
+    m_diagnostics = Errors::GetErrors();
+    if (!m_diagnostics.empty()) {
+        cout << "__________________________________________________________" << endl;
+        Errors::DisplayErrors();
+        cout << "__________________________________________________________" << endl << endl << endl;
+    }
+    return linked;
+}
+
+/*
+NAME
+
+    Assembler::Pack - translates sources into an archive
+
+SYNOPSIS
+
+    bool Assembler::Pack();
+
+DESCRIPTION
+
+    Each source named on the command line is translated as it would be
+    to run it, using the translation cache if there is one, but without
+    displaying the listing.  The translations are added to the archive
+    under the names of their sources without the directory and
+    extension, replacing programs of the same names; the programs
+    already in the archive are kept.  A source with errors is reported
+    and left out.  The archive is written once, at the end.
+
+RETURNS
+
+    Whether every source was packed
+
+*/
+bool Assembler::Pack()
+{
+    Stats::Phase phase("Pack");
+    ArchiveBuilder builder;
+    if (filesystem::exists(m_opts.GetPackFile())) {
+        ImageArchive archive;
+        if (!archive.Open(m_opts.GetPackFile()) || !builder.AddArchive(archive)) {
+            cerr << "Archive " << m_opts.GetPackFile() << " could not be read." << endl;
+            return false;
+        }
+    }
+
+    bool packed = true;
+    for (const string& source : m_opts.GetPackSources()) {
+        // An assembler holds a whole machine, so it is not kept on the stack.
+        unique_ptr<Assembler> assem(new Assembler(m_opts.ForSource(source)));
+        bool translated = assem->TranslateQuietly();
+        Stats::AddCounter("symbols", (long long)assem->m_symtab.GetSymbols().size());
+        Stats::AddCounter("errors", (long long)assem->m_diagnostics.size());
+        if (!translated) {
+            cerr << source << ": " << assem->m_diagnostics.size() << " errors, the first: " << assem->m_diagnostics[0]
+                << "; not packed." << endl;
+            packed = false;
+            continue;
+        }
+        builder.Add(filesystem::path(source).stem().string(), assem->m_image);
+    }
+
+    if (!builder.Write(m_opts.GetPackFile())) {
+        cerr << "Archive " << m_opts.GetPackFile() << " could not be written." << endl;
+        return false;
+    }
+    builder.DisplaySummary(m_opts.GetPackFile());
+    return packed;
+}
+
+/*
+NAME
+
+    Assembler::TranslateQuietly - translates the source without a listing
+
+SYNOPSIS
+
+    bool Assembler::TranslateQuietly();
+
+DESCRIPTION
+
+    The passes run as usual, with cout discarding what they display.
+
+RETURNS
+
+    Whether the translation has no errors
+
+*/
+bool Assembler::TranslateQuietly()
+{
+    // Discards everything written to it.
+    class Discard : public streambuf {
+    protected:
+        int overflow(int a_ch) override { return a_ch == EOF ? 0 : a_ch; }
+        streamsize xsputn(const char*, streamsize a_count) override { return a_count; }
+    };
+
+    Discard discard;
+    streambuf* display = cout.rdbuf(&discard);
+    if (!LoadCachedTranslation()) {
+        PassI();
+        PassII();
+        StoreCachedTranslation();
+    }
+    cout.rdbuf(display);
+    return m_diagnostics.empty();
+}
+
+/*
+NAME
+
+    Assembler::LoadFromArchive - loads a program from an archive
+
+SYNOPSIS
+
+    bool Assembler::LoadFromArchive();
+
+DESCRIPTION
+
+    The program named on the command line is found in the archive and
+    becomes the translation, which is recorded in the emulator's memory
+    just as one made by the passes is.  The archive is mapped and only
+    the program's own chunks are read, so loading takes as long in a
+    small archive as in a large one.  There is no symbol table.
+
+RETURNS
+
+    Whether the program was loaded
+
+*/
+bool Assembler::LoadFromArchive()
+{
+    Stats::Phase phase("Load from archive");
+    ImageArchive archive;
+    if (!archive.Open(m_opts.GetArchiveFile())) {
+        cerr << "Archive " << m_opts.GetArchiveFile() << " could not be read." << endl;
+        return false;
+    }
+    if (!archive.Load(m_opts.GetArchiveProgram(), m_image)) {
+        cerr << "Program " << m_opts.GetArchiveProgram() << " is not in archive " << m_opts.GetArchiveFile()
+            << ", or is damaged." << endl;
+        return false;
+    }
+    if (!m_image.LoadInto(m_emul)) {
+        cerr << "Program " << m_opts.GetArchiveProgram() << " does not fit in memory." << endl;
+        return false;
+    }
+    cout << "Program " << m_opts.GetArchiveProgram() << " loaded from " << m_opts.GetArchiveFile() << ": "
+        << m_image.GetWords().size() << " words" << endl << endl;
+    return true;
+}
@@ -4,38 +4,223 @@
 //
 #pragma once 
 
+#include <memory>
+
 #include "SymTab.h"
 #include "Instruction.h"
 #include "FileAccess.h"
 #include "Emulator.h"
+#include "Library.h"
+#include "MacroExpander.h"
+#include "ObjectFile.h"
+#include "MemoryImage.h"
+#include "Options.h"
+#include "Profiler.h"
+#include "Stats.h"
+#include "TimingModel.h"
 
 
 class Assembler {
 
 public:
     Assembler(int argc, char* argv[]);
-    ~Assembler() {};
+    Assembler(const Options& a_opts);
+    ~Assembler();
+
+    // Identifies the translation rules.  Change it whenever a change to the
+    // assembler would translate the same source differently.
+    static constexpr const char* VERSION = "Quack3200 Assembler 1.7";
 
     // Pass I - establishs the locations of the symbols
     void PassI();
 
-    // Pass II - generates a translation
+    // Pass II - generates a translation.  A source that can only be read once is
+    // translated by this pass alone.
     void PassII();
 
+    // Determines if the source can only be read once, so it is assembled in one pass.
+    bool IsStreaming() const { return m_facc.IsStreaming(); }
+
     // Sequence of format and validation checks
     void ErrorProccessing(string& a_message);
 
     // Display the symbols in the symbol table.
-    void DisplaySymbolTable() { m_symtab.DisplaySymbolTable(); }
+    void DisplaySymbolTable() {
+        Stats::Phase phase("Symbol table");
+        m_symtab.DisplaySymbolTable();
+    }
 
     // Run emulator on the translation.
-    void RunProgramInEmulator() { m_emul.runProgram(); }
+    emulator::RunResult RunProgramInEmulator();
+
+    // Determines if the translation is to be written as C++ rather than emulated.
+    bool IsTranslatingToCpp() { return !m_opts.GetCppFile().empty(); }
+
+    // Writes the translation as a C++ program.
+    bool TranslateToCpp();
+
+    // Reuses a cached translation of the source.  On a miss, starts capturing
+    // the listing so the translation can be cached once the passes are done.
+    bool LoadCachedTranslation();
+
+    // Records the translation produced by the passes in the cache.
+    void StoreCachedTranslation();
+
+    // Writes the statistics files named on the command line.
+    void ReportStats();
+
+    // Runs the peephole optimizer over the translation, if asked to.
+    void Optimize();
+
+    // Specializes the translation for the first values it reads, if asked to.
+    void Specialize();
+
+    // Determines if a relocatable module is to be written rather than the program run.
+    bool IsWritingObject() { return !m_opts.GetObjectFile().empty(); }
+
+    // Writes the translation as a relocatable module.
+    bool WriteObject();
+
+    // Determines if object files are to be linked rather than a source assembled.
+    bool IsLinking() { return m_opts.GetLink(); }
+
+    // Links the object files named on the command line in place of the passes.
+    bool Link();
+
+    // Determines if sources are to be packed into an archive rather than a program run.
+    bool IsPacking() { return !m_opts.GetPackFile().empty(); }
+
+    // Translates the sources named on the command line into the archive.
+    bool Pack();
+
+    // Determines if the program is to be loaded from an archive rather than assembled.
+    bool IsLoadingFromArchive() { return !m_opts.GetArchiveFile().empty(); }
+
+    // Loads the program named on the command line from the archive in place of the passes.
+    bool LoadFromArchive();
 
 
 private:
 
+    // Runs the translation on a machine other than the standard one.
+    template<typename Machine>
+    emulator::RunResult RunOnMachine(const vector<long long>& a_input);
+
+    // Runs the translation on a machine with the hooks asked for on the command line.
+    template<typename Machine>
+    emulator::RunResult Emulate(Machine& a_machine);
+    template<typename Machine, typename Hooks>
+    emulator::RunResult EmulateCheckpointing(Machine& a_machine, Hooks& a_hooks);
+    template<typename Machine, typename Hooks>
+    emulator::RunResult EmulateDetectingLoops(Machine& a_machine, Hooks& a_hooks);
+    template<typename Machine, typename Hooks>
+    emulator::RunResult EmulateTiming(Machine& a_machine, Hooks& a_hooks);
+    template<typename Cache, typename Machine, typename Hooks>
+    emulator::RunResult EmulateTimed(Machine& a_machine, Hooks& a_hooks, const TimingConfig& a_config);
+    template<typename Machine, typename Hooks>
+    emulator::RunResult EmulateProfiling(Machine& a_machine, Hooks& a_hooks);
+    template<typename Machine, typename Hooks>
+    emulator::RunResult EmulateCounting(Machine& a_machine, Hooks& a_hooks);
+
+    // The instructions the machine may still execute; negative for no limit.  The
+    // limit counts from the start of the run, so a resumed run stops where it would
+    // have.
+    template<typename Machine>
+    long long RemainingSteps(const Machine& a_machine) const {
+        return m_opts.GetMaxSteps() < 0 ? -1 : max(0LL, m_opts.GetMaxSteps() - a_machine.GetSteps());
+    }
+
+    // Finds the source statement translated at each location.
+    SourceMap MapSourceLines();
+
+    // Loads the file named by the current INCLUDE statement.  Returns null if it
+    // cannot be read.
+    shared_ptr<const Library> IncludeLibrary() {
+        return Library::Load(Library::ResolvePath(m_inst.GetOperand(), m_opts.GetSourceFile()), m_opts.GetCacheDir());
+    }
+
+    // Translates the library named by the current INCLUDE statement, placing it at a_loc.
+    void TranslateLibrary(int a_loc, const string& a_line);
+
+    // Records the labels defined by a statement at a_loc, as Pass I does.  Returns
+    // the location of the next statement.
+    int DefineLabels(Instruction::InstructionType a_type, int a_loc);
+
+    // Finds the location of the label used by the instruction that is word a_word of
+    // the translation, recording that the linker must relocate the instruction.
+    int LocateOperand(string a_operand, int a_word);
+
+    // Finds the location of the label operand of the instruction about to be added at
+    // a_loc, recording an error, preceded by a_where, if it is undefined.  A single
+    // pass leaves a label it has not yet met to the END, and returns 0.
+    int LocateLabel(string a_label, int a_loc, const string& a_where);
+
+    // A check that a single pass leaves to the END, since it depends on labels that
+    // may be defined later in the source.
+    struct Deferred {
+        enum Kind {
+            DK_Operand,             // A label operand, whose location is filled in.
+            DK_Label,               // A label not yet met, which must be defined once.
+            DK_MultiplyDefined,     // A label, which must not be defined again.
+            DK_Import,              // An imported label, which must not be defined.
+            DK_Export               // An exported label, which must be defined.
+        };
+        Kind m_kind;
+        string m_label;         // The label checked.
+        string m_context;       // What is put before its error messages.
+        size_t m_position;      // The number of errors recorded before it.
+        int m_loc;              // For an operand, the location of the instruction.
+        int m_word;             // For an operand, its index in the translation.
+    };
+
+    // Leaves a check to the END of a single pass.
+    void Defer(Deferred::Kind a_kind, const string& a_label, const string& a_where = "", int a_loc = 0, int a_word = 0);
+
+    // Makes the checks left to the END, recording their errors where the two passes
+    // would have recorded them, and fills in the locations of the operands.
+    void ResolveDeferred();
+
+    // Records the labels of the rest of the source, after an error stopped a single pass.
+    void SkipToEnd(int a_loc);
+
+    // Checks an EXTERN or ENTRY statement, recording the labels a module exports.
+    void CheckLinkage();
+
+    // Translates the source without displaying the listing.  Returns false if the
+    // translation has errors.
+    bool TranslateQuietly();
+
+    // Runs copies of the translation under the scheduler.
+    emulator::RunResult RunGuests(const vector<long long>& a_input);
+
+    // Runs the translation on several cores sharing one memory.
+    emulator::RunResult RunMultiCore(const vector<long long>& a_input);
+
+    // Records the counters of a finished emulation.
+    template<typename Machine>
+    void CountRun(const Machine& a_machine) {
+        Stats::SetCounter("guest_instructions", a_machine.GetSteps());
+        Stats::SetCounter("reads", (long long)a_machine.GetInputPosition());
+        Stats::SetCounter("writes", a_machine.GetWrites());
+        Stats::SetCounter("loop_iterations_skipped", a_machine.GetSkippedIterations());
+    }
+
+    Options m_opts;         // Command line options
     FileAccess m_facc;	    // File Access object
+    MacroExpander m_source; // Statements of the source, with macros expanded
     SymbolTable m_symtab;	// Symbol table object
     Instruction m_inst;	    // Instruction object
     emulator m_emul;        // Emulator object
+    MemoryImage m_image;    // The translation generated in Pass II
+
+    uint64_t m_cacheKey = 0;            // Cache key of the source program
+    uint64_t m_cacheDigest = 0;         // Digest telling apart sources whose keys collide
+    vector<string> m_diagnostics;       // Error messages of the translation
+    string m_listing;                   // Captured listing of the translation
+    map<int, int> m_relocation;         // New location of each instruction moved by the optimizer
+    map<string, int> m_externs;         // Index of each label imported from another module
+    vector<Deferred> m_deferred;        // Checks a single pass has left to the END
+    ObjectFile::Module m_object;        // The translation as a relocatable module
+    streambuf* m_coutBuf = nullptr;     // Display buffer of cout while the listing is captured
+    unique_ptr<streambuf> m_tee;        // Buffer copying cout to the captured listing
 };
@@ -0,0 +1,92 @@
+//
+//		Classes to build and parse the binary files written by the assembler.
+//		Values are stored in the byte order of the host.
+//
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+using namespace std;
+
+// Appends binary values to a byte string.
+class BinaryWriter {
+
+public:
+
+    BinaryWriter() {};
+    ~BinaryWriter() {};
+
+    void PutInt32(int32_t a_value) { PutRaw(&a_value, sizeof(a_value)); }
+    void PutUInt32(uint32_t a_value) { PutRaw(&a_value, sizeof(a_value)); }
+    void PutInt64(int64_t a_value) { PutRaw(&a_value, sizeof(a_value)); }
+    void PutUInt64(uint64_t a_value) { PutRaw(&a_value, sizeof(a_value)); }
+    void PutByte(unsigned char a_value) { m_bytes.push_back((char)a_value); }
+
+    // Writes a length prefixed string.
+    void PutString(const string& a_value) {
+        PutUInt32((uint32_t)a_value.size());
+        m_bytes.append(a_value);
+    }
+
+    void PutRaw(const void* a_data, size_t a_size) {
+        m_bytes.append(static_cast<const char*>(a_data), a_size);
+    }
+
+    string& GetBytes() { return m_bytes; }
+
+private:
+
+    string m_bytes;     // The bytes written so far.
+};
+
+// Reads binary values from a block of memory.  Reading past the end of the
+// block returns zeros and marks the reader as failed rather than overrunning.
+class BinaryReader {
+
+public:
+
+    BinaryReader(const unsigned char* a_data, size_t a_size) : m_data(a_data), m_size(a_size) {};
+    ~BinaryReader() {};
+
+    int32_t GetInt32() { int32_t value = 0; GetRaw(&value, sizeof(value)); return value; }
+    uint32_t GetUInt32() { uint32_t value = 0; GetRaw(&value, sizeof(value)); return value; }
+    int64_t GetInt64() { int64_t value = 0; GetRaw(&value, sizeof(value)); return value; }
+    uint64_t GetUInt64() { uint64_t value = 0; GetRaw(&value, sizeof(value)); return value; }
+    unsigned char GetByte() { unsigned char value = 0; GetRaw(&value, sizeof(value)); return value; }
+
+    // Reads a length prefixed string.
+    string GetString() {
+        uint32_t length = GetUInt32();
+        if (m_failed || length > m_size - m_pos) {
+            m_failed = true;
+            return "";
+        }
+        string value((const char*)m_data + m_pos, length);
+        m_pos += length;
+        return value;
+    }
+
+    bool GetRaw(void* a_data, size_t a_size) {
+        if (m_failed || a_size > m_size - m_pos) {
+            m_failed = true;
+            return false;
+        }
+        memcpy(a_data, m_data + m_pos, a_size);
+        m_pos += a_size;
+        return true;
+    }
+
+    // Getter Functions
+    bool Failed() const { return m_failed; }
+    size_t GetPosition() const { return m_pos; }
+    size_t GetRemaining() const { return m_size - m_pos; }
+    const unsigned char* GetCurrent() const { return m_data + m_pos; }
+
+private:
+
+    const unsigned char* m_data;    // The block being read.
+    size_t m_size;                  // Size of the block in bytes.
+    size_t m_pos = 0;               // Offset of the next byte to be read.
+    bool m_failed = false;          // == true if a read ran past the end.
+};
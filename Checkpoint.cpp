@@ -0,0 +1,448 @@
+//
+//		Implementation of the CheckpointFile class.
+//
+//		A checkpoint file is laid out as
+//
+//			header      "QKCK", format, hash of the translation, memory size, register
+//			            count and word size of the machine, checksum of the above
+//			records     (length, checkpoint, checksum of the checkpoint) of each
+//			            checkpoint, in the order they were taken
+//
+//		A checkpoint is the step count, location, registers and WRITE count, then the
+//		values read and the words stored, as (location, value), since the one before.
+//
+#include "stdafx.h"
+#include <filesystem>
+#include "Checkpoint.h"
+#include "Binary.h"
+#include "Hash.h"
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+    const uint32_t CHECKPOINT_MAGIC = 0x4b434b51;   // "QKCK"
+    const uint32_t CHECKPOINT_FORMAT = 1;           // Layout version of a checkpoint file.
+}
+
+// Constructor for the checkpoint file.  Nothing is read or written until the file is
+// loaded or started.
+CheckpointFile::CheckpointFile(const string& a_path, uint64_t a_imageHash, int a_memSize, int a_regCount, int a_wordSize) :
+    m_path(a_path), m_imageHash(a_imageHash), m_memSize(a_memSize), m_regCount(a_regCount), m_wordSize(a_wordSize)
+{
+    m_state.m_reg.assign(m_regCount, 0);
+}
+
+/*
+NAME
+
+    CheckpointFile::Load - reads the last checkpoint of the file
+
+SYNOPSIS
+
+    bool CheckpointFile::Load(State& a_state, string& a_error);
+    a_state -> the storage for the state at the last checkpoint
+    a_error -> the storage for why there is none
+
+DESCRIPTION
+
+    This function reads the records of the file in order, adding each
+    to the state, and stops at the first that is cut short or does not
+    match its checksum: a crash while it was being written leaves the
+    file as it was before it.  The state is kept, so the file can be
+    started again holding just it.
+
+RETURNS
+
+    Whether the file held a checkpoint of this translation and machine
+
+*/
+bool CheckpointFile::Load(State& a_state, string& a_error)
+{
+    MappedFile file;
+    if (!file.Open(m_path)) {
+        a_error = "the file could not be read";
+        return false;
+    }
+    const unsigned char* data = file.GetData();
+    size_t size = file.GetSize();
+
+    BinaryReader in(data, size);
+    uint32_t magic = in.GetUInt32();
+    uint32_t format = in.GetUInt32();
+    uint64_t imageHash = in.GetUInt64();
+    uint32_t memSize = in.GetUInt32();
+    uint32_t regCount = in.GetUInt32();
+    uint32_t wordSize = in.GetUInt32();
+    size_t headerSize = in.GetPosition();
+    uint64_t checksum = in.GetUInt64();
+    if (in.Failed() || magic != CHECKPOINT_MAGIC || format != CHECKPOINT_FORMAT || checksum != Hash::Fnv1a(data, headerSize)) {
+        a_error = "the file is not a checkpoint";
+        return false;
+    }
+    if (imageHash != m_imageHash) {
+        a_error = "the checkpoint is of another translation";
+        return false;
+    }
+    if (memSize != (uint32_t)m_memSize || regCount != (uint32_t)m_regCount || wordSize != (uint32_t)m_wordSize) {
+        a_error = "the checkpoint is of another machine";
+        return false;
+    }
+
+    State state;
+    state.m_reg.assign(m_regCount, 0);
+    map<int, long long> words;
+    bool found = false;
+    size_t pos = in.GetPosition();
+    while (size - pos >= sizeof(uint32_t) + sizeof(uint64_t)) {
+        uint32_t length;
+        memcpy(&length, data + pos, sizeof(length));
+        pos += sizeof(length);
+        if (length > size - pos - sizeof(uint64_t)) {
+            break;
+        }
+        memcpy(&checksum, data + pos + length, sizeof(checksum));
+        State delta;
+        if (checksum != Hash::Fnv1a(data + pos, length) || !ParseRecord(data + pos, length, delta)) {
+            break;
+        }
+        Merge(state, words, delta);
+        found = true;
+        pos += length + sizeof(checksum);
+    }
+    if (!found) {
+        a_error = "the file holds no checkpoint";
+        return false;
+    }
+
+    m_state = state;
+    m_words = words;
+    m_hasState = true;
+    a_state = state;
+    a_state.m_changes.assign(words.begin(), words.end());
+    return true;
+}
+
+/*
+NAME
+
+    CheckpointFile::Start - starts the file and the writing thread
+
+SYNOPSIS
+
+    bool CheckpointFile::Start(string& a_error);
+    a_error -> the storage for why the file cannot be written
+
+DESCRIPTION
+
+    The file is rewritten to hold only the header and, if a checkpoint
+    was loaded, that checkpoint as a single record.  A record torn by a
+    crash is dropped with it, so new records follow intact ones.
+
+RETURNS
+
+    Whether the file was written
+
+*/
+bool CheckpointFile::Start(string& a_error)
+{
+    if (!Rewrite()) {
+        a_error = "the file could not be written";
+        return false;
+    }
+    m_writer = thread(&CheckpointFile::WriteLoop, this);
+    return true;
+}
+
+// Determines if the last checkpoint handed over is still being written.
+bool CheckpointFile::IsBusy()
+{
+    lock_guard<mutex> lock(m_lock);
+    return m_hasPending;
+}
+
+// Hands a checkpoint over to the writing thread, once the last one is written.
+void CheckpointFile::Write(State&& a_delta)
+{
+    unique_lock<mutex> lock(m_lock);
+    m_changed.wait(lock, [this] { return !m_hasPending; });
+    m_pending = move(a_delta);
+    m_hasPending = true;
+    m_changed.notify_all();
+}
+
+/*
+NAME
+
+    CheckpointFile::Finish - writes what is left and stops the writing thread
+
+SYNOPSIS
+
+    bool CheckpointFile::Finish();
+
+DESCRIPTION
+
+    The writing thread writes the checkpoint handed over, if any, before
+    it stops.  Finishing a file that was never started does nothing.
+
+RETURNS
+
+    Whether every checkpoint was written
+
+*/
+bool CheckpointFile::Finish()
+{
+    {
+        lock_guard<mutex> lock(m_lock);
+        m_stopping = true;
+    }
+    m_changed.notify_all();
+    if (m_writer.joinable()) {
+        m_writer.join();
+    }
+    if (m_file != nullptr) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+    return !m_failed;
+}
+
+// Writes the checkpoints handed over until told to stop.
+void CheckpointFile::WriteLoop()
+{
+    unique_lock<mutex> lock(m_lock);
+    for (;;) {
+        m_changed.wait(lock, [this] { return m_hasPending || m_stopping; });
+        if (!m_hasPending) {
+            return;
+        }
+        State delta = move(m_pending);
+        lock.unlock();
+        bool written = Append(delta);
+        lock.lock();
+
+        if (written) {
+            m_written++;
+        }
+        else {
+            m_failed = true;
+        }
+        m_hasPending = false;
+        m_changed.notify_all();
+    }
+}
+
+/*
+NAME
+
+    CheckpointFile::Append - writes a checkpoint to the file
+
+SYNOPSIS
+
+    bool CheckpointFile::Append(const State& a_delta);
+    a_delta -> the input read and the words stored since the last checkpoint
+
+DESCRIPTION
+
+    The checkpoint is added to the state and appended to the file as a
+    record.  Words stored again and again are in many records, so once
+    the file is more than twice the size of a record of the whole state
+    it is rewritten as that record instead.  It is also rewritten after
+    a record could not be written, which may have left part of it.
+
+RETURNS
+
+    Whether the checkpoint was written
+
+*/
+bool CheckpointFile::Append(const State& a_delta)
+{
+    Merge(m_state, m_words, a_delta);
+    m_hasState = true;
+
+    string record = Record(a_delta);
+    // The size of a record of the whole state: the framing and counts, the values
+    // read and the words stored.
+    size_t full = 40 + (m_regCount + m_state.m_input.size()) * sizeof(int64_t) + m_words.size() * (sizeof(int32_t) + sizeof(int64_t));
+    if (m_rewrite || m_size + record.size() > max(MIN_REWRITE, 2 * full)) {
+        return Rewrite();
+    }
+    if (fwrite(record.data(), 1, record.size(), m_file) != record.size() || !Sync()) {
+        m_rewrite = true;
+        return false;
+    }
+    m_size += record.size();
+    return true;
+}
+
+/*
+NAME
+
+    CheckpointFile::Rewrite - replaces the file with one holding the state
+
+SYNOPSIS
+
+    bool CheckpointFile::Rewrite();
+
+DESCRIPTION
+
+    The header and, if there is one, the state as a single record are
+    written to a temporary file, which is made durable and then renamed
+    over the checkpoint file, so a crash leaves either the old file or
+    the new one.  The new file is left open for appending.
+
+RETURNS
+
+    Whether the file was replaced
+
+*/
+bool CheckpointFile::Rewrite()
+{
+    if (m_file != nullptr) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+    m_rewrite = true;
+
+    string contents = Header();
+    if (m_hasState) {
+        State full = m_state;
+        full.m_changes.assign(m_words.begin(), m_words.end());
+        contents += Record(full);
+    }
+    string temp = m_path + ".tmp";
+    m_file = fopen(temp.c_str(), "wb");
+    if (m_file == nullptr) {
+        return false;
+    }
+    bool written = fwrite(contents.data(), 1, contents.size(), m_file) == contents.size() && Sync();
+    fclose(m_file);
+    m_file = nullptr;
+
+    error_code ec;
+    if (written) {
+        filesystem::rename(temp, m_path, ec);
+    }
+    if (!written || ec) {
+        filesystem::remove(temp, ec);
+        return false;
+    }
+    m_file = fopen(m_path.c_str(), "ab");
+    if (m_file == nullptr) {
+        return false;
+    }
+    m_size = contents.size();
+    m_rewrite = false;
+    return true;
+}
+
+// Returns the header of the file, which identifies the translation and the machine.
+string CheckpointFile::Header() const
+{
+    BinaryWriter out;
+    out.PutUInt32(CHECKPOINT_MAGIC);
+    out.PutUInt32(CHECKPOINT_FORMAT);
+    out.PutUInt64(m_imageHash);
+    out.PutUInt32((uint32_t)m_memSize);
+    out.PutUInt32((uint32_t)m_regCount);
+    out.PutUInt32((uint32_t)m_wordSize);
+    out.PutUInt64(Hash::Fnv1a(out.GetBytes().data(), out.GetBytes().size()));
+    return out.GetBytes();
+}
+
+// Returns a checkpoint as a record: its length, the checkpoint and its checksum.
+string CheckpointFile::Record(const State& a_state) const
+{
+    BinaryWriter out;
+    out.PutInt64(a_state.m_steps);
+    out.PutInt32(a_state.m_pc);
+    for (long long value : a_state.m_reg) {
+        out.PutInt64(value);
+    }
+    out.PutInt64(a_state.m_writes);
+    out.PutUInt32((uint32_t)a_state.m_input.size());
+    for (long long value : a_state.m_input) {
+        out.PutInt64(value);
+    }
+    out.PutUInt32((uint32_t)a_state.m_changes.size());
+    for (const auto& change : a_state.m_changes) {
+        out.PutInt32(change.first);
+        out.PutInt64(change.second);
+    }
+
+    BinaryWriter record;
+    record.PutUInt32((uint32_t)out.GetBytes().size());
+    record.PutRaw(out.GetBytes().data(), out.GetBytes().size());
+    record.PutUInt64(Hash::Fnv1a(out.GetBytes().data(), out.GetBytes().size()));
+    return record.GetBytes();
+}
+
+// Reads the checkpoint of a record.  Returns false if it does not fit the machine.
+bool CheckpointFile::ParseRecord(const unsigned char* a_data, size_t a_size, State& a_state) const
+{
+    BinaryReader in(a_data, a_size);
+    a_state.m_steps = in.GetInt64();
+    a_state.m_pc = in.GetInt32();
+    a_state.m_reg.resize(m_regCount);
+    for (int i = 0; i < m_regCount; i++) {
+        a_state.m_reg[i] = in.GetInt64();
+    }
+    a_state.m_writes = in.GetInt64();
+    if (a_state.m_pc < 0 || a_state.m_pc >= m_memSize) {
+        return false;
+    }
+
+    uint32_t count = in.GetUInt32();
+    if (count > in.GetRemaining() / sizeof(int64_t)) {
+        return false;
+    }
+    a_state.m_input.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        a_state.m_input[i] = in.GetInt64();
+    }
+
+    count = in.GetUInt32();
+    if (count > in.GetRemaining() / (sizeof(int32_t) + sizeof(int64_t))) {
+        return false;
+    }
+    a_state.m_changes.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        a_state.m_changes[i].first = in.GetInt32();
+        a_state.m_changes[i].second = in.GetInt64();
+        if (a_state.m_changes[i].first < 0 || a_state.m_changes[i].first >= m_memSize) {
+            return false;
+        }
+    }
+    return !in.Failed() && in.GetRemaining() == 0;
+}
+
+// Adds a checkpoint to the state: its registers and counts replace the state's, its
+// values read follow the state's, and its words replace theirs in a_words.
+void CheckpointFile::Merge(State& a_state, map<int, long long>& a_words, const State& a_delta)
+{
+    a_state.m_steps = a_delta.m_steps;
+    a_state.m_pc = a_delta.m_pc;
+    a_state.m_reg = a_delta.m_reg;
+    a_state.m_writes = a_delta.m_writes;
+    a_state.m_input.insert(a_state.m_input.end(), a_delta.m_input.begin(), a_delta.m_input.end());
+    for (const auto& change : a_delta.m_changes) {
+        a_words[change.first] = change.second;
+    }
+}
+
+// Makes what has been written to the file durable.
+bool CheckpointFile::Sync()
+{
+    if (fflush(m_file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(m_file)) == 0;
+#else
+    return fsync(fileno(m_file)) == 0;
+#endif
+}
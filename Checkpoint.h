@@ -0,0 +1,242 @@
+//
+//		Classes to checkpoint a long running emulation to a file so that it can be
+//		resumed, exactly where it was, after the host restarts.
+//
+//		As hooks, the checkpointer marks each word that is stored to.  Every so many
+//		instructions it copies the registers, the location, the input read and the
+//		marked words, and hands them to a thread that appends them to the file as a
+//		record, so the emulation only pauses for as long as the copy takes.  Each
+//		record is checksummed and made durable before the next is written, so a record
+//		torn by a crash is ignored and the one before it is resumed from.  When the
+//		records outgrow the state they describe, the thread rewrites the file as a
+//		single record.
+//
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+#include "Emulator.h"
+
+// A checkpoint file and the thread that writes it.
+class CheckpointFile {
+
+public:
+
+    // The state of a machine at a checkpoint.  A record holds the input read and the
+    // words stored since the record before it; the state read from a file holds
+    // everything read and every word stored since the run began.
+    struct State {
+        long long m_steps = 0;                      // The instructions executed.
+        int m_pc = EmulatorBase::ORIGIN;            // The location of the next instruction.
+        vector<long long> m_reg;                    // The registers.
+        long long m_writes = 0;                     // The WRITE instructions executed.
+        vector<long long> m_input;                  // The values read.
+        vector<pair<int, long long>> m_changes;     // Words stored and their values.
+    };
+
+    // Checkpoints a run of the translation with hash a_imageHash to a_path, on a
+    // machine of a_memSize words of a_wordSize bytes and a_regCount registers.
+    CheckpointFile(const string& a_path, uint64_t a_imageHash, int a_memSize, int a_regCount, int a_wordSize);
+    ~CheckpointFile() { Finish(); }
+
+    // Reads the last intact checkpoint of the file.  Returns false, with why, if there
+    // is none or it is of another translation or machine.
+    bool Load(State& a_state, string& a_error);
+
+    // Starts the file afresh, holding only what was loaded, and starts the writing
+    // thread.  Returns false, with why, if the file cannot be written.
+    bool Start(string& a_error);
+
+    // Determines if the last checkpoint handed over is still being written.
+    bool IsBusy();
+
+    // Hands a checkpoint over to be written, waiting for the last one to be written
+    // first if need be.
+    void Write(State&& a_delta);
+
+    // Writes what has been handed over and stops the writing thread.  Returns false if
+    // a checkpoint could not be written.
+    bool Finish();
+
+    // The checkpoints written.
+    long long GetWritten() const { return m_written; }
+
+private:
+
+    CheckpointFile(const CheckpointFile&) = delete;
+    CheckpointFile& operator=(const CheckpointFile&) = delete;
+
+    // The loop of the writing thread.
+    void WriteLoop();
+
+    // Adds a checkpoint to the state and appends it to the file, rewriting the file
+    // if the records have grown too large.
+    bool Append(const State& a_delta);
+
+    // Returns the header of the file.
+    string Header() const;
+
+    // Replaces the file with one holding the state, and opens it for appending.
+    bool Rewrite();
+
+    // Returns a checkpoint as a record of the file.
+    string Record(const State& a_state) const;
+
+    // Reads the checkpoint of a record.  Returns false if it does not fit the machine.
+    bool ParseRecord(const unsigned char* a_data, size_t a_size, State& a_state) const;
+
+    // Adds a checkpoint to the state, with the words stored kept in a_words.
+    static void Merge(State& a_state, map<int, long long>& a_words, const State& a_delta);
+
+    // Makes what has been written to the file durable.
+    bool Sync();
+
+    static const size_t MIN_REWRITE = 1 << 20;  // The size the file may grow to before it is rewritten.
+
+    string m_path;                      // The checkpoint file.
+    uint64_t m_imageHash;               // The hash of the translation being run.
+    int m_memSize;                      // The words of memory of the machine.
+    int m_regCount;                     // The registers of the machine.
+    int m_wordSize;                     // The bytes of a word of the machine.
+
+    State m_state;                      // The state at the last checkpoint written, but for the words stored.
+    map<int, long long> m_words;        // The words stored by the last checkpoint written, and their values.
+    bool m_hasState = false;            // == true once a checkpoint has been loaded or written.
+    bool m_rewrite = false;             // == true if the file must be rewritten before a record is appended.
+    FILE* m_file = nullptr;             // The file, open for appending.
+    size_t m_size = 0;                  // The bytes in the file.
+    long long m_written = 0;            // The checkpoints written.
+    bool m_failed = false;              // == true if a checkpoint could not be written.
+
+    mutex m_lock;                       // Guards the members below.
+    condition_variable m_changed;       // Signalled when a checkpoint is handed over or written.
+    State m_pending;                    // The checkpoint handed over.
+    bool m_hasPending = false;          // == true until the checkpoint handed over is written.
+    bool m_stopping = false;            // == true when the writing thread should finish.
+    thread m_writer;                    // The writing thread.
+};
+
+// Hooks that checkpoint a run on a machine every so many instructions.
+template<typename Machine>
+class Checkpointer : public EmulatorBase::NoHooks {
+
+public:
+
+    typedef typename Machine::Word Word;
+
+    // Checkpoints to a_path every a_interval instructions.
+    Checkpointer(const string& a_path, uint64_t a_imageHash, long long a_interval) :
+        m_file(a_path, a_imageHash, Machine::MEMSZ, Machine::REGCOUNT, sizeof(Word)),
+        m_interval(a_interval > 0 ? a_interval : 1), m_dirty(Machine::MEMSZ, 0)
+    {
+    }
+
+    // Puts the machine, which holds the translation and any input given up front, in
+    // the state of the last checkpoint of the file.  Values the run read that the
+    // machine was not given are added to its input.  Returns false, with why, if it
+    // cannot be.
+    bool Restore(Machine& a_machine, string& a_error) {
+        CheckpointFile::State state;
+        if (!m_file.Load(state, a_error)) {
+            return false;
+        }
+        const vector<Word>& input = a_machine.GetInput();
+        for (size_t i = 0; i < state.m_input.size(); i++) {
+            if (i >= input.size()) {
+                a_machine.AddInput((Word)state.m_input[i]);
+            }
+            else if (input[i] != (Word)state.m_input[i]) {
+                a_error = "the input differs from the values the run read";
+                return false;
+            }
+        }
+        Word* memory = a_machine.GetMemory();
+        for (const auto& change : state.m_changes) {
+            memory[change.first] = (Word)change.second;
+        }
+        Word reg[Machine::REGCOUNT];
+        for (int i = 0; i < Machine::REGCOUNT; i++) {
+            reg[i] = (Word)state.m_reg[i];
+        }
+        a_machine.RestoreState(state.m_pc, reg, state.m_steps, state.m_input.size(), state.m_writes);
+        return true;
+    }
+
+    // Starts checkpointing the run from the machine's state.
+    bool Start(const Machine& a_machine, string& a_error) {
+        m_next = a_machine.GetSteps() + m_interval;
+        m_inputTaken = a_machine.GetInputPosition();
+        return m_file.Start(a_error);
+    }
+
+    // Takes a checkpoint every m_interval instructions.  One that falls due while the
+    // last is still being written is put off for another interval.
+    bool BeforeInstruction(const Machine& a_machine, int a_loc, long long a_steps, EmulatorBase::RunResult&) {
+        if (a_steps < m_next) {
+            return false;
+        }
+        m_next = a_steps + m_interval;
+        if (!m_file.IsBusy()) {
+            Take(a_machine, a_loc, a_steps);
+        }
+        return false;
+    }
+
+    // Marks the word as changed since the last checkpoint.
+    template<typename Value>
+    void BeforeStore(int a_address, Value, Value) {
+        if (!m_dirty[a_address]) {
+            m_dirty[a_address] = 1;
+            m_dirtyList.push_back(a_address);
+        }
+    }
+
+    // Finishes checkpointing once the run has stopped.  A run that ran out of
+    // instructions or input could go on, so it is checkpointed where it stopped.
+    // Returns false if a checkpoint could not be written.
+    bool Finish(const Machine& a_machine, EmulatorBase::RunResult a_result) {
+        if (a_result == EmulatorBase::RR_Budget || a_result == EmulatorBase::RR_EndOfInput
+            || a_result == EmulatorBase::RR_WaitingForInput) {
+            Take(a_machine, a_machine.GetPC(), a_machine.GetSteps());
+        }
+        return m_file.Finish();
+    }
+
+    // The checkpoints written.
+    long long GetWritten() const { return m_file.GetWritten(); }
+
+private:
+
+    // Copies the state that changed since the last checkpoint and hands it over.
+    void Take(const Machine& a_machine, int a_loc, long long a_steps) {
+        CheckpointFile::State delta;
+        delta.m_steps = a_steps;
+        delta.m_pc = a_loc;
+        delta.m_reg.assign(a_machine.GetRegisters(), a_machine.GetRegisters() + Machine::REGCOUNT);
+        delta.m_writes = a_machine.GetWrites();
+
+        const vector<Word>& input = a_machine.GetInput();
+        delta.m_input.assign(input.begin() + m_inputTaken, input.begin() + a_machine.GetInputPosition());
+        m_inputTaken = a_machine.GetInputPosition();
+
+        const Word* memory = a_machine.GetMemory();
+        delta.m_changes.reserve(m_dirtyList.size());
+        for (int loc : m_dirtyList) {
+            delta.m_changes.push_back({ loc, memory[loc] });
+            m_dirty[loc] = 0;
+        }
+        m_dirtyList.clear();
+        m_file.Write(move(delta));
+    }
+
+    CheckpointFile m_file;              // The file checkpoints are written to.
+    long long m_interval;               // Instructions between checkpoints.
+    long long m_next = 0;               // The step count of the next checkpoint.
+    size_t m_inputTaken = 0;            // The values read by the last checkpoint.
+    vector<char> m_dirty;               // == 1 for each word stored to since the last checkpoint.
+    vector<int> m_dirtyList;            // The words stored to since the last checkpoint.
+};
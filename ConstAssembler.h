@@ -0,0 +1,309 @@
+//
+//		Compile time assembler.  Translates Quack3200 source held in a string
+//		literal into a memory image while the host program is being compiled:
+//
+//			constexpr string_view kernel = R"(
+//			         org 100
+//			         ...
+//			         end
+//			)";
+//			constexpr auto image = QUACK_ASSEMBLE(kernel);
+//			...
+//			emul.LoadImage(image.data(), image.size());
+//
+//		The op code tables and format rules are those in OpCodes.h, which the run
+//		time assembler also uses.  A program with an error does not compile; the
+//		compiler reports the call to ConstAssembler::Error with the error message.
+//
+#pragma once
+
+#include <array>
+#include <stdexcept>
+#include <string_view>
+#include "OpCodes.h"
+#include "Emulator.h"
+
+class ConstAssembler {
+
+public:
+
+    static constexpr int MAX_SYMBOLS = 1024;    // The most labels a program may define.
+
+    // Returns the number of words from location 0 through the last word of the program.
+    static constexpr size_t ImageSize(string_view a_source) {
+        return Translate(a_source, nullptr, 0);
+    }
+
+    // Translates the program.  a_size must be ImageSize(a_source).
+    template<size_t N>
+    static constexpr array<int, N> Assemble(string_view a_source) {
+        array<int, N> words{};
+        Translate(a_source, words.data(), N);
+        return words;
+    }
+
+    // Reports an error.  Not constexpr, so reaching it during compile time
+    // translation is a compile error that shows the message.
+    static void Error(const char* a_message) {
+        throw logic_error(a_message);
+    }
+
+private:
+
+    // Codes to indicate the type of statement, as in Instruction::InstructionType.
+    enum StatementType { ST_MachineLanguage, ST_AssemblerInstr, ST_Comment, ST_End, ST_Error };
+
+    // The elements of a statement.
+    struct Statement {
+        string_view m_label;
+        string_view m_opcode;
+        string_view m_register;
+        string_view m_operand;
+        bool m_extraOperand = false;
+        StatementType m_type = ST_Error;
+    };
+
+    // The labels of the program.
+    struct Symbols {
+        string_view m_names[MAX_SYMBOLS] = {};
+        int m_locs[MAX_SYMBOLS] = {};
+        bool m_multiply[MAX_SYMBOLS] = {};
+        int m_count = 0;
+
+        constexpr int Find(string_view a_name) const {
+            for (int i = 0; i < m_count; i++) {
+                if (m_names[i] == a_name) {
+                    return i;
+                }
+            }
+            return -1;
+        }
+    };
+
+    // Breaks a line into its elements, following Instruction::ParseInstruction.
+    static constexpr Statement Parse(string_view a_line) {
+        Statement st;
+
+        // Get rid of everything after the semicolon if it exists.
+        size_t isemi = a_line.find(';');
+        if (isemi != string_view::npos) {
+            a_line = a_line.substr(0, isemi);
+        }
+
+        string_view tokens[4] = {};
+        size_t pos = 0;
+        for (int i = 0; i < 4; i++) {
+            while (pos < a_line.length() && OpCodes::IsSpace(a_line[pos])) {
+                pos++;
+            }
+            size_t start = pos;
+            while (pos < a_line.length() && !OpCodes::IsSpace(a_line[pos])) {
+                pos++;
+            }
+            tokens[i] = a_line.substr(start, pos - start);
+        }
+
+        if (tokens[0].empty()) {
+            st.m_type = ST_Comment;
+            return st;
+        }
+        if (a_line[0] != ' ' && a_line[0] != '\t') {
+            st.m_label = tokens[0];
+            st.m_opcode = tokens[1];
+            st.m_operand = tokens[2];
+            st.m_extraOperand = !tokens[3].empty();
+        }
+        else {
+            st.m_opcode = tokens[0];
+            st.m_operand = tokens[1];
+            st.m_extraOperand = !tokens[2].empty();
+        }
+
+        size_t icomma = st.m_operand.find(',');
+        if (icomma != string_view::npos) {
+            st.m_register = st.m_operand.substr(0, icomma);
+            st.m_operand = st.m_operand.substr(icomma + 1);
+        }
+        else {
+            st.m_register = "9";
+        }
+
+        if (OpCodes::LookupMachine(st.m_opcode) != 0) {
+            st.m_type = ST_MachineLanguage;
+        }
+        else if (OpCodes::EqualNoCase(st.m_opcode, "dc") || OpCodes::EqualNoCase(st.m_opcode, "ds") || OpCodes::EqualNoCase(st.m_opcode, "org")) {
+            st.m_type = ST_AssemblerInstr;
+        }
+        else if (OpCodes::EqualNoCase(st.m_opcode, "end")) {
+            st.m_type = ST_End;
+        }
+        else if (st.m_opcode.empty() && st.m_label.empty()) {
+            st.m_type = ST_Comment;
+        }
+        return st;
+    }
+
+    // Computes the location of the next statement, following Instruction::LocationNextInstruction.
+    static constexpr int NextLocation(const Statement& a_st, int a_loc) {
+        if ((OpCodes::EqualNoCase(a_st.m_opcode, "org") || OpCodes::EqualNoCase(a_st.m_opcode, "ds")) && OpCodes::IsNumber(a_st.m_operand)) {
+            return a_loc + OpCodes::ToNumber(a_st.m_operand);
+        }
+        return a_loc + 1;
+    }
+
+    // Returns the next line of the source, advancing a_pos past it.
+    static constexpr string_view NextLine(string_view a_source, size_t& a_pos) {
+        size_t end = a_source.find('\n', a_pos);
+        if (end == string_view::npos) {
+            end = a_source.length();
+        }
+        string_view line = a_source.substr(a_pos, end - a_pos);
+        a_pos = end + 1;
+        return line;
+    }
+
+    // Runs both passes.  Words are recorded only if a_words is not null.  Applies the
+    // checks of Assembler::PassII, reporting the first error found.
+    static constexpr size_t Translate(string_view a_source, int* a_words, size_t a_size) {
+        Symbols symbols;
+        size_t pos = 0;
+        int loc = 0;
+
+        // Pass I - establish the locations of the labels.
+        while (pos <= a_source.length()) {
+            Statement st = Parse(NextLine(a_source, pos));
+            if (st.m_type == ST_End) {
+                break;
+            }
+            if (st.m_type != ST_MachineLanguage && st.m_type != ST_AssemblerInstr) {
+                continue;
+            }
+            if (!st.m_label.empty()) {
+                int index = symbols.Find(st.m_label);
+                if (index >= 0) {
+                    symbols.m_multiply[index] = true;
+                }
+                else {
+                    if (symbols.m_count == MAX_SYMBOLS) {
+                        Error("Program has too many labels for the compile time assembler");
+                    }
+                    symbols.m_names[symbols.m_count] = st.m_label;
+                    symbols.m_locs[symbols.m_count] = loc;
+                    symbols.m_count++;
+                }
+            }
+            loc = NextLocation(st, loc);
+        }
+
+        // Pass II - validate and translate.
+        pos = 0;
+        loc = 0;
+        size_t extent = 0;
+        bool ended = false;
+        while (pos <= a_source.length()) {
+            Statement st = Parse(NextLine(a_source, pos));
+            if (st.m_type == ST_Comment) {
+                continue;
+            }
+
+            if (!st.m_label.empty() && !OpCodes::IsValidSymbol(st.m_label)) {
+                Error("Program has illegal label");
+            }
+            int index = st.m_label.empty() ? -1 : symbols.Find(st.m_label);
+            if (!st.m_label.empty() && index < 0) {
+                Error("Program does not contain the Label in the symbol table");
+            }
+            if (index >= 0 && symbols.m_multiply[index]) {
+                Error("Program has multiply defined labels");
+            }
+            if (OpCodes::EqualNoCase(st.m_opcode, "include")) {
+                Error("The compile time assembler cannot INCLUDE files");
+            }
+            if (OpCodes::EqualNoCase(st.m_opcode, "extern") || OpCodes::EqualNoCase(st.m_opcode, "entry")) {
+                Error("The compile time assembler cannot assemble modules to be linked");
+            }
+            if (OpCodes::EqualNoCase(st.m_opcode, "macro") || OpCodes::EqualNoCase(st.m_opcode, "endm")) {
+                Error("The compile time assembler cannot expand macros");
+            }
+            if (!OpCodes::IsAssembly(st.m_opcode) && OpCodes::LookupMachine(st.m_opcode) == 0) {
+                Error("Program uses an illegal OpCode");
+            }
+            if (!st.m_operand.empty()) {
+                if (OpCodes::IsAssembly(st.m_opcode)) {
+                    if (!OpCodes::IsNumber(st.m_operand) || !OpCodes::IsValidConstant(OpCodes::ToNumber(st.m_operand))) {
+                        Error("Program has illegal Operand");
+                    }
+                }
+                else if (OpCodes::ModeOf(st.m_operand) != OpCodes::OM_Memory) {
+                    if (!OpCodes::IsValidOperandForm(OpCodes::LookupMachine(st.m_opcode), st.m_operand)) {
+                        Error("Program has illegal Operand");
+                    }
+                }
+                else if (OpCodes::IsNumber(st.m_operand) || !OpCodes::IsValidSymbol(st.m_operand)) {
+                    Error("Program has illegal Operand");
+                }
+            }
+            if (OpCodes::IsMissingOrExtraOperand(st.m_opcode, !st.m_operand.empty(), st.m_extraOperand)) {
+                Error("Program has Extra or Missing Operand");
+            }
+
+            if (st.m_type == ST_End) {
+                ended = true;
+                break;
+            }
+
+            int opcode = OpCodes::LookupMachine(st.m_opcode);
+            if (st.m_type == ST_MachineLanguage) {
+                if (!OpCodes::IsNumber(st.m_register) || !OpCodes::IsValidRegister(OpCodes::ToNumber(st.m_register))) {
+                    Error("Program has illegal Register");
+                }
+                int address = 0;
+                if (OpCodes::ModeOf(st.m_operand) != OpCodes::OM_Memory) {
+                    opcode = OpCodes::OperandForm(opcode, OpCodes::ModeOf(st.m_operand));
+                    address = OpCodes::OperandValue(st.m_operand);
+                }
+                else if (!st.m_operand.empty()) {
+                    int target = symbols.Find(st.m_operand);
+                    if (target < 0) {
+                        Error("Program uses an undefined label");
+                    }
+                    address = symbols.m_locs[target];
+                }
+                if (loc < 0 || loc >= emulator::MEMSZ) {
+                    Error("Insufficient memory for translation");
+                }
+                if (a_words != nullptr && (size_t)loc < a_size) {
+                    a_words[loc] = emulator::Encoding::Encode(opcode, OpCodes::ToNumber(st.m_register), address);
+                }
+                extent = (size_t)loc + 1 > extent ? (size_t)loc + 1 : extent;
+            }
+            else if (OpCodes::EqualNoCase(st.m_opcode, "dc")) {
+                if (loc < 0 || loc >= emulator::MEMSZ) {
+                    Error("Insufficient memory for translation");
+                }
+                if (a_words != nullptr && (size_t)loc < a_size) {
+                    a_words[loc] = OpCodes::ToNumber(st.m_operand);
+                }
+                extent = (size_t)loc + 1 > extent ? (size_t)loc + 1 : extent;
+            }
+
+            loc = NextLocation(st, loc);
+            if (loc > emulator::MEMSZ) {
+                Error("Program location out-of-bound");
+            }
+        }
+
+        if (!ended) {
+            Error("Program is missing an END statement");
+        }
+        while (pos <= a_source.length()) {
+            if (Parse(NextLine(a_source, pos)).m_type != ST_Comment) {
+                Error("Program instructions does not stop after END statement");
+            }
+        }
+        return extent;
+    }
+};
+
+// Translates a constant expression holding Quack3200 source into a std::array image.
+#define QUACK_ASSEMBLE(source) ConstAssembler::Assemble<ConstAssembler::ImageSize(source)>(source)
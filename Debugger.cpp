@@ -0,0 +1,510 @@
+//
+//		Implementation of the Debugger class.
+//
+#include "stdafx.h"
+#include "Debugger.h"
+
+/*
+NAME
+
+    Debugger::Debugger - prepares to debug a program
+
+SYNOPSIS
+
+    Debugger::Debugger(emulator& a_emul, const map<string, int>& a_symbols, const SourceMap& a_lines, long long a_interval);
+    a_emul -> the machine holding the program
+    a_symbols -> the labels of the program
+    a_lines -> the statement translated at each location
+    a_interval -> the instructions between snapshots
+
+DESCRIPTION
+
+    The state of the machine when the debugger starts is the first
+    snapshot, so the program can be taken back to its beginning.
+
+*/
+Debugger::Debugger(emulator& a_emul, const map<string, int>& a_symbols, const SourceMap& a_lines, long long a_interval) :
+    m_emul(a_emul), m_symbols(a_symbols), m_lines(a_lines), m_interval(a_interval > 0 ? a_interval : 1),
+    m_recorded(emulator::MEMSZ, 0), m_breakpoints(emulator::MEMSZ, 0), m_watchpoints(emulator::MEMSZ, 0)
+{
+    TakeSnapshot();
+}
+
+/*
+NAME
+
+    Debugger::Run - carries out the user's commands
+
+SYNOPSIS
+
+    emulator::RunResult Debugger::Run();
+
+DESCRIPTION
+
+    This function reads commands from cin until the user quits or the
+    input ends.  READ instructions of the program also read from cin
+    unless an input file was given.
+
+RETURNS
+
+    How the program last stopped
+
+*/
+emulator::RunResult Debugger::Run()
+{
+    cout << "Quack3200 debugger.  Type help for the commands." << endl;
+    DisplayPosition();
+
+    string line;
+    while (true) {
+        cout << "(qdb) ";
+        if (!getline(cin, line) || !Command(line)) {
+            break;
+        }
+    }
+    return m_result;
+}
+
+/*
+NAME
+
+    Debugger::Command - carries out one command
+
+SYNOPSIS
+
+    bool Debugger::Command(const string& a_line);
+    a_line -> the command as the user typed it
+
+RETURNS
+
+    false if the user quit
+
+*/
+bool Debugger::Command(const string& a_line)
+{
+    istringstream in(a_line);
+    string command;
+    if (!(in >> command)) {
+        return true;
+    }
+    string argument;
+    in >> argument;
+    long long count = argument.empty() ? 1 : atoll(argument.c_str());
+
+    if (command == "s" || command == "step" || command == "c" || command == "continue") {
+        if (m_result != emulator::RR_Budget) {
+            cout << "The program has stopped; use rstep or rcontinue to go back." << endl;
+            return true;
+        }
+        m_reason.clear();
+        if (command == "s" || command == "step") {
+            RunForward(count, false);
+        }
+        else {
+            RunForward(-1, m_breakCount > 0);
+        }
+        DisplayPosition();
+    }
+    else if (command == "rs" || command == "rstep") {
+        m_reason.clear();
+        GoTo(m_emul.GetSteps() - count);
+        DisplayPosition();
+    }
+    else if (command == "rc" || command == "rcontinue") {
+        ReverseContinue();
+        DisplayPosition();
+    }
+    else if (command == "b" || command == "break" || command == "w" || command == "watch") {
+        int loc = ParseLocation(argument);
+        if (loc < 0) {
+            cout << "Give a label or a location." << endl;
+            return true;
+        }
+        vector<char>& points = command[0] == 'b' ? m_breakpoints : m_watchpoints;
+        if (!points[loc]) {
+            points[loc] = 1;
+            m_breakCount++;
+        }
+        cout << (command[0] == 'b' ? "Breakpoint at location " : "Watching location ") << loc << endl;
+    }
+    else if (command == "d" || command == "delete") {
+        int loc = ParseLocation(argument);
+        if (loc < 0) {
+            cout << "Give a label or a location." << endl;
+            return true;
+        }
+        m_breakCount -= m_breakpoints[loc] + m_watchpoints[loc];
+        m_breakpoints[loc] = 0;
+        m_watchpoints[loc] = 0;
+    }
+    else if (command == "r" || command == "regs") {
+        for (int i = 0; i < emulator::REGCOUNT; i++) {
+            cout << "R" << i << " = " << m_emul.GetRegisters()[i] << (i % 5 == 4 ? "\n" : "    ");
+        }
+    }
+    else if (command == "m" || command == "mem") {
+        int loc = ParseLocation(argument);
+        long long words = 1;
+        in >> words;
+        for (int i = loc; loc >= 0 && i < emulator::MEMSZ && i < loc + words; i++) {
+            cout << setw(6) << i << "  " << m_emul.GetMemory()[i] << endl;
+        }
+    }
+    else if (command == "q" || command == "quit") {
+        return false;
+    }
+    else {
+        cout << "step [n]         run n instructions" << endl
+            << "continue         run to a breakpoint, a watched change or the end" << endl
+            << "rstep [n]        go back n instructions" << endl
+            << "rcontinue        go back to the last breakpoint or watched change" << endl
+            << "break <loc>      stop before the instruction at a label or location" << endl
+            << "watch <loc>      stop after the word at a label or location changes" << endl
+            << "delete <loc>     remove the breakpoint or watch at a label or location" << endl
+            << "regs             display the registers" << endl
+            << "mem <loc> [n]    display n words of memory" << endl
+            << "quit             leave the debugger" << endl;
+    }
+    return true;
+}
+
+/*
+NAME
+
+    Debugger::RunForward - runs the program forward
+
+SYNOPSIS
+
+    void Debugger::RunForward(long long a_count, bool a_check);
+    a_count -> the most instructions to run; negative for no limit
+    a_check -> == true to stop at breakpoints and watched changes
+
+DESCRIPTION
+
+    This function runs the program a snapshot interval at a time,
+    taking a snapshot at the end of each.  Without a_check the hooks
+    only record changes to memory, so the emulator does nothing extra
+    before each instruction.  While scanning, hits are collected rather
+    than stopped at.
+
+*/
+void Debugger::RunForward(long long a_count, bool a_check)
+{
+    long long target = a_count < 0 ? LLONG_MAX : m_emul.GetSteps() + a_count;
+    m_resumeSteps = m_scanning ? -1 : m_emul.GetSteps();
+    m_stopped = false;
+
+    while (m_emul.GetSteps() < target) {
+        long long next = m_snapshots.back().m_steps + m_interval;
+        if (m_emul.GetSteps() >= next) {
+            TakeSnapshot();
+            continue;
+        }
+
+        emulator::RunResult result;
+        if (a_check) {
+            Checker hooks(*this);
+            result = m_emul.Execute(min(target, next) - m_emul.GetSteps(), hooks);
+        }
+        else {
+            Recorder hooks(*this);
+            result = m_emul.Execute(min(target, next) - m_emul.GetSteps(), hooks);
+        }
+        m_result = result;
+
+        // A watched change made by the last instruction of a run.
+        if (m_watchHit) {
+            m_watchHit = false;
+            if (m_scanning) {
+                m_hits.push_back(m_emul.GetSteps());
+            }
+            else {
+                m_stopped = true;
+            }
+        }
+        if (m_stopped || result != emulator::RR_Budget) {
+            return;
+        }
+    }
+}
+
+/*
+NAME
+
+    Debugger::GoTo - returns the program to an earlier point
+
+SYNOPSIS
+
+    void Debugger::GoTo(long long a_steps);
+    a_steps -> the number of instructions executed at that point
+
+DESCRIPTION
+
+    This function undoes the changes to memory recorded since the
+    nearest snapshot at or before the point, restores that snapshot,
+    and runs forward to the point with the program's output discarded.
+
+*/
+void Debugger::GoTo(long long a_steps)
+{
+    a_steps = max(a_steps, 0LL);
+    size_t nearest = 0;
+    while (nearest + 1 < m_snapshots.size() && m_snapshots[nearest + 1].m_steps <= a_steps) {
+        nearest++;
+    }
+
+    Word* memory = m_emul.GetMemory();
+    for (size_t i = m_snapshots.size(); i-- > nearest;) {
+        for (const auto& word : m_snapshots[i].m_undo) {
+            memory[word.first] = word.second;
+        }
+    }
+    m_snapshots.resize(nearest + 1);
+
+    Snapshot& snapshot = m_snapshots.back();
+    snapshot.m_undo.clear();
+    snapshot.m_generation = ++m_generation;
+    m_emul.RestoreState(snapshot.m_pc, snapshot.m_reg, snapshot.m_steps, snapshot.m_inputPos);
+    m_result = emulator::RR_Budget;
+
+    m_emul.SetOutput(&m_discard);
+    bool scanning = m_scanning;
+    m_scanning = false;
+    RunForward(a_steps - snapshot.m_steps, false);
+    m_scanning = scanning;
+    m_emul.SetOutput(&cout);
+    m_discard.str("");
+}
+
+/*
+NAME
+
+    Debugger::ReverseContinue - goes back to the last breakpoint or watched change
+
+SYNOPSIS
+
+    void Debugger::ReverseContinue();
+
+DESCRIPTION
+
+    This function searches back a snapshot interval at a time.  Each
+    interval is run again from its snapshot to collect the points where
+    a breakpoint or watched change would have stopped the program; the
+    last of them before the current point is where the program is taken.
+    If there is none, the program is taken back to its beginning.
+
+*/
+void Debugger::ReverseContinue()
+{
+    long long current = m_emul.GetSteps();
+    long long end = current;
+
+    for (size_t i = m_snapshots.size(); i-- > 0 && m_breakCount > 0;) {
+        long long start = m_snapshots[i].m_steps;
+        GoTo(start);
+
+        m_emul.SetOutput(&m_discard);
+        m_scanning = true;
+        m_hits.clear();
+        RunForward(end - start, true);
+        m_scanning = false;
+        m_emul.SetOutput(&cout);
+        m_discard.str("");
+
+        long long target = -1;
+        for (long long hit : m_hits) {
+            if (hit < current) {
+                target = max(target, hit);
+            }
+        }
+        if (target >= 0) {
+            GoTo(target);
+            m_reason = "Went back to the last breakpoint or watched change";
+            return;
+        }
+        end = start;
+    }
+    GoTo(0);
+    m_reason = "Went back to the beginning of the program";
+}
+
+/*
+NAME
+
+    Debugger::TakeSnapshot - records the state of the machine
+
+SYNOPSIS
+
+    void Debugger::TakeSnapshot();
+
+DESCRIPTION
+
+    Memory is not copied; the words changed after the snapshot are
+    recorded with their old values as the program runs.
+
+*/
+void Debugger::TakeSnapshot()
+{
+    Snapshot snapshot;
+    snapshot.m_steps = m_emul.GetSteps();
+    snapshot.m_pc = m_emul.GetPC();
+    memcpy(snapshot.m_reg, m_emul.GetRegisters(), sizeof(snapshot.m_reg));
+    snapshot.m_inputPos = m_emul.GetInputPosition();
+    snapshot.m_generation = ++m_generation;
+    m_snapshots.push_back(move(snapshot));
+    if (m_snapshots.size() > MAX_SNAPSHOTS) {
+        ThinSnapshots();
+    }
+}
+
+/*
+NAME
+
+    Debugger::ThinSnapshots - bounds the number of snapshots
+
+SYNOPSIS
+
+    void Debugger::ThinSnapshots();
+
+DESCRIPTION
+
+    Every second snapshot of the older half is dropped.  The words it
+    recorded that the snapshot before it did not are added to that
+    snapshot, whose undo log then reaches to the next snapshot kept.
+    Each thinning halves the older snapshots again, so their spacing
+    grows geometrically with age while the recent ones stay one
+    interval apart.  The first snapshot and the newest are always kept.
+
+*/
+void Debugger::ThinSnapshots()
+{
+    size_t older = m_snapshots.size() / 2;
+    vector<char> recorded(emulator::MEMSZ, 0);
+    vector<Snapshot> kept;
+    kept.reserve(m_snapshots.size() - older / 2);
+    for (size_t i = 0; i < m_snapshots.size(); i++) {
+        if (i >= older || i % 2 == 0) {
+            kept.push_back(move(m_snapshots[i]));
+            continue;
+        }
+        vector<pair<int, Word>>& undo = kept.back().m_undo;
+        for (const auto& word : undo) {
+            recorded[word.first] = 1;
+        }
+        for (const auto& word : m_snapshots[i].m_undo) {
+            if (!recorded[word.first]) {
+                undo.push_back(word);
+            }
+        }
+        for (const auto& word : undo) {
+            recorded[word.first] = 0;
+        }
+    }
+    m_snapshots = move(kept);
+}
+
+// Records the old value of a word the first time it changes after a snapshot.
+void Debugger::Record(int a_address, Word a_old)
+{
+    if (m_recorded[a_address] != m_generation) {
+        m_recorded[a_address] = m_generation;
+        m_snapshots.back().m_undo.push_back({ a_address, a_old });
+    }
+}
+
+// Stops before an instruction with a breakpoint or after a watched change.
+bool Debugger::Check(int a_loc, long long a_steps)
+{
+    m_lastSteps = a_steps;
+    bool hit = false;
+    if (m_watchHit) {
+        m_watchHit = false;
+        hit = true;
+    }
+    if (m_breakpoints[a_loc] && a_steps != m_resumeSteps) {
+        if (!m_scanning) {
+            m_reason = "Breakpoint at location " + to_string(a_loc);
+        }
+        hit = true;
+    }
+    if (!hit) {
+        return false;
+    }
+    if (m_scanning) {
+        m_hits.push_back(a_steps);
+        return false;
+    }
+    m_stopped = true;
+    return true;
+}
+
+// Notes a change to a watched word, which stops the program after the instruction.
+void Debugger::Watch(int a_address, Word a_old, Word a_new)
+{
+    if (m_watchpoints[a_address] && a_old != a_new) {
+        m_watchHit = true;
+        if (!m_scanning) {
+            m_reason = "Location " + to_string(a_address) + " changed from " + to_string(a_old) + " to " + to_string(a_new);
+        }
+    }
+}
+
+/*
+NAME
+
+    Debugger::ParseLocation - converts a label or number to a location
+
+SYNOPSIS
+
+    int Debugger::ParseLocation(const string& a_text) const;
+    a_text -> a label of the program or a location
+
+RETURNS
+
+    The location, or -1 if a_text is not a label or a location in memory
+
+*/
+int Debugger::ParseLocation(const string& a_text) const
+{
+    auto symbol = m_symbols.find(a_text);
+    if (symbol != m_symbols.end()) {
+        return symbol->second >= 0 ? symbol->second : -1;
+    }
+    if (a_text.empty() || a_text.find_first_not_of("0123456789") != string::npos) {
+        return -1;
+    }
+    int loc = atoi(a_text.c_str());
+    return loc < emulator::MEMSZ ? loc : -1;
+}
+
+/*
+NAME
+
+    Debugger::DisplayPosition - shows where the program is
+
+SYNOPSIS
+
+    void Debugger::DisplayPosition() const;
+
+DESCRIPTION
+
+    This function displays why the program stopped, the number of
+    instructions executed, and the statement at the next location.
+
+*/
+void Debugger::DisplayPosition() const
+{
+    if (m_result != emulator::RR_Budget) {
+        m_emul.DisplayResult(m_result);
+    }
+    else if (!m_reason.empty()) {
+        cout << m_reason << endl;
+    }
+
+    cout << "Step " << m_emul.GetSteps() << ", location " << m_emul.GetPC();
+    auto line = m_lines.find(m_emul.GetPC());
+    if (line != m_lines.end()) {
+        cout << ", line " << line->second.m_number << ": " << line->second.m_text;
+    }
+    cout << endl;
+}
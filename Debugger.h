@@ -0,0 +1,118 @@
+//
+//		Interactive debugger for the emulator with breakpoints, watchpoints and
+//		reverse execution.  Snapshots of the registers are taken every so many
+//		instructions, and between snapshots only the first old value of each word
+//		changed by STORE, READ, FAA or CAS is recorded.  Going back restores the
+//		nearest snapshot before the target and runs forward to it, so a reverse
+//		step costs at most one snapshot interval of re-execution.  Once too many
+//		snapshots are kept, the older half is thinned out, so snapshots grow
+//		sparser further back and memory stays bounded however long the session.
+//
+#pragma once
+
+#include <sstream>
+#include "MemoryImage.h"
+
+class Debugger {
+
+public:
+
+    // Debugs the program in a_emul.  a_symbols and a_lines let commands name
+    // labels and show the statement at each location.
+    Debugger(emulator& a_emul, const map<string, int>& a_symbols, const SourceMap& a_lines, long long a_interval = 10000);
+    ~Debugger() {};
+
+    // Reads and carries out commands from cin until the user quits.
+    emulator::RunResult Run();
+
+private:
+
+    typedef emulator::Word Word;
+
+    // The state of the machine at a snapshot and the memory changed since.
+    struct Snapshot {
+        long long m_steps;                      // The instructions executed.
+        int m_pc;                               // The location of the next instruction.
+        Word m_reg[emulator::REGCOUNT];         // The registers.
+        size_t m_inputPos;                      // The input consumed.
+        unsigned m_generation;                  // Identifies the words recorded since the snapshot.
+        vector<pair<int, Word>> m_undo;         // The first old value of each word changed since.
+    };
+
+    // Hooks that only record changes to memory, used when nothing is being watched
+    // for, so that nothing is checked before each instruction.
+    struct Recorder : public EmulatorBase::NoHooks {
+        Debugger& m_debugger;
+        Recorder(Debugger& a_debugger) : m_debugger(a_debugger) {}
+        void BeforeStore(int a_address, Word a_old, Word) { m_debugger.Record(a_address, a_old); }
+    };
+
+    // Hooks that also check for breakpoints and watchpoints.
+    struct Checker : public EmulatorBase::NoHooks {
+        Debugger& m_debugger;
+        Checker(Debugger& a_debugger) : m_debugger(a_debugger) {}
+        bool BeforeInstruction(const emulator&, int a_loc, long long a_steps, EmulatorBase::RunResult&) {
+            return m_debugger.Check(a_loc, a_steps);
+        }
+        void BeforeStore(int a_address, Word a_old, Word a_new) {
+            m_debugger.Record(a_address, a_old);
+            m_debugger.Watch(a_address, a_old, a_new);
+        }
+    };
+
+    // Runs forward at most a_count instructions, taking snapshots on the way.  If
+    // a_check, stops at breakpoints and watched changes.
+    void RunForward(long long a_count, bool a_check);
+
+    // Returns the machine to the state after a_steps instructions.
+    void GoTo(long long a_steps);
+
+    // Goes back to the most recent breakpoint or watched change.
+    void ReverseContinue();
+
+    // Called by the hooks.
+    void Record(int a_address, Word a_old);
+    bool Check(int a_loc, long long a_steps);
+    void Watch(int a_address, Word a_old, Word a_new);
+
+    // Starts a new snapshot of the current state.
+    void TakeSnapshot();
+
+    // Drops every second snapshot of the older half, folding its changes into the
+    // snapshot before it.
+    void ThinSnapshots();
+
+    // Carries out one command.  Returns false when the user quits.
+    bool Command(const string& a_line);
+
+    // Converts a label or number to a location.  Returns -1 if it is neither.
+    int ParseLocation(const string& a_text) const;
+
+    // Displays where the program is and why it stopped.
+    void DisplayPosition() const;
+
+    static const size_t MAX_SNAPSHOTS = 256;    // The most snapshots kept before they are thinned out.
+
+    emulator& m_emul;                       // The machine being debugged.
+    const map<string, int>& m_symbols;      // The labels of the program.
+    const SourceMap& m_lines;               // The statement at each location.
+    long long m_interval;                   // Instructions between snapshots.
+
+    vector<Snapshot> m_snapshots;           // Snapshots, oldest first.
+    vector<unsigned> m_recorded;            // The generation in which each word was last recorded.
+    unsigned m_generation = 0;              // The generation of the newest snapshot.
+
+    vector<char> m_breakpoints;             // == 1 for each location with a breakpoint.
+    vector<char> m_watchpoints;             // == 1 for each watched word.
+    int m_breakCount = 0;                   // The number of breakpoints and watchpoints.
+
+    long long m_resumeSteps = -1;           // A breakpoint is not reported at the step the run resumed from.
+    bool m_scanning = false;                // == true to collect hits instead of stopping at them.
+    vector<long long> m_hits;               // The steps at which hits were found while scanning.
+    bool m_watchHit = false;                // == true if the last instruction changed a watched word.
+    bool m_stopped = false;                 // == true if a hook stopped the run.
+    long long m_lastSteps = 0;              // The step count of the instruction being executed.
+    string m_reason;                        // Why the program last stopped.
+    emulator::RunResult m_result = emulator::RR_Budget; // How the program last stopped.
+    ostringstream m_discard;                // Receives output while instructions are run again.
+};
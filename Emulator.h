@@ -1,18 +1,191 @@
 #pragma once
 
-class emulator {
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "LoopAccelerator.h"
+using namespace std;
+
+#include <atomic>
+#ifndef _WIN32
+#include <csetjmp>
+#include <csignal>
+#endif
+
+// AArch64 does not trap on integer division: a division by zero gives 0 and an
+// overflow gives the dividend.  On such a host no trap can catch a faulting DIV, so
+// the emulators test the operands of each DIV explicitly instead.
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define DIVIDE_DOES_NOT_TRAP
+#endif
+
+// The packing of an instruction into a word, defined once for the assembler, the
+// emulator and the tools that read translations.  The op code, register and
+// address are the digits of (opcode * a_RegCount + register) * a_AddrRadix + address,
+// so for the standard machine 01455555 is ADD 4,55555.
+template<int a_AddrRadix, int a_RegCount, typename Word>
+class InstructionEncoding {
+
+public:
+
+	static constexpr Word Encode(int a_opcode, int a_register, int a_address) {
+		return ((Word)a_opcode * a_RegCount + a_register) * a_AddrRadix + a_address;
+	}
+
+	static constexpr int OpCode(Word a_word) { return (int)(a_word / ((Word)a_AddrRadix * a_RegCount)); }
+	static constexpr int Register(Word a_word) { return (int)(a_word / a_AddrRadix % a_RegCount); }
+	static constexpr int Address(Word a_word) { return (int)(a_word % a_AddrRadix); }
+};
+
+// The parts of the emulator that do not depend on the configuration of the machine.
+class EmulatorBase {
 
 public:
 
-	const static int MEMSZ = 100000;	// The size of the memory of the Quack3200.
-	emulator() {
+	const static int ORIGIN = 100;		// The location of the first instruction executed.
 
-		memset(m_memory, 0, MEMSZ * sizeof(int));
-		memset(m_reg, 0, 10 * sizeof(int));
+	// Reasons an emulation stops.
+	enum RunResult {
+		RR_Halted,			// A HALT instruction was executed.
+		RR_Budget,			// The instruction budget ran out.
+		RR_EndOfInput,		// A READ instruction found no more input.
+		RR_IllegalOpcode,	// An instruction had an illegal opcode.
+		RR_WaitingForInput,	// A READ instruction found no value yet; more may be added.
+		RR_InfiniteLoop,	// The program returned to an earlier state, so it can never halt.
+		RR_Fault			// A DIV divided by zero or overflowed.
+	};
+
+	// Determines if a guest DIV of a_left by a_right faults, for hosts whose divide
+	// does not trap: a division by zero, or the most negative word by -1.
+	template<typename Word>
+	static bool DivideFaults(Word a_left, Word a_right) {
+		return a_right == 0 || (a_right == -1 && a_left == (numeric_limits<Word>::min)());
+	}
+
+#ifdef _WIN32
+	// Decides, as the filter of an __except, if a structured exception is a guest DIV
+	// that faulted.  Windows raises one for the host's divide trap, as POSIX raises
+	// SIGFPE; any other exception is the host's own and is passed on.
+	static int FaultFilter(unsigned long a_code) {
+		return a_code == EXCEPTION_INT_DIVIDE_BY_ZERO || a_code == EXCEPTION_INT_OVERFLOW
+			? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH;
+	}
+#else
+	// Turns the host's SIGFPE from a guest DIV into a stop of the emulation, so a
+	// faulting guest does not take the host down and the divide needs no test of its
+	// divisor.  Each call of Execute sets a trap, which the signal jumps back to.
+	// Traps are kept per thread, so guests on several threads fault independently,
+	// and a trap set within another restores it when it goes.
+	class FaultTrap {
+
+	public:
+
+		FaultTrap() : m_outer(t_active) {
+			static const bool installed = Install();
+			(void)installed;
+			t_active = this;
+		}
+		~FaultTrap() { t_active = m_outer; }
+
+		sigjmp_buf m_jump;		// Where the signal returns to.
+
+	private:
+
+		// Installs the handler, once for the process.  SA_NODEFER leaves the signal
+		// unblocked after the jump, so the mask need not be saved by each trap.
+		static bool Install() {
+			struct sigaction action;
+			memset(&action, 0, sizeof(action));
+			action.sa_handler = OnSignal;
+			action.sa_flags = SA_NODEFER;
+			sigemptyset(&action.sa_mask);
+			return sigaction(SIGFPE, &action, nullptr) == 0;
+		}
+
+		// Jumps to the trap of this thread.  A SIGFPE outside any emulation is the
+		// host's own, so it is given its default action when the instruction is retried.
+		static void OnSignal(int a_signal) {
+			if (t_active == nullptr) {
+				signal(a_signal, SIG_DFL);
+				return;
+			}
+			siglongjmp(t_active->m_jump, 1);
+		}
+
+		FaultTrap* m_outer;								// The trap this one was set within.
+		static inline thread_local FaultTrap* t_active = nullptr;	// The innermost trap of the thread.
+	};
+#endif
+
+	// Hooks that observe an emulation.  Execute calls a hooks object before every
+	// instruction and before every change to memory.  These do nothing and compile
+	// away, so an emulation with no hooks runs at full speed.
+	struct NoHooks {
+
+		// Called before the instruction at a_loc, after a_steps instructions.  Returns
+		// true to stop the emulation with a_result.
+		template<typename Machine>
+		bool BeforeInstruction(const Machine&, int, long long, RunResult&) { return false; }
+
+		// Called before the word at a_address changes from a_old to a_new.
+		template<typename Word>
+		void BeforeStore(int, Word, Word) {}
+	};
+
+	// Hooks that call a_First's hooks and then a_Second's.
+	template<typename First, typename Second>
+	class HookChain {
+
+	public:
+
+		HookChain(First& a_first, Second& a_second) : m_first(a_first), m_second(a_second) {}
+
+		template<typename Machine>
+		bool BeforeInstruction(const Machine& a_machine, int a_loc, long long a_steps, RunResult& a_result) {
+			return m_first.BeforeInstruction(a_machine, a_loc, a_steps, a_result)
+				|| m_second.BeforeInstruction(a_machine, a_loc, a_steps, a_result);
+		}
+
+		template<typename Word>
+		void BeforeStore(int a_address, Word a_old, Word a_new) {
+			m_first.BeforeStore(a_address, a_old, a_new);
+			m_second.BeforeStore(a_address, a_old, a_new);
+		}
+
+	private:
+
+		First& m_first;
+		Second& m_second;
+	};
+};
+
+// A Quack3200 with a_MemSize words of memory, a_RegCount registers and words of
+// type Word.  Addresses are encoded in a field of a_MemSize values, so every decoded
+// address is in memory.
+template<int a_MemSize, int a_RegCount, typename a_Word>
+class BasicEmulator : public EmulatorBase {
+
+public:
+
+	typedef a_Word Word;
+	typedef InstructionEncoding<a_MemSize, a_RegCount, Word> Encoding;
+
+	const static int MEMSZ = a_MemSize;		// The size of the memory of the Quack3200.
+	const static int REGCOUNT = a_RegCount;	// The number of registers of the Quack3200.
+
+	BasicEmulator() {
+
+		memset(m_memory, 0, MEMSZ * sizeof(Word));
+		memset(m_reg, 0, REGCOUNT * sizeof(Word));
 	}
 
 	// Records instructions and data into Quack3200 memory.
-	bool insertMemory(int a_location, int a_contents) {
+	bool insertMemory(int a_location, Word a_contents) {
 		if (a_location >= 0 && a_location < MEMSZ) {
 			m_memory[a_location] = a_contents;
 			return true;
@@ -23,74 +196,247 @@ public:
 		}
 	}
 
-	// Runs the Quack3200 program recorded in memory.
-	bool runProgram() {
-		int loc = 100;
+	// Copies a memory image, such as one made by the compile time assembler, into memory
+	// starting at location 0.
+	bool LoadImage(const Word* a_words, size_t a_count) {
+		if (a_count > (size_t)MEMSZ) {
+			return false;
+		}
+		memcpy(m_memory, a_words, a_count * sizeof(Word));
+		return true;
+	}
+
+	// Supplies the input of the program instead of prompting for it.  If a_moreToCome,
+	// a READ that finds no value stops with RR_WaitingForInput and is executed again
+	// when the emulation is resumed, so values can be added as they arrive.
+	template<typename Value>
+	void SetInput(const vector<Value>& a_input, bool a_moreToCome = false) {
+		m_input.assign(a_input.begin(), a_input.end());
+		m_inputPos = 0;
+		m_interactive = false;
+		m_inputOpen = a_moreToCome;
+	}
+
+	// Adds a value to the input, and marks the end of the input.
+	void AddInput(Word a_value) { m_input.push_back(a_value); }
+	void CloseInput() { m_inputOpen = false; }
 
+	// Determines if a READ could proceed now.
+	bool IsInputReady() const { return m_inputPos < m_input.size() || !m_inputOpen; }
+
+	// Turns on or off the skipping of the iterations of simple counting loops, which
+	// leaves the machine in the state that executing them would.
+	void SetFastForward(bool a_on) {
+		m_accelerator.reset(a_on ? new LoopAccelerator<Word, Encoding, REGCOUNT>() : nullptr);
+	}
+
+	// Redirects the output of WRITE instructions and prompts.
+	void SetOutput(ostream* a_out) { m_out = a_out; }
+
+	// Runs the Quack3200 program recorded in memory, for at most a_budget instructions
+	// if a_budget is not negative.
+	RunResult runProgram(long long a_budget = -1) {
+		NoHooks hooks;
+		return runProgram(a_budget, hooks);
+	}
+
+	template<typename Hooks>
+	RunResult runProgram(long long a_budget, Hooks& a_hooks) {
+		DisplayHeader();
+		RunResult result = Execute(a_budget, a_hooks);
+		DisplayResult(result);
+		return result;
+	}
+
+	// Announces the results of the emulation.
+	void DisplayHeader() const {
 		cout << "Results from emulating program :" << endl << endl;
-		while (true) {
-			int contents = m_memory[loc];  // 01455555
-			int opcode = contents / 1000000;
-			int reg = contents / 100000 % 10; // 14
-			int address = contents % 100000;
+	}
+
+	// Reports why the emulation stopped.
+	void DisplayResult(RunResult a_result) const {
+		switch (a_result) {
+		case RR_Halted:
+			cout << endl << "End of emulation" << endl;
+			break;
+		case RR_Budget:
+			cout << endl << "Emulation stopped after " << m_steps << " instructions" << endl;
+			break;
+		case RR_EndOfInput:
+			cout << endl << "Emulation stopped at location " << m_pc << ": no more input" << endl;
+			break;
+		case RR_IllegalOpcode:
+			cerr << "Illegal opcode" << endl;
+			break;
+		case RR_WaitingForInput:
+			cout << endl << "Emulation waiting at location " << m_pc << " for more input" << endl;
+			break;
+		case RR_InfiniteLoop:
+			cout << endl << "Emulation stopped at location " << m_pc << ": the program is in an infinite loop" << endl;
+			break;
+		case RR_Fault:
+			cout << endl << "Emulation stopped at location " << m_pc << ": division by zero or overflow" << endl;
+			cout << "Registers:";
+			for (int i = 0; i < REGCOUNT; i++) {
+				cout << " " << m_reg[i];
+			}
+			cout << endl;
+			break;
+		}
+	}
+
+	// Executes instructions from the current location until the program stops or
+	// a_maxSteps more instructions have been executed, if a_maxSteps is not negative.
+	// The emulation can be resumed by calling Execute again; a scheduler uses this to
+	// run a program a quantum of instructions at a time.
+	RunResult Execute(long long a_maxSteps) {
+		NoHooks hooks;
+		return Execute(a_maxSteps, hooks);
+	}
+
+	// A DIV that faults stops the emulation with RR_Fault at the DIV, with the registers
+	// as they were before it.  The host's divide trap is caught as SIGFPE, or as a
+	// structured exception on Windows; where the divide does not trap, the DIV tests
+	// its operands instead.
+	template<typename Hooks>
+	RunResult Execute(long long a_maxSteps, Hooks& a_hooks) {
+#ifdef _WIN32
+		__try {
+			return Interpret(a_maxSteps, a_hooks);
+		}
+		__except (FaultFilter(GetExceptionCode())) {
+			return RR_Fault;
+		}
+#else
+		FaultTrap trap;
+		if (sigsetjmp(trap.m_jump, 0) != 0) {
+			return RR_Fault;
+		}
+		return Interpret(a_maxSteps, a_hooks);
+#endif
+	}
+
+	// Replaces the state of the machine with one saved earlier.  The count of WRITEs
+	// is replaced too if a_writes is not negative.
+	void RestoreState(int a_pc, const Word* a_reg, long long a_steps, size_t a_inputPos, long long a_writes = -1) {
+		m_pc = a_pc;
+		memcpy(m_reg, a_reg, REGCOUNT * sizeof(Word));
+		m_steps = a_steps;
+		m_inputPos = a_inputPos;
+		if (a_writes >= 0) {
+			m_writes = a_writes;
+		}
+	}
+
+	// The number of words of a block of a_count words at a_start that are in memory.
+	// A block that starts outside memory or has no words is empty.
+	static int BlockLength(Word a_start, Word a_count) {
+		if (a_start < 0 || a_start >= MEMSZ || a_count <= 0) {
+			return 0;
+		}
+		return (int)min<Word>(a_count, MEMSZ - a_start);
+	}
+
+	// Getter Functions
+	const Word* GetMemory() const { return m_memory; }
+	Word* GetMemory() { return m_memory; }
+	const Word* GetRegisters() const { return m_reg; }
+	int GetPC() const { return m_pc; }
+	long long GetSteps() const { return m_steps; }
+	long long GetWrites() const { return m_writes; }
+	long long GetSkippedIterations() const { return m_accelerator ? m_accelerator->GetSkipped() : 0; }
+	size_t GetInputPosition() const { return m_inputPos; }
+	const vector<Word>& GetInput() const { return m_input; }
+
+private:
+
+	// Executes instructions, as Execute does, without setting a trap.
+	template<typename Hooks>
+	RunResult Interpret(long long a_maxSteps, Hooks& a_hooks) {
+		int loc = m_pc;
+		long long steps = m_steps;
+		long long limit = a_maxSteps < 0 ? LLONG_MAX : steps + a_maxSteps;
+		RunResult result = RR_Budget;
+
+		while (steps < limit) {
+			if (a_hooks.BeforeInstruction(*this, loc, steps, result)) {
+				goto stopped;
+			}
+			Word contents = m_memory[loc];
+			int opcode = Encoding::OpCode(contents);
+			int reg = Encoding::Register(contents);
+			int address = Encoding::Address(contents);
 
 			switch (opcode) {
 			// ADD instruction
 			case 1:
 				m_reg[reg] += m_memory[address];
 				loc += 1;
-				continue;
+				break;
 			// SUB instruction
 			case 2:
 				m_reg[reg] -= m_memory[address];
 				loc += 1;
-				continue;
+				break;
 			// MULT instruction
 			case 3:
 				m_reg[reg] *= m_memory[address];
 				loc += 1;
-				continue;
+				break;
 			// DIV instruction
 			case 4:
+				PublishLocation(loc, steps);
+#ifdef DIVIDE_DOES_NOT_TRAP
+				if (DivideFaults(m_reg[reg], m_memory[address])) {
+					result = RR_Fault;
+					goto stopped;
+				}
+#endif
 				m_reg[reg] /= m_memory[address];
 				loc += 1;
-				continue;
+				break;
 			// LOAD instruction
 			case 5:
 				m_reg[reg] = m_memory[address];
 				loc += 1;
-				continue;
+				break;
 			// STORE instruction
 			case 6:
+				a_hooks.BeforeStore(address, m_memory[address], m_reg[reg]);
 				m_memory[address] = m_reg[reg];
 				loc += 1;
-				continue;
+				break;
 			// READ instruction
 			case 7:
-				int input;
-				cout << "? ";
-				cin >> input;
+				Word input;
+				if (!ReadInput(input)) {
+					result = m_inputOpen ? RR_WaitingForInput : RR_EndOfInput;
+					goto stopped;
+				}
+				a_hooks.BeforeStore(address, m_memory[address], input);
 				m_memory[address] = input;
 				loc += 1;
-				continue;
+				break;
 			// WRITE instruction
 			case 8:
-				cout << m_memory[address] << endl;
+				*m_out << m_memory[address] << endl;
+				m_writes++;
 				loc += 1;
-				continue;
+				break;
 			// Branch instruction
 			case 9:
 				loc = address;
-				continue;
+				break;
 			// Branch Minus instruction
 			case 10:
 				if (m_reg[reg] < 0) {
+					steps += FastForward<Hooks>(address, loc, limit - steps - 1);
 					loc = address;
 				}
 				else {
 					loc += 1;
 				}
-				continue;
+				break;
 			// Branch Zero instruction
 			case 11:
 				if (m_reg[reg] == 0) {
@@ -99,29 +445,220 @@ public:
 				else {
 					loc += 1;
 				}
-				continue;
+				break;
 			// Branch Positive instruction
 			case 12:
 				if (m_reg[reg] > 0) {
+					steps += FastForward<Hooks>(address, loc, limit - steps - 1);
 					loc = address;
 				}
 				else {
 					loc += 1;
 				}
-				continue;
+				break;
 			// HALT instruction
 			case 13:
-				cout << endl << "End of emulation" << endl;
-				exit(0);
+				steps++;
+				result = RR_Halted;
+				goto stopped;
+			// Fetch and Add instruction
+			case 14: {
+				Word old = m_memory[address];
+				a_hooks.BeforeStore(address, old, old + m_reg[reg]);
+				m_memory[address] = old + m_reg[reg];
+				m_reg[reg] = old;
+				loc += 1;
+				break;
+			}
+			// Compare and Swap instruction
+			case 15: {
+				Word old = m_memory[address];
+				if (old == m_reg[0]) {
+					a_hooks.BeforeStore(address, old, m_reg[reg]);
+					m_memory[address] = m_reg[reg];
+				}
+				m_reg[0] = old;
+				loc += 1;
+				break;
+			}
+			// Core instruction.  A single Quack3200 is core 0.
+			case 16:
+				m_reg[reg] = m_memory[address];
+				loc += 1;
+				break;
+			// Block Copy instruction.  The words are moved as if through a buffer,
+			// so the source and destination may overlap.
+			case 17: {
+				int count = BlockLength(m_reg[reg], m_reg[0]);
+				count = min(count, BlockLength(address, m_reg[0]));
+				for (int i = 0; i < count; i++) {
+					a_hooks.BeforeStore(address + i, m_memory[address + i], m_memory[m_reg[reg] + i]);
+				}
+				memmove(m_memory + address, m_memory + m_reg[reg], count * sizeof(Word));
+				loc += 1;
+				break;
+			}
+			// Block Fill instruction
+			case 18: {
+				int count = BlockLength(address, m_reg[0]);
+				for (int i = 0; i < count; i++) {
+					a_hooks.BeforeStore(address + i, m_memory[address + i], m_reg[reg]);
+				}
+				fill(m_memory + address, m_memory + address + count, m_reg[reg]);
+				loc += 1;
+				break;
+			}
+			// Block Sum instruction
+			case 19: {
+				Word sum = 0;
+				const Word* block = m_memory + address;
+				for (int i = 0, count = BlockLength(address, m_reg[0]); i < count; i++) {
+					sum += block[i];
+				}
+				m_reg[reg] = sum;
+				loc += 1;
+				break;
+			}
+			// The immediate forms take the value in the address field.
+			// ADD Immediate instruction
+			case 20:
+				m_reg[reg] += address;
+				loc += 1;
+				break;
+			// SUB Immediate instruction
+			case 21:
+				m_reg[reg] -= address;
+				loc += 1;
+				break;
+			// MULT Immediate instruction
+			case 22:
+				m_reg[reg] *= address;
+				loc += 1;
+				break;
+			// DIV Immediate instruction
+			case 23:
+				PublishLocation(loc, steps);
+#ifdef DIVIDE_DOES_NOT_TRAP
+				if (DivideFaults(m_reg[reg], (Word)address)) {
+					result = RR_Fault;
+					goto stopped;
+				}
+#endif
+				m_reg[reg] /= address;
+				loc += 1;
+				break;
+			// LOAD Immediate instruction
+			case 24:
+				m_reg[reg] = address;
+				loc += 1;
+				break;
+			// The register forms take the register numbered in the address field.
+			// ADD Register instruction
+			case 25:
+				m_reg[reg] += m_reg[address % REGCOUNT];
+				loc += 1;
+				break;
+			// SUB Register instruction
+			case 26:
+				m_reg[reg] -= m_reg[address % REGCOUNT];
+				loc += 1;
+				break;
+			// MULT Register instruction
+			case 27:
+				m_reg[reg] *= m_reg[address % REGCOUNT];
+				loc += 1;
+				break;
+			// DIV Register instruction
+			case 28:
+				PublishLocation(loc, steps);
+#ifdef DIVIDE_DOES_NOT_TRAP
+				if (DivideFaults(m_reg[reg], m_reg[address % REGCOUNT])) {
+					result = RR_Fault;
+					goto stopped;
+				}
+#endif
+				m_reg[reg] /= m_reg[address % REGCOUNT];
+				loc += 1;
+				break;
+			// LOAD Register instruction
+			case 29:
+				m_reg[reg] = m_reg[address % REGCOUNT];
+				loc += 1;
+				break;
 			default:
-				cerr << "Illegal opcode" << endl;
-				exit(1);
+				result = RR_IllegalOpcode;
+				goto stopped;
 			}
+			steps++;
 		}
+
+	stopped:
+		m_pc = loc;
+		m_steps = steps;
+		return result;
 	}
 
-private:
+	// Skips iterations of the loop that the branch at a_branch has just gone back to
+	// a_start, if fast forwarding is on.  Hooks watch every instruction, so no
+	// iterations are skipped in an emulation with hooks.  Returns the instructions
+	// skipped.
+	template<typename Hooks>
+	long long FastForward(int a_start, int a_branch, long long a_budget) {
+		if (!is_same<Hooks, NoHooks>::value || !m_accelerator || a_start > a_branch) {
+			return 0;
+		}
+		return m_accelerator->Skip(m_memory, m_reg, a_start, a_branch, a_budget);
+	}
+
+	// Records where a DIV is, for the trap to report if it faults.  The fence keeps the
+	// compiler from moving the stores of earlier instructions past the divide; it
+	// emits no instructions.
+	void PublishLocation(int a_loc, long long a_steps) {
+		m_pc = a_loc;
+		m_steps = a_steps;
+		atomic_signal_fence(memory_order_seq_cst);
+	}
+
+	// Prompts for and gets the value for a READ instruction.  Interactive input is
+	// recorded so the values consumed by a run are always known.
+	bool ReadInput(Word& a_value) {
+		if (m_inputPos < m_input.size()) {
+			*m_out << "? ";
+			a_value = m_input[m_inputPos++];
+			return true;
+		}
+		if (!m_interactive) {
+			return false;
+		}
+		*m_out << "? ";
+		if (!(cin >> a_value)) {
+			return false;
+		}
+		m_input.push_back(a_value);
+		m_inputPos++;
+		return true;
+	}
+
+	Word m_memory[MEMSZ];   // The memory of the Quack3200.
+	Word m_reg[REGCOUNT];   // The accumulator for the Quack3200
+
+	int m_pc = ORIGIN;              // The location of the next instruction.
+	long long m_steps = 0;          // The number of instructions executed.
+	long long m_writes = 0;         // The number of WRITE instructions executed.
+	vector<Word> m_input;           // The values for READ instructions.
+	size_t m_inputPos = 0;          // The index of the next value to be read.
+	bool m_interactive = true;      // == true if values are read from cin when m_input runs out.
+	bool m_inputOpen = false;       // == true if values may still be added to m_input.
+	ostream* m_out = &cout;         // Where WRITE instructions display their values.
+	unique_ptr<LoopAccelerator<Word, Encoding, REGCOUNT>> m_accelerator;	// Skips loop iterations; null if not fast forwarding.
+};
+
+// The standard Quack3200 that the assembler translates for.
+typedef BasicEmulator<100000, 10, int> emulator;
+
+// A Quack3200 whose memory fits in the first level data cache, for small programs.
+typedef BasicEmulator<1000, 10, int> SmallEmulator;
 
-	int m_memory[MEMSZ];    // The memory of the Quack3200.
-	int m_reg[10];		    // The accumulator for the Quack3200
-};
\ No newline at end of file
+// A Quack3200 with 64 bit words and ten million words of memory, for programs that
+// process a lot of data.  Too large for the stack; allocate it with new.
+typedef BasicEmulator<10000000, 10, long long> LargeEmulator;
@@ -5,6 +5,7 @@
 
 vector<string> Errors::m_ErrorMsgs;
 bool Errors::m_WasErrorMessages = false;
+string Errors::m_Context;
 
 /*
 NAME
@@ -11,15 +11,34 @@ public:
 
     // Records an error message.
     static void RecordError(const string a_emsg) {
-        m_ErrorMsgs.push_back(a_emsg);
+        m_ErrorMsgs.push_back(m_Context + a_emsg);
         m_WasErrorMessages = true;
     }
 
+    // Records an error message among those recorded already, before the one at
+    // a_position, for a check that could only be made later.  The message is
+    // recorded as it is given, without the context.
+    static void InsertError(size_t a_position, const string& a_emsg) {
+        m_ErrorMsgs.insert(m_ErrorMsgs.begin() + a_position, a_emsg);
+        m_WasErrorMessages = true;
+    }
+
+    // Sets the text put before the messages recorded next, such as where the
+    // statement being checked came from.
+    static void SetContext(const string& a_context) { m_Context = a_context; }
+
+    // Returns the text put before the messages recorded next.
+    static const string& GetContext() { return m_Context; }
+
     // Displays the collected error message.
     static void DisplayErrors();
 
+    // Returns the error messages collected since they were last displayed.
+    static const vector<string>& GetErrors() { return m_ErrorMsgs; }
+
 private:
 
     static vector<string> m_ErrorMsgs;
     static bool m_WasErrorMessages;
+    static string m_Context;
 };
\ No newline at end of file
@@ -3,65 +3,73 @@
 //
 #include "stdafx.h"
 #include "FileAccess.h"
+#include "Hash.h"
+#include "Stats.h"
 #include <iostream>
+#include <chrono>
+#include <filesystem>
+#include <random>
 
 /*
 NAME
 
-    FileAccess::FileAccess - opens an assembly program file
+    FileAccess::FileAccess - reads an assembly program file
 
 SYNOPSIS
 
-    FileAccess::FileAccess(int argc, char* argv[]);
-    int argc -> the amount of command line arguments given
-    char* argv[] -> a list of provided file names
+    FileAccess::FileAccess(const string& a_fileName, bool a_streaming);
+    a_fileName -> the name of the assembly program file; "-" for standard input
+    a_streaming -> == true to read even a regular file a line at a time
 
 DESCRIPTION
 
-    This constructor takes in a command line argument abd opens the
-    file to an assembly program. It also provides reliability with
-    file error checking.
+    This constructor reads the whole assembly program named on the
+    command line into memory, so that the passes and the translation
+    cache do not go back to the file. It also provides reliability with
+    file error checking.  An empty name gives an empty source, for a
+    run that links object files instead of assembling.
+
+    Standard input, a pipe or other file that cannot be read twice, and
+    any file when a_streaming is true are not read into memory; their
+    lines are read as they are asked for, by a single pass.
 
 */
-FileAccess::FileAccess(int argc, char* argv[])
+FileAccess::FileAccess(const string& a_fileName, bool a_streaming) : m_input(&m_sfile)
 {
-    // Check that there is exactly one run time parameter.
-    if (argc != 2) 
-    {
-        cerr << "Usage: Assem <FileName>" << endl;
-        exit(1);
+    if (a_fileName.empty()) {
+        return;
     }
-
-    m_sfile.open(argv[1], ios::in);
+    if (a_fileName == "-") {
+        m_input = &cin;
+        return;
+    }
+    error_code ec;
+    bool regular = filesystem::is_regular_file(a_fileName, ec);
+    if (a_streaming || (filesystem::exists(a_fileName, ec) && !regular)) {
+        m_stream.open(a_fileName, ios::in);
+        if (!m_stream) {
+            cerr << "Source file could not be opened, assembler terminated."
+                << endl;
+            exit(1);
+        }
+        m_input = &m_stream;
+        return;
+    }
+    Stats::Phase phase("Read source");
+    ifstream file(a_fileName, ios::in);
 
     // If the open failed, report the error and terminate.
-    if (!m_sfile) 
+    if (!file) 
     {
         cerr << "Source file could not be opened, assembler terminated."
             << endl;
         exit(1);
     }
-}
-
-/*
-NAME
-
-    FileAccess::~FileAccess - closes an opened file
-
-SYNOPSIS
-
-    FileAccess::~FileAccess();
-
-DESCRIPTION
+    string contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    m_sfile.str(contents);
 
-    This destructor closes the file of the assembly program once the
-    program has been completed and terminated.
-
-*/
-FileAccess::~FileAccess()
-{
-
-    m_sfile.close();
+    long long lines = count(contents.begin(), contents.end(), '\n');
+    Stats::AddCounter("lines", !contents.empty() && contents.back() != '\n' ? lines + 1 : lines);
 }
 
 /*
@@ -88,12 +96,18 @@ RETURNS
 bool FileAccess::GetNextLine(string& a_buff)
 {
     // If there is no more data, return false.
-    if (m_sfile.eof()) 
+    if (m_input->eof()) 
     {
 
         return false;
     }
-    getline(m_sfile, a_buff);
+    getline(*m_input, a_buff);
+
+    // A streamed source is counted as it is read, as the whole source is when it
+    // is read into memory.  The empty line after the last end of line is not a line.
+    if (IsStreaming() && !(m_input->eof() && a_buff.empty())) {
+        m_lines++;
+    }
 
     // Return indicating success.
     return true;
@@ -119,4 +133,76 @@ void FileAccess::rewind()
     // Clean all file flags and go back to the beginning of the file.
     m_sfile.clear();
     m_sfile.seekg(0, ios::beg);
+}
+
+/*
+NAME
+
+    FileAccess::ReadAll - reads the whole program file
+
+SYNOPSIS
+
+    void FileAccess::ReadAll(string& a_contents);
+    a_contents -> the storage buffer for the contents of the file
+
+DESCRIPTION
+
+    This function reads every byte of the assembly program into the
+    buffer and then rewinds the file so that the passes of the
+    assembler see it from the beginning.
+
+*/
+void FileAccess::ReadAll(string& a_contents)
+{
+    a_contents = m_sfile.str();
+    rewind();
+}
+
+/*
+NAME
+
+    FileAccess::WriteAtomically - replaces a file in one step
+
+SYNOPSIS
+
+    bool FileAccess::WriteAtomically(const string& a_fileName, const string& a_contents);
+    a_fileName -> the file to be written
+    a_contents -> the bytes to be written
+
+DESCRIPTION
+
+    This function writes the bytes to a temporary file with a name no
+    other process will choose and then renames it over the target, so
+    that other processes reading the file never see it half written.
+
+RETURNS
+
+    Whether the file was written
+
+*/
+bool FileAccess::WriteAtomically(const string& a_fileName, const string& a_contents)
+{
+    random_device random;
+    uint64_t unique = ((uint64_t)random() << 32) ^ random()
+        ^ (uint64_t)chrono::steady_clock::now().time_since_epoch().count();
+    string temp = a_fileName + "." + Hash::ToHex(unique) + ".tmp";
+
+    ofstream file(temp, ios::out | ios::binary | ios::trunc);
+    if (!file) {
+        return false;
+    }
+    file.write(a_contents.data(), a_contents.size());
+    file.close();
+
+    error_code ec;
+    if (!file) {
+        filesystem::remove(temp, ec);
+        return false;
+    }
+    filesystem::rename(temp, a_fileName, ec);
+    if (ec) {
+        filesystem::remove(temp, ec);
+        return false;
+    }
+    return true;
 }
\ No newline at end of file
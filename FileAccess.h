@@ -1,6 +1,7 @@
 #pragma once
 
 #include <fstream>
+#include <sstream>
 #include <stdlib.h>
 #include <string>
 
@@ -8,11 +9,12 @@ class FileAccess {
 
 public:
 
-    // Opens the file.
-    FileAccess(int argc, char* argv[]);
+    // Reads the file into memory.  Standard input, named "-", a file that is not a
+    // regular file, such as a pipe, and any file when a_streaming is true are read a
+    // line at a time instead, and cannot be rewound.
+    FileAccess(const string& a_fileName, bool a_streaming = false);
 
-    // Closes the file.
-    ~FileAccess();
+    ~FileAccess() {};
 
     // Gets the next line from the source file.
     bool GetNextLine(string& a_buff);
@@ -20,7 +22,22 @@ public:
     // Puts the file pointer back to the beginning of the file.
     void rewind();
 
+    // Determines if the source is read a line at a time, so it can be read only once.
+    bool IsStreaming() const { return m_input != &m_sfile; }
+
+    // The lines read so far.
+    long long GetLineCount() const { return m_lines; }
+
+    // Reads the entire source file and puts the file pointer back to the beginning.
+    void ReadAll(string& a_contents);
+
+    // Writes a file so that readers see either its old contents or all of the new ones.
+    static bool WriteAtomically(const string& a_fileName, const string& a_contents);
+
 private:
 
-    ifstream m_sfile;		// Source file object.
+    istringstream m_sfile;	// Contents of the source file.
+    ifstream m_stream;      // The source file, when it is read a line at a time.
+    istream* m_input;       // The stream lines are read from.
+    long long m_lines = 0;  // The lines read so far.
 };
\ No newline at end of file
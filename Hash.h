@@ -0,0 +1,46 @@
+//
+//		Hashing helpers shared by the components that key data by content.
+//
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+class Hash {
+
+public:
+
+    static const uint64_t FNV_OFFSET = 14695981039346656037ULL;    // FNV-1a offset basis.
+    static const uint64_t FNV_PRIME = 1099511628211ULL;             // FNV-1a prime.
+
+    // Folds a run of bytes into a running FNV-1a hash.
+    static uint64_t Fnv1a(const void* a_data, size_t a_size, uint64_t a_hash = FNV_OFFSET) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(a_data);
+        for (size_t i = 0; i < a_size; i++) {
+            a_hash ^= bytes[i];
+            a_hash *= FNV_PRIME;
+        }
+        return a_hash;
+    }
+
+    // Scrambles a 64 bit value so that nearby inputs give unrelated outputs.
+    static uint64_t Mix(uint64_t a_value) {
+        a_value ^= a_value >> 33;
+        a_value *= 0xff51afd7ed558ccdULL;
+        a_value ^= a_value >> 33;
+        a_value *= 0xc4ceb9fe1a85ec53ULL;
+        a_value ^= a_value >> 33;
+        return a_value;
+    }
+
+    // Formats a hash as a fixed width hexadecimal string for use in file names.
+    static string ToHex(uint64_t a_hash) {
+        static const char digits[] = "0123456789abcdef";
+        string hex(16, '0');
+        for (int i = 15; i >= 0; i--) {
+            hex[i] = digits[a_hash & 0xf];
+            a_hash >>= 4;
+        }
+        return hex;
+    }
+};
@@ -0,0 +1,517 @@
+//
+//		Implementation of the ImageArchive and ArchiveBuilder classes.
+//
+//		An archive is laid out as
+//
+//			header      "QKAR", format, the offset and count of each part below, padding
+//			name table  slots of (hash of name, offset of entry); offset 0 if empty
+//			chunk table (offset, size, hash) of each chunk
+//			entries     (name, word count, chunk count, chunk indexes) of each program
+//			chunks      the bytes of the chunks
+//
+//		A word is stored as its location, contents and code flag, 9 bytes.
+//
+#include "stdafx.h"
+#include "ImageArchive.h"
+#include "Binary.h"
+#include "FileAccess.h"
+#include "Hash.h"
+#include "Stats.h"
+
+const char ImageArchive::MAGIC[4] = { 'Q', 'K', 'A', 'R' };
+
+namespace {
+
+    // The random values of the gear hash that finds the ends of chunks, one for each
+    // byte value.  Generated rather than listed; any fixed values would do.
+    struct GearTable {
+        uint64_t m_values[256];
+        GearTable() {
+            for (int i = 0; i < 256; i++) {
+                m_values[i] = Hash::Mix(0x9e3779b97f4a7c15ULL * (i + 1));
+            }
+        }
+    };
+    const GearTable GEAR;
+}
+
+/*
+NAME
+
+    ImageArchive::Open - maps an archive
+
+SYNOPSIS
+
+    bool ImageArchive::Open(const string& a_fileName);
+    a_fileName -> the archive
+
+DESCRIPTION
+
+    Only the header is read.  The tables it locates are checked to lie
+    within the file, so a damaged archive is never read past its end.
+
+RETURNS
+
+    Whether the file is an archive
+
+*/
+bool ImageArchive::Open(const string& a_fileName)
+{
+    if (!m_file.Open(a_fileName) || m_file.GetSize() < HEADER_SIZE) {
+        return false;
+    }
+    BinaryReader in(m_file.GetData(), m_file.GetSize());
+    char magic[4];
+    in.GetRaw(magic, sizeof(magic));
+    if (memcmp(magic, MAGIC, sizeof(magic)) != 0 || in.GetUInt32() != FORMAT) {
+        return false;
+    }
+    m_slotsOffset = in.GetUInt64();
+    m_slotCount = in.GetUInt32();
+    m_chunkTableOffset = in.GetUInt64();
+    m_chunkCount = in.GetUInt32();
+    m_entriesOffset = in.GetUInt64();
+    m_programCount = in.GetUInt32();
+    in.GetUInt64();     // Where the chunks start; the chunk table locates each one.
+    in.GetUInt32();     // Reserved.
+
+    uint64_t size = m_file.GetSize();
+    return !in.Failed() && m_slotCount > 0 && (m_slotCount & (m_slotCount - 1)) == 0
+        && m_slotsOffset + (uint64_t)m_slotCount * SLOT_SIZE <= size
+        && m_chunkTableOffset + (uint64_t)m_chunkCount * CHUNK_SIZE <= size
+        && m_entriesOffset <= size;
+}
+
+/*
+NAME
+
+    ImageArchive::Load - loads a program by name
+
+SYNOPSIS
+
+    bool ImageArchive::Load(const string& a_name, MemoryImage& a_image) const;
+    a_name -> the name of the program
+    a_image -> receives the translation
+
+DESCRIPTION
+
+    The name is hashed to a slot of the name table, and the slots that
+    follow are probed until the name or an empty slot is found.  The
+    program's chunks are then checked against their hashes and decoded
+    straight from the mapped file into a_image.  Nothing else in the
+    archive is read.
+
+RETURNS
+
+    Whether the program was found and loaded
+
+*/
+bool ImageArchive::Load(const string& a_name, MemoryImage& a_image) const
+{
+    uint64_t hash = Hash::Fnv1a(a_name.data(), a_name.size());
+    string name;
+    uint32_t words = 0;
+    vector<uint32_t> chunks;
+
+    bool found = false;
+    for (uint32_t probe = 0; probe < m_slotCount && !found; probe++) {
+        uint32_t slot = (uint32_t)(hash + probe) & (m_slotCount - 1);
+        BinaryReader in(m_file.GetData() + m_slotsOffset + (uint64_t)slot * SLOT_SIZE, SLOT_SIZE);
+        uint64_t slotHash = in.GetUInt64();
+        uint64_t offset = in.GetUInt64();
+        if (offset == 0) {
+            return false;
+        }
+        if (slotHash == hash) {
+            found = ReadEntry(offset, name, words, chunks) && name == a_name;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+
+    a_image.Clear();
+    a_image.GetWords().reserve(words);
+    for (uint32_t chunk : chunks) {
+        uint32_t size;
+        const unsigned char* bytes = GetChunk(chunk, size);
+        if (bytes == nullptr) {
+            return false;
+        }
+        for (uint32_t i = 0; i + WORD_SIZE <= size; i += WORD_SIZE) {
+            a_image.GetWords().push_back(ArchiveBuilder::DecodeWord(bytes + i));
+        }
+    }
+    return a_image.GetWords().size() == words;
+}
+
+/*
+NAME
+
+    ImageArchive::GetChunk - finds the bytes of a chunk
+
+SYNOPSIS
+
+    const unsigned char* ImageArchive::GetChunk(uint32_t a_chunk, uint32_t& a_size) const;
+    a_chunk -> the index of the chunk
+    a_size -> receives the size of the chunk in bytes
+
+DESCRIPTION
+
+    The chunk is checked against the hash recorded for it, so a damaged
+    chunk is never decoded.
+
+RETURNS
+
+    The bytes of the chunk in the mapped file, or null if it is damaged
+
+*/
+const unsigned char* ImageArchive::GetChunk(uint32_t a_chunk, uint32_t& a_size) const
+{
+    a_size = 0;
+    if (a_chunk >= m_chunkCount) {
+        return nullptr;
+    }
+    BinaryReader in(m_file.GetData() + m_chunkTableOffset + (uint64_t)a_chunk * CHUNK_SIZE, CHUNK_SIZE);
+    uint64_t offset = in.GetUInt64();
+    uint32_t size = in.GetUInt32();
+    uint64_t hash = in.GetUInt64();
+    if (offset > m_file.GetSize() || size > m_file.GetSize() - offset || size % WORD_SIZE != 0) {
+        return nullptr;
+    }
+    const unsigned char* bytes = m_file.GetData() + offset;
+    if (Hash::Fnv1a(bytes, size) != hash) {
+        return nullptr;
+    }
+    a_size = size;
+    return bytes;
+}
+
+/*
+NAME
+
+    ImageArchive::ReadEntry - reads the entry of a program
+
+SYNOPSIS
+
+    bool ImageArchive::ReadEntry(uint64_t a_offset, string& a_name, uint32_t& a_words, vector<uint32_t>& a_chunks) const;
+    a_offset -> where the entry starts
+    a_name -> receives the name of the program
+    a_words -> receives the number of words in its translation
+    a_chunks -> receives the indexes of its chunks
+
+RETURNS
+
+    Whether the entry lies within the file
+
+*/
+bool ImageArchive::ReadEntry(uint64_t a_offset, string& a_name, uint32_t& a_words, vector<uint32_t>& a_chunks) const
+{
+    if (a_offset < m_entriesOffset || a_offset >= m_file.GetSize()) {
+        return false;
+    }
+    BinaryReader in(m_file.GetData() + a_offset, m_file.GetSize() - a_offset);
+    a_name = in.GetString();
+    a_words = in.GetUInt32();
+    uint32_t count = in.GetUInt32();
+    if (in.Failed() || count > in.GetRemaining() / 4) {
+        return false;
+    }
+    a_chunks.resize(count);
+    for (uint32_t& chunk : a_chunks) {
+        chunk = in.GetUInt32();
+    }
+    return !in.Failed();
+}
+
+/*
+NAME
+
+    ArchiveBuilder::Add - adds a program
+
+SYNOPSIS
+
+    void ArchiveBuilder::Add(const string& a_name, const MemoryImage& a_image);
+    a_name -> the name the program is loaded by
+    a_image -> its translation
+
+DESCRIPTION
+
+    The words of the translation are encoded one after another and cut
+    into chunks with a gear hash: a chunk ends after a word when the
+    top bits of the hash of the last 64 bytes are all 0, so the ends
+    depend on the content and not on the offset.  Two programs sharing
+    a run of code therefore cut it the same way, however much differs
+    before it, and its chunks are stored once.  Chunks only end between
+    words and are kept between MIN_WORDS and MAX_WORDS long.
+
+*/
+void ArchiveBuilder::Add(const string& a_name, const MemoryImage& a_image)
+{
+    Program program;
+    program.m_name = a_name;
+    program.m_words = (uint32_t)a_image.GetWords().size();
+
+    string chunk;
+    uint64_t gear = 0;
+    int words = 0;
+    for (const MemoryImage::Word& word : a_image.GetWords()) {
+        size_t start = chunk.size();
+        EncodeWord(word, chunk);
+        for (size_t i = start; i < chunk.size(); i++) {
+            gear = (gear << 1) + GEAR.m_values[(unsigned char)chunk[i]];
+        }
+        words++;
+        if ((words >= MIN_WORDS && (gear >> (64 - AVERAGE_BITS)) == 0) || words >= MAX_WORDS) {
+            program.m_chunks.push_back(AddChunk((const unsigned char*)chunk.data(), chunk.size()));
+            chunk.clear();
+            words = 0;
+        }
+    }
+    if (!chunk.empty()) {
+        program.m_chunks.push_back(AddChunk((const unsigned char*)chunk.data(), chunk.size()));
+    }
+    m_rawBytes += (long long)program.m_words * ImageArchive::WORD_SIZE;
+    AddProgram(move(program));
+}
+
+/*
+NAME
+
+    ArchiveBuilder::AddArchive - adds the programs of an archive
+
+SYNOPSIS
+
+    bool ArchiveBuilder::AddArchive(const ImageArchive& a_archive);
+    a_archive -> the archive
+
+DESCRIPTION
+
+    The chunks of each program are copied as they are, so the programs
+    are not cut again.
+
+RETURNS
+
+    Whether every program could be read
+
+*/
+bool ArchiveBuilder::AddArchive(const ImageArchive& a_archive)
+{
+    bool intact = true;
+    bool read = a_archive.ForEachProgram([&](const string& a_name, uint32_t a_words, const vector<uint32_t>& a_chunks) {
+        Program program;
+        program.m_name = a_name;
+        program.m_words = a_words;
+        for (uint32_t chunk : a_chunks) {
+            uint32_t size;
+            const unsigned char* bytes = a_archive.GetChunk(chunk, size);
+            if (bytes == nullptr) {
+                intact = false;
+                return;
+            }
+            program.m_chunks.push_back(AddChunk(bytes, size));
+        }
+        m_rawBytes += (long long)a_words * ImageArchive::WORD_SIZE;
+        AddProgram(move(program));
+    });
+    return read && intact;
+}
+
+/*
+NAME
+
+    ArchiveBuilder::Write - writes the archive
+
+SYNOPSIS
+
+    bool ArchiveBuilder::Write(const string& a_fileName) const;
+    a_fileName -> the archive to be written
+
+DESCRIPTION
+
+    Chunks that only programs since replaced referred to are left out.
+    The name table has at least twice as many slots as there are
+    programs, so a lookup rarely probes more than a slot or two.
+
+RETURNS
+
+    Whether the archive was written
+
+*/
+bool ArchiveBuilder::Write(const string& a_fileName) const
+{
+    // Number the chunks still in use in the order they are first used.
+    vector<uint32_t> renumbered(m_chunks.size(), UINT32_MAX);
+    vector<uint32_t> used;
+    for (const Program& program : m_programs) {
+        for (uint32_t chunk : program.m_chunks) {
+            if (renumbered[chunk] == UINT32_MAX) {
+                renumbered[chunk] = (uint32_t)used.size();
+                used.push_back(chunk);
+            }
+        }
+    }
+
+    uint32_t slotCount = 1;
+    while (slotCount < 2 * m_programs.size() + 1) {
+        slotCount *= 2;
+    }
+    uint64_t slotsOffset = ImageArchive::HEADER_SIZE;
+    uint64_t chunkTableOffset = slotsOffset + (uint64_t)slotCount * ImageArchive::SLOT_SIZE;
+    uint64_t entriesOffset = chunkTableOffset + (uint64_t)used.size() * ImageArchive::CHUNK_SIZE;
+
+    BinaryWriter entries;
+    vector<pair<uint64_t, uint64_t>> slots(slotCount, { 0, 0 });
+    for (const Program& program : m_programs) {
+        uint64_t hash = Hash::Fnv1a(program.m_name.data(), program.m_name.size());
+        uint32_t slot = (uint32_t)hash & (slotCount - 1);
+        while (slots[slot].second != 0) {
+            slot = (slot + 1) & (slotCount - 1);
+        }
+        slots[slot] = { hash, entriesOffset + entries.GetBytes().size() };
+
+        entries.PutString(program.m_name);
+        entries.PutUInt32(program.m_words);
+        entries.PutUInt32((uint32_t)program.m_chunks.size());
+        for (uint32_t chunk : program.m_chunks) {
+            entries.PutUInt32(renumbered[chunk]);
+        }
+    }
+    uint64_t chunksOffset = entriesOffset + entries.GetBytes().size();
+
+    BinaryWriter out;
+    out.PutRaw(ImageArchive::MAGIC, sizeof(ImageArchive::MAGIC));
+    out.PutUInt32(ImageArchive::FORMAT);
+    out.PutUInt64(slotsOffset);
+    out.PutUInt32(slotCount);
+    out.PutUInt64(chunkTableOffset);
+    out.PutUInt32((uint32_t)used.size());
+    out.PutUInt64(entriesOffset);
+    out.PutUInt32((uint32_t)m_programs.size());
+    out.PutUInt64(chunksOffset);
+    out.PutUInt32(0);
+    for (const auto& slot : slots) {
+        out.PutUInt64(slot.first);
+        out.PutUInt64(slot.second);
+    }
+    uint64_t offset = chunksOffset;
+    for (uint32_t chunk : used) {
+        const string& bytes = m_chunks[chunk];
+        out.PutUInt64(offset);
+        out.PutUInt32((uint32_t)bytes.size());
+        out.PutUInt64(Hash::Fnv1a(bytes.data(), bytes.size()));
+        offset += bytes.size();
+    }
+    out.PutRaw(entries.GetBytes().data(), entries.GetBytes().size());
+    for (uint32_t chunk : used) {
+        out.PutRaw(m_chunks[chunk].data(), m_chunks[chunk].size());
+    }
+    return FileAccess::WriteAtomically(a_fileName, out.GetBytes());
+}
+
+/*
+NAME
+
+    ArchiveBuilder::DisplaySummary - displays what the archive holds
+
+SYNOPSIS
+
+    void ArchiveBuilder::DisplaySummary(const string& a_fileName) const;
+    a_fileName -> the archive, for the message
+
+*/
+void ArchiveBuilder::DisplaySummary(const string& a_fileName) const
+{
+    // Chunks only replaced programs used are not written, so are not counted.
+    vector<bool> used(m_chunks.size(), false);
+    long long stored = 0;
+    long long chunks = 0;
+    for (const Program& program : m_programs) {
+        for (uint32_t chunk : program.m_chunks) {
+            if (!used[chunk]) {
+                used[chunk] = true;
+                stored += m_chunks[chunk].size();
+                chunks++;
+            }
+        }
+    }
+    cout << "Archive " << a_fileName << ": " << m_programs.size() << " programs, " << chunks
+        << " different chunks, " << stored << " bytes of chunks for " << m_rawBytes << " bytes of programs";
+    if (stored > 0) {
+        cout << " (" << fixed << setprecision(1) << (double)m_rawBytes / stored << " to 1)";
+    }
+    cout << endl;
+    Stats::SetCounter("archive_programs", (long long)m_programs.size());
+    Stats::SetCounter("archive_chunks", chunks);
+}
+
+// Encodes a word as its location, contents and code flag.
+void ArchiveBuilder::EncodeWord(const MemoryImage::Word& a_word, string& a_bytes)
+{
+    BinaryWriter out;
+    out.PutInt32(a_word.m_loc);
+    out.PutInt32(a_word.m_contents);
+    out.PutByte(a_word.m_isCode ? 1 : 0);
+    a_bytes.append(out.GetBytes());
+}
+
+// Decodes a word encoded by EncodeWord.
+MemoryImage::Word ArchiveBuilder::DecodeWord(const unsigned char* a_bytes)
+{
+    BinaryReader in(a_bytes, ImageArchive::WORD_SIZE);
+    MemoryImage::Word word;
+    word.m_loc = in.GetInt32();
+    word.m_contents = in.GetInt32();
+    word.m_isCode = in.GetByte() != 0;
+    return word;
+}
+
+/*
+NAME
+
+    ArchiveBuilder::AddChunk - stores a chunk once
+
+SYNOPSIS
+
+    uint32_t ArchiveBuilder::AddChunk(const unsigned char* a_bytes, size_t a_size);
+    a_bytes -> the bytes of the chunk
+    a_size -> its size
+
+DESCRIPTION
+
+    Chunks are looked up by hash and compared byte for byte, so two
+    chunks that only share a hash are both kept.
+
+RETURNS
+
+    The index of the stored chunk
+
+*/
+uint32_t ArchiveBuilder::AddChunk(const unsigned char* a_bytes, size_t a_size)
+{
+    uint64_t hash = Hash::Fnv1a(a_bytes, a_size);
+    auto range = m_chunkIndex.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        const string& chunk = m_chunks[it->second];
+        if (chunk.size() == a_size && memcmp(chunk.data(), a_bytes, a_size) == 0) {
+            return it->second;
+        }
+    }
+    uint32_t index = (uint32_t)m_chunks.size();
+    m_chunks.emplace_back((const char*)a_bytes, a_size);
+    m_chunkIndex.emplace(hash, index);
+    return index;
+}
+
+// Records a program, replacing any program of the same name.
+void ArchiveBuilder::AddProgram(Program&& a_program)
+{
+    auto named = m_names.find(a_program.m_name);
+    if (named != m_names.end()) {
+        m_rawBytes -= (long long)m_programs[named->second].m_words * ImageArchive::WORD_SIZE;
+        m_programs[named->second] = move(a_program);
+        return;
+    }
+    m_names[a_program.m_name] = m_programs.size();
+    m_programs.push_back(move(a_program));
+}
@@ -0,0 +1,135 @@
+//
+//		Classes to pack many translations into one archive file and to load any one
+//		of them by name.  Each translation is cut into chunks where its content says
+//		so, not at fixed offsets, so translations that share code share the chunks
+//		holding it even when they differ elsewhere; each different chunk is stored
+//		once.  The archive ends its header with a hash table of the names, so a
+//		program is found with a few probes of the mapped file and loading one costs
+//		the same however many programs the archive holds.
+//
+#pragma once
+
+#include <map>
+#include <stdint.h>
+#include <unordered_map>
+#include "MappedFile.h"
+#include "MemoryImage.h"
+
+// Reads an archive.  The file is mapped, and only the parts belonging to the program
+// loaded are read.
+class ImageArchive {
+
+public:
+
+    ImageArchive() {};
+    ~ImageArchive() {};
+
+    // Maps an archive and checks its header.  Returns false if it is not an archive.
+    bool Open(const string& a_fileName);
+
+    // Loads the named program.  Returns false if the archive has no such program or
+    // its chunks are damaged.
+    bool Load(const string& a_name, MemoryImage& a_image) const;
+
+    // The programs in the archive.
+    int GetProgramCount() const { return (int)m_programCount; }
+
+    // Calls a_function with the name and the chunks of each program, in the order
+    // they are stored.  Used to copy an archive's programs into a new one.
+    template<typename Function>
+    bool ForEachProgram(Function a_function) const;
+
+    // Returns the bytes of a chunk, or null, with a_size 0, if it is damaged.
+    const unsigned char* GetChunk(uint32_t a_chunk, uint32_t& a_size) const;
+
+private:
+
+    friend class ArchiveBuilder;
+
+    static const char MAGIC[4];             // Identifies an archive.
+    static const uint32_t FORMAT = 1;       // Changed whenever the layout changes.
+    static const size_t HEADER_SIZE = 56;   // Bytes in the header.
+    static const size_t SLOT_SIZE = 16;     // Bytes in each slot of the name table.
+    static const size_t CHUNK_SIZE = 20;    // Bytes in each entry of the chunk table.
+    static const size_t WORD_SIZE = 9;      // Bytes in each encoded word.
+
+    // Reads a program's entry: its name, its word count and its chunks.
+    bool ReadEntry(uint64_t a_offset, string& a_name, uint32_t& a_words, vector<uint32_t>& a_chunks) const;
+
+    MappedFile m_file;                      // The archive.
+    uint64_t m_slotsOffset = 0;             // Where the name table starts.
+    uint32_t m_slotCount = 0;               // Slots in the name table, a power of two.
+    uint64_t m_chunkTableOffset = 0;        // Where the chunk table starts.
+    uint32_t m_chunkCount = 0;              // Chunks in the archive.
+    uint64_t m_entriesOffset = 0;           // Where the entries of the programs start.
+    uint32_t m_programCount = 0;            // Programs in the archive.
+};
+
+// Builds an archive in memory and writes it.
+class ArchiveBuilder {
+
+public:
+
+    ArchiveBuilder() {};
+    ~ArchiveBuilder() {};
+
+    // Adds a program, replacing any program of the same name.
+    void Add(const string& a_name, const MemoryImage& a_image);
+
+    // Adds every program of an archive.  Returns false if one is damaged.
+    bool AddArchive(const ImageArchive& a_archive);
+
+    // Writes the archive, replacing the file as a whole.  Returns false if it
+    // cannot be written.
+    bool Write(const string& a_fileName) const;
+
+    // Displays the programs, the chunks and how much deduplication saved.
+    void DisplaySummary(const string& a_fileName) const;
+
+    // Converts words to the bytes stored in chunks, and back.
+    static void EncodeWord(const MemoryImage::Word& a_word, string& a_bytes);
+    static MemoryImage::Word DecodeWord(const unsigned char* a_bytes);
+
+private:
+
+    // A program to be written.
+    struct Program {
+        string m_name;                  // The name it is loaded by.
+        uint32_t m_words;               // Words in its translation.
+        vector<uint32_t> m_chunks;      // Its chunks, in order.
+    };
+
+    static const int MIN_WORDS = 32;        // No chunk but the last is shorter.
+    static const int MAX_WORDS = 1024;      // No chunk is longer.
+    static const int AVERAGE_BITS = 7;      // Chunks average about 2^7 words past the minimum.
+
+    // Stores a chunk unless an identical one is stored.  Returns its index.
+    uint32_t AddChunk(const unsigned char* a_bytes, size_t a_size);
+
+    // Records a program, replacing any of the same name.
+    void AddProgram(Program&& a_program);
+
+    vector<string> m_chunks;                                // The different chunks.
+    unordered_multimap<uint64_t, uint32_t> m_chunkIndex;    // The chunks by hash.
+    vector<Program> m_programs;                             // The programs, in the order added.
+    map<string, size_t> m_names;                            // The index of each program by name.
+    long long m_rawBytes = 0;                               // Bytes of the programs before deduplication.
+};
+
+// Calls a_function(name, words, chunks) for each program.
+template<typename Function>
+bool ImageArchive::ForEachProgram(Function a_function) const
+{
+    uint64_t offset = m_entriesOffset;
+    string name;
+    uint32_t words;
+    vector<uint32_t> chunks;
+    for (uint32_t i = 0; i < m_programCount; i++) {
+        if (!ReadEntry(offset, name, words, chunks)) {
+            return false;
+        }
+        a_function(name, words, chunks);
+        offset += 12 + name.size() + 4 * chunks.size();
+    }
+    return true;
+}
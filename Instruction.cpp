@@ -46,9 +46,14 @@ Instruction::InstructionType Instruction::ParseInstruction(string a_buff) {
 
 	m_type = DetermineInstructionType();
 	
-	// Records the numeric machine language OpCode
+	// Records the numeric machine language OpCode.  An operand given as a value
+	// or a register selects that form of the instruction, if it has one.
 	if (m_type == InstructionType::ST_MachineLanguage) {
-		m_NumOpCode = m_MachineOpCodes[m_OpCode];
+		m_NumOpCode = OpCodes::LookupMachine(m_OpCode);
+		int form = OpCodes::OperandForm(m_NumOpCode, m_OperandMode);
+		if (form != 0) {
+			m_NumOpCode = form;
+		}
 	}
 
 	return m_type;
@@ -75,15 +80,18 @@ RETURNS
 */
 Instruction::InstructionType Instruction::DetermineInstructionType() {
 	
-	if (m_MachineOpCodes[m_OpCode]) {
+	if (OpCodes::LookupMachine(m_OpCode)) {
 		return InstructionType::ST_MachineLanguage;
 	}
-	else if (m_OpCode == "dc" || m_OpCode == "ds" || m_OpCode == "org") {
+	else if (m_OpCode == "dc" || m_OpCode == "ds" || m_OpCode == "org" || m_OpCode == "extern" || m_OpCode == "entry") {
 		return InstructionType::ST_AssemblerInstr;
 	}
 	else if (m_OpCode == "end") {
 		return InstructionType::ST_End;
 	}
+	else if (m_OpCode == "include") {
+		return InstructionType::ST_Include;
+	}
 	else if (m_OpCode == "" && m_Label == "") {
 		return InstructionType::ST_Comment;
 	}
@@ -106,7 +114,9 @@ DESCRIPTION
 
 	This function will increment the current location for all types
 	of OpCodes besides "ds" and "org" codes which provide a specified
-	location.
+	location.  An "include" takes no room itself; the assembler places
+	the included file where it appears.  Nor do "extern" and "entry",
+	which only name labels.
 
 RETURNS
 	
@@ -118,6 +128,9 @@ int Instruction::LocationNextInstruction(int a_loc) {
 	if (m_OpCode == "org" || m_OpCode == "ds" && m_IsNumericOperand) {
 		return a_loc + ConvertToNumeric(m_Operand);
 	}
+	if (m_OpCode == "include" || m_OpCode == "extern" || m_OpCode == "entry") {
+		return a_loc;
+	}
 
 	return a_loc + 1;
 }
@@ -148,7 +161,7 @@ bool Instruction::ValidateLabelFormat() {
 		return true;
 	}
 
-	return m_Label.length() >= 1 && m_Label.length() <= 10 && isalpha(m_Label[0]) > 0;
+	return OpCodes::IsValidSymbol(m_Label);
 
 }
 
@@ -168,7 +181,10 @@ DESCRIPTION
 	is an assembly instruction, machine code instruction, or neither. 
 	Assembly instructions are then tested to see if they conform to
 	the specified numeric range and Machine code instructions are tested
-	for symbolic specifications.
+	for symbolic specifications.  ADD, SUB, MULT, DIV and LOAD may
+	instead take a value, #n, or a register, $n.  The operand of an
+	INCLUDE is a file name, which is not checked here, and those of
+	EXTERN and ENTRY are labels.
 
 RETURNS
 
@@ -181,22 +197,34 @@ bool Instruction::ValidateOperandFormat() {
 		return true;
 	}
 
+	if (m_OpCode == "include") {
+		return true;
+	}
+	if (m_OpCode == "extern" || m_OpCode == "entry") {
+		return !m_IsNumericOperand && OpCodes::IsValidSymbol(m_Operand);
+	}
+
 	if (isAssembly(m_OpCode)) {
 
 		// Assembly OpCodes can only have numeric operands
 		if (m_IsNumericOperand) {
-			return m_OperandValue >= -99999 && m_OperandValue <= 99999;
+			return OpCodes::IsValidConstant(m_OperandValue);
 		}
 		else {
 			return false;
 		}
 
 	}
-	else if (m_MachineOpCodes[m_OpCode]) {
+	else if (OpCodes::LookupMachine(m_OpCode)) {
+
+		// Values and registers are only allowed for the instructions that have those forms
+		if (m_OperandMode != OpCodes::OM_Memory) {
+			return OpCodes::IsValidOperandForm(OpCodes::LookupMachine(m_OpCode), m_Operand);
+		}
 
 		// Machine language OpCodes can only have symbolic operands
 		if (!m_IsNumericOperand) {
-			return m_Operand.length() >= 1 && m_Operand.length() <= 10 && isalpha(m_Operand[0]) > 0;
+			return OpCodes::IsValidSymbol(m_Operand);
 		}
 		else {
 			return false;
@@ -220,7 +248,8 @@ DESCRIPTION
 
 	This function first determines if a register exists in the
 	instruction set. Then it checks if the registers are in
-	the 0-9 numeric range.
+	the 0-9 numeric range.  A register that is not a number is
+	never in range.
 	
 RETURNS
 
@@ -232,7 +261,7 @@ bool Instruction::ValidateRegisterFormat() {
 		return true;
 	}
 	
-	return (m_NumRegister >= 0 && m_NumRegister <= 9);
+	return OpCodes::IsValidRegister(m_NumRegister);
 }
 
 /*
@@ -258,83 +287,60 @@ RETURNS
 */
 bool Instruction::MissingOrExtraOperand() {
 
-	// Checks if extra values were recorded in instruction parsing
-	if (m_ExtraOperand) {
-		return true;
-	}
-
-	// Checks if standalone OpCodes have an operand
-	if (m_OpCode == "halt" || m_OpCode == "end" && m_Operand == "") {
-		return false;
-	}
-
-	// Examines whether assembly or machine codes are missing operands
-	if (isAssembly(m_OpCode) && m_Operand == "") {
-		return true;
-	}
-	else if (m_MachineOpCodes[m_OpCode] && m_Operand == "") {
-		return true;
-	}
-	else {
-		return false;
-	}
+	return OpCodes::IsMissingOrExtraOperand(m_OpCode, m_Operand != "", m_ExtraOperand);
 }
 
 /*
 NAME
 
-	Instruction::isAssembly - Determines if an OpCode is an assembly instruction
+	Instruction::SetDefault - sets member variables to default
 
 SYNOPSIS
 
-	bool Instruction::isAssembly(string a_OpCode);
-	a_OpCode -> OpCode being reviewed
+	void Instruction::SetDefault();
 
 DESCRIPTION
 
-	This function loops through the list of assembly OpCodes and 
-	checks if the given OpCode matches any of them.
-
-RETURNS
-
-	Whether the operation code is an assembly instruction
+	This function takes a majority of the member variables and sets them 
+	to a default value.
 
 */
-bool Instruction::isAssembly(string a_OpCode) {
-
-	for (string OpCode : m_AssemblyOpCodes) {
-		if (OpCode == a_OpCode) {
-			return true;
-		}
-	}
+void Instruction::SetDefault() {
 
-	return false;
+	m_instruction = "";
+	m_NumOpCode = -1;
+	m_NumRegister = -1;
+	m_type = ST_Error;
+	m_ExtraOperand = false;
+	m_IsNumericOperand = false;
+	m_OperandValue = -1;
+	m_OperandMode = OpCodes::OM_Memory;
 }
 
 /*
 NAME
 
-	Instruction::SetDefault - sets member variables to default
+	Instruction::QualifyLocalLabels - makes the labels of a macro its own
 
 SYNOPSIS
 
-	void Instruction::SetDefault();
+	void Instruction::QualifyLocalLabels(const string& a_suffix);
+	a_suffix -> the suffix of the use of the macro
 
 DESCRIPTION
 
-	This function takes a majority of the member variables and sets them 
-	to a default value.
+	A label or operand beginning with ? loses the ? and gains the
+	suffix, so that each use of a macro has labels of its own.
 
 */
-void Instruction::SetDefault() {
+void Instruction::QualifyLocalLabels(const string& a_suffix) {
 
-	m_instruction = "";
-	m_NumOpCode = -1;
-	m_NumRegister = -1;
-	m_type = ST_Error;
-	m_ExtraOperand = false;
-	m_IsNumericOperand = false;
-	m_OperandValue = -1;
+	if (!m_Label.empty() && m_Label[0] == '?') {
+		m_Label = m_Label.substr(1) + a_suffix;
+	}
+	if (!m_Operand.empty() && m_Operand[0] == '?') {
+		m_Operand = m_Operand.substr(1) + a_suffix;
+	}
 }
 
 /*
@@ -399,7 +405,7 @@ void Instruction::SetLabelOpcodeEtc(const string& a_buff)
 		m_Register = m_Operand.substr(0, icomma);
 		m_Operand = m_Operand.substr(icomma + 1);
 
-		m_NumRegister = ConvertToNumeric(m_Register);
+		m_NumRegister = isNumber(m_Register) ? ConvertToNumeric(m_Register) : -1;
 	}
 	else
 	{
@@ -414,6 +420,12 @@ void Instruction::SetLabelOpcodeEtc(const string& a_buff)
 		m_OperandValue = ConvertToNumeric(m_Operand);
 	}
 
+	// Values (#n) and registers ($n) given as operands
+	m_OperandMode = OpCodes::ModeOf(m_Operand);
+	if (m_OperandMode != OpCodes::OM_Memory) {
+		m_OperandValue = OpCodes::OperandValue(m_Operand);
+	}
+
 	// Sets OpCodes to lower case
 	transform(m_OpCode.begin(), m_OpCode.end(), m_OpCode.begin(), ::tolower);
 
@@ -3,6 +3,8 @@
 //
 #pragma once
 
+#include "OpCodes.h"
+
 // The elements of an instruction.
 class Instruction {
 
@@ -18,6 +20,7 @@ public:
         ST_AssemblerInstr,  		// Assembler Language instruction.
         ST_Comment,          		// Comment or blank line
         ST_End,                   	// end instruction.
+        ST_Include,                 // include instruction.
         ST_Error                    // Default instruction
     };
 
@@ -31,12 +34,12 @@ public:
 
     // Converts a string to a numeric value
     int ConvertToNumeric(string a_value) {
-        return stoi(a_value, NULL);
+        return OpCodes::ToNumber(a_value);
     }
 
     // Determines if OpCode is legal
     bool OpCodeLookup() {
-        return isAssembly(m_OpCode) || m_MachineOpCodes[m_OpCode];
+        return isAssembly(m_OpCode) || OpCodes::LookupMachine(m_OpCode) != 0;
     }
 
     bool ValidateLabelFormat();
@@ -51,14 +54,13 @@ public:
     // Determines if a label is blank.
     bool isLabel() { return !m_Label.empty(); }
 
-    // Regular expression used to determine if
-    // a string with any sign is a number
+    // Determines if a string with any sign is a number
     bool isNumber(string a_value) {
-        return regex_match(a_value, regex(("((\\+|-)?[[:digit:]]+)(\\.(([[:digit:]]+)?))?")));
+        return OpCodes::IsNumber(a_value);
     }
 
     // Checks if an OpCode is an assembly OpCode
-    bool isAssembly(string a_OpCode);
+    bool isAssembly(string a_OpCode) { return OpCodes::IsAssembly(a_OpCode); }
 
     // Error Overwrite functions
     void SetOpCodeError() { m_OpCode = "??"; }
@@ -68,12 +70,17 @@ public:
     // Sets most member variables to their default values
     void SetDefault();
 
+    // Gives a label or operand beginning with ? a suffix, for a use of a macro.
+    void QualifyLocalLabels(const string& a_suffix);
+
     // Getter Functions
     string& GetLabel() { return m_Label; }
     string& GetOperand() { return m_Operand; }
     string& GetOpCode() { return m_OpCode; }
     int GetOpCodeNum() { return m_NumOpCode; }
     int GetRegisterNum() { return m_NumRegister; }
+    OpCodes::OperandMode GetOperandMode() { return m_OperandMode; }
+    int GetOperandValue() { return m_OperandValue; }
 
 private:
 
@@ -96,12 +103,10 @@ private:
 
     bool m_ExtraOperand = false;       // == true if there is an extra operand
     bool m_IsNumericOperand = false;    // == true if the operand is numeric.
-    int m_OperandValue = -1;     // The value of the operand if it is numeric.
+    int m_OperandValue = -1;     // The value of the operand if it is numeric, a #n value or a $n register.
+    OpCodes::OperandMode m_OperandMode = OpCodes::OM_Memory;   // How the operand is given.
 
-    // The map containing all machine language op codes and their numeric equivalent
-    map<string, int> m_MachineOpCodes = { {"add",1}, {"sub",2}, {"mult",3}, {"div",4}, {"load",5}, {"store", 6}, {"read", 7}, {"write", 8}, {"b", 9}, {"bm", 10}, {"bz", 11}, {"bp", 12}, {"halt", 13} };
-    
-    // The vector containing all assembly language op codes
-    vector<string> m_AssemblyOpCodes = { "dc", "ds", "org", "end" };
+    // The op code tables and the format rules are in OpCodes.h, shared with the
+    // compile time assembler.
 
 };
@@ -0,0 +1,394 @@
+//
+//		Implementation of the Library class.
+//
+#include "stdafx.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "Library.h"
+#include "Assembler.h"
+#include "Binary.h"
+#include "FileAccess.h"
+#include "Hash.h"
+#include "Instruction.h"
+#include "MappedFile.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    const uint32_t LIBRARY_MAGIC = 0x424c4b51;  // "QKLB"
+    const uint32_t LIBRARY_FORMAT = 1;          // Layout version of a library file.
+    const char* const LIBRARY_EXTENSION = ".lib.qac";
+}
+
+map<string, shared_ptr<const Library>> Library::s_loaded;
+
+/*
+NAME
+
+    Library::Load - gets the parsed form of an included file
+
+SYNOPSIS
+
+    shared_ptr<const Library> Library::Load(const string& a_path, const string& a_cacheDir);
+    a_path -> the path of the included file
+    a_cacheDir -> the translation cache directory; empty if there is none
+
+DESCRIPTION
+
+    A library already loaded this run is returned as it is.  Otherwise
+    the cache is checked for the parsed form made from the file as it
+    is now, and only if that misses is the file parsed; the result is
+    then stored in the cache.  Library files share the cache directory,
+    and its size limit, with cached translations.
+
+RETURNS
+
+    The library, or null if the file could not be read
+
+*/
+shared_ptr<const Library> Library::Load(const string& a_path, const string& a_cacheDir)
+{
+    auto loaded = s_loaded.find(a_path);
+    if (loaded != s_loaded.end()) {
+        return loaded->second;
+    }
+
+    uint64_t key;
+    if (!ComputeKey(a_path, key)) {
+        return nullptr;
+    }
+    shared_ptr<Library> library(new Library);
+    library->m_path = a_path;
+
+    string cached = a_cacheDir.empty() ? "" : (fs::path(a_cacheDir) / (Hash::ToHex(key) + LIBRARY_EXTENSION)).string();
+    MappedFile file;
+    if (!cached.empty() && file.Open(cached) && library->Decode(file.GetData(), file.GetSize(), key)) {
+        error_code ec;
+        fs::last_write_time(cached, fs::file_time_type::clock::now(), ec);
+    }
+    else {
+        Stats::Phase phase("Parse library");
+        ifstream in(a_path);
+        if (!in) {
+            return nullptr;
+        }
+        string contents((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        *library = Library();
+        library->m_path = a_path;
+        library->Parse(contents);
+
+        if (!cached.empty()) {
+            error_code ec;
+            fs::create_directories(a_cacheDir, ec);
+            FileAccess::WriteAtomically(cached, library->Encode(key));
+        }
+    }
+
+    s_loaded[a_path] = library;
+    return library;
+}
+
+/*
+NAME
+
+    Library::ResolvePath - finds an included file
+
+SYNOPSIS
+
+    string Library::ResolvePath(const string& a_name, const string& a_sourcePath);
+    a_name -> the operand of the INCLUDE statement
+    a_sourcePath -> the path of the program that includes it
+
+RETURNS
+
+    The absolute path of the included file
+
+*/
+string Library::ResolvePath(const string& a_name, const string& a_sourcePath)
+{
+    fs::path name(a_name);
+    if (name.is_relative()) {
+        name = fs::path(a_sourcePath).parent_path() / name;
+    }
+    error_code ec;
+    fs::path absolute = fs::absolute(name, ec);
+    return (ec ? name : absolute).lexically_normal().string();
+}
+
+/*
+NAME
+
+    Library::DescribeIncludes - describes the files a source includes
+
+SYNOPSIS
+
+    string Library::DescribeIncludes(const string& a_source, const string& a_sourcePath);
+    a_source -> the source program
+    a_sourcePath -> the path of the source program
+
+DESCRIPTION
+
+    Each file named by an INCLUDE statement is described by its path,
+    size and modification time.  A file that cannot be found is
+    described by its path alone.
+
+RETURNS
+
+    The descriptions, one after another
+
+*/
+string Library::DescribeIncludes(const string& a_source, const string& a_sourcePath)
+{
+    string description;
+    Instruction inst;
+    istringstream in(a_source);
+    string line;
+    while (getline(in, line)) {
+        Instruction::InstructionType st = inst.ParseInstruction(line);
+        if (st == Instruction::ST_End) {
+            break;
+        }
+        if (st != Instruction::ST_Include) {
+            continue;
+        }
+        string path = ResolvePath(inst.GetOperand(), a_sourcePath);
+        uint64_t key = 0;
+        ComputeKey(path, key);
+        description += path + '\0' + Hash::ToHex(key) + '\0';
+    }
+    return description;
+}
+
+/*
+NAME
+
+    Library::ComputeKey - computes the cache key of a library
+
+SYNOPSIS
+
+    bool Library::ComputeKey(const string& a_path, uint64_t& a_key);
+    a_path -> the path of the library
+    a_key -> the key computed
+
+DESCRIPTION
+
+    The key covers the version of the assembler and the path, size and
+    modification time of the file, so the file is not read to find
+    its key.
+
+RETURNS
+
+    Whether the file exists
+
+*/
+bool Library::ComputeKey(const string& a_path, uint64_t& a_key)
+{
+    error_code ec;
+    uintmax_t size = fs::file_size(a_path, ec);
+    if (ec) {
+        return false;
+    }
+    long long modified = (long long)fs::last_write_time(a_path, ec).time_since_epoch().count();
+    if (ec) {
+        return false;
+    }
+
+    a_key = Hash::Fnv1a(Assembler::VERSION, strlen(Assembler::VERSION));
+    a_key = Hash::Fnv1a(a_path.data(), a_path.size(), a_key);
+    a_key = Hash::Fnv1a(&size, sizeof(size), a_key);
+    a_key = Hash::Fnv1a(&modified, sizeof(modified), a_key);
+    return true;
+}
+
+/*
+NAME
+
+    Library::Parse - parses an included file
+
+SYNOPSIS
+
+    void Library::Parse(const string& a_contents);
+    a_contents -> the contents of the file
+
+DESCRIPTION
+
+    This function lays the library out from location 0, recording its
+    labels and the statements that generate words, and applies the
+    checks of Assembler::ErrorProccessing.  Labels used as operands are
+    kept by name, since they may be defined by the including program.
+    An END statement ends the library.
+
+*/
+void Library::Parse(const string& a_contents)
+{
+    string name = fs::path(m_path).filename().string();
+    Instruction inst;
+    istringstream in(a_contents);
+    string line;
+    int number = 0;
+    int loc = 0;
+
+    while (getline(in, line)) {
+        number++;
+        Instruction::InstructionType st = inst.ParseInstruction(line);
+        if (st == Instruction::ST_Comment) {
+            continue;
+        }
+        if (st == Instruction::ST_End) {
+            break;
+        }
+
+        string where = name + " line " + to_string(number) + ": ";
+        if (st == Instruction::ST_Include) {
+            m_errors.push_back(where + "Included files may not include other files");
+            continue;
+        }
+        if (inst.GetOpCode() == "extern" || inst.GetOpCode() == "entry") {
+            m_errors.push_back(where + "Included files may not import or export labels");
+            continue;
+        }
+        if (st == Instruction::ST_Error) {
+            m_errors.push_back(where + "Program uses an illegal OpCode");
+            continue;
+        }
+        if (!inst.ValidateLabelFormat()) {
+            m_errors.push_back(where + "Program has illegal label");
+        }
+        if (!inst.ValidateOperandFormat()) {
+            m_errors.push_back(where + "Program has illegal Operand");
+        }
+        if (inst.MissingOrExtraOperand()) {
+            m_errors.push_back(where + "Program has Extra or Missing Operand");
+        }
+        if (st == Instruction::ST_MachineLanguage && !inst.ValidateRegisterFormat()) {
+            m_errors.push_back(where + "Program has illegal Register");
+        }
+        if (inst.isLabel() && !m_symbols.emplace(inst.GetLabel(), loc).second) {
+            m_errors.push_back(where + "Program has multiply defined labels");
+        }
+
+        if (st == Instruction::ST_MachineLanguage) {
+            bool symbolic = inst.GetOperandMode() == OpCodes::OM_Memory;
+            m_statements.push_back({ loc, number, line, true, inst.GetOpCodeNum(), inst.GetRegisterNum(),
+                symbolic ? 0 : inst.GetOperandValue(), symbolic ? inst.GetOperand() : "" });
+        }
+        else if (inst.GetOpCode() == "dc" && inst.isNumber(inst.GetOperand())) {
+            m_statements.push_back({ loc, number, line, false, 0, 0, inst.ConvertToNumeric(inst.GetOperand()), "" });
+        }
+        loc = inst.LocationNextInstruction(loc);
+        m_size = max(m_size, loc);
+    }
+}
+
+/*
+NAME
+
+    Library::Decode - reads the parsed form of a library
+
+SYNOPSIS
+
+    bool Library::Decode(const unsigned char* a_data, size_t a_size, uint64_t a_key);
+    a_data -> the bytes of a cached library
+    a_size -> the number of bytes
+    a_key -> the key the library must have
+
+DESCRIPTION
+
+    The bytes are checked as AsmCache::Lookup checks a cached
+    translation: by checksum, format and key.
+
+RETURNS
+
+    Whether the bytes held the library
+
+*/
+bool Library::Decode(const unsigned char* a_data, size_t a_size, uint64_t a_key)
+{
+    if (a_size < 2 * sizeof(uint64_t)) {
+        return false;
+    }
+    size_t payload = a_size - sizeof(uint64_t);
+    uint64_t checksum;
+    memcpy(&checksum, a_data + payload, sizeof(checksum));
+    if (checksum != Hash::Fnv1a(a_data, payload)) {
+        return false;
+    }
+
+    BinaryReader in(a_data, payload);
+    if (in.GetUInt32() != LIBRARY_MAGIC || in.GetUInt32() != LIBRARY_FORMAT || in.GetUInt64() != a_key) {
+        return false;
+    }
+
+    m_size = in.GetInt32();
+    uint32_t count = in.GetUInt32();
+    for (uint32_t i = 0; i < count && !in.Failed(); i++) {
+        Statement statement;
+        statement.m_offset = in.GetInt32();
+        statement.m_line = in.GetInt32();
+        statement.m_text = in.GetString();
+        statement.m_isCode = in.GetByte() != 0;
+        statement.m_opcode = in.GetInt32();
+        statement.m_register = in.GetInt32();
+        statement.m_value = in.GetInt32();
+        statement.m_operand = in.GetString();
+        m_statements.push_back(move(statement));
+    }
+    count = in.GetUInt32();
+    for (uint32_t i = 0; i < count && !in.Failed(); i++) {
+        string symbol = in.GetString();
+        m_symbols[symbol] = in.GetInt32();
+    }
+    count = in.GetUInt32();
+    for (uint32_t i = 0; i < count && !in.Failed(); i++) {
+        m_errors.push_back(in.GetString());
+    }
+    return !in.Failed();
+}
+
+/*
+NAME
+
+    Library::Encode - writes the parsed form of a library
+
+SYNOPSIS
+
+    string Library::Encode(uint64_t a_key) const;
+    a_key -> the key of the library
+
+RETURNS
+
+    The bytes to be cached
+
+*/
+string Library::Encode(uint64_t a_key) const
+{
+    BinaryWriter out;
+    out.PutUInt32(LIBRARY_MAGIC);
+    out.PutUInt32(LIBRARY_FORMAT);
+    out.PutUInt64(a_key);
+
+    out.PutInt32(m_size);
+    out.PutUInt32((uint32_t)m_statements.size());
+    for (const Statement& statement : m_statements) {
+        out.PutInt32(statement.m_offset);
+        out.PutInt32(statement.m_line);
+        out.PutString(statement.m_text);
+        out.PutByte(statement.m_isCode ? 1 : 0);
+        out.PutInt32(statement.m_opcode);
+        out.PutInt32(statement.m_register);
+        out.PutInt32(statement.m_value);
+        out.PutString(statement.m_operand);
+    }
+    out.PutUInt32((uint32_t)m_symbols.size());
+    for (const auto& symbol : m_symbols) {
+        out.PutString(symbol.first);
+        out.PutInt32(symbol.second);
+    }
+    out.PutUInt32((uint32_t)m_errors.size());
+    for (const string& message : m_errors) {
+        out.PutString(message);
+    }
+    out.PutUInt64(Hash::Fnv1a(out.GetBytes().data(), out.GetBytes().size()));
+    return out.GetBytes();
+}
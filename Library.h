@@ -0,0 +1,70 @@
+//
+//		Class to hold a file named by an INCLUDE statement in parsed form.  A library
+//		is laid out from location 0 so it can be placed wherever it is included, and
+//		its labels are relative to its start.  A library is parsed at most once a
+//		run, and if a translation cache is named it is kept there in parsed form,
+//		keyed by its path, size and modification time, so an unchanged library is
+//		not parsed again by later runs either.
+//
+#pragma once
+
+#include <memory>
+#include <stdint.h>
+#include "MemoryImage.h"
+
+class Library {
+
+public:
+
+    // A statement of the library that generates a word.
+    struct Statement {
+        int m_offset;           // The location relative to the start of the library.
+        int m_line;             // The line number in the library.
+        string m_text;          // The original statement.
+        bool m_isCode;          // == true for an instruction; false for a constant.
+        int m_opcode;           // The numeric op code, including its operand form.
+        int m_register;         // The register.
+        int m_value;            // The constant, or the value or register given as the operand.
+        string m_operand;       // The label the instruction refers to; empty if none.
+    };
+
+    // Returns the library in a_path, parsing it only if it is neither loaded nor in
+    // the cache directory a_cacheDir.  Returns null if the file cannot be read.
+    static shared_ptr<const Library> Load(const string& a_path, const string& a_cacheDir);
+
+    // Finds an included file.  A relative name is relative to the including source.
+    static string ResolvePath(const string& a_name, const string& a_sourcePath);
+
+    // Describes the files a source includes by path, size and modification time, so
+    // a cached translation is not reused once a library changes.
+    static string DescribeIncludes(const string& a_source, const string& a_sourcePath);
+
+    // Getter Functions
+    const string& GetPath() const { return m_path; }
+    const vector<Statement>& GetStatements() const { return m_statements; }
+    const map<string, int>& GetSymbols() const { return m_symbols; }
+    const vector<string>& GetErrors() const { return m_errors; }
+    int GetSize() const { return m_size; }
+
+private:
+
+    Library() {};
+
+    // Computes the cache key of a library from its path, size and modification time.
+    static bool ComputeKey(const string& a_path, uint64_t& a_key);
+
+    // Parses the contents of the library, recording the errors found.
+    void Parse(const string& a_contents);
+
+    // Reads and writes the parsed form.
+    bool Decode(const unsigned char* a_data, size_t a_size, uint64_t a_key);
+    string Encode(uint64_t a_key) const;
+
+    string m_path;                      // The path of the library.
+    vector<Statement> m_statements;     // The statements that generate words.
+    map<string, int> m_symbols;         // The labels and their locations relative to the start.
+    vector<string> m_errors;            // The errors found, with the line of each.
+    int m_size = 0;                     // The number of locations the library occupies.
+
+    static map<string, shared_ptr<const Library>> s_loaded;     // The libraries loaded this run.
+};
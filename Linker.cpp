@@ -0,0 +1,266 @@
+//
+//		Implementation of the Linker class.
+//
+#include "stdafx.h"
+#include <thread>
+#include "Linker.h"
+#include "Errors.h"
+#include "Stats.h"
+
+/*
+NAME
+
+    Linker::Link - links the modules
+
+SYNOPSIS
+
+    bool Linker::Link();
+
+DESCRIPTION
+
+    This function reads the modules, places them one after another,
+    resolves the labels each imports and relocates their instructions
+    into one translation.  Errors are recorded with the name of the
+    module they were found in.
+
+RETURNS
+
+    Whether the modules were linked without errors
+
+*/
+bool Linker::Link()
+{
+    if (!ReadModules() || !ResolveSymbols()) {
+        return false;
+    }
+
+    Stats::Phase phase("Relocate");
+    m_image.GetWords().resize(m_firstWords.back());
+    vector<char> fits(m_modules.size(), 1);
+    ForEachModule([&](size_t a_module) { fits[a_module] = Relocate(a_module) ? 1 : 0; });
+
+    bool linked = true;
+    for (size_t i = 0; i < m_modules.size(); i++) {
+        m_relocationCount += m_modules[i].m_relocations.size();
+        if (!fits[i]) {
+            Errors::RecordError("Module " + m_modules[i].m_name + " refers to a location outside memory");
+            linked = false;
+        }
+    }
+    Stats::SetCounter("modules", (long long)m_modules.size());
+    Stats::SetCounter("relocations", m_relocationCount);
+    return linked;
+}
+
+/*
+NAME
+
+    Linker::DisplayModuleMap - displays where each module was placed
+
+SYNOPSIS
+
+    void Linker::DisplayModuleMap() const;
+
+*/
+void Linker::DisplayModuleMap() const
+{
+    cout << "Module Map:" << endl << endl;
+    cout << left << setw(20) << "Module" << setw(10) << "Location" << "Size" << endl;
+    for (size_t i = 0; i < m_bases.size(); i++) {
+        cout << left << setw(20) << m_modules[i].m_name << setw(10) << m_bases[i] << m_modules[i].m_size << endl;
+    }
+    cout << right << "__________________________________________________________" << endl << endl;
+}
+
+/*
+NAME
+
+    Linker::ReadModules - reads every module
+
+SYNOPSIS
+
+    bool Linker::ReadModules();
+
+RETURNS
+
+    Whether every module could be read
+
+*/
+bool Linker::ReadModules()
+{
+    Stats::Phase phase("Read objects");
+    m_modules.resize(m_fileNames.size());
+    vector<char> read(m_fileNames.size(), 0);
+    ForEachModule([&](size_t a_module) {
+        read[a_module] = ObjectFile::Read(m_fileNames[a_module], m_modules[a_module]) ? 1 : 0;
+    });
+
+    bool all = true;
+    for (size_t i = 0; i < m_fileNames.size(); i++) {
+        if (!read[i]) {
+            Errors::RecordError("Object file " + m_fileNames[i] + " could not be read");
+            all = false;
+        }
+    }
+    return all;
+}
+
+/*
+NAME
+
+    Linker::ResolveSymbols - places the modules and matches their labels
+
+SYNOPSIS
+
+    bool Linker::ResolveSymbols();
+
+DESCRIPTION
+
+    Each module is placed after the one before it.  The labels each
+    module exports are then given their final locations, and every
+    imported label is looked up among them.  A label exported by two
+    modules, an import that no module exports and modules that do not
+    fit in memory are errors.
+
+RETURNS
+
+    Whether every label was resolved
+
+*/
+bool Linker::ResolveSymbols()
+{
+    Stats::Phase phase("Resolve symbols");
+    bool resolved = true;
+
+    int base = 0;
+    size_t words = 0;
+    for (const ObjectFile::Module& module : m_modules) {
+        m_bases.push_back(base);
+        m_firstWords.push_back(words);
+        base += module.m_size;
+        words += module.m_image.GetWords().size();
+    }
+    m_firstWords.push_back(words);
+    if (base > emulator::MEMSZ) {
+        Errors::RecordError("The modules need " + to_string(base) + " locations, more than there are in memory");
+        resolved = false;
+    }
+
+    for (size_t i = 0; i < m_modules.size(); i++) {
+        for (const auto& symbol : m_modules[i].m_exports) {
+            auto exporter = m_exporters.emplace(symbol.first, i);
+            if (!exporter.second) {
+                Errors::RecordError("Module " + m_modules[i].m_name + " exports \"" + symbol.first +
+                    "\", which module " + m_modules[exporter.first->second].m_name + " also exports");
+                resolved = false;
+                continue;
+            }
+            m_symbols[symbol.first] = m_bases[i] + symbol.second;
+        }
+    }
+
+    m_importLocations.resize(m_modules.size());
+    for (size_t i = 0; i < m_modules.size(); i++) {
+        for (const string& symbol : m_modules[i].m_imports) {
+            auto found = m_symbols.find(symbol);
+            if (found == m_symbols.end()) {
+                Errors::RecordError("Module " + m_modules[i].m_name + " imports the undefined label \"" + symbol + "\"");
+                resolved = false;
+            }
+            m_importLocations[i].push_back(found == m_symbols.end() ? 0 : found->second);
+        }
+    }
+    return resolved;
+}
+
+/*
+NAME
+
+    Linker::Relocate - places a module in the image
+
+SYNOPSIS
+
+    bool Linker::Relocate(size_t a_module);
+    a_module -> the index of the module
+
+DESCRIPTION
+
+    The words of the module are copied to their own part of the image,
+    moved by the location of the module.  An instruction referring to
+    a label of the module has the location of the module added to its
+    address; one referring to an imported label is given the label's
+    location.  Modules share nothing that is written, so several may be
+    relocated at once.
+
+RETURNS
+
+    Whether every address fits in memory
+
+*/
+bool Linker::Relocate(size_t a_module)
+{
+    const ObjectFile::Module& module = m_modules[a_module];
+    const vector<MemoryImage::Word>& words = module.m_image.GetWords();
+    vector<MemoryImage::Word>& image = m_image.GetWords();
+    int base = m_bases[a_module];
+    size_t first = m_firstWords[a_module];
+
+    for (size_t i = 0; i < words.size(); i++) {
+        image[first + i] = { words[i].m_loc + base, words[i].m_contents, words[i].m_isCode };
+    }
+
+    bool fits = true;
+    for (const ObjectFile::Relocation& relocation : module.m_relocations) {
+        MemoryImage::Word& word = image[first + relocation.m_word];
+        int address = emulator::Encoding::Address(word.m_contents);
+        address = relocation.m_import < 0 ? address + base : m_importLocations[a_module][relocation.m_import];
+        if (address >= emulator::MEMSZ) {
+            fits = false;
+            continue;
+        }
+        word.m_contents = emulator::Encoding::Encode(emulator::Encoding::OpCode(word.m_contents),
+            emulator::Encoding::Register(word.m_contents), address);
+    }
+    return fits;
+}
+
+/*
+NAME
+
+    Linker::ForEachModule - works on several modules at once
+
+SYNOPSIS
+
+    void Linker::ForEachModule(const function<void(size_t)>& a_function) const;
+    a_function -> the work to be done for a module, given its index
+
+DESCRIPTION
+
+    The modules are dealt out to one thread per host core, each taking
+    every n-th module.  a_function must only change what belongs to the
+    module it is given.
+
+*/
+void Linker::ForEachModule(const function<void(size_t)>& a_function) const
+{
+    size_t count = m_fileNames.size();
+    size_t threads = min<size_t>(count, max(1u, thread::hardware_concurrency()));
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; i++) {
+            a_function(i);
+        }
+        return;
+    }
+
+    vector<thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            for (size_t i = t; i < count; i += threads) {
+                a_function(i);
+            }
+        });
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
@@ -0,0 +1,55 @@
+//
+//		Class to link relocatable modules into one translation.  The modules are
+//		placed one after another in the order given, so the first module is at
+//		location 0 and its ORG decides where the program begins.  Reading the
+//		modules and relocating them are done for several modules at once; only
+//		placing them and matching imports with exports is done in order.
+//
+#pragma once
+
+#include <functional>
+#include "ObjectFile.h"
+
+class Linker {
+
+public:
+
+    Linker(const vector<string>& a_fileNames) : m_fileNames(a_fileNames) {};
+    ~Linker() {};
+
+    // Links the modules, recording the errors found.  Returns false if there were any.
+    bool Link();
+
+    // Displays where each module was placed.
+    void DisplayModuleMap() const;
+
+    // Getter Functions
+    const MemoryImage& GetImage() const { return m_image; }
+    const map<string, int>& GetSymbols() const { return m_symbols; }
+    long long GetRelocationCount() const { return m_relocationCount; }
+
+private:
+
+    // Reads every module.
+    bool ReadModules();
+
+    // Places the modules and finds the location of every exported label.
+    bool ResolveSymbols();
+
+    // Copies a module into its place in the image, relocating its instructions.
+    // Returns false if an address does not fit in memory.
+    bool Relocate(size_t a_module);
+
+    // Calls a_function for each module, spread over the host's cores.
+    void ForEachModule(const function<void(size_t)>& a_function) const;
+
+    vector<string> m_fileNames;                 // The object files in the order they are placed.
+    vector<ObjectFile::Module> m_modules;       // The modules read from them.
+    vector<int> m_bases;                        // The location of each module.
+    vector<size_t> m_firstWords;                // The index in the image of each module's first word.
+    vector<vector<int>> m_importLocations;      // The location of each label imported by each module.
+    map<string, int> m_symbols;                 // The exported labels and their locations.
+    map<string, size_t> m_exporters;            // The module that exports each label.
+    MemoryImage m_image;                        // The linked translation.
+    long long m_relocationCount = 0;            // The number of instructions relocated.
+};
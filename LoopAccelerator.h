@@ -0,0 +1,388 @@
+//
+//		Skips the iterations of simple counting loops.  When a BM or BP goes back to
+//		an earlier location, the instructions from there to the branch are a loop.
+//		If they only load, store, add and subtract, each register and word they
+//		change ends an iteration as a fixed value, or as one value from the start of
+//		the iteration plus a fixed step.  The iteration after which the branch
+//		register no longer satisfies the branch is then found by division, and the
+//		state after all the iterations before it is computed directly, wrapping as
+//		adding the step that many times would.  The interpreter runs the last
+//		iteration, so the loop is left exactly as it would have been.
+//
+//		Each loop is analyzed once and remembered with its instructions, which are
+//		compared each time it is met, so a loop that changes is analyzed again.
+//
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <vector>
+using namespace std;
+
+template<typename Word, typename Encoding, int a_RegCount>
+class LoopAccelerator {
+
+public:
+
+    LoopAccelerator() : m_loops(TABLE_SIZE) {}
+
+    // Skips iterations of the loop from a_start to the branch at a_branch, which has
+    // just gone back to a_start, changing a_memory and a_reg as they would have.  At
+    // most a_budget instructions are skipped.  Returns the instructions skipped.  A
+    // loop known not to be skippable is passed over here, at the cost of a compare.
+    long long Skip(Word* a_memory, Word* a_reg, int a_start, int a_branch, long long a_budget) {
+        Loop& loop = m_loops[a_branch & (TABLE_SIZE - 1)];
+        if (loop.m_branch == a_branch && loop.m_start == a_start && !loop.m_skippable && --loop.m_retry > 0) {
+            return 0;
+        }
+        return SkipLoop(loop, a_memory, a_reg, a_start, a_branch, a_budget);
+    }
+
+    // The iterations skipped so far.
+    long long GetSkipped() const { return m_skipped; }
+
+private:
+
+    typedef typename make_unsigned<Word>::type UWord;
+
+    static const int MAX_BODY = 64;         // The most instructions in a loop analyzed.
+    static const int MAX_TERMS = 64;        // The most invariants in one value.
+    static const int TABLE_SIZE = 256;      // The loops remembered; a power of two.
+    static const int RETRY = 1024;          // Times a loop that cannot be skipped is passed over before it is compared again.
+
+    // A value at the end of an iteration: a variable's value at its start, or 0, plus a
+    // constant and the values of variables the loop does not change.  Variables are the
+    // registers, then the words of memory the loop uses.
+    struct Affine {
+        int m_base = -1;                    // The variable, or -1 for none.
+        UWord m_constant = 0;               // The constant added.
+        vector<pair<int, bool>> m_terms;    // The unchanged variables, each added if true, else subtracted.
+    };
+
+    // A loop, as analyzed.
+    struct Loop {
+        int m_branch = -1;                  // The location of the branch; -1 if the entry is unused.
+        int m_start = 0;                    // The location it branches back to.
+        vector<Word> m_code;                // The instructions when it was analyzed.
+        bool m_skippable = false;           // == true if its iterations can be skipped.
+        int m_retry = 0;                    // Passes left before a loop that cannot be skipped is compared again.
+        vector<int> m_addresses;            // The words of memory it uses.
+        vector<pair<int, Affine>> m_effects;    // Each variable it changes, with its value after an iteration.
+        vector<int> m_sources;              // For each effect, the effect of the variable it copies; -1 if none.
+        int m_condition = -1;               // The effect of the branch register.
+    };
+
+    // Skips iterations of a loop, analyzing it first if it is new or has changed.
+    long long SkipLoop(Loop& a_loop, Word* a_memory, Word* a_reg, int a_start, int a_branch, long long a_budget);
+
+    // Analyzes the loop from a_start to a_branch into a_loop.
+    void Analyze(Loop& a_loop, const Word* a_memory, int a_start, int a_branch);
+
+    // Adds or subtracts a_value from a_target.  Returns false if the result would
+    // depend on two variables, or on one subtracted.
+    static bool Combine(Affine& a_target, const Affine& a_value, bool a_add);
+
+    // Computes the constant part of a value from the current state.
+    UWord Step(const Loop& a_loop, const Affine& a_value, const Word* a_memory, const Word* a_reg) const {
+        UWord step = a_value.m_constant;
+        for (const pair<int, bool>& term : a_value.m_terms) {
+            UWord value = (UWord)Current(a_loop, term.first, a_memory, a_reg);
+            step = term.second ? step + value : step - value;
+        }
+        return step;
+    }
+
+    // Returns the current value of a variable.
+    static Word Current(const Loop& a_loop, int a_variable, const Word* a_memory, const Word* a_reg) {
+        return a_variable < a_RegCount ? a_reg[a_variable] : a_memory[a_loop.m_addresses[a_variable - a_RegCount]];
+    }
+
+    vector<Loop> m_loops;               // The loops remembered, by the location of the branch.
+    vector<UWord> m_values;             // The values computed for the variables a loop changes.
+    long long m_skipped = 0;            // The iterations skipped.
+};
+
+/*
+NAME
+
+    LoopAccelerator::SkipLoop - skips iterations of a loop
+
+SYNOPSIS
+
+    long long LoopAccelerator::SkipLoop(Loop& a_loop, Word* a_memory, Word* a_reg, int a_start, int a_branch, long long a_budget);
+    a_loop -> the loop's entry in the table
+    a_memory -> the memory of the machine
+    a_reg -> the registers of the machine
+    a_start -> the location the branch went back to
+    a_branch -> the location of the BM or BP
+    a_budget -> the most instructions to skip
+
+DESCRIPTION
+
+    The branch register takes the values A + i * D after the iterations
+    i = 1, 2, ...  The iterations that leave it satisfying the branch
+    are counted: a BP counting down is left when the register reaches 0,
+    and one counting up when the register wraps past the largest value;
+    a BM the same the other way.  All of them are skipped but the last,
+    so that the interpreter executes the one that leaves the loop, and
+    only whole iterations are skipped within the budget.  A variable
+    that steps by D is left with its value plus the skipped iterations
+    times D, and one that copies such a variable is left with the copy
+    it made in the last of them.
+
+RETURNS
+
+    The instructions skipped
+
+*/
+template<typename Word, typename Encoding, int a_RegCount>
+long long LoopAccelerator<Word, Encoding, a_RegCount>::SkipLoop(Loop& a_loop, Word* a_memory, Word* a_reg, int a_start, int a_branch, long long a_budget)
+{
+    bool same = a_loop.m_branch == a_branch && a_loop.m_start == a_start;
+    if (!same || !equal(a_loop.m_code.begin(), a_loop.m_code.end(), a_memory + a_start)) {
+        Analyze(a_loop, a_memory, a_start, a_branch);
+    }
+    if (!a_loop.m_skippable) {
+        a_loop.m_retry = RETRY;
+        return 0;
+    }
+
+    // The branch register after each iteration.
+    int variable = a_loop.m_effects[a_loop.m_condition].first;
+    const Affine& condition = a_loop.m_effects[a_loop.m_condition].second;
+    UWord start, step;
+    if (condition.m_base == variable) {
+        step = Step(a_loop, condition, a_memory, a_reg);
+        start = (UWord)Current(a_loop, variable, a_memory, a_reg);
+    }
+    else {
+        step = Step(a_loop, a_loop.m_effects[a_loop.m_sources[a_loop.m_condition]].second, a_memory, a_reg);
+        start = (UWord)Current(a_loop, condition.m_base, a_memory, a_reg) + Step(a_loop, condition, a_memory, a_reg) - step;
+    }
+    Word first = (Word)(start + step);
+    Word delta = (Word)step;
+
+    // The iterations that satisfy the branch before the one that leaves the a_loop.
+    UWord iterations;
+    if (delta == 0) {
+        return 0;
+    }
+    if (Encoding::OpCode(a_memory[a_branch]) == 12) {
+        if (first <= 0) {
+            return 0;
+        }
+        iterations = delta < 0 ? ((UWord)first - 1) / (0 - step) + 1 : ((UWord)(numeric_limits<Word>::max)() - (UWord)first) / step + 1;
+    }
+    else {
+        if (first >= 0) {
+            return 0;
+        }
+        iterations = delta > 0 ? (0 - (UWord)first - 1) / step + 1 : ((UWord)first - (UWord)(numeric_limits<Word>::min)()) / (0 - step) + 1;
+    }
+    int length = a_branch - a_start + 1;
+    unsigned long long skipped = min<unsigned long long>(iterations, a_budget < 0 ? 0 : a_budget / length);
+    if (skipped < 2) {
+        return 0;
+    }
+
+    // The values are all computed from the state before they are stored.
+    m_values.resize(a_loop.m_effects.size());
+    for (size_t i = 0; i < a_loop.m_effects.size(); i++) {
+        int target = a_loop.m_effects[i].first;
+        const Affine& value = a_loop.m_effects[i].second;
+        UWord constant = Step(a_loop, value, a_memory, a_reg);
+        if (value.m_base < 0) {
+            m_values[i] = constant;
+        }
+        else if (value.m_base == target) {
+            m_values[i] = (UWord)Current(a_loop, target, a_memory, a_reg) + (UWord)skipped * constant;
+        }
+        else {
+            const Affine& source = a_loop.m_effects[a_loop.m_sources[i]].second;
+            UWord sourceStep = Step(a_loop, source, a_memory, a_reg);
+            m_values[i] = source.m_base < 0 ? sourceStep + constant :
+                (UWord)Current(a_loop, value.m_base, a_memory, a_reg) + (UWord)(skipped - 1) * sourceStep + constant;
+        }
+    }
+    for (size_t i = 0; i < a_loop.m_effects.size(); i++) {
+        int target = a_loop.m_effects[i].first;
+        if (target < a_RegCount) {
+            a_reg[target] = (Word)m_values[i];
+        }
+        else {
+            a_memory[a_loop.m_addresses[target - a_RegCount]] = (Word)m_values[i];
+        }
+    }
+    m_skipped += (long long)skipped;
+    return (long long)skipped * length;
+}
+
+/*
+NAME
+
+    LoopAccelerator::Analyze - analyzes a loop
+
+SYNOPSIS
+
+    void LoopAccelerator::Analyze(Loop& a_loop, const Word* a_memory, int a_start, int a_branch);
+    a_loop <- the analysis
+    a_memory -> the memory of the machine
+    a_start -> the location the branch goes back to
+    a_branch -> the location of the branch
+
+DESCRIPTION
+
+    The loop is executed once symbolically, each variable it changes
+    starting as itself.  A variable it does not change is an invariant,
+    read when the loop is skipped.  The loop can be skipped if it has
+    only loads, stores, adds and subtracts, stores into none of its own
+    instructions, and leaves each variable it changes as a fixed value,
+    itself plus a step, or a copy of one that is.  The branch register
+    must step, or copy one that does.
+
+*/
+template<typename Word, typename Encoding, int a_RegCount>
+void LoopAccelerator<Word, Encoding, a_RegCount>::Analyze(Loop& a_loop, const Word* a_memory, int a_start, int a_branch)
+{
+    a_loop.m_branch = a_branch;
+    a_loop.m_start = a_start;
+    a_loop.m_code.assign(a_memory + a_start, a_memory + a_branch + 1);
+    a_loop.m_skippable = false;
+    a_loop.m_addresses.clear();
+    a_loop.m_effects.clear();
+    a_loop.m_sources.clear();
+    if (a_branch - a_start > MAX_BODY) {
+        return;
+    }
+
+    // Returns the variable of a word of memory.
+    auto memoryVariable = [&](int a_address) {
+        auto found = find(a_loop.m_addresses.begin(), a_loop.m_addresses.end(), a_address);
+        if (found == a_loop.m_addresses.end()) {
+            a_loop.m_addresses.push_back(a_address);
+            return a_RegCount + (int)a_loop.m_addresses.size() - 1;
+        }
+        return a_RegCount + (int)(found - a_loop.m_addresses.begin());
+    };
+
+    // Find the variables and those the loop changes.
+    vector<int> changed;
+    for (int loc = a_start; loc < a_branch; loc++) {
+        int opcode = Encoding::OpCode(a_memory[loc]);
+        int reg = Encoding::Register(a_memory[loc]);
+        int address = Encoding::Address(a_memory[loc]);
+        switch (opcode) {
+        case 1: case 2: case 5:
+            memoryVariable(address);
+            changed.push_back(reg);
+            break;
+        case 6:
+            if (address >= a_start && address <= a_branch) {
+                return;
+            }
+            changed.push_back(memoryVariable(address));
+            break;
+        case 20: case 21: case 24: case 25: case 26: case 29:
+            changed.push_back(reg);
+            break;
+        default:
+            return;
+        }
+    }
+    vector<char> isChanged(a_RegCount + a_loop.m_addresses.size(), 0);
+    for (int variable : changed) {
+        isChanged[variable] = 1;
+    }
+
+    // Execute an iteration symbolically.
+    vector<Affine> state(isChanged.size());
+    for (size_t variable = 0; variable < state.size(); variable++) {
+        state[variable].m_base = (int)variable;
+    }
+    auto value = [&](int a_variable) {
+        Affine result;
+        if (isChanged[a_variable]) {
+            result = state[a_variable];
+        }
+        else {
+            result.m_terms.push_back({ a_variable, true });
+        }
+        return result;
+    };
+    for (int loc = a_start; loc < a_branch; loc++) {
+        int opcode = Encoding::OpCode(a_memory[loc]);
+        int reg = Encoding::Register(a_memory[loc]);
+        int address = Encoding::Address(a_memory[loc]);
+        int source = address % a_RegCount;
+        bool combined = true;
+        switch (opcode) {
+        case 1: case 2:
+            combined = Combine(state[reg], value(memoryVariable(address)), opcode == 1);
+            break;
+        case 5:
+            state[reg] = value(memoryVariable(address));
+            break;
+        case 6:
+            state[memoryVariable(address)] = value(reg);
+            break;
+        case 20: case 21:
+            combined = Combine(state[reg], Affine{ -1, (UWord)address, {} }, opcode == 20);
+            break;
+        case 24:
+            state[reg] = Affine{ -1, (UWord)address, {} };
+            break;
+        case 25: case 26:
+            combined = Combine(state[reg], value(source), opcode == 25);
+            break;
+        case 29:
+            state[reg] = value(source);
+            break;
+        }
+        if (!combined || state[reg].m_terms.size() > (size_t)MAX_TERMS) {
+            return;
+        }
+    }
+
+    // Each value must be fixed, step, or copy a variable that steps or is fixed.
+    vector<int> effectOf(isChanged.size(), -1);
+    for (size_t variable = 0; variable < isChanged.size(); variable++) {
+        if (isChanged[variable]) {
+            effectOf[variable] = (int)a_loop.m_effects.size();
+            a_loop.m_effects.push_back({ (int)variable, state[variable] });
+        }
+    }
+    for (const pair<int, Affine>& effect : a_loop.m_effects) {
+        int base = effect.second.m_base;
+        if (base >= 0 && base != effect.first && state[base].m_base >= 0 && state[base].m_base != base) {
+            return;
+        }
+        a_loop.m_sources.push_back(base >= 0 && base != effect.first ? effectOf[base] : -1);
+    }
+
+    // The branch register must change by a step each iteration.
+    int reg = Encoding::Register(a_memory[a_branch]);
+    a_loop.m_condition = effectOf[reg];
+    if (a_loop.m_condition < 0) {
+        return;
+    }
+    int base = state[reg].m_base;
+    a_loop.m_skippable = base == reg || (base >= 0 && state[base].m_base == base);
+}
+
+// Adds or subtracts a value, which must not make the result depend on two variables.
+template<typename Word, typename Encoding, int a_RegCount>
+bool LoopAccelerator<Word, Encoding, a_RegCount>::Combine(Affine& a_target, const Affine& a_value, bool a_add)
+{
+    if (a_value.m_base >= 0) {
+        if (!a_add || a_target.m_base >= 0) {
+            return false;
+        }
+        a_target.m_base = a_value.m_base;
+    }
+    a_target.m_constant = a_add ? a_target.m_constant + a_value.m_constant : a_target.m_constant - a_value.m_constant;
+    for (const pair<int, bool>& term : a_value.m_terms) {
+        a_target.m_terms.push_back({ term.first, term.second == a_add });
+    }
+    return true;
+}
@@ -0,0 +1,129 @@
+//
+//		Hooks for the emulator that stop a program once it is in an infinite loop.
+//		The Quack3200 is deterministic, so a program that returns to an earlier
+//		state (location, registers, memory and input consumed) will repeat forever.
+//
+//		The state is fingerprinted every so many instructions and the fingerprints
+//		are checked for a repeat with Brent's algorithm.  The memory part of the
+//		fingerprint is a Zobrist-style hash.  A store only marks its word, keeping the
+//		value it replaced; the words marked are rehashed at the next fingerprint, so
+//		a fingerprint costs the same however large memory is, and a store costs a
+//		test of its mark.  A matching fingerprint is confirmed against a full copy of
+//		the state before the program is stopped.
+//
+#pragma once
+
+#include <algorithm>
+#include <stdint.h>
+#include "Emulator.h"
+#include "Hash.h"
+
+template<typename Machine>
+class LoopDetector : public EmulatorBase::NoHooks {
+
+public:
+
+    typedef typename Machine::Word Word;
+
+    // Fingerprints the state of a_machine every a_interval instructions.
+    LoopDetector(const Machine& a_machine, long long a_interval = 4096) :
+        m_interval(a_interval > 0 ? a_interval : 1), m_nextCheck(a_machine.GetSteps()), m_stored(Machine::MEMSZ, 0)
+    {
+        const Word* memory = a_machine.GetMemory();
+        for (int loc = 0; loc < Machine::MEMSZ; loc++) {
+            m_memoryHash ^= WordHash(loc, memory[loc]);
+        }
+    }
+
+    // Checks for a repeated state every m_interval instructions.
+    bool BeforeInstruction(const Machine& a_machine, int a_loc, long long a_steps, EmulatorBase::RunResult& a_result) {
+        if (a_steps < m_nextCheck) {
+            return false;
+        }
+        m_nextCheck = a_steps + m_interval;
+        UpdateMemoryHash(a_machine);
+
+        uint64_t fingerprint = Fingerprint(a_machine, a_loc);
+        if (fingerprint == m_savedFingerprint && IsSavedState(a_machine, a_loc)) {
+            a_result = EmulatorBase::RR_InfiniteLoop;
+            return true;
+        }
+
+        // Brent's algorithm: keep the state at each power of two and compare later
+        // states with it, so a cycle is found within twice its length of its start.
+        if (m_lambda == m_power) {
+            SaveState(a_machine, a_loc, fingerprint);
+            m_power *= 2;
+            m_lambda = 0;
+        }
+        m_lambda++;
+        return false;
+    }
+
+    // Marks the word as stored to, keeping the value it held at the last fingerprint.
+    void BeforeStore(int a_address, Word a_old, Word) {
+        if (!m_stored[a_address]) {
+            m_stored[a_address] = 1;
+            m_storedList.push_back({ a_address, a_old });
+        }
+    }
+
+private:
+
+    // Brings the hash of memory up to date with the words stored to since the last
+    // fingerprint.
+    void UpdateMemoryHash(const Machine& a_machine) {
+        const Word* memory = a_machine.GetMemory();
+        for (const auto& stored : m_storedList) {
+            m_memoryHash ^= WordHash(stored.first, stored.second) ^ WordHash(stored.first, memory[stored.first]);
+            m_stored[stored.first] = 0;
+        }
+        m_storedList.clear();
+    }
+
+    // The contribution of one word to the memory hash.  Words holding 0 contribute
+    // nothing, so the hash of an empty memory is 0.
+    static uint64_t WordHash(int a_loc, Word a_value) {
+        return a_value == 0 ? 0 : Hash::Mix(((uint64_t)a_loc << 40) ^ Hash::Mix((uint64_t)a_value));
+    }
+
+    // Folds the location, registers, input consumed and memory hash together.
+    uint64_t Fingerprint(const Machine& a_machine, int a_loc) const {
+        uint64_t hash = Hash::Mix(m_memoryHash ^ (uint64_t)a_loc);
+        const Word* reg = a_machine.GetRegisters();
+        for (int i = 0; i < Machine::REGCOUNT; i++) {
+            hash = Hash::Mix(hash ^ (uint64_t)reg[i]);
+        }
+        return Hash::Mix(hash ^ (uint64_t)a_machine.GetInputPosition());
+    }
+
+    // Keeps a full copy of the state to compare later states with.
+    void SaveState(const Machine& a_machine, int a_loc, uint64_t a_fingerprint) {
+        m_savedFingerprint = a_fingerprint;
+        m_savedLoc = a_loc;
+        m_savedInputPos = a_machine.GetInputPosition();
+        m_savedReg.assign(a_machine.GetRegisters(), a_machine.GetRegisters() + Machine::REGCOUNT);
+        m_savedMemory.assign(a_machine.GetMemory(), a_machine.GetMemory() + Machine::MEMSZ);
+    }
+
+    // Determines if the state is the saved one.
+    bool IsSavedState(const Machine& a_machine, int a_loc) const {
+        return a_loc == m_savedLoc && a_machine.GetInputPosition() == m_savedInputPos
+            && equal(m_savedReg.begin(), m_savedReg.end(), a_machine.GetRegisters())
+            && equal(m_savedMemory.begin(), m_savedMemory.end(), a_machine.GetMemory());
+    }
+
+    long long m_interval;               // Instructions between fingerprints.
+    long long m_nextCheck;              // The step count of the next fingerprint.
+    uint64_t m_memoryHash = 0;          // The hash of memory at the last fingerprint.
+    vector<char> m_stored;              // == 1 for each word stored to since the last fingerprint.
+    vector<pair<int, Word>> m_storedList;   // The words stored to since the last fingerprint, and their values then.
+
+    long long m_power = 1;              // The checks until the saved state is replaced.
+    long long m_lambda = 1;             // The checks since the saved state was taken.
+    uint64_t m_savedFingerprint = 0;    // The fingerprint of the saved state.
+    int m_savedLoc = -1;                // The location of the saved state.
+    size_t m_savedInputPos = 0;         // The input consumed by the saved state.
+    vector<Word> m_savedReg;            // The registers of the saved state.
+    vector<Word> m_savedMemory;         // The memory of the saved state.
+};
@@ -0,0 +1,539 @@
+//
+//		Implementation of the MacroExpander class.
+//
+#include "stdafx.h"
+#include <sstream>
+#include "MacroExpander.h"
+#include "Errors.h"
+
+/*
+NAME
+
+    MacroExpander::GetNextStatement - gets the next statement of the source
+
+SYNOPSIS
+
+    bool MacroExpander::GetNextStatement(Instruction& a_inst, string& a_line, Instruction::InstructionType& a_type);
+    a_inst -> the storage for the parsed statement
+    a_line -> the storage for the text of the statement
+    a_type -> the storage for the type of the statement
+
+DESCRIPTION
+
+    While a macro is being used, its statements are returned, already
+    parsed.  Otherwise the next line of the source is read.  The lines
+    of a definition are kept as its body, and a use of a macro starts
+    returning its statements with the next call; both are returned as
+    comments so that they are listed but not translated.  Any other
+    line is parsed as it is.
+
+RETURNS
+
+    Whether there was a statement
+
+*/
+bool MacroExpander::GetNextStatement(Instruction& a_inst, string& a_line, Instruction::InstructionType& a_type)
+{
+    // The statements of a macro being used come first.
+    if (NextExpanded(a_inst, a_line, a_type)) {
+        return true;
+    }
+    m_context.clear();
+
+    if (!m_facc.GetNextLine(a_line)) {
+        if (m_defining != nullptr) {
+            Report("Macro " + m_definingName + " is missing an ENDM");
+            m_defining = nullptr;
+        }
+        return false;
+    }
+    m_number++;
+
+    string label, opcode, operand;
+    bool extra;
+    Split(a_line, label, opcode, operand, extra);
+
+    // The body of a definition is kept as it is, to be parsed when it is used.
+    if (m_defining != nullptr) {
+        if (opcode == "endm") {
+            m_defining = nullptr;
+        }
+        else if (opcode == "macro") {
+            Report("Macro definitions may not be nested");
+        }
+        else {
+            m_defining->m_body.push_back(a_line);
+        }
+        a_type = Instruction::ST_Comment;
+        return true;
+    }
+
+    if (opcode == "macro") {
+        string name = label;
+        transform(name.begin(), name.end(), name.begin(), ::tolower);
+        m_discarded = Macro{ m_number, SplitList(operand), {} };
+        m_defining = &m_discarded;
+        m_definingName = name;
+
+        if (!OpCodes::IsValidSymbol(name)) {
+            Report("Macro has an illegal name");
+        }
+        else if (OpCodes::LookupMachine(name) != 0 || OpCodes::IsAssembly(name) || name == "macro" || name == "endm") {
+            Report("Macro " + name + " has the name of an op code");
+        }
+        else {
+            if (m_macros.count(name)) {
+                Report("Macro " + name + " is defined more than once");
+            }
+            m_macros[name] = m_discarded;
+            m_defining = &m_macros[name];
+        }
+        for (const string& param : m_defining->m_params) {
+            if (!OpCodes::IsValidSymbol(param)) {
+                Report("Macro " + name + " has the illegal parameter \"" + param + "\"");
+            }
+        }
+        if (extra) {
+            Report("Program has Extra or Missing Operand");
+        }
+        a_type = Instruction::ST_Comment;
+        return true;
+    }
+    if (opcode == "endm") {
+        Report("Program has an ENDM without a MACRO");
+        a_type = Instruction::ST_Comment;
+        return true;
+    }
+
+    // A use is listed as it is written, followed by its statements.
+    if (m_macros.count(opcode)) {
+        if (extra) {
+            Report("Program has Extra or Missing Operand");
+        }
+        Call(opcode, operand, label);
+        a_type = Instruction::ST_Comment;
+        return true;
+    }
+
+    a_type = a_inst.ParseInstruction(a_line);
+    return true;
+}
+
+/*
+NAME
+
+    MacroExpander::rewind - goes back to the start of the source
+
+SYNOPSIS
+
+    void MacroExpander::rewind();
+
+DESCRIPTION
+
+    The definitions are forgotten, since each pass meets them again in
+    the same order, but the parsed expansions are kept, so that a later
+    pass parses no statement of a macro again.  An expansion is kept by
+    the line of its definition, so a macro defined twice is not
+    confused with its other definition.
+
+*/
+void MacroExpander::rewind()
+{
+    m_facc.rewind();
+    m_macros.clear();
+    m_frames.clear();
+    m_defining = nullptr;
+    m_number = 0;
+    m_uses = 0;
+    m_context.clear();
+}
+
+/*
+NAME
+
+    MacroExpander::Call - starts a use of a macro
+
+SYNOPSIS
+
+    bool MacroExpander::Call(const string& a_name, const string& a_args, const string& a_label);
+    a_name -> the name of the macro
+    a_args -> the arguments, separated by commas
+    a_label -> the label of the use; empty if none
+
+RETURNS
+
+    Whether the macro is being used
+
+*/
+bool MacroExpander::Call(const string& a_name, const string& a_args, const string& a_label)
+{
+    if (m_frames.size() >= MAX_DEPTH) {
+        Report("Macro " + a_name + " uses macros too deeply");
+        return false;
+    }
+    const Macro& macro = m_macros.at(a_name);
+    vector<string> args = SplitList(a_args);
+    if (args.size() != macro.m_params.size()) {
+        Report("Macro " + a_name + " needs " + to_string(macro.m_params.size()) + " arguments");
+        return false;
+    }
+
+    m_expansions++;
+    shared_ptr<const Expansion> expansion = Expand(macro, a_name, args);
+    if (expansion->empty() && !a_label.empty()) {
+        Report("Macro " + a_name + " has no statement to label");
+    }
+    m_frames.push_back({ expansion, 0, MakeSuffix(++m_uses), a_label,
+        "line " + to_string(m_number) + ", in macro " + a_name + ": " });
+    return true;
+}
+
+/*
+NAME
+
+    MacroExpander::Expand - parses the body of a macro
+
+SYNOPSIS
+
+    shared_ptr<const Expansion> MacroExpander::Expand(const Macro& a_macro, const string& a_name, const vector<string>& a_args);
+    a_macro -> the macro
+    a_name -> its name
+    a_args -> the arguments of the use
+
+DESCRIPTION
+
+    The body is parsed with the arguments in place of the parameters,
+    and the parsed statements are kept for the next use with the same
+    arguments.  The ? labels are left as they are, to be given the
+    suffix of each use when it is returned, and a use of another macro
+    is left to be started when it is reached.  Comments are dropped.
+
+RETURNS
+
+    The statements of the macro
+
+*/
+shared_ptr<const MacroExpander::Expansion> MacroExpander::Expand(const Macro& a_macro, const string& a_name, const vector<string>& a_args)
+{
+    string key = to_string(a_macro.m_line) + '\0' + a_name;
+    for (const string& arg : a_args) {
+        key += '\0' + arg;
+    }
+    auto parsed = m_parsed.find(key);
+    if (parsed != m_parsed.end()) {
+        m_reuses++;
+        return parsed->second;
+    }
+
+    shared_ptr<Expansion> expansion = make_shared<Expansion>();
+    for (const string& line : a_macro.m_body) {
+        Statement statement;
+        statement.m_text = Substitute(line, a_macro, a_args);
+
+        string label, opcode, operand;
+        bool extra;
+        Split(statement.m_text, label, opcode, operand, extra);
+        statement.m_isCall = m_macros.count(opcode) > 0;
+        statement.m_type = Instruction::ST_Comment;
+        if (!statement.m_isCall) {
+            statement.m_type = statement.m_inst.ParseInstruction(statement.m_text);
+            if (statement.m_type == Instruction::ST_Comment) {
+                continue;
+            }
+        }
+        statement.m_hasLocal = statement.m_text.substr(0, statement.m_text.find(';')).find('?') != string::npos;
+        expansion->push_back(move(statement));
+    }
+    m_parsed[key] = expansion;
+    return expansion;
+}
+
+/*
+NAME
+
+    MacroExpander::NextExpanded - gets the next statement of a use
+
+SYNOPSIS
+
+    bool MacroExpander::NextExpanded(Instruction& a_inst, string& a_line, Instruction::InstructionType& a_type);
+    a_inst -> the storage for the parsed statement
+    a_line -> the storage for the text of the statement
+    a_type -> the storage for the type of the statement
+
+DESCRIPTION
+
+    The parsed statement is copied rather than parsed again.  Its ?
+    labels are given the suffix of the use, and the first statement is
+    given the label of the use.  A use of another macro is returned as
+    a comment and started.
+
+RETURNS
+
+    Whether there was a statement
+
+*/
+bool MacroExpander::NextExpanded(Instruction& a_inst, string& a_line, Instruction::InstructionType& a_type)
+{
+    while (!m_frames.empty() && m_frames.back().m_next == m_frames.back().m_expansion->size()) {
+        m_frames.pop_back();
+    }
+    if (m_frames.empty()) {
+        return false;
+    }
+
+    Frame& frame = m_frames.back();
+    const Statement& statement = (*frame.m_expansion)[frame.m_next++];
+    string useLabel = frame.m_next == 1 ? frame.m_label : "";
+    string suffix = frame.m_suffix;
+    m_context = frame.m_context;
+
+    a_line = statement.m_hasLocal ? QualifyLocalLabels(statement.m_text, suffix) : statement.m_text;
+    if (statement.m_isCall) {
+        string label, opcode, operand;
+        bool extra;
+        Split(a_line, label, opcode, operand, extra);
+        if (!useLabel.empty() && !label.empty()) {
+            Report("Macro use has a label, but so does the first statement of the macro");
+        }
+        Call(opcode, operand, label.empty() ? useLabel : label);
+        a_type = Instruction::ST_Comment;
+        return true;
+    }
+
+    a_inst = statement.m_inst;
+    a_type = statement.m_type;
+    if (statement.m_hasLocal) {
+        a_inst.QualifyLocalLabels(suffix);
+    }
+    if (!useLabel.empty()) {
+        if (a_inst.isLabel()) {
+            Report("Macro use has a label, but so does the first statement of the macro");
+        }
+        else {
+            a_inst.GetLabel() = useLabel;
+            size_t indent = min(a_line.find_first_not_of(" \t"), useLabel.length());
+            a_line = useLabel + a_line.substr(indent);
+        }
+    }
+    return true;
+}
+
+/*
+NAME
+
+    MacroExpander::Report - records an error in a definition or use
+
+SYNOPSIS
+
+    void MacroExpander::Report(const string& a_message);
+    a_message -> the error message
+
+DESCRIPTION
+
+    The message is given the line of the source it was found at, or the
+    use of a macro it was found in.  Errors are only recorded by the
+    pass that reports them, so that each is recorded once.
+
+*/
+void MacroExpander::Report(const string& a_message)
+{
+    if (!m_reporting) {
+        return;
+    }
+    Errors::SetContext("");
+    Errors::RecordError((m_frames.empty() ? "line " + to_string(m_number) + ": " : m_frames.back().m_context) + a_message);
+}
+
+/*
+NAME
+
+    MacroExpander::Split - splits a line into its fields
+
+SYNOPSIS
+
+    void MacroExpander::Split(const string& a_line, string& a_label, string& a_opcode, string& a_operand, bool& a_extra);
+    a_line -> the line
+    a_label -> the storage for the label
+    a_opcode -> the storage for the op code, in lower case
+    a_operand -> the storage for the operand
+    a_extra -> set to true if there is more after the operand
+
+DESCRIPTION
+
+    The line is split as Instruction::SetLabelOpcodeEtc splits it, but
+    the operand is not looked into.
+
+*/
+void MacroExpander::Split(const string& a_line, string& a_label, string& a_opcode, string& a_operand, bool& a_extra)
+{
+    string line = a_line.substr(0, a_line.find(';'));
+    istringstream ins(line);
+    string a1, a2, a3, a4;
+    ins >> a1 >> a2 >> a3 >> a4;
+
+    a_label = a_opcode = a_operand = "";
+    a_extra = false;
+    if (a1.empty()) {
+        return;
+    }
+    if (line[0] != ' ' && line[0] != '\t') {
+        a_label = a1;
+        a_opcode = a2;
+        a_operand = a3;
+        a_extra = !a4.empty();
+    }
+    else {
+        a_opcode = a1;
+        a_operand = a2;
+        a_extra = !a3.empty();
+    }
+    transform(a_opcode.begin(), a_opcode.end(), a_opcode.begin(), ::tolower);
+}
+
+/*
+NAME
+
+    MacroExpander::SplitList - splits a list at its commas
+
+SYNOPSIS
+
+    vector<string> MacroExpander::SplitList(const string& a_list);
+    a_list -> the list
+
+RETURNS
+
+    The items of the list; none if it is empty
+
+*/
+vector<string> MacroExpander::SplitList(const string& a_list)
+{
+    vector<string> items;
+    if (a_list.empty()) {
+        return items;
+    }
+    size_t start = 0;
+    while (true) {
+        size_t comma = a_list.find(',', start);
+        items.push_back(a_list.substr(start, comma - start));
+        if (comma == string::npos) {
+            return items;
+        }
+        start = comma + 1;
+    }
+}
+
+/*
+NAME
+
+    MacroExpander::Substitute - puts the arguments in place of the parameters
+
+SYNOPSIS
+
+    string MacroExpander::Substitute(const string& a_line, const Macro& a_macro, const vector<string>& a_args);
+    a_line -> a line of the body
+    a_macro -> the macro
+    a_args -> the arguments of the use
+
+DESCRIPTION
+
+    Each word of the line that is the name of a parameter is replaced
+    by its argument, so a parameter may be a label, a register or,
+    after # or $, a value or a register operand.  The comment is left
+    as it is.
+
+RETURNS
+
+    The line with the arguments in place
+
+*/
+string MacroExpander::Substitute(const string& a_line, const Macro& a_macro, const vector<string>& a_args)
+{
+    size_t end = min(a_line.find(';'), a_line.length());
+    string result;
+    size_t i = 0;
+    while (i < end) {
+        if (!isalnum((unsigned char)a_line[i]) && a_line[i] != '_') {
+            result += a_line[i++];
+            continue;
+        }
+        size_t start = i;
+        while (i < end && (isalnum((unsigned char)a_line[i]) || a_line[i] == '_')) {
+            i++;
+        }
+        string word = a_line.substr(start, i - start);
+        auto param = find(a_macro.m_params.begin(), a_macro.m_params.end(), word);
+        result += param == a_macro.m_params.end() ? word : a_args[param - a_macro.m_params.begin()];
+    }
+    return result + a_line.substr(end);
+}
+
+/*
+NAME
+
+    MacroExpander::QualifyLocalLabels - gives the ? labels of a line a suffix
+
+SYNOPSIS
+
+    string MacroExpander::QualifyLocalLabels(const string& a_line, const string& a_suffix);
+    a_line -> a line of an expansion
+    a_suffix -> the suffix of the use
+
+DESCRIPTION
+
+    Each ?name before the comment becomes name followed by the suffix,
+    as Instruction::QualifyLocalLabels does to the parsed statement.
+
+RETURNS
+
+    The line as it is listed
+
+*/
+string MacroExpander::QualifyLocalLabels(const string& a_line, const string& a_suffix)
+{
+    size_t end = min(a_line.find(';'), a_line.length());
+    string result;
+    size_t i = 0;
+    while (i < end) {
+        if (a_line[i] != '?') {
+            result += a_line[i++];
+            continue;
+        }
+        i++;
+        while (i < end && !isspace((unsigned char)a_line[i]) && a_line[i] != ',') {
+            result += a_line[i++];
+        }
+        result += a_suffix;
+    }
+    return result + a_line.substr(end);
+}
+
+/*
+NAME
+
+    MacroExpander::MakeSuffix - makes the suffix of the ? labels of a use
+
+SYNOPSIS
+
+    string MacroExpander::MakeSuffix(int a_use);
+    a_use -> the number of the use in this pass
+
+DESCRIPTION
+
+    Labels are at most 10 characters, so the number is written in base
+    36: the first 46655 uses need a suffix of 4 characters at most.
+
+RETURNS
+
+    The suffix, an underscore and the number
+
+*/
+string MacroExpander::MakeSuffix(int a_use)
+{
+    const char* const DIGITS = "0123456789abcdefghijklmnopqrstuvwxyz";
+    string digits;
+    do {
+        digits.insert(digits.begin(), DIGITS[a_use % 36]);
+        a_use /= 36;
+    } while (a_use > 0);
+    return "_" + digits;
+}
@@ -0,0 +1,121 @@
+//
+//		Class to read the statements of a source program, expanding macros.  A macro
+//		is defined by
+//
+//			name    macro p1,p2
+//			        ...
+//			        endm
+//
+//		and used as an op code, "name a1,a2".  Each parameter in the body is replaced
+//		by its argument, and a label beginning with ? is given a suffix that is new
+//		for each use, so a macro may have labels of its own.  A body is parsed once
+//		for each different list of arguments; later uses reuse the parsed statements,
+//		and so do the later passes.
+//
+#pragma once
+
+#include <memory>
+#include "FileAccess.h"
+#include "Instruction.h"
+
+class MacroExpander {
+
+public:
+
+    MacroExpander(FileAccess& a_facc) : m_facc(a_facc) {};
+    ~MacroExpander() {};
+
+    // Gets the next statement, parsed into a_inst.  a_line is the text to be listed.
+    // Definitions and uses of macros are returned as comments, and the statements
+    // of a use follow it.  Returns false at the end of the source.
+    bool GetNextStatement(Instruction& a_inst, string& a_line, Instruction::InstructionType& a_type);
+
+    // Goes back to the start of the source.  Parsed expansions are kept.
+    void rewind();
+
+    // Records the errors in definitions and uses of macros, for the pass that reports errors.
+    void SetReporting(bool a_reporting) { m_reporting = a_reporting; }
+
+    // The line of the source the last statement came from; for a statement of a
+    // macro, the line that used it.
+    int GetLineNumber() const { return m_number; }
+
+    // Where the last statement came from, to be put before its error messages.  Empty
+    // for a statement of the source itself.
+    const string& GetContext() const { return m_context; }
+
+    // The number of uses of macros, and how many of those reused parsed statements.
+    long long GetExpansions() const { return m_expansions; }
+    long long GetReuses() const { return m_reuses; }
+
+private:
+
+    // A macro definition.
+    struct Macro {
+        int m_line;                 // The line of the definition, which identifies it.
+        vector<string> m_params;    // The names of the parameters.
+        vector<string> m_body;      // The lines of the body.
+    };
+
+    // A statement of an expansion.
+    struct Statement {
+        Instruction m_inst;                     // The parsed statement.
+        Instruction::InstructionType m_type;    // Its type.
+        string m_text;                          // The text, with the arguments in place.
+        bool m_hasLocal;                        // == true if it has a ? label.
+        bool m_isCall;                          // == true if it uses another macro; it is then not parsed.
+    };
+    typedef vector<Statement> Expansion;
+
+    // A use of a macro whose statements are being returned.
+    struct Frame {
+        shared_ptr<const Expansion> m_expansion;    // The statements.
+        size_t m_next;                              // The next statement to return.
+        string m_suffix;                            // The suffix of the ? labels of this use.
+        string m_label;                             // The label of the use, for its first statement.
+        string m_context;                           // Where the statements came from.
+    };
+
+    static const int MAX_DEPTH = 16;        // The deepest macros may use other macros.
+
+    // Splits a line into its label, op code and operand, ignoring the comment.
+    static void Split(const string& a_line, string& a_label, string& a_opcode, string& a_operand, bool& a_extra);
+
+    // Splits a list of parameters or arguments at its commas.
+    static vector<string> SplitList(const string& a_list);
+
+    // Replaces each parameter in a line of the body by its argument.
+    static string Substitute(const string& a_line, const Macro& a_macro, const vector<string>& a_args);
+
+    // Gives each ? label in a line the suffix of a use.
+    static string QualifyLocalLabels(const string& a_line, const string& a_suffix);
+
+    // Makes the suffix of the ? labels of a use, short enough to leave room in a label.
+    static string MakeSuffix(int a_use);
+
+    // Starts a use of a macro.  Returns false if it cannot be used.
+    bool Call(const string& a_name, const string& a_args, const string& a_label);
+
+    // Parses the body of a macro for a list of arguments, or finds it already parsed.
+    shared_ptr<const Expansion> Expand(const Macro& a_macro, const string& a_name, const vector<string>& a_args);
+
+    // Returns the next statement of the innermost use.  Returns false if there is none.
+    bool NextExpanded(Instruction& a_inst, string& a_line, Instruction::InstructionType& a_type);
+
+    // Records an error at the current line, if errors are being reported.
+    void Report(const string& a_message);
+
+    FileAccess& m_facc;                                     // The source.
+    map<string, Macro> m_macros;                            // The macros defined so far.
+    map<string, shared_ptr<const Expansion>> m_parsed;      // The expansions by definition and arguments.
+    vector<Frame> m_frames;                                 // The uses in progress, innermost last.
+    Macro* m_defining = nullptr;                            // The macro whose body is being read.
+    string m_definingName;                                  // Its name.
+    Macro m_discarded;                                      // The body of a macro that cannot be used.
+    bool m_reporting = false;                               // == true to record errors.
+    int m_number = 0;                                       // The current line of the source.
+    int m_uses = 0;                                         // The uses so far in this pass.
+    string m_context;                                       // Where the last statement came from.
+    long long m_expansions = 0;                             // The uses of macros.
+    long long m_reuses = 0;                                 // The uses that reused parsed statements.
+};
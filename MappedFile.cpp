@@ -0,0 +1,137 @@
+//
+//		Implementation of the MappedFile class.
+//
+#include "stdafx.h"
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+NAME
+
+    MappedFile::Open - maps a file into memory
+
+SYNOPSIS
+
+    bool MappedFile::Open(const string& a_fileName);
+    a_fileName -> the file to be mapped
+
+DESCRIPTION
+
+    This function maps the whole of the named file read-only into the
+    address space of the process.  An empty file is treated as opened
+    successfully with no data.
+
+RETURNS
+
+    Whether the file could be mapped
+
+*/
+#ifdef _WIN32
+bool MappedFile::Open(const string& a_fileName)
+{
+    Close();
+
+    m_file = CreateFileA(a_fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size)) {
+        Close();
+        return false;
+    }
+    m_size = (size_t)size.QuadPart;
+    if (m_size == 0) {
+        return true;
+    }
+
+    m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_mapping == NULL) {
+        Close();
+        return false;
+    }
+    m_data = (const unsigned char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (m_data == nullptr) {
+        Close();
+        return false;
+    }
+    return true;
+}
+#else
+bool MappedFile::Open(const string& a_fileName)
+{
+    Close();
+
+    int fd = open(a_fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return false;
+    }
+    m_size = (size_t)info.st_size;
+    if (m_size == 0) {
+        close(fd);
+        return true;
+    }
+
+    // The mapping stays valid after the descriptor is closed.
+    void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        m_size = 0;
+        return false;
+    }
+    m_data = (const unsigned char*)data;
+    return true;
+}
+#endif
+
+/*
+NAME
+
+    MappedFile::Close - releases the mapping
+
+SYNOPSIS
+
+    void MappedFile::Close();
+
+DESCRIPTION
+
+    This function unmaps the file, if one is mapped, and returns the
+    object to its empty state.
+
+*/
+void MappedFile::Close()
+{
+#ifdef _WIN32
+    if (m_data != nullptr) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping != NULL) {
+        CloseHandle(m_mapping);
+        m_mapping = NULL;
+    }
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_data != nullptr) {
+        munmap((void*)m_data, m_size);
+    }
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
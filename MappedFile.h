@@ -0,0 +1,38 @@
+//
+//		Class to map a file read-only into memory.
+//
+#pragma once
+
+#include <string>
+using namespace std;
+
+class MappedFile {
+
+public:
+
+    MappedFile() {};
+    ~MappedFile() { Close(); }
+
+    // Maps the named file.  Returns false if it could not be opened or mapped.
+    bool Open(const string& a_fileName);
+
+    // Releases the mapping.
+    void Close();
+
+    // Getter Functions
+    const unsigned char* GetData() const { return m_data; }
+    size_t GetSize() const { return m_size; }
+
+private:
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* m_data = nullptr;  // Start of the mapped bytes.
+    size_t m_size = 0;                      // Number of mapped bytes.
+
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;   // The open file.
+    HANDLE m_mapping = NULL;                // The file mapping object.
+#endif
+};
@@ -0,0 +1,48 @@
+//
+//		Implementation of the MemoryImage class.
+//
+#include "stdafx.h"
+#include "MemoryImage.h"
+#include "Hash.h"
+
+/*
+NAME
+
+    MemoryImage::ComputeHash - hashes the contents of the image
+
+SYNOPSIS
+
+    uint64_t MemoryImage::ComputeHash() const;
+
+DESCRIPTION
+
+    This function lays the words out as loading the image would, a word
+    recorded later at an address replacing any recorded there before,
+    and folds the address, contents and kind of each word laid out into
+    a single hash in order of address.  Two images hash the same if they
+    lay out the same words, whatever order the words were recorded in,
+    and a program that goes back over a location is told apart from one
+    whose earlier word stood.
+
+RETURNS
+
+    The hash of the image
+
+*/
+uint64_t MemoryImage::ComputeHash() const
+{
+    map<int, const Word*> laidOut;
+    for (const Word& word : m_words) {
+        laidOut[word.m_loc] = &word;
+    }
+
+    uint64_t hash = Hash::FNV_OFFSET;
+    for (const auto& loc : laidOut) {
+        const Word& word = *loc.second;
+        unsigned char isCode = word.m_isCode ? 1 : 0;
+        hash = Hash::Fnv1a(&word.m_loc, sizeof(word.m_loc), hash);
+        hash = Hash::Fnv1a(&word.m_contents, sizeof(word.m_contents), hash);
+        hash = Hash::Fnv1a(&isCode, sizeof(isCode), hash);
+    }
+    return Hash::Mix(hash ^ laidOut.size());
+}
@@ -0,0 +1,72 @@
+//
+//		Class to hold the translation of a program as a list of memory words.
+//
+#pragma once
+
+#include <map>
+#include <stdint.h>
+#include "Emulator.h"
+
+// The source statement translated at a location, for tools that report on a running program.
+struct SourceLine {
+    int m_number;       // The line number in the source file.
+    string m_text;      // The text of the line.
+};
+typedef map<int, SourceLine> SourceMap;     // The source line of each location.
+
+class MemoryImage {
+
+public:
+
+    // A single word of the translation.
+    struct Word {
+        int m_loc;          // The address of the word.
+        int m_contents;     // The contents of the word.
+        bool m_isCode;      // == true if the word was translated from a machine language instruction.
+    };
+
+    MemoryImage() {};
+    ~MemoryImage() {};
+
+    // Records a word of the translation.
+    void AddWord(int a_loc, int a_contents, bool a_isCode) {
+        m_words.push_back({ a_loc, a_contents, a_isCode });
+    }
+
+    // Removes all words.
+    void Clear() { m_words.clear(); }
+
+    // Computes a hash of the memory the image lays out.
+    uint64_t ComputeHash() const;
+
+    // Records the image into the memory of a machine.  Instructions are translated for
+    // the standard emulator, so they are re-encoded for the machine.  Returns false if
+    // a word or an address does not fit in its memory.
+    template<typename Machine>
+    bool LoadInto(Machine& a_emul) const {
+        bool fits = true;
+        for (const Word& word : m_words) {
+            typename Machine::Word contents = word.m_contents;
+            if (word.m_isCode) {
+                int address = emulator::Encoding::Address(word.m_contents);
+                if (address >= Machine::MEMSZ) {
+                    fits = false;
+                }
+                contents = Machine::Encoding::Encode(emulator::Encoding::OpCode(word.m_contents),
+                    emulator::Encoding::Register(word.m_contents), address % Machine::MEMSZ);
+            }
+            if (!a_emul.insertMemory(word.m_loc, contents)) {
+                fits = false;
+            }
+        }
+        return fits;
+    }
+
+    // Getter Functions
+    const vector<Word>& GetWords() const { return m_words; }
+    vector<Word>& GetWords() { return m_words; }
+
+private:
+
+    vector<Word> m_words;   // The words in the order they were translated.
+};
@@ -0,0 +1,333 @@
+//
+//		Implementation of the MultiCore class.
+//
+#include "stdafx.h"
+#include "MultiCore.h"
+#include <thread>
+
+/*
+NAME
+
+    MultiCore::MultiCore - prepares the cores and an empty memory
+
+SYNOPSIS
+
+    MultiCore::MultiCore(int a_cores);
+    a_cores -> the number of cores
+
+*/
+MultiCore::MultiCore(int a_cores) : m_memory(new atomic<Word>[MEMSZ]()), m_cores(max(a_cores, 1))
+{
+}
+
+/*
+NAME
+
+    MultiCore::insertMemory - records a word into the shared memory
+
+SYNOPSIS
+
+    bool MultiCore::insertMemory(int a_location, Word a_contents);
+    a_location -> the address of the word
+    a_contents -> the contents of the word
+
+RETURNS
+
+    Whether the location is in memory
+
+*/
+bool MultiCore::insertMemory(int a_location, Word a_contents)
+{
+    if (a_location < 0 || a_location >= MEMSZ) {
+        return false;
+    }
+    m_memory[a_location].store(a_contents, memory_order_relaxed);
+    return true;
+}
+
+/*
+NAME
+
+    MultiCore::SetInput - supplies the input of the program
+
+SYNOPSIS
+
+    void MultiCore::SetInput(const vector<long long>& a_input);
+    a_input -> the values for READ instructions
+
+*/
+void MultiCore::SetInput(const vector<long long>& a_input)
+{
+    m_input.assign(a_input.begin(), a_input.end());
+    m_inputPos = 0;
+}
+
+/*
+NAME
+
+    MultiCore::Run - runs the cores
+
+SYNOPSIS
+
+    EmulatorBase::RunResult MultiCore::Run(long long a_budget);
+    a_budget -> the instructions each core may run; negative for no limit
+
+DESCRIPTION
+
+    This function starts every core at the origin on its own thread and
+    waits for all of them to stop.  A core stops on its own HALT; the
+    others carry on.
+
+RETURNS
+
+    The most serious reason a core stopped: a fault, then an illegal
+    opcode, then the end of the input, then the budget, then HALT
+
+*/
+EmulatorBase::RunResult MultiCore::Run(long long a_budget)
+{
+    vector<thread> threads;
+    for (int i = 1; i < (int)m_cores.size(); i++) {
+        threads.emplace_back(&MultiCore::Execute, this, i, a_budget);
+    }
+    Execute(0, a_budget);
+    for (thread& core : threads) {
+        core.join();
+    }
+
+    const EmulatorBase::RunResult order[] = {
+        EmulatorBase::RR_Fault, EmulatorBase::RR_IllegalOpcode, EmulatorBase::RR_EndOfInput, EmulatorBase::RR_Budget
+    };
+    for (EmulatorBase::RunResult result : order) {
+        for (const Core& core : m_cores) {
+            if (core.m_result == result) {
+                return result;
+            }
+        }
+    }
+    return EmulatorBase::RR_Halted;
+}
+
+/*
+NAME
+
+    MultiCore::GetSteps - counts the instructions executed
+
+SYNOPSIS
+
+    long long MultiCore::GetSteps() const;
+
+RETURNS
+
+    The instructions executed by all of the cores
+
+*/
+long long MultiCore::GetSteps() const
+{
+    long long steps = 0;
+    for (const Core& core : m_cores) {
+        steps += core.m_steps;
+    }
+    return steps;
+}
+
+/*
+NAME
+
+    MultiCore::Execute - runs one core
+
+SYNOPSIS
+
+    void MultiCore::Execute(int a_core, long long a_budget);
+    a_core -> the number of the core
+    a_budget -> the instructions the core may run; negative for no limit
+
+DESCRIPTION
+
+    The core runs under a trap of its own thread, or a structured
+    exception handler on Windows, so a DIV that faults stops just this
+    core, with RR_Fault.
+
+*/
+void MultiCore::Execute(int a_core, long long a_budget)
+{
+#ifdef _WIN32
+    __try {
+        Interpret(a_core, a_budget);
+    }
+    __except (EmulatorBase::FaultFilter(GetExceptionCode())) {
+        m_cores[a_core].m_result = EmulatorBase::RR_Fault;
+    }
+#else
+    EmulatorBase::FaultTrap trap;
+    if (sigsetjmp(trap.m_jump, 0) != 0) {
+        m_cores[a_core].m_result = EmulatorBase::RR_Fault;
+        return;
+    }
+    Interpret(a_core, a_budget);
+#endif
+}
+
+/*
+NAME
+
+    MultiCore::Interpret - runs one core without a trap
+
+SYNOPSIS
+
+    void MultiCore::Interpret(int a_core, long long a_budget);
+    a_core -> the number of the core
+    a_budget -> the instructions the core may run; negative for no limit
+
+DESCRIPTION
+
+    This function is BasicEmulator::Interpret with every access to
+    memory made through the shared atomic words.  Ordinary accesses are
+    relaxed; FAA and CAS are sequentially consistent.  The block
+    instructions access their words one at a time, so other cores may
+    see a block partly copied or filled.  A DIV records its location in
+    the core before dividing, for the trap to report.
+
+*/
+void MultiCore::Interpret(int a_core, long long a_budget)
+{
+    Core& core = m_cores[a_core];
+    Word* reg = core.m_reg;
+    int loc = core.m_pc;
+    long long steps = core.m_steps;
+    long long limit = a_budget < 0 ? LLONG_MAX : a_budget;
+    EmulatorBase::RunResult result = EmulatorBase::RR_Budget;
+
+    while (steps < limit) {
+        Word contents = m_memory[loc].load(memory_order_relaxed);
+        int opcode = Encoding::OpCode(contents);
+        int r = Encoding::Register(contents);
+        atomic<Word>& word = m_memory[Encoding::Address(contents)];
+
+        switch (opcode) {
+        case 1: reg[r] += word.load(memory_order_relaxed); loc++; break;
+        case 2: reg[r] -= word.load(memory_order_relaxed); loc++; break;
+        case 3: reg[r] *= word.load(memory_order_relaxed); loc++; break;
+        case 4: {
+            Word divisor = word.load(memory_order_relaxed);
+            PublishLocation(core, loc, steps);
+#ifdef DIVIDE_DOES_NOT_TRAP
+            if (EmulatorBase::DivideFaults(reg[r], divisor)) {
+                result = EmulatorBase::RR_Fault;
+                goto stopped;
+            }
+#endif
+            reg[r] /= divisor;
+            loc++;
+            break;
+        }
+        case 5: reg[r] = word.load(memory_order_relaxed); loc++; break;
+        case 6: word.store(reg[r], memory_order_relaxed); loc++; break;
+        case 7: {
+            size_t pos = m_inputPos.fetch_add(1, memory_order_relaxed);
+            if (pos >= m_input.size()) {
+                result = EmulatorBase::RR_EndOfInput;
+                goto stopped;
+            }
+            {
+                lock_guard<mutex> lock(m_outputLock);
+                cout << "? ";
+            }
+            word.store(m_input[pos], memory_order_relaxed);
+            loc++;
+            break;
+        }
+        case 8: {
+            Word value = word.load(memory_order_relaxed);
+            lock_guard<mutex> lock(m_outputLock);
+            cout << value << endl;
+            loc++;
+            break;
+        }
+        case 9: loc = Encoding::Address(contents); break;
+        case 10: loc = reg[r] < 0 ? Encoding::Address(contents) : loc + 1; break;
+        case 11: loc = reg[r] == 0 ? Encoding::Address(contents) : loc + 1; break;
+        case 12: loc = reg[r] > 0 ? Encoding::Address(contents) : loc + 1; break;
+        case 13:
+            steps++;
+            result = EmulatorBase::RR_Halted;
+            goto stopped;
+        case 14: reg[r] = word.fetch_add(reg[r]); loc++; break;
+        case 15: word.compare_exchange_strong(reg[0], reg[r]); loc++; break;
+        case 16: reg[r] = word.load(memory_order_relaxed) + a_core; loc++; break;
+        case 17: {
+            int to = Encoding::Address(contents);
+            int count = min(emulator::BlockLength(reg[r], reg[0]), emulator::BlockLength(to, reg[0]));
+            if (to <= reg[r]) {
+                for (int i = 0; i < count; i++) {
+                    m_memory[to + i].store(m_memory[reg[r] + i].load(memory_order_relaxed), memory_order_relaxed);
+                }
+            }
+            else {
+                for (int i = count - 1; i >= 0; i--) {
+                    m_memory[to + i].store(m_memory[reg[r] + i].load(memory_order_relaxed), memory_order_relaxed);
+                }
+            }
+            loc++;
+            break;
+        }
+        case 18: {
+            int to = Encoding::Address(contents);
+            for (int i = 0, count = emulator::BlockLength(to, reg[0]); i < count; i++) {
+                m_memory[to + i].store(reg[r], memory_order_relaxed);
+            }
+            loc++;
+            break;
+        }
+        case 19: {
+            int from = Encoding::Address(contents);
+            Word sum = 0;
+            for (int i = 0, count = emulator::BlockLength(from, reg[0]); i < count; i++) {
+                sum += m_memory[from + i].load(memory_order_relaxed);
+            }
+            reg[r] = sum;
+            loc++;
+            break;
+        }
+        case 20: reg[r] += Encoding::Address(contents); loc++; break;
+        case 21: reg[r] -= Encoding::Address(contents); loc++; break;
+        case 22: reg[r] *= Encoding::Address(contents); loc++; break;
+        case 23:
+            PublishLocation(core, loc, steps);
+#ifdef DIVIDE_DOES_NOT_TRAP
+            if (EmulatorBase::DivideFaults(reg[r], (Word)Encoding::Address(contents))) {
+                result = EmulatorBase::RR_Fault;
+                goto stopped;
+            }
+#endif
+            reg[r] /= Encoding::Address(contents);
+            loc++;
+            break;
+        case 24: reg[r] = Encoding::Address(contents); loc++; break;
+        case 25: reg[r] += reg[Encoding::Address(contents) % emulator::REGCOUNT]; loc++; break;
+        case 26: reg[r] -= reg[Encoding::Address(contents) % emulator::REGCOUNT]; loc++; break;
+        case 27: reg[r] *= reg[Encoding::Address(contents) % emulator::REGCOUNT]; loc++; break;
+        case 28:
+            PublishLocation(core, loc, steps);
+#ifdef DIVIDE_DOES_NOT_TRAP
+            if (EmulatorBase::DivideFaults(reg[r], reg[Encoding::Address(contents) % emulator::REGCOUNT])) {
+                result = EmulatorBase::RR_Fault;
+                goto stopped;
+            }
+#endif
+            reg[r] /= reg[Encoding::Address(contents) % emulator::REGCOUNT];
+            loc++;
+            break;
+        case 29: reg[r] = reg[Encoding::Address(contents) % emulator::REGCOUNT]; loc++; break;
+        default:
+            result = EmulatorBase::RR_IllegalOpcode;
+            goto stopped;
+        }
+        steps++;
+    }
+
+stopped:
+    core.m_pc = loc;
+    core.m_steps = steps;
+    core.m_result = result;
+}
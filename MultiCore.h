@@ -0,0 +1,77 @@
+//
+//		Class to emulate a Quack3200 with several cores sharing one memory.  Each
+//		core has its own registers and runs on its own host thread.
+//
+//		Memory semantics: every word of memory is read and written atomically, so
+//		a core never sees a torn word, but ordinary instructions (LOAD, STORE, ADD,
+//		READ, ...) are not ordered with respect to other cores.  FAA and CAS are
+//		sequentially consistent read-modify-writes and order every access of the
+//		core around them, so they are the way cores synchronize.  A core that
+//		stores to an instruction another core is executing gives no guarantee of
+//		which version is executed.
+//
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include "Emulator.h"
+
+class MultiCore {
+
+public:
+
+    typedef emulator::Word Word;
+    typedef emulator::Encoding Encoding;
+
+    const static int MEMSZ = emulator::MEMSZ;       // The size of the shared memory.
+    const static int REGCOUNT = emulator::REGCOUNT; // The number of registers of each core.
+
+    MultiCore(int a_cores);
+    ~MultiCore() {};
+
+    // Records instructions and data into the shared memory.
+    bool insertMemory(int a_location, Word a_contents);
+
+    // Supplies the input shared by the cores.  Each value is read by one core.
+    void SetInput(const vector<long long>& a_input);
+
+    // Runs every core from the origin until each stops.  Each core may run at most
+    // a_budget instructions if a_budget is not negative.
+    EmulatorBase::RunResult Run(long long a_budget);
+
+    // Getter Functions
+    int GetCoreCount() const { return (int)m_cores.size(); }
+    long long GetSteps() const;
+    size_t GetInputPosition() const { return min(m_inputPos.load(), m_input.size()); }
+
+private:
+
+    // The state of one core.  Each core's thread writes its registers on nearly every
+    // instruction, so each core has cache lines of its own, not shared with another's.
+    struct alignas(64) Core {
+        int m_pc = EmulatorBase::ORIGIN;                        // The location of the next instruction.
+        Word m_reg[REGCOUNT] = {};                              // The registers of the core.
+        long long m_steps = 0;                                  // The instructions executed.
+        EmulatorBase::RunResult m_result = EmulatorBase::RR_Budget;  // Why the core stopped.
+    };
+
+    // Runs one core until it stops, under a trap for faults.
+    void Execute(int a_core, long long a_budget);
+
+    // Runs one core until it stops.
+    void Interpret(int a_core, long long a_budget);
+
+    // Records where a DIV is, for the trap to report if it faults.
+    static void PublishLocation(Core& a_core, int a_loc, long long a_steps) {
+        a_core.m_pc = a_loc;
+        a_core.m_steps = a_steps;
+        atomic_signal_fence(memory_order_seq_cst);
+    }
+
+    unique_ptr<atomic<Word>[]> m_memory;    // The shared memory.
+    vector<Core> m_cores;                   // The cores.
+    vector<Word> m_input;                   // The values for READ instructions.
+    atomic<size_t> m_inputPos{ 0 };         // The index of the next value to be read.
+    mutex m_outputLock;                     // Keeps the output of each instruction together.
+};
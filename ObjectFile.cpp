@@ -0,0 +1,142 @@
+//
+//		Implementation of the ObjectFile class.
+//
+#include "stdafx.h"
+#include <filesystem>
+#include "ObjectFile.h"
+#include "Binary.h"
+#include "FileAccess.h"
+#include "Hash.h"
+#include "MappedFile.h"
+
+namespace {
+    const uint32_t OBJECT_MAGIC = 0x424f4b51;   // "QKOB"
+    const uint32_t OBJECT_FORMAT = 1;           // Layout version of an object file.
+}
+
+/*
+NAME
+
+    ObjectFile::Write - writes a relocatable module
+
+SYNOPSIS
+
+    bool ObjectFile::Write(const string& a_fileName, const Module& a_module);
+    a_fileName -> the object file to be written
+    a_module -> the module
+
+DESCRIPTION
+
+    The module is written with a checksum, as a cached translation is,
+    and replaces the file in one step so that a linker never reads a
+    partly written module.
+
+RETURNS
+
+    Whether the file was written
+
+*/
+bool ObjectFile::Write(const string& a_fileName, const Module& a_module)
+{
+    BinaryWriter out;
+    out.PutUInt32(OBJECT_MAGIC);
+    out.PutUInt32(OBJECT_FORMAT);
+
+    out.PutInt32(a_module.m_size);
+    const vector<MemoryImage::Word>& words = a_module.m_image.GetWords();
+    out.PutUInt32((uint32_t)words.size());
+    for (const MemoryImage::Word& word : words) {
+        out.PutInt32(word.m_loc);
+        out.PutInt32(word.m_contents);
+        out.PutByte(word.m_isCode ? 1 : 0);
+    }
+    out.PutUInt32((uint32_t)a_module.m_exports.size());
+    for (const auto& symbol : a_module.m_exports) {
+        out.PutString(symbol.first);
+        out.PutInt32(symbol.second);
+    }
+    out.PutUInt32((uint32_t)a_module.m_imports.size());
+    for (const string& symbol : a_module.m_imports) {
+        out.PutString(symbol);
+    }
+    out.PutUInt32((uint32_t)a_module.m_relocations.size());
+    for (const Relocation& relocation : a_module.m_relocations) {
+        out.PutInt32(relocation.m_word);
+        out.PutInt32(relocation.m_import);
+    }
+    out.PutUInt64(Hash::Fnv1a(out.GetBytes().data(), out.GetBytes().size()));
+
+    return FileAccess::WriteAtomically(a_fileName, out.GetBytes());
+}
+
+/*
+NAME
+
+    ObjectFile::Read - reads a relocatable module
+
+SYNOPSIS
+
+    bool ObjectFile::Read(const string& a_fileName, Module& a_module);
+    a_fileName -> the object file
+    a_module -> the storage for the module
+
+DESCRIPTION
+
+    The file is mapped and checked by its checksum and format.  A
+    relocation that names a word or an import the module does not have
+    makes the whole file unusable.
+
+RETURNS
+
+    Whether the module was read
+
+*/
+bool ObjectFile::Read(const string& a_fileName, Module& a_module)
+{
+    MappedFile file;
+    if (!file.Open(a_fileName) || file.GetSize() < 2 * sizeof(uint64_t)) {
+        return false;
+    }
+    size_t payload = file.GetSize() - sizeof(uint64_t);
+    uint64_t checksum;
+    memcpy(&checksum, file.GetData() + payload, sizeof(checksum));
+    if (checksum != Hash::Fnv1a(file.GetData(), payload)) {
+        return false;
+    }
+
+    BinaryReader in(file.GetData(), payload);
+    if (in.GetUInt32() != OBJECT_MAGIC || in.GetUInt32() != OBJECT_FORMAT) {
+        return false;
+    }
+
+    a_module = Module();
+    a_module.m_name = std::filesystem::path(a_fileName).filename().string();
+    a_module.m_size = in.GetInt32();
+    uint32_t count = in.GetUInt32();
+    for (uint32_t i = 0; i < count && !in.Failed(); i++) {
+        int loc = in.GetInt32();
+        int contents = in.GetInt32();
+        a_module.m_image.AddWord(loc, contents, in.GetByte() != 0);
+    }
+    count = in.GetUInt32();
+    for (uint32_t i = 0; i < count && !in.Failed(); i++) {
+        string symbol = in.GetString();
+        a_module.m_exports[symbol] = in.GetInt32();
+    }
+    count = in.GetUInt32();
+    for (uint32_t i = 0; i < count && !in.Failed(); i++) {
+        a_module.m_imports.push_back(in.GetString());
+    }
+    count = in.GetUInt32();
+    for (uint32_t i = 0; i < count && !in.Failed(); i++) {
+        Relocation relocation;
+        relocation.m_word = in.GetInt32();
+        relocation.m_import = in.GetInt32();
+        if (relocation.m_word < 0 || relocation.m_word >= (int)a_module.m_image.GetWords().size() ||
+            relocation.m_import < -1 || relocation.m_import >= (int)a_module.m_imports.size()) {
+            return false;
+        }
+        a_module.m_relocations.push_back(relocation);
+    }
+    return !in.Failed() && in.GetRemaining() == 0;
+}
@@ -0,0 +1,37 @@
+//
+//		Class to read and write relocatable object files.  A module is translated as
+//		if it were placed at location 0, and records which of its instructions refer
+//		to its own labels, which must be moved with it, and which refer to labels it
+//		imports, which only the linker can resolve.
+//
+#pragma once
+
+#include <stdint.h>
+#include "MemoryImage.h"
+
+class ObjectFile {
+
+public:
+
+    // An instruction whose address field the linker must fill in.
+    struct Relocation {
+        int m_word;         // The index of the instruction in the words of the module.
+        int m_import;       // The index of the imported label; -1 for a label of the module.
+    };
+
+    // A relocatable module.
+    struct Module {
+        string m_name;                      // The name of the module, for messages.
+        int m_size = 0;                     // The number of locations the module occupies.
+        MemoryImage m_image;                // The translation, as if placed at location 0.
+        map<string, int> m_exports;         // The labels other modules may use, and their locations.
+        vector<string> m_imports;           // The labels defined by other modules.
+        vector<Relocation> m_relocations;   // The instructions to be relocated.
+    };
+
+    // Writes a module.  Returns false if the file cannot be written.
+    static bool Write(const string& a_fileName, const Module& a_module);
+
+    // Reads a module.  Returns false if the file cannot be read or is not an object file.
+    static bool Read(const string& a_fileName, Module& a_module);
+};
@@ -0,0 +1,225 @@
+//
+//		The op code tables and format rules of the Quack3200 assembly language.
+//		Everything here is constexpr so the run time assembler (Instruction) and
+//		the compile time assembler (ConstAssembler) share one definition.
+//
+#pragma once
+
+#include <string_view>
+using namespace std;
+
+class OpCodes {
+
+public:
+
+    // A machine language op code and its numeric equivalent.
+    struct MachineOpCode {
+        const char* m_name;
+        int m_code;
+    };
+
+    // All machine language op codes.
+    static constexpr MachineOpCode MACHINE[] = {
+        {"add", 1}, {"sub", 2}, {"mult", 3}, {"div", 4}, {"load", 5}, {"store", 6}, {"read", 7},
+        {"write", 8}, {"b", 9}, {"bm", 10}, {"bz", 11}, {"bp", 12}, {"halt", 13},
+        {"faa", 14}, {"cas", 15}, {"core", 16}, {"bcopy", 17}, {"bfill", 18}, {"bsum", 19}
+    };
+
+    // All assembly language op codes.
+    static constexpr const char* ASSEMBLY[] = { "dc", "ds", "org", "end", "include", "extern", "entry" };
+
+    // How the operand of a machine language instruction is given: a label, a value
+    // (#n) or a register ($n).
+    enum OperandMode { OM_Memory, OM_Immediate, OM_Register };
+
+    // The immediate forms of ADD, SUB, MULT, DIV and LOAD are 20-24 and their register
+    // forms are 25-29, in that order.  The address field holds the value or the number
+    // of the register.
+    static constexpr int IMMEDIATE_BASE = 20;
+    static constexpr int REGISTER_BASE = 25;
+
+    // Determines how an operand is given.
+    static constexpr OperandMode ModeOf(string_view a_operand) {
+        if (!a_operand.empty() && a_operand[0] == '#') {
+            return OM_Immediate;
+        }
+        if (!a_operand.empty() && a_operand[0] == '$') {
+            return OM_Register;
+        }
+        return OM_Memory;
+    }
+
+    // Returns the op code of the form of a_opcode taking an operand given in a_mode,
+    // or 0 if it has no such form.
+    static constexpr int OperandForm(int a_opcode, OperandMode a_mode) {
+        if (a_mode == OM_Memory) {
+            return a_opcode;
+        }
+        if (a_opcode < 1 || a_opcode > 5) {
+            return 0;
+        }
+        return (a_mode == OM_Immediate ? IMMEDIATE_BASE : REGISTER_BASE) + a_opcode - 1;
+    }
+
+    // Returns the value of a #n operand or the register number of a $n operand.
+    static constexpr int OperandValue(string_view a_operand) {
+        return ToNumber(a_operand.substr(1));
+    }
+
+    // Determines if a #n or $n operand is allowed.  Values must fit in the address
+    // field, and an immediate divisor may not be 0.
+    static constexpr bool IsValidOperandForm(int a_opcode, string_view a_operand) {
+        OperandMode mode = ModeOf(a_operand);
+        if (OperandForm(a_opcode, mode) == 0 || !IsNumber(a_operand.substr(1))) {
+            return false;
+        }
+        int value = OperandValue(a_operand);
+        if (mode == OM_Register) {
+            return IsValidRegister(value);
+        }
+        return IsValidConstant(value) && value >= 0 && !(a_opcode == 4 && value == 0);
+    }
+
+    // Returns the numeric op code of a machine language instruction, or 0 if a_name is not one.
+    static constexpr int LookupMachine(string_view a_name) {
+        for (const MachineOpCode& opcode : MACHINE) {
+            if (EqualNoCase(a_name, opcode.m_name)) {
+                return opcode.m_code;
+            }
+        }
+        return 0;
+    }
+
+    // Returns the name of a numeric op code, or null if it is not one.  The immediate and
+    // register forms are named by the instruction they are forms of; see FormOf.
+    static constexpr const char* NameOf(int a_code) {
+        if (a_code >= IMMEDIATE_BASE && a_code < REGISTER_BASE + 5) {
+            a_code = (a_code - IMMEDIATE_BASE) % 5 + 1;
+        }
+        for (const MachineOpCode& opcode : MACHINE) {
+            if (opcode.m_code == a_code) {
+                return opcode.m_name;
+            }
+        }
+        return nullptr;
+    }
+
+    // Returns how the operand of a numeric op code is given.
+    static constexpr OperandMode FormOf(int a_code) {
+        if (a_code >= IMMEDIATE_BASE && a_code < REGISTER_BASE) {
+            return OM_Immediate;
+        }
+        if (a_code >= REGISTER_BASE && a_code < REGISTER_BASE + 5) {
+            return OM_Register;
+        }
+        return OM_Memory;
+    }
+
+    // Determines if a_name is an assembly language op code.
+    static constexpr bool IsAssembly(string_view a_name) {
+        for (const char* opcode : ASSEMBLY) {
+            if (EqualNoCase(a_name, opcode)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Labels and symbolic operands are 1-10 characters and start with a letter.
+    static constexpr bool IsValidSymbol(string_view a_symbol) {
+        return a_symbol.length() >= 1 && a_symbol.length() <= 10 && IsAlpha(a_symbol[0]);
+    }
+
+    // Registers are numbered 0-9.
+    static constexpr bool IsValidRegister(int a_register) {
+        return a_register >= 0 && a_register <= 9;
+    }
+
+    // Numeric operands of assembly language instructions must fit in five digits.
+    static constexpr bool IsValidConstant(int a_value) {
+        return a_value >= -99999 && a_value <= 99999;
+    }
+
+    // Determines if a string is a number: an optional sign, digits, and an optional
+    // decimal point followed by optional digits.
+    static constexpr bool IsNumber(string_view a_value) {
+        size_t i = 0;
+        if (i < a_value.length() && (a_value[i] == '+' || a_value[i] == '-')) {
+            i++;
+        }
+        size_t digits = i;
+        while (i < a_value.length() && IsDigit(a_value[i])) {
+            i++;
+        }
+        if (i == digits) {
+            return false;
+        }
+        if (i < a_value.length() && a_value[i] == '.') {
+            i++;
+            while (i < a_value.length() && IsDigit(a_value[i])) {
+                i++;
+            }
+        }
+        return i == a_value.length();
+    }
+
+    // Converts the leading integer of a number.  Values too large for an int are clamped.
+    static constexpr int ToNumber(string_view a_value) {
+        size_t i = 0;
+        bool negative = false;
+        if (i < a_value.length() && (a_value[i] == '+' || a_value[i] == '-')) {
+            negative = a_value[i] == '-';
+            i++;
+        }
+        long long value = 0;
+        while (i < a_value.length() && IsDigit(a_value[i])) {
+            value = value * 10 + (a_value[i] - '0');
+            if (value > 2147483647LL) {
+                value = 2147483648LL;
+            }
+            i++;
+        }
+        value = negative ? -value : value;
+        return value > 2147483647LL ? 2147483647 : (int)value;
+    }
+
+    // Determines if an instruction is missing its operand or has one too many.
+    static constexpr bool IsMissingOrExtraOperand(string_view a_opcode, bool a_hasOperand, bool a_extraOperand) {
+        if (a_extraOperand) {
+            return true;
+        }
+        // HALT never needs an operand and END does not need one.
+        if (EqualNoCase(a_opcode, "halt") || (EqualNoCase(a_opcode, "end") && !a_hasOperand)) {
+            return false;
+        }
+        return (IsAssembly(a_opcode) || LookupMachine(a_opcode) != 0) && !a_hasOperand;
+    }
+
+    static constexpr bool IsAlpha(char a_ch) {
+        return (a_ch >= 'a' && a_ch <= 'z') || (a_ch >= 'A' && a_ch <= 'Z');
+    }
+
+    static constexpr bool IsDigit(char a_ch) {
+        return a_ch >= '0' && a_ch <= '9';
+    }
+
+    static constexpr bool IsSpace(char a_ch) {
+        return a_ch == ' ' || a_ch == '\t' || a_ch == '\n' || a_ch == '\r' || a_ch == '\v' || a_ch == '\f';
+    }
+
+    static constexpr char ToLower(char a_ch) {
+        return a_ch >= 'A' && a_ch <= 'Z' ? (char)(a_ch - 'A' + 'a') : a_ch;
+    }
+
+    static constexpr bool EqualNoCase(string_view a_left, string_view a_right) {
+        if (a_left.length() != a_right.length()) {
+            return false;
+        }
+        for (size_t i = 0; i < a_left.length(); i++) {
+            if (ToLower(a_left[i]) != ToLower(a_right[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
@@ -0,0 +1,463 @@
+//
+//		Implementation of the Optimizer class.
+//
+#include "stdafx.h"
+#include "Optimizer.h"
+
+/*
+NAME
+
+    Optimizer::Load - lays the translation out in memory
+
+SYNOPSIS
+
+    void Optimizer::Load();
+
+DESCRIPTION
+
+    The program is laid out in memory as the emulator would lay it out.
+    A location translated twice is noted, since such a program is not
+    optimized.
+
+*/
+void Optimizer::Load()
+{
+    m_memory.assign(emulator::MEMSZ, 0);
+    m_isCode.assign(emulator::MEMSZ, 0);
+    set<int> seen;
+    for (const MemoryImage::Word& word : m_image.GetWords()) {
+        if (word.m_loc < 0 || word.m_loc >= emulator::MEMSZ || !seen.insert(word.m_loc).second) {
+            m_refusal = "a location is translated more than once";
+            continue;
+        }
+        m_memory[word.m_loc] = word.m_contents;
+        m_isCode[word.m_loc] = word.m_isCode;
+    }
+}
+
+/*
+NAME
+
+    Optimizer::Optimize - optimizes the translation
+
+SYNOPSIS
+
+    bool Optimizer::Optimize();
+
+DESCRIPTION
+
+    Each round threads branches first, since that can leave instructions
+    that are no longer reached.  The instructions that remain are then
+    split into basic blocks, each block is rewritten on its own, and
+    the code is closed up over the instructions removed.  Closing up
+    can bring a branch next to its target, so rounds are repeated until
+    one changes nothing.
+
+RETURNS
+
+    Whether the translation was optimized
+
+*/
+bool Optimizer::Optimize()
+{
+    Load();
+    set<int> reachable = FindReachable();
+    if (!m_refusal.empty() || !IsSafe(reachable)) {
+        return false;
+    }
+
+    map<int, int> relocation;
+    for (int round = 0; round < MAX_ROUNDS; round++) {
+        if (round > 0) {
+            Load();
+            reachable = FindReachable();
+        }
+        int changes = m_threaded + m_removed + m_unreachable + m_forwarded + m_unusedConstants;
+
+        m_leaders.clear();
+        m_blocks.clear();
+        m_removedLocs.clear();
+        m_relocation.clear();
+        ThreadBranches(reachable);
+        m_code = FindReachable();
+        BuildBlocks();
+        RewriteBlocks();
+        Compact();
+
+        // Carry the original locations through this round's moves.
+        if (round == 0) {
+            relocation = m_relocation;
+        }
+        for (auto& entry : relocation) {
+            auto moved = m_relocation.find(entry.second);
+            if (round > 0 && entry.second >= 0 && moved != m_relocation.end()) {
+                entry.second = moved->second;
+            }
+        }
+        if (changes == m_threaded + m_removed + m_unreachable + m_forwarded + m_unusedConstants) {
+            break;
+        }
+    }
+    m_relocation = relocation;
+    return true;
+}
+
+/*
+NAME
+
+    Optimizer::FindReachable - finds the instructions that may be executed
+
+SYNOPSIS
+
+    set<int> Optimizer::FindReachable() const;
+
+DESCRIPTION
+
+    This function follows every path of execution from the origin, as
+    Translator::FindReachable does.
+
+RETURNS
+
+    The locations of the reachable instructions
+
+*/
+set<int> Optimizer::FindReachable() const
+{
+    set<int> reachable;
+    vector<int> pending = { emulator::ORIGIN };
+
+    while (!pending.empty()) {
+        int loc = pending.back();
+        pending.pop_back();
+        if (loc < 0 || loc >= emulator::MEMSZ || !reachable.insert(loc).second) {
+            continue;
+        }
+
+        int opcode = emulator::Encoding::OpCode(m_memory[loc]);
+        if (IsBranch(opcode)) {
+            pending.push_back(emulator::Encoding::Address(m_memory[loc]));
+        }
+        if (opcode >= 1 && opcode <= 29 && FallsThrough(opcode)) {
+            pending.push_back(loc + 1);
+        }
+    }
+    return reachable;
+}
+
+/*
+NAME
+
+    Optimizer::IsSafe - determines if the program can be optimized
+
+SYNOPSIS
+
+    bool Optimizer::IsSafe(const set<int>& a_reachable);
+    a_reachable -> the instructions reachable from the origin
+
+DESCRIPTION
+
+    Instructions are moved, so the program must not look at them:
+    every operand in memory must be data, no block may reach the code,
+    and BCOPY, whose source address is computed, may not be used.
+    Every reachable word must also be an instruction that the assembler
+    translated.
+
+RETURNS
+
+    Whether the program can be optimized
+
+*/
+bool Optimizer::IsSafe(const set<int>& a_reachable)
+{
+    int lastCode = -1;
+    for (int loc = 0; loc < emulator::MEMSZ; loc++) {
+        if (m_isCode[loc]) {
+            lastCode = loc;
+        }
+    }
+
+    for (int loc : a_reachable) {
+        int opcode = emulator::Encoding::OpCode(m_memory[loc]);
+        int address = emulator::Encoding::Address(m_memory[loc]);
+        if (!m_isCode[loc]) {
+            m_refusal = "the program executes a word that is not an instruction";
+        }
+        else if (FallsThrough(opcode) && loc + 1 >= emulator::MEMSZ) {
+            m_refusal = "the program runs off the end of memory";
+        }
+        else if (opcode == 17) {
+            m_refusal = "BCOPY copies from a computed address";
+        }
+        else if (IsMemoryOperand(opcode) && m_isCode[address]) {
+            m_refusal = "the program could read or change its own instructions";
+        }
+        else if ((opcode == 18 || opcode == 19) && address <= lastCode) {
+            m_refusal = "a block could reach the program's instructions";
+        }
+        if (!m_refusal.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+NAME
+
+    Optimizer::ThreadBranches - sends branches straight to their final target
+
+SYNOPSIS
+
+    void Optimizer::ThreadBranches(const set<int>& a_reachable);
+    a_reachable -> the instructions reachable from the origin
+
+DESCRIPTION
+
+    A branch to an unconditional branch is retargeted to where that
+    branch goes, following chains of them.  An unconditional branch
+    to a HALT becomes a HALT.
+
+*/
+void Optimizer::ThreadBranches(const set<int>& a_reachable)
+{
+    for (int loc : a_reachable) {
+        int opcode = emulator::Encoding::OpCode(m_memory[loc]);
+        if (!IsBranch(opcode)) {
+            continue;
+        }
+        int address = emulator::Encoding::Address(m_memory[loc]);
+
+        // A chain that loops back on itself is followed only so far.
+        int target = address;
+        for (int hops = 0; hops < 64 && emulator::Encoding::OpCode(m_memory[target]) == 9; hops++) {
+            target = emulator::Encoding::Address(m_memory[target]);
+        }
+
+        if (opcode == 9 && emulator::Encoding::OpCode(m_memory[target]) == 13) {
+            m_memory[loc] = m_memory[target];
+            m_threaded++;
+        }
+        else if (target != address) {
+            m_memory[loc] = emulator::Encoding::Encode(opcode, emulator::Encoding::Register(m_memory[loc]), target);
+            m_threaded++;
+        }
+    }
+}
+
+/*
+NAME
+
+    Optimizer::BuildBlocks - splits the code into basic blocks
+
+SYNOPSIS
+
+    void Optimizer::BuildBlocks();
+
+DESCRIPTION
+
+    A block starts at the origin, at each branch target, after each
+    branch, and wherever the code does not follow on from the location
+    before.  It ends before the next block starts or after a branch or
+    a HALT.
+
+*/
+void Optimizer::BuildBlocks()
+{
+    m_leaders = { emulator::ORIGIN };
+    for (int loc : m_code) {
+        int opcode = emulator::Encoding::OpCode(m_memory[loc]);
+        if (IsBranch(opcode)) {
+            m_leaders.insert(emulator::Encoding::Address(m_memory[loc]));
+        }
+        if (IsBranch(opcode) || !FallsThrough(opcode)) {
+            m_leaders.insert(loc + 1);
+        }
+        if (!m_code.count(loc - 1)) {
+            m_leaders.insert(loc);
+        }
+    }
+
+    for (int loc : m_code) {
+        if (!m_leaders.count(loc)) {
+            continue;
+        }
+        Block block = { loc, loc + 1 };
+        while (m_code.count(block.m_end) && !m_leaders.count(block.m_end)) {
+            block.m_end++;
+        }
+        m_blocks.push_back(block);
+    }
+}
+
+/*
+NAME
+
+    Optimizer::RewriteBlocks - removes redundant instructions
+
+SYNOPSIS
+
+    void Optimizer::RewriteBlocks();
+
+DESCRIPTION
+
+    Within a block each instruction is compared with the one kept
+    before it.  A LOAD or STORE of a word that the register already
+    holds is removed, and a LOAD of a word just stored from another
+    register becomes a copy of that register.  A branch to the next
+    location is removed, since it does nothing.
+
+*/
+void Optimizer::RewriteBlocks()
+{
+    for (const Block& block : m_blocks) {
+        int prev = -1;
+        for (int loc = block.m_start; loc < block.m_end; loc++) {
+            int opcode = emulator::Encoding::OpCode(m_memory[loc]);
+            int reg = emulator::Encoding::Register(m_memory[loc]);
+            int address = emulator::Encoding::Address(m_memory[loc]);
+
+            if (IsBranch(opcode) && address == loc + 1) {
+                m_removedLocs.insert(loc);
+                m_removed++;
+                continue;
+            }
+            if (prev >= 0 && (opcode == 5 || opcode == 6)) {
+                int prevOpcode = emulator::Encoding::OpCode(m_memory[prev]);
+                int prevReg = emulator::Encoding::Register(m_memory[prev]);
+                int prevAddress = emulator::Encoding::Address(m_memory[prev]);
+
+                if ((prevOpcode == 5 || prevOpcode == 6) && prevAddress == address) {
+                    if (prevReg == reg) {
+                        m_removedLocs.insert(loc);
+                        m_removed++;
+                        continue;
+                    }
+                    if (prevOpcode == 6 && opcode == 5) {
+                        m_memory[loc] = emulator::Encoding::Encode(OpCodes::REGISTER_BASE + 4, reg, prevReg);
+                        m_forwarded++;
+                    }
+                }
+            }
+            prev = loc;
+        }
+    }
+}
+
+/*
+NAME
+
+    Optimizer::Compact - closes up the code and rebuilds the image
+
+SYNOPSIS
+
+    void Optimizer::Compact();
+
+DESCRIPTION
+
+    Each run of consecutive instructions is closed up toward its first
+    location, which does not move, so the origin and the data stay
+    where they were.  Instructions removed or no longer reachable leave
+    no gap.  Branch targets are relocated.  Instructions no
+    longer reachable are dropped, as are constants that no remaining
+    instruction refers to, unless a block instruction could reach them.
+
+*/
+void Optimizer::Compact()
+{
+    vector<int> pending;
+    int next = 0;
+    for (int loc = 0; loc < emulator::MEMSZ; loc++) {
+        if (!m_isCode[loc]) {
+            continue;
+        }
+        if (loc == 0 || !m_isCode[loc - 1] || loc == emulator::ORIGIN) {
+            next = loc;
+        }
+        if (!m_code.count(loc)) {
+            continue;
+        }
+        if (m_removedLocs.count(loc)) {
+            pending.push_back(loc);
+            continue;
+        }
+        for (int removed : pending) {
+            m_relocation[removed] = next;
+        }
+        pending.clear();
+        m_relocation[loc] = next++;
+    }
+
+    set<int> referenced;
+    bool blocks = false;
+    for (int loc : m_code) {
+        int opcode = emulator::Encoding::OpCode(m_memory[loc]);
+        if (!m_removedLocs.count(loc) && IsMemoryOperand(opcode)) {
+            referenced.insert(emulator::Encoding::Address(m_memory[loc]));
+            blocks = blocks || opcode == 18 || opcode == 19;
+        }
+    }
+
+    MemoryImage image;
+    for (const MemoryImage::Word& word : m_image.GetWords()) {
+        if (!word.m_isCode) {
+            if (blocks || referenced.count(word.m_loc)) {
+                image.AddWord(word.m_loc, word.m_contents, false);
+            }
+            else {
+                m_unusedConstants++;
+            }
+            continue;
+        }
+        if (!m_code.count(word.m_loc)) {
+            m_relocation[word.m_loc] = -1;
+            m_unreachable++;
+            continue;
+        }
+        if (m_removedLocs.count(word.m_loc)) {
+            continue;
+        }
+
+        int contents = m_memory[word.m_loc];
+        int opcode = emulator::Encoding::OpCode(contents);
+        if (IsBranch(opcode)) {
+            contents = emulator::Encoding::Encode(opcode, emulator::Encoding::Register(contents),
+                m_relocation[emulator::Encoding::Address(contents)]);
+        }
+        image.AddWord(m_relocation[word.m_loc], contents, true);
+    }
+    m_image = image;
+}
+
+// Determines if an op code takes its operand from memory or stores to it.
+bool Optimizer::IsMemoryOperand(int a_opcode)
+{
+    return (a_opcode >= 1 && a_opcode <= 8) || (a_opcode >= 14 && a_opcode <= 19);
+}
+
+/*
+NAME
+
+    Optimizer::DisplayReport - shows what the optimizer did
+
+SYNOPSIS
+
+    void Optimizer::DisplayReport() const;
+
+*/
+void Optimizer::DisplayReport() const
+{
+    cout << "Optimization of the translation:" << endl << endl;
+    if (!m_refusal.empty()) {
+        cout << "Not optimized: " << m_refusal << "." << endl;
+    }
+    else {
+        cout << left << setw(40) << "Basic blocks" << m_blocks.size() << endl
+            << setw(40) << "Branches threaded" << m_threaded << endl
+            << setw(40) << "Redundant instructions removed" << m_removed << endl
+            << setw(40) << "Unreachable instructions dropped" << m_unreachable << endl
+            << setw(40) << "Loads turned into register copies" << m_forwarded << endl
+            << setw(40) << "Unused constants dropped" << m_unusedConstants << endl
+            << setw(40) << "Instructions eliminated" << GetEliminated() << right << endl;
+    }
+    cout << "__________________________________________________________" << endl << endl;
+}
@@ -0,0 +1,94 @@
+//
+//		Peephole optimizer for a translated program.  The reachable instructions are
+//		split into basic blocks, branches to branches are threaded, redundant loads
+//		and stores are removed, and the code is closed up over the removed words.
+//		Data stays where it was, so only branch targets have to be relocated.
+//
+//		A program that could read or change its own instructions is left alone, as
+//		is one that executes a word that was not translated from an instruction.
+//
+#pragma once
+
+#include <set>
+#include "MemoryImage.h"
+#include "OpCodes.h"
+
+class Optimizer {
+
+public:
+
+    Optimizer(MemoryImage& a_image) : m_image(a_image) {};
+    ~Optimizer() {};
+
+    // Optimizes the image in place.  Returns false, leaving the image untouched, if
+    // the program is not safe to optimize.
+    bool Optimize();
+
+    // Displays what was done, or why nothing was.
+    void DisplayReport() const;
+
+    // The new location of each instruction of the original image: the location of
+    // the next instruction kept for one that was removed, and -1 for one that can
+    // never be reached.
+    const map<int, int>& GetRelocation() const { return m_relocation; }
+
+    // The number of instructions removed or dropped as unreachable.
+    int GetEliminated() const { return m_removed + m_unreachable; }
+
+private:
+
+    // A straight-line run of instructions entered only at its first.
+    struct Block {
+        int m_start;            // The location of the first instruction.
+        int m_end;              // The location after the last instruction.
+    };
+
+    static const int MAX_ROUNDS = 8;    // The most rounds of optimization.
+
+    // Lays the translation out in memory.
+    void Load();
+
+    // Finds the instructions reachable from the origin.
+    set<int> FindReachable() const;
+
+    // Determines if the program can be optimized, recording why not if it cannot.
+    bool IsSafe(const set<int>& a_reachable);
+
+    // Sends branches that reach an unconditional branch straight to its target.
+    void ThreadBranches(const set<int>& a_reachable);
+
+    // Splits the reachable instructions into basic blocks.
+    void BuildBlocks();
+
+    // Removes redundant instructions within each block.
+    void RewriteBlocks();
+
+    // Closes up the code over the removed instructions and rebuilds the image.
+    void Compact();
+
+    // Determines if an op code takes its operand from memory or stores to it.
+    static bool IsMemoryOperand(int a_opcode);
+
+    // Determines if execution may continue with the next location.
+    static bool FallsThrough(int a_opcode) { return a_opcode != 9 && a_opcode != 13; }
+
+    // Determines if an op code is a branch.
+    static bool IsBranch(int a_opcode) { return a_opcode >= 9 && a_opcode <= 12; }
+
+    MemoryImage& m_image;           // The translation being optimized.
+    vector<int> m_memory;           // The initial memory of the program.
+    vector<char> m_isCode;          // == 1 for each word translated from an instruction.
+
+    set<int> m_code;                // The reachable instructions.
+    set<int> m_leaders;             // The instructions that start blocks.
+    vector<Block> m_blocks;         // The basic blocks, in order of location.
+    set<int> m_removedLocs;         // The instructions to be removed.
+    map<int, int> m_relocation;     // The new location of each original instruction.
+
+    string m_refusal;               // Why the program was not optimized.
+    int m_threaded = 0;             // Branches sent straight to their final target.
+    int m_removed = 0;              // Redundant instructions removed.
+    int m_unreachable = 0;          // Instructions that can no longer be reached.
+    int m_forwarded = 0;            // Loads of a just stored word turned into register copies.
+    int m_unusedConstants = 0;      // Constants that no instruction refers to.
+};
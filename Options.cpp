@@ -0,0 +1,271 @@
+//
+//		Implementation of the Options class.
+//
+#include "stdafx.h"
+#include "Options.h"
+
+/*
+NAME
+
+    Options::Options - parses the command line
+
+SYNOPSIS
+
+    Options::Options(int argc, char* argv[]);
+    argc -> the amount of command line arguments given
+    argv -> the command line arguments
+
+DESCRIPTION
+
+    This constructor walks the command line, recording each option
+    and the name of the source file.  Exactly one source file must be
+    given, "-" for standard input, unless --link is, when the object files to be linked are
+    given instead, or --pack, when the sources to be packed are, or
+    --archive, when the name of a program in the archive is.  Options are:
+
+        --cache <dir>       reuse translations stored in <dir>
+        --cache-size <MB>   limit the size of the cache directory
+        --input <file>      take the values for READ from <file>
+        --max-steps <n>     stop the emulator after <n> instructions
+        --memo <dir>        reuse emulator runs recorded in <dir>
+        --memo-stats        report the hit rate of the run memo
+        --emit-cpp <file>   write a C++ translation to <file> instead of emulating
+        --machine <name>    emulate the small, standard or large machine
+        --stats <file>      write the phase times and counters as JSON to <file>
+        --trace <file>      write a Chrome trace event timeline to <file>
+        --guests <n>        run <n> copies of the program under the scheduler
+        --workers <n>       run the guests on <n> threads
+        --quantum <n>       let each guest run <n> instructions before yielding
+        --cores <n>         run the program on <n> cores sharing one memory
+        --detect-loops      stop the program if it is in an infinite loop
+        --fast-forward      skip the iterations of simple counting loops
+        --checkpoint <file> checkpoint the run to <file> as it goes
+        --checkpoint-every <n> checkpoint the run every <n> instructions
+        --resume <file>     continue the run from its last checkpoint in <file>
+        --profile <file>    sample the running program and write a profile to <file>
+        --timing <file>     estimate the cycles of the run with the costs in <file>
+        --perf              report the host's performance counters for the run
+        --debug             run the program under the time-travel debugger
+        --optimize          remove redundant instructions before running
+        --stream            assemble the source in one pass as it is read
+        --specialize <file> specialize the program for the first values it reads, from <file>
+        --object <file>     write a relocatable module to <file> instead of running it
+        --link              link the object files named and run the result
+        --pack <file>       translate the sources named into the archive <file>
+        --archive <file>    run the program named from the archive <file>
+
+*/
+Options::Options(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+
+        if (arg == "--cache") {
+            m_CacheDir = NextArgument(argc, argv, i);
+        }
+        else if (arg == "--cache-size") {
+            m_CacheLimit = atoll(NextArgument(argc, argv, i).c_str()) << 20;
+        }
+        else if (arg == "--input") {
+            m_InputFile = NextArgument(argc, argv, i);
+        }
+        else if (arg == "--max-steps") {
+            m_MaxSteps = atoll(NextArgument(argc, argv, i).c_str());
+        }
+        else if (arg == "--memo") {
+            m_MemoDir = NextArgument(argc, argv, i);
+        }
+        else if (arg == "--memo-stats") {
+            m_MemoStats = true;
+        }
+        else if (arg == "--emit-cpp") {
+            m_CppFile = NextArgument(argc, argv, i);
+        }
+        else if (arg == "--machine") {
+            m_Machine = NextArgument(argc, argv, i);
+            if (m_Machine != "small" && m_Machine != "standard" && m_Machine != "large") {
+                Usage();
+            }
+        }
+        else if (arg == "--stats") {
+            m_StatsFile = NextArgument(argc, argv, i);
+        }
+        else if (arg == "--trace") {
+            m_TraceFile = NextArgument(argc, argv, i);
+        }
+        else if (arg == "--guests") {
+            m_Guests = atoi(NextArgument(argc, argv, i).c_str());
+        }
+        else if (arg == "--workers") {
+            m_Workers = atoi(NextArgument(argc, argv, i).c_str());
+        }
+        else if (arg == "--quantum") {
+            m_Quantum = atoll(NextArgument(argc, argv, i).c_str());
+        }
+        else if (arg == "--cores") {
+            m_Cores = atoi(NextArgument(argc, argv, i).c_str());
+        }
+        else if (arg == "--detect-loops") {
+            m_DetectLoops = true;
+        }
+        else if (arg == "--fast-forward") {
+            m_FastForward = true;
+        }
+        else if (arg == "--checkpoint") {
+            m_CheckpointFile = NextArgument(argc, argv, i);
+        }
+        else if (arg == "--checkpoint-every") {
+            m_CheckpointInterval = atoll(NextArgument(argc, argv, i).c_str());
+        }
+        else if (arg == "--resume") {
+            m_CheckpointFile = NextArgument(argc, argv, i);
+            m_Resume = true;
+        }
+        else if (arg == "--profile") {
+            m_ProfileFile = NextArgument(argc, argv, i);
+        }
+        else if (arg == "--timing") {
+            m_TimingFile = NextArgument(argc, argv, i);
+        }
+        else if (arg == "--perf") {
+            m_Perf = true;
+        }
+        else if (arg == "--debug") {
+            m_Debug = true;
+        }
+        else if (arg == "--optimize") {
+            m_Optimize = true;
+        }
+        else if (arg == "--stream") {
+            m_Stream = true;
+        }
+        else if (arg == "--specialize") {
+            m_SpecializeFile = NextArgument(argc, argv, i);
+        }
+        else if (arg == "--object") {
+            m_ObjectFile = NextArgument(argc, argv, i);
+        }
+        else if (arg == "--link") {
+            m_Link = true;
+        }
+        else if (arg == "--pack") {
+            m_PackFile = NextArgument(argc, argv, i);
+        }
+        else if (arg == "--archive") {
+            m_ArchiveFile = NextArgument(argc, argv, i);
+        }
+        else if (arg.length() > 2 && arg.compare(0, 2, "--") == 0) {
+            Usage();
+        }
+        else if (m_Link) {
+            m_LinkFiles.push_back(arg);
+        }
+        else if (!m_PackFile.empty()) {
+            m_PackSources.push_back(arg);
+        }
+        else if (!m_ArchiveFile.empty() && m_ArchiveProgram.empty()) {
+            m_ArchiveProgram = arg;
+        }
+        else if (m_SourceFile.empty()) {
+            m_SourceFile = arg;
+        }
+        else {
+            Usage();
+        }
+    }
+
+    // Linking takes object files rather than a source file, and does not make a module.
+    // Packing takes sources, and loading from an archive takes a program's name.
+    int modes = (m_Link ? 1 : 0) + (m_PackFile.empty() ? 0 : 1) + (m_ArchiveFile.empty() ? 0 : 1);
+    if (modes > 1 || (modes == 1 && !m_ObjectFile.empty())) {
+        Usage();
+    }
+    // A memoized run may be replayed without being executed, so nothing can watch it.
+    if (!m_MemoDir.empty() && (m_DetectLoops || m_FastForward || !m_ProfileFile.empty() || !m_TimingFile.empty() || m_Perf)) {
+        cerr << "--memo cannot be combined with --detect-loops, --fast-forward, --profile, --timing or --perf." << endl;
+        Usage();
+    }
+    if (m_Link ? m_LinkFiles.empty() : !m_PackFile.empty() ? m_PackSources.empty() :
+        !m_ArchiveFile.empty() ? m_ArchiveProgram.empty() : m_SourceFile.empty()) {
+        Usage();
+    }
+}
+
+/*
+NAME
+
+    Options::ForSource - makes the options for one source being packed
+
+SYNOPSIS
+
+    Options Options::ForSource(const string& a_sourceFile) const;
+    a_sourceFile -> the source
+
+RETURNS
+
+    These options, assembling a_sourceFile rather than packing
+
+*/
+Options Options::ForSource(const string& a_sourceFile) const
+{
+    Options options(*this);
+    options.m_SourceFile = a_sourceFile;
+    options.m_PackFile.clear();
+    options.m_PackSources.clear();
+    return options;
+}
+
+/*
+NAME
+
+    Options::NextArgument - gets the value of an option
+
+SYNOPSIS
+
+    string Options::NextArgument(int argc, char* argv[], int& a_index);
+    argc -> the amount of command line arguments given
+    argv -> the command line arguments
+    a_index -> the index of the option; advanced past its value
+
+RETURNS
+
+    The argument following the option
+
+*/
+string Options::NextArgument(int argc, char* argv[], int& a_index)
+{
+    if (a_index + 1 >= argc) {
+        Usage();
+    }
+    return argv[++a_index];
+}
+
+/*
+NAME
+
+    Options::Usage - reports a malformed command line
+
+SYNOPSIS
+
+    void Options::Usage();
+
+DESCRIPTION
+
+    This function displays the expected command line and terminates
+    the assembler.
+
+*/
+void Options::Usage()
+{
+    cerr << "Usage: Assem [--cache <dir>] [--cache-size <MB>] [--input <file>] [--max-steps <n>]" << endl
+        << "             [--memo <dir>] [--memo-stats] [--emit-cpp <file>]" << endl
+        << "             [--machine small|standard|large] [--stats <file>] [--trace <file>]" << endl
+        << "             [--guests <n>] [--workers <n>] [--quantum <n>] [--cores <n>]" << endl
+        << "             [--detect-loops] [--checkpoint <file>] [--checkpoint-every <n>]" << endl
+        << "             [--resume <file>] [--profile <file>] [--timing <file>] [--perf]" << endl
+        << "             [--debug] [--optimize] [--stream] [--object <file>] <FileName>" << endl
+        << "       Assem --link [options] <ObjectFile>..." << endl
+        << "       Assem --pack <archive> [options] <FileName>..." << endl
+        << "       Assem --archive <archive> [options] <ProgramName>" << endl;
+    exit(1);
+}
@@ -0,0 +1,99 @@
+//
+//		Class to parse the command line options of the assembler.
+//
+#pragma once
+
+#include <string>
+#include <vector>
+using namespace std;
+
+class Options {
+
+public:
+
+    // Parses the command line.  Terminates with a usage message if it is malformed.
+    Options(int argc, char* argv[]);
+    ~Options() {};
+
+    // Getter Functions
+    const string& GetSourceFile() const { return m_SourceFile; }
+    const string& GetCacheDir() const { return m_CacheDir; }
+    long long GetCacheLimit() const { return m_CacheLimit; }
+    const string& GetInputFile() const { return m_InputFile; }
+    long long GetMaxSteps() const { return m_MaxSteps; }
+    const string& GetMemoDir() const { return m_MemoDir; }
+    bool GetMemoStats() const { return m_MemoStats; }
+    const string& GetCppFile() const { return m_CppFile; }
+    const string& GetMachine() const { return m_Machine; }
+    const string& GetStatsFile() const { return m_StatsFile; }
+    const string& GetTraceFile() const { return m_TraceFile; }
+    int GetGuests() const { return m_Guests; }
+    int GetWorkers() const { return m_Workers; }
+    long long GetQuantum() const { return m_Quantum; }
+    int GetCores() const { return m_Cores; }
+    bool GetDetectLoops() const { return m_DetectLoops; }
+    bool GetFastForward() const { return m_FastForward; }
+    const string& GetCheckpointFile() const { return m_CheckpointFile; }
+    long long GetCheckpointInterval() const { return m_CheckpointInterval; }
+    bool GetResume() const { return m_Resume; }
+    const string& GetProfileFile() const { return m_ProfileFile; }
+    const string& GetTimingFile() const { return m_TimingFile; }
+    bool GetPerf() const { return m_Perf; }
+    bool GetDebug() const { return m_Debug; }
+    bool GetOptimize() const { return m_Optimize; }
+    bool GetStream() const { return m_Stream; }
+    const string& GetSpecializeFile() const { return m_SpecializeFile; }
+    const string& GetObjectFile() const { return m_ObjectFile; }
+    bool GetLink() const { return m_Link; }
+    const vector<string>& GetLinkFiles() const { return m_LinkFiles; }
+    const string& GetPackFile() const { return m_PackFile; }
+    const vector<string>& GetPackSources() const { return m_PackSources; }
+    const string& GetArchiveFile() const { return m_ArchiveFile; }
+    const string& GetArchiveProgram() const { return m_ArchiveProgram; }
+
+    // Returns the options for assembling one of the sources being packed.
+    Options ForSource(const string& a_sourceFile) const;
+
+private:
+
+    // Reports a malformed command line and terminates.
+    void Usage();
+
+    // Returns the argument following option a_index, or terminates if there is none.
+    string NextArgument(int argc, char* argv[], int& a_index);
+
+    string m_SourceFile = "";                   // The assembly language source file.
+    string m_CacheDir = "";                     // Directory of the translation cache; empty if disabled.
+    long long m_CacheLimit = 64LL << 20;        // Size limit of the translation cache in bytes.
+    string m_InputFile = "";                    // File of values for READ instructions; empty to prompt.
+    long long m_MaxSteps = -1;                  // Instruction budget of the emulator; negative for none.
+    string m_MemoDir = "";                      // Directory of recorded emulator runs; empty if disabled.
+    bool m_MemoStats = false;                   // == true to report the effectiveness of the run memo.
+    string m_CppFile = "";                      // File to receive a C++ translation; empty to emulate.
+    string m_Machine = "standard";              // The machine to emulate: small, standard or large.
+    string m_StatsFile = "";                    // File to receive a JSON summary of the run; empty if none.
+    string m_TraceFile = "";                    // File to receive a trace event timeline; empty if none.
+    int m_Guests = 0;                           // Copies of the program to run under the scheduler; 0 for none.
+    int m_Workers = 0;                          // Threads running the guests; 0 for one per host core.
+    long long m_Quantum = 10000;                // Instructions a guest runs before yielding.
+    int m_Cores = 0;                            // Cores sharing memory; 0 for the single core emulator.
+    bool m_DetectLoops = false;                 // == true to stop programs that are in an infinite loop.
+    bool m_FastForward = false;                 // == true to skip the iterations of simple counting loops.
+    string m_CheckpointFile = "";               // File the run is checkpointed to; empty if none.
+    long long m_CheckpointInterval = 100000000; // Instructions between checkpoints.
+    bool m_Resume = false;                      // == true to continue the run from its checkpoint file.
+    string m_ProfileFile = "";                  // File to receive the sampling profile; empty if none.
+    string m_TimingFile = "";                   // File of cycle costs and cache shape; empty for no timing.
+    bool m_Perf = false;                        // == true to report the host's performance counters.
+    bool m_Debug = false;                       // == true to run the translation under the debugger.
+    bool m_Optimize = false;                    // == true to run the peephole optimizer over the translation.
+    bool m_Stream = false;                      // == true to assemble the source in one pass as it is read.
+    string m_SpecializeFile = "";               // File of the values of the first READs to specialize for; empty if none.
+    string m_ObjectFile = "";                   // File to receive a relocatable module; empty to run the program.
+    bool m_Link = false;                        // == true to link object files rather than assemble a source.
+    vector<string> m_LinkFiles;                 // The object files to be linked, in the order they are placed.
+    string m_PackFile = "";                     // Archive to receive the translations of the sources; empty if none.
+    vector<string> m_PackSources;               // The sources to be packed.
+    string m_ArchiveFile = "";                  // Archive to load the program from; empty to assemble a source.
+    string m_ArchiveProgram = "";               // The name of the program in the archive.
+};
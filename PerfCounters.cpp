@@ -0,0 +1,406 @@
+//
+//		Implementation of the PerfCounters and PerfSampler classes.
+//
+#include "stdafx.h"
+#include "PerfCounters.h"
+#include "OpCodes.h"
+#include "Stats.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+PerfSampler* PerfSampler::s_active = nullptr;
+constexpr PerfCounters::Counter PerfSampler::SAMPLED[];
+constexpr long long PerfSampler::PERIOD[];
+
+/*
+NAME
+
+    PerfCounters::Open - opens the counters
+
+SYNOPSIS
+
+    bool PerfCounters::Open();
+
+DESCRIPTION
+
+    Each counter is opened on its own, counting this thread in user
+    mode only, so that a host that lacks some counters or permits only
+    software ones still provides the others.
+
+RETURNS
+
+    Whether any counter was opened
+
+*/
+bool PerfCounters::Open()
+{
+    bool any = false;
+    for (int i = 0; i < PC_COUNT; i++) {
+        m_fd[i] = OpenCounter((Counter)i, 0, m_problem);
+        any = any || m_fd[i] >= 0;
+    }
+    return any;
+}
+
+// Starts counting from zero.
+void PerfCounters::Start()
+{
+#ifdef __linux__
+    for (int fd : m_fd) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+// Stops counting.
+void PerfCounters::Stop()
+{
+#ifdef __linux__
+    for (int fd : m_fd) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+#endif
+}
+
+/*
+NAME
+
+    PerfCounters::GetValue - reads a counter
+
+SYNOPSIS
+
+    long long PerfCounters::GetValue(Counter a_counter) const;
+    a_counter -> the counter
+
+DESCRIPTION
+
+    When there are more counters than the processor has registers, the
+    kernel takes turns with them; the count is then scaled up by the
+    share of the time the counter was running.
+
+RETURNS
+
+    The count; 0 if the counter is not open
+
+*/
+long long PerfCounters::GetValue(Counter a_counter) const
+{
+#ifdef __linux__
+    uint64_t values[3];     // The count, the time enabled and the time running.
+    if (m_fd[a_counter] < 0 || read(m_fd[a_counter], values, sizeof(values)) != (ssize_t)sizeof(values)) {
+        return 0;
+    }
+    if (values[2] > 0 && values[2] < values[1]) {
+        return (long long)((double)values[0] * values[1] / values[2]);
+    }
+    return (long long)values[0];
+#else
+    return 0;
+#endif
+}
+
+/*
+NAME
+
+    PerfCounters::DisplayReport - displays the counts
+
+SYNOPSIS
+
+    void PerfCounters::DisplayReport(long long a_guestInstructions) const;
+    a_guestInstructions -> the instructions the emulator executed while counting
+
+DESCRIPTION
+
+    Each count is displayed with its value per guest instruction and
+    recorded as a counter of the run.  The counters that could not be
+    opened are named, with the reason.
+
+*/
+void PerfCounters::DisplayReport(long long a_guestInstructions) const
+{
+    cout << endl << "Host performance counters for " << a_guestInstructions << " guest instructions:" << endl;
+    for (int i = 0; i < PC_COUNT; i++) {
+        cout << "  " << left << setw(16) << GetName((Counter)i) << right;
+        if (!IsOpen((Counter)i)) {
+            cout << "not available" << endl;
+            continue;
+        }
+        long long value = GetValue((Counter)i);
+        cout << setw(16) << value;
+        if (a_guestInstructions > 0) {
+            cout << setw(12) << fixed << setprecision(2) << (double)value / a_guestInstructions << " per guest instruction";
+        }
+        cout << endl;
+
+        string name = string("host_") + GetName((Counter)i);
+        replace(name.begin(), name.end(), ' ', '_');
+        Stats::SetCounter(name, value);
+    }
+    if (!m_problem.empty()) {
+        cout << "  (" << m_problem << ")" << endl;
+    }
+}
+
+// Returns the name of a counter.
+const char* PerfCounters::GetName(Counter a_counter)
+{
+    static const char* const NAMES[PC_COUNT] = { "task clock ns", "cycles", "instructions", "branch misses", "cache misses" };
+    return NAMES[a_counter];
+}
+
+/*
+NAME
+
+    PerfCounters::OpenCounter - opens one counter
+
+SYNOPSIS
+
+    int PerfCounters::OpenCounter(Counter a_counter, long long a_period, string& a_problem);
+    a_counter -> the counter
+    a_period -> the counts between signals; 0 for a counter that is only read
+    a_problem -> set to why the counter could not be opened, if it could not
+
+DESCRIPTION
+
+    The counter counts this thread in user mode, which is all an
+    unprivileged process is permitted under the usual
+    perf_event_paranoid setting, and is left stopped.
+
+RETURNS
+
+    The file descriptor of the counter, or -1
+
+*/
+int PerfCounters::OpenCounter(Counter a_counter, long long a_period, string& a_problem)
+{
+#ifdef __linux__
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.sample_period = (uint64_t)a_period;
+
+    switch (a_counter) {
+    case PC_TaskClock:
+        attr.type = PERF_TYPE_SOFTWARE;
+        attr.config = PERF_COUNT_SW_TASK_CLOCK;
+        break;
+    case PC_Cycles:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PC_Instructions:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PC_BranchMisses:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    default:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    }
+
+    int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0 && a_problem.empty()) {
+        a_problem = string(GetName(a_counter)) + ": " + strerror(errno);
+        if (errno == EACCES || errno == EPERM) {
+            a_problem += "; see /proc/sys/kernel/perf_event_paranoid";
+        }
+        else if (errno == ENOENT || errno == EOPNOTSUPP) {
+            a_problem += "; the host does not provide hardware counters to this process";
+        }
+    }
+    return fd;
+#else
+    a_problem = "performance counters are only read on Linux";
+    return -1;
+#endif
+}
+
+// Closes the counters.
+void PerfCounters::Close()
+{
+#ifdef __linux__
+    for (int& fd : m_fd) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+#endif
+}
+
+/*
+NAME
+
+    PerfSampler::Start - starts sampling
+
+SYNOPSIS
+
+    bool PerfSampler::Start();
+
+DESCRIPTION
+
+    A sampling counter is opened for the task clock, instructions and
+    branch misses.  Each signals this thread when it has counted its
+    period, and the signal charges the period to the op code being
+    executed.  The kernel stops a counter after each signal until it is
+    refreshed, so the handler refreshes it.
+
+RETURNS
+
+    Whether any counter is being sampled
+
+*/
+bool PerfSampler::Start()
+{
+#ifdef __linux__
+    if (s_active != nullptr) {
+        return false;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = OnSignal;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    s_active = this;
+    sigaction(SIGIO, &action, &m_oldAction);
+    m_running = true;
+
+    bool any = false;
+    for (int i = 0; i < SAMPLED_COUNT; i++) {
+        int fd = PerfCounters::OpenCounter(SAMPLED[i], PERIOD[i], m_problem);
+        if (fd < 0) {
+            continue;
+        }
+        f_owner_ex owner = { F_OWNER_TID, (pid_t)syscall(SYS_gettid) };
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_ASYNC);
+        fcntl(fd, F_SETSIG, SIGIO);
+        fcntl(fd, F_SETOWN_EX, &owner);
+        m_fd[i] = fd;
+        m_sampled[i] = true;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_REFRESH, 1);
+        any = true;
+    }
+    if (!any) {
+        Stop();
+    }
+    return any;
+#else
+    return false;
+#endif
+}
+
+// Stops sampling and restores the signal handler it replaced.
+void PerfSampler::Stop()
+{
+#ifdef __linux__
+    if (!m_running) {
+        return;
+    }
+    for (int& fd : m_fd) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            close(fd);
+            fd = -1;
+        }
+    }
+    sigaction(SIGIO, &m_oldAction, nullptr);
+    s_active = nullptr;
+    m_running = false;
+#endif
+}
+
+/*
+NAME
+
+    PerfSampler::DisplayReport - displays the counts of each op code
+
+SYNOPSIS
+
+    void PerfSampler::DisplayReport() const;
+
+DESCRIPTION
+
+    For each op code executed, the number executed is displayed with
+    the counts charged to it per instruction: each sample stands for a
+    period of counts.  Op codes executed rarely get few samples, so
+    their figures are rough.
+
+*/
+void PerfSampler::DisplayReport() const
+{
+    cout << endl << "Host counts per guest instruction by op code (sampled):" << endl;
+    cout << "  " << left << setw(10) << "Op code" << right << setw(14) << "Executed";
+    for (int i = 0; i < SAMPLED_COUNT; i++) {
+        cout << setw(16) << PerfCounters::GetName(SAMPLED[i]);
+    }
+    cout << endl;
+
+    for (int opcode = 0; opcode < MAX_OPCODE; opcode++) {
+        if (m_executed[opcode] == 0) {
+            continue;
+        }
+        // The immediate and register forms are shown as "add #" and "add $".
+        const char* base = OpCodes::NameOf(opcode);
+        string name = base == nullptr ? to_string(opcode) : base;
+        if (OpCodes::FormOf(opcode) != OpCodes::OM_Memory) {
+            name += OpCodes::FormOf(opcode) == OpCodes::OM_Immediate ? " #" : " $";
+        }
+        cout << "  " << left << setw(10) << name << right << setw(14) << m_executed[opcode];
+        for (int i = 0; i < SAMPLED_COUNT; i++) {
+            if (!m_sampled[i]) {
+                cout << setw(16) << "-";
+            }
+            else {
+                cout << setw(16) << fixed << setprecision(2) << (double)m_samples[i][opcode] * PERIOD[i] / m_executed[opcode];
+            }
+        }
+        cout << endl;
+    }
+}
+
+// Charges a sample of the counter with file descriptor a_fd to the published op code.
+void PerfSampler::TakeSample(int a_fd)
+{
+    for (int i = 0; i < SAMPLED_COUNT; i++) {
+        if (m_fd[i] == a_fd) {
+            m_samples[i][m_opcode.load(memory_order_relaxed)]++;
+#ifdef __linux__
+            ioctl(a_fd, PERF_EVENT_IOC_REFRESH, 1);
+#endif
+        }
+    }
+}
+
+#ifdef __linux__
+// Handles the signal of a sampling counter.
+void PerfSampler::OnSignal(int, siginfo_t* a_info, void*)
+{
+    PerfSampler* sampler = s_active;
+    if (sampler != nullptr) {
+        sampler->TakeSample(a_info->si_fd);
+    }
+}
+#endif
@@ -0,0 +1,121 @@
+//
+//		Classes to read the host's performance counters while the emulator runs.
+//		PerfCounters counts over a whole run; PerfSampler, as hooks, publishes the
+//		op code of each instruction and is interrupted every so many counts to
+//		charge them to the op code being executed.  Counters the host does not have,
+//		or does not permit, are left out, so a run is never stopped for want of them.
+//		The counters are read with perf_event_open, so only on Linux.
+//
+#pragma once
+
+#include <atomic>
+#include "Emulator.h"
+
+#ifdef __linux__
+#include <signal.h>
+#endif
+
+class PerfCounters {
+
+public:
+
+    // The counters read.  The task clock, in nanoseconds, is a software counter and
+    // is available in containers that do not permit the hardware ones.
+    enum Counter { PC_TaskClock, PC_Cycles, PC_Instructions, PC_BranchMisses, PC_CacheMisses, PC_COUNT };
+
+    PerfCounters() {};
+    ~PerfCounters() { Close(); }
+
+    // Opens the counters the host permits.  Returns false if there are none.
+    bool Open();
+
+    // Starts and stops counting.
+    void Start();
+    void Stop();
+
+    // Determines if a counter could be opened.
+    bool IsOpen(Counter a_counter) const { return m_fd[a_counter] >= 0; }
+
+    // Returns the count, scaled up if the counter was shared with others.
+    long long GetValue(Counter a_counter) const;
+
+    // Why the counters that are missing could not be opened.
+    const string& GetProblem() const { return m_problem; }
+
+    // Displays the counts and the counts per guest instruction.
+    void DisplayReport(long long a_guestInstructions) const;
+
+    // Returns the name of a counter.
+    static const char* GetName(Counter a_counter);
+
+    // Opens a counter, leaving it stopped.  Returns -1, recording why, if it cannot be
+    // opened.  a_period > 0 makes a sampling counter that signals each a_period counts.
+    static int OpenCounter(Counter a_counter, long long a_period, string& a_problem);
+
+private:
+
+    // Closes the counters.
+    void Close();
+
+    int m_fd[PC_COUNT] = { -1, -1, -1, -1, -1 };   // The counters; -1 for those not opened.
+    string m_problem;                               // Why some counters could not be opened.
+};
+
+class PerfSampler : public EmulatorBase::NoHooks {
+
+public:
+
+    PerfSampler() {};
+    ~PerfSampler() { Stop(); }
+
+    // Starts and stops sampling.  Only one sampler may sample at a time.  Returns
+    // false if no counter can be sampled.
+    bool Start();
+    void Stop();
+
+    // Publishes the op code of the instruction about to be executed and counts it.
+    template<typename Machine>
+    bool BeforeInstruction(const Machine& a_machine, int a_loc, long long, EmulatorBase::RunResult&) {
+        int opcode = Machine::Encoding::OpCode(a_machine.GetMemory()[a_loc]);
+        if (opcode < 0 || opcode >= MAX_OPCODE) {
+            opcode = 0;
+        }
+        m_opcode.store(opcode, memory_order_relaxed);
+        m_executed[opcode]++;
+        return false;
+    }
+
+    // Displays, for each op code executed, the counts charged to each instruction.
+    void DisplayReport() const;
+
+private:
+
+    static const int MAX_OPCODE = 100;      // Op codes are two digits; others are counted as 0.
+
+    // Counters sampled and the counts between samples.
+    static constexpr PerfCounters::Counter SAMPLED[] = { PerfCounters::PC_TaskClock, PerfCounters::PC_Instructions, PerfCounters::PC_BranchMisses };
+    static constexpr long long PERIOD[] = { 100000, 1000000, 10000 };
+    static const int SAMPLED_COUNT = 3;
+
+    // Charges a sample to the published op code.  Called by the counter's signal.
+    void TakeSample(int a_fd);
+
+#ifdef __linux__
+    // Handles the signal of a sampling counter.
+    static void OnSignal(int a_signal, siginfo_t* a_info, void* a_context);
+#endif
+
+    int m_fd[SAMPLED_COUNT] = { -1, -1, -1 };               // The sampling counters.
+    bool m_sampled[SAMPLED_COUNT] = {};                     // == true for the counters that were sampled.
+    atomic<int> m_opcode{ 0 };                              // The published op code.
+    long long m_executed[MAX_OPCODE] = {};                  // Instructions executed of each op code.
+    long long m_samples[SAMPLED_COUNT][MAX_OPCODE] = {};    // Samples charged to each op code.
+    bool m_running = false;                                 // == true while sampling.
+    string m_problem;                                       // Why counters could not be sampled.
+
+#ifdef __linux__
+    struct sigaction m_oldAction;           // The signal handler replaced while sampling.
+#endif
+
+    static PerfSampler* s_active;           // The sampler that is sampling.
+};
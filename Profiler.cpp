@@ -0,0 +1,258 @@
+//
+//		Implementation of the Profiler class.
+//
+#include "stdafx.h"
+#include "Profiler.h"
+#include <chrono>
+#include <fstream>
+
+Profiler* Profiler::s_active = nullptr;
+
+/*
+NAME
+
+    Profiler::Profiler - prepares an empty histogram
+
+SYNOPSIS
+
+    Profiler::Profiler(int a_memSize, int a_rate);
+    a_memSize -> the number of locations that can be sampled
+    a_rate -> the samples to take each second
+
+*/
+Profiler::Profiler(int a_memSize, int a_rate) :
+    m_rate(a_rate > 0 ? a_rate : 1), m_samples(new long long[a_memSize]()), m_memSize(a_memSize)
+{
+}
+
+/*
+NAME
+
+    Profiler::Start - starts sampling
+
+SYNOPSIS
+
+    bool Profiler::Start();
+
+DESCRIPTION
+
+    On POSIX systems this function installs a handler for SIGPROF and
+    sets the profiling timer, which counts the CPU time of the process.
+    On Windows it starts a thread that samples at the same rate.
+
+RETURNS
+
+    Whether sampling started
+
+*/
+bool Profiler::Start()
+{
+    if (m_running || s_active != nullptr) {
+        return false;
+    }
+    s_active = this;
+
+#ifdef _WIN32
+    m_stopping = false;
+    m_sampler = thread(&Profiler::SampleLoop, this);
+#else
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = &Profiler::OnSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &m_oldAction) != 0) {
+        s_active = nullptr;
+        return false;
+    }
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 1000000 / m_rate;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, &m_oldTimer) != 0) {
+        sigaction(SIGPROF, &m_oldAction, nullptr);
+        s_active = nullptr;
+        return false;
+    }
+#endif
+
+    m_running = true;
+    return true;
+}
+
+/*
+NAME
+
+    Profiler::Stop - stops sampling
+
+SYNOPSIS
+
+    void Profiler::Stop();
+
+DESCRIPTION
+
+    This function restores the profiling timer and signal handler that
+    were in place when sampling started.  The run is over by then, so
+    the published location is withdrawn first, and a sample taken
+    before the timer is disarmed is counted as outside the program
+    rather than against its last instruction.
+
+*/
+void Profiler::Stop()
+{
+    if (!m_running) {
+        return;
+    }
+    m_loc.store(-1, memory_order_relaxed);
+
+#ifdef _WIN32
+    m_stopping = true;
+    m_sampler.join();
+#else
+    setitimer(ITIMER_PROF, &m_oldTimer, nullptr);
+    sigaction(SIGPROF, &m_oldAction, nullptr);
+#endif
+
+    m_running = false;
+    s_active = nullptr;
+}
+
+/*
+NAME
+
+    Profiler::TakeSample - records the published location
+
+SYNOPSIS
+
+    void Profiler::TakeSample();
+
+DESCRIPTION
+
+    This function runs in the signal handler, so it only reads the
+    published location and counts it.
+
+*/
+void Profiler::TakeSample()
+{
+    int loc = m_loc.load(memory_order_relaxed);
+    if (loc >= 0 && loc < m_memSize) {
+        m_samples[loc]++;
+    }
+    else {
+        m_outside++;
+    }
+}
+
+#ifdef _WIN32
+/*
+NAME
+
+    Profiler::SampleLoop - samples until stopped
+
+SYNOPSIS
+
+    void Profiler::SampleLoop();
+
+*/
+void Profiler::SampleLoop()
+{
+    chrono::microseconds period(1000000 / m_rate);
+    while (!m_stopping) {
+        this_thread::sleep_for(period);
+        TakeSample();
+    }
+}
+#else
+/*
+NAME
+
+    Profiler::OnSignal - handles the profiling timer
+
+SYNOPSIS
+
+    void Profiler::OnSignal(int a_signal);
+    a_signal -> SIGPROF
+
+*/
+void Profiler::OnSignal(int)
+{
+    if (s_active != nullptr) {
+        s_active->TakeSample();
+    }
+}
+#endif
+
+/*
+NAME
+
+    Profiler::WriteReport - writes the histogram
+
+SYNOPSIS
+
+    bool Profiler::WriteReport(const string& a_fileName, const SourceMap& a_lines, const map<string, int>& a_symbols) const;
+    a_fileName -> the file to be written
+    a_lines -> the source line translated at each location
+    a_symbols -> the labels of the program and their locations
+
+DESCRIPTION
+
+    This function lists every sampled location, most sampled first,
+    with its share of the samples, the nearest label at or before it
+    and the source statement it was translated from.
+
+RETURNS
+
+    Whether the file was written
+
+*/
+bool Profiler::WriteReport(const string& a_fileName, const SourceMap& a_lines, const map<string, int>& a_symbols) const
+{
+    ofstream out(a_fileName);
+    if (!out) {
+        return false;
+    }
+
+    // The labels by location, to find the one nearest each sampled location.
+    map<int, string> labels;
+    for (const auto& symbol : a_symbols) {
+        if (symbol.second >= 0) {
+            labels[symbol.second] = symbol.first;
+        }
+    }
+
+    vector<int> sampled;
+    long long total = m_outside;
+    for (int loc = 0; loc < m_memSize; loc++) {
+        if (m_samples[loc] > 0) {
+            sampled.push_back(loc);
+            total += m_samples[loc];
+        }
+    }
+    stable_sort(sampled.begin(), sampled.end(), [this](int a, int b) { return m_samples[a] > m_samples[b]; });
+
+    out << "Samples taken every " << 1000000 / m_rate << " microseconds of CPU time: " << total << endl;
+    out << "Outside the program: " << m_outside << endl << endl;
+    out << left << setw(10) << "Samples" << setw(9) << "Percent" << setw(10) << "Location" << setw(16) << "Label"
+        << setw(7) << "Line" << "Statement" << endl;
+
+    for (int loc : sampled) {
+        string label;
+        auto nearest = labels.upper_bound(loc);
+        if (nearest != labels.begin()) {
+            --nearest;
+            label = nearest->second + (loc == nearest->first ? "" : "+" + to_string(loc - nearest->first));
+        }
+        auto line = a_lines.find(loc);
+
+        out << left << setw(10) << m_samples[loc] << right << setw(6) << fixed << setprecision(1)
+            << 100.0 * m_samples[loc] / total << "%  " << left << setw(10) << loc << setw(16) << label;
+        if (line != a_lines.end()) {
+            out << setw(7) << line->second.m_number << line->second.m_text;
+        }
+        out << endl;
+    }
+
+    out.close();
+    return !out.fail();
+}
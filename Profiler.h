@@ -0,0 +1,71 @@
+//
+//		Sampling profiler for the emulator.  As hooks, it publishes the location of
+//		each instruction to a single slot; a profiling timer samples the slot at a
+//		fixed rate.  The samples are reported against the source lines and labels.
+//
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <thread>
+#include "MemoryImage.h"
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+class Profiler : public EmulatorBase::NoHooks {
+
+public:
+
+    // Prepares to sample locations 0 to a_memSize - 1, a_rate times a second of CPU time.
+    Profiler(int a_memSize, int a_rate = 1000);
+    ~Profiler() { Stop(); }
+
+    // Starts and stops sampling.  Only one profiler may sample at a time.
+    bool Start();
+    void Stop();
+
+    // Publishes the location of the instruction about to be executed.
+    template<typename Machine>
+    bool BeforeInstruction(const Machine&, int a_loc, long long, EmulatorBase::RunResult&) {
+        m_loc.store(a_loc, memory_order_relaxed);
+        return false;
+    }
+
+    // Writes the samples of each location, most sampled first, with the source line
+    // and the nearest label at or before the location.
+    bool WriteReport(const string& a_fileName, const SourceMap& a_lines, const map<string, int>& a_symbols) const;
+
+private:
+
+    // Records the published location.  Called by the profiling timer.
+    void TakeSample();
+
+#ifdef _WIN32
+    // Samples until stopped.  Windows has no profiling timer, so a thread samples.
+    void SampleLoop();
+#else
+    // Handles the profiling timer signal.
+    static void OnSignal(int a_signal);
+#endif
+
+    int m_rate;                         // Samples a second.
+    atomic<int> m_loc{ -1 };            // The published location; -1 when not emulating.
+    unique_ptr<long long[]> m_samples;  // Samples of each location.
+    int m_memSize;                      // Locations that can be sampled.
+    long long m_outside = 0;            // Samples taken when no location was published.
+    bool m_running = false;             // == true while sampling.
+
+#ifdef _WIN32
+    atomic<bool> m_stopping{ false };   // == true when the sampling thread should finish.
+    thread m_sampler;                   // The sampling thread.
+#else
+    struct sigaction m_oldAction;       // The signal handler replaced while sampling.
+    struct itimerval m_oldTimer;        // The profiling timer replaced while sampling.
+#endif
+
+    static Profiler* s_active;          // The profiler that is sampling.
+};
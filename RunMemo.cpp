@@ -0,0 +1,416 @@
+//
+//		Implementation of the RunMemo class.
+//
+#include "stdafx.h"
+#include <filesystem>
+#include <fstream>
+#include "RunMemo.h"
+#include "AsmCache.h"
+#include "Binary.h"
+#include "FileAccess.h"
+#include "Hash.h"
+#include "MappedFile.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    const uint32_t MEMO_MAGIC = 0x524d4b51;     // "QKMR"
+    const uint32_t MEMO_FORMAT = 2;             // Layout version of a record file.
+    const char* const RECORD_EXTENSION = ".run";
+    const char* const STATS_FILE = "stats.log";
+
+    // Hashes of every prefix of the input values.  Element k covers the first k values.
+    vector<uint64_t> PrefixHashes(const vector<int>& a_input, size_t a_count)
+    {
+        vector<uint64_t> hashes(1, Hash::FNV_OFFSET);
+        for (size_t i = 0; i < a_count; i++) {
+            hashes.push_back(Hash::Fnv1a(&a_input[i], sizeof(int), hashes.back()));
+        }
+        return hashes;
+    }
+}
+
+// Constructor for the memo.  The directory is created if it does not exist.
+RunMemo::RunMemo(const string& a_dir) : m_dir(a_dir)
+{
+    error_code ec;
+    fs::create_directories(m_dir, ec);
+}
+
+/*
+NAME
+
+    RunMemo::Run - runs a program, reusing a recorded run if possible
+
+SYNOPSIS
+
+    emulator::RunResult RunMemo::Run(emulator& a_emul, uint64_t a_imageHash, long long a_budget);
+    a_emul -> the emulator holding the program and its input
+    a_imageHash -> the hash of the initial memory of the emulator
+    a_budget -> the most instructions to execute, or negative for no limit
+
+DESCRIPTION
+
+    This function looks for a recorded run of the same program whose
+    consumed input is a prefix of the emulator's input.  A complete
+    match is replayed without executing anything: its output is
+    displayed and its final state is restored into the emulator.  A
+    run that was cut off by a smaller budget, or that ran out of input
+    where this run has more, is restored and then continued.  Whatever
+    is executed is recorded for next time.
+
+RETURNS
+
+    Why the run stopped
+
+*/
+emulator::RunResult RunMemo::Run(emulator& a_emul, uint64_t a_imageHash, long long a_budget)
+{
+    string runDir = (fs::path(m_dir) / Hash::ToHex(a_imageHash)).string();
+    error_code ec;
+    fs::create_directories(runDir, ec);
+
+    // Keep the initial memory to find the words the run changes.
+    vector<int> initial(a_emul.GetMemory(), a_emul.GetMemory() + emulator::MEMSZ);
+
+    Record record;
+    LookupResult found = Lookup(runDir, a_imageHash, a_emul.GetInput(), a_budget, record);
+    string output;
+    if (found != LR_Miss) {
+        for (const auto& change : record.m_changes) {
+            a_emul.GetMemory()[change.first] = change.second;
+        }
+        a_emul.RestoreState(record.m_pc, record.m_reg, record.m_steps, record.m_input.size(), record.m_writes);
+        cout << record.m_output;
+        output = record.m_output;
+    }
+    if (found == LR_Hit) {
+        LogOutcome('H');
+        return record.m_result;
+    }
+    LogOutcome(found == LR_Partial ? 'P' : 'M');
+
+    // Execute the rest of the run, capturing what it displays.
+    OutputTee tee(cout.rdbuf(), output);
+    ostream capture(&tee);
+    a_emul.SetOutput(&capture);
+    emulator::RunResult result = a_emul.Execute(a_budget < 0 ? -1 : a_budget - a_emul.GetSteps());
+    capture.flush();
+    a_emul.SetOutput(&cout);
+
+    record.m_input.assign(a_emul.GetInput().begin(), a_emul.GetInput().begin() + a_emul.GetInputPosition());
+    record.m_result = result;
+    record.m_steps = a_emul.GetSteps();
+    record.m_writes = a_emul.GetWrites();
+    record.m_pc = a_emul.GetPC();
+    memcpy(record.m_reg, a_emul.GetRegisters(), sizeof(record.m_reg));
+    record.m_changes.clear();
+    for (int loc = 0; loc < emulator::MEMSZ; loc++) {
+        if (a_emul.GetMemory()[loc] != initial[loc]) {
+            record.m_changes.push_back({ loc, a_emul.GetMemory()[loc] });
+        }
+    }
+    record.m_output = output;
+    WriteRecord(runDir, a_imageHash, record);
+
+    return result;
+}
+
+/*
+NAME
+
+    RunMemo::Lookup - finds the best recorded run
+
+SYNOPSIS
+
+    RunMemo::LookupResult RunMemo::Lookup(const string& a_runDir, uint64_t a_imageHash,
+        const vector<int>& a_input, long long a_budget, Record& a_record);
+    a_runDir -> the directory of runs of this program
+    a_imageHash -> the hash of the initial memory of the emulator
+    a_input -> the input values available to this run
+    a_budget -> the most instructions to execute, or negative for no limit
+    a_record -> the storage for the run that was found
+
+DESCRIPTION
+
+    Record files are named after the number of values they consumed,
+    the hash of those values and the number of instructions executed,
+    so candidates are found from the directory listing alone.  A
+    candidate that stopped on its own, or stopped for the same reason
+    this run would, is a complete answer.  Otherwise the candidate that
+    got furthest is returned so the run can be continued from it.  A
+    candidate whose record names another program, as one copied into
+    the wrong directory would, is skipped.
+
+RETURNS
+
+    Whether a complete, partial or no recorded run was found
+
+*/
+RunMemo::LookupResult RunMemo::Lookup(const string& a_runDir, uint64_t a_imageHash, const vector<int>& a_input, long long a_budget, Record& a_record)
+{
+    struct Candidate {
+        string m_path;
+        size_t m_count;
+        long long m_steps;
+    };
+    vector<Candidate> candidates;
+    vector<uint64_t> prefixes;
+
+    error_code ec;
+    for (fs::directory_iterator it(a_runDir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().extension() != RECORD_EXTENSION) {
+            continue;
+        }
+
+        // Names are <count>-<hash>-<steps>.run
+        string name = it->path().stem().string();
+        size_t first = name.find('-');
+        size_t second = name.rfind('-');
+        if (first == string::npos || first == second) {
+            continue;
+        }
+        size_t count = strtoull(name.substr(0, first).c_str(), NULL, 10);
+        uint64_t hash = strtoull(name.substr(first + 1, second - first - 1).c_str(), NULL, 16);
+        long long steps = strtoll(name.substr(second + 1).c_str(), NULL, 10);
+        if (count > a_input.size() || (a_budget >= 0 && steps > a_budget)) {
+            continue;
+        }
+        if (prefixes.empty()) {
+            prefixes = PrefixHashes(a_input, a_input.size());
+        }
+        if (prefixes[count] == hash) {
+            candidates.push_back({ it->path().string(), count, steps });
+        }
+    }
+
+    // Prefer the candidates that got furthest.
+    sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.m_steps > b.m_steps; });
+
+    LookupResult found = LR_Miss;
+    Record record;
+    for (const Candidate& candidate : candidates) {
+        if (!ReadRecord(candidate.m_path, a_imageHash, record) || !equal(record.m_input.begin(), record.m_input.end(), a_input.begin())) {
+            continue;
+        }
+
+        bool complete = false;
+        switch (record.m_result) {
+        case emulator::RR_Halted:
+        case emulator::RR_IllegalOpcode:
+        case emulator::RR_InfiniteLoop:
+        case emulator::RR_Fault:
+            complete = true;
+            break;
+        case emulator::RR_Budget:
+            complete = record.m_steps == a_budget;
+            break;
+        case emulator::RR_EndOfInput:
+            complete = record.m_input.size() == a_input.size();
+            break;
+        case emulator::RR_WaitingForInput:
+            break;
+        }
+        if (complete) {
+            a_record = record;
+            return LR_Hit;
+        }
+        if (found == LR_Miss) {
+            a_record = record;
+            found = LR_Partial;
+        }
+    }
+    return found;
+}
+
+/*
+NAME
+
+    RunMemo::ReadRecord - reads a record file
+
+SYNOPSIS
+
+    bool RunMemo::ReadRecord(const string& a_path, uint64_t a_imageHash, Record& a_record);
+    a_path -> the record file
+    a_imageHash -> the hash of the program the record must belong to
+    a_record -> the storage for the record
+
+RETURNS
+
+    Whether the file held an intact record of the program
+
+*/
+bool RunMemo::ReadRecord(const string& a_path, uint64_t a_imageHash, Record& a_record)
+{
+    MappedFile file;
+    if (!file.Open(a_path) || file.GetSize() < 2 * sizeof(uint64_t)) {
+        return false;
+    }
+    size_t payload = file.GetSize() - sizeof(uint64_t);
+    uint64_t checksum;
+    memcpy(&checksum, file.GetData() + payload, sizeof(checksum));
+    if (checksum != Hash::Fnv1a(file.GetData(), payload)) {
+        return false;
+    }
+
+    BinaryReader in(file.GetData(), payload);
+    if (in.GetUInt32() != MEMO_MAGIC || in.GetUInt32() != MEMO_FORMAT) {
+        return false;
+    }
+    if (in.GetUInt64() != a_imageHash) {
+        return false;
+    }
+
+    uint32_t count = in.GetUInt32();
+    if (count > in.GetRemaining() / sizeof(int32_t)) {
+        return false;
+    }
+    a_record.m_input.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        a_record.m_input[i] = in.GetInt32();
+    }
+    a_record.m_result = (emulator::RunResult)in.GetInt32();
+    a_record.m_steps = in.GetInt64();
+    a_record.m_writes = in.GetInt64();
+    a_record.m_pc = in.GetInt32();
+    for (int i = 0; i < emulator::REGCOUNT; i++) {
+        a_record.m_reg[i] = in.GetInt32();
+    }
+    count = in.GetUInt32();
+    if (count > in.GetRemaining() / (2 * sizeof(int32_t))) {
+        return false;
+    }
+    a_record.m_changes.clear();
+    for (uint32_t i = 0; i < count; i++) {
+        int loc = in.GetInt32();
+        int value = in.GetInt32();
+        if (loc < 0 || loc >= emulator::MEMSZ) {
+            return false;
+        }
+        a_record.m_changes.push_back({ loc, value });
+    }
+    a_record.m_output = in.GetString();
+    return !in.Failed();
+}
+
+/*
+NAME
+
+    RunMemo::WriteRecord - writes a record file
+
+SYNOPSIS
+
+    void RunMemo::WriteRecord(const string& a_runDir, uint64_t a_imageHash, const Record& a_record);
+    a_runDir -> the directory of runs of this program
+    a_imageHash -> the hash of the program
+    a_record -> the run to be recorded
+
+DESCRIPTION
+
+    This function writes the record file in one step so that concurrent
+    runs never read a partial record.
+
+*/
+void RunMemo::WriteRecord(const string& a_runDir, uint64_t a_imageHash, const Record& a_record)
+{
+    BinaryWriter out;
+    out.PutUInt32(MEMO_MAGIC);
+    out.PutUInt32(MEMO_FORMAT);
+    out.PutUInt64(a_imageHash);
+    out.PutUInt32((uint32_t)a_record.m_input.size());
+    for (int value : a_record.m_input) {
+        out.PutInt32(value);
+    }
+    out.PutInt32(a_record.m_result);
+    out.PutInt64(a_record.m_steps);
+    out.PutInt64(a_record.m_writes);
+    out.PutInt32(a_record.m_pc);
+    for (int i = 0; i < emulator::REGCOUNT; i++) {
+        out.PutInt32(a_record.m_reg[i]);
+    }
+    out.PutUInt32((uint32_t)a_record.m_changes.size());
+    for (const auto& change : a_record.m_changes) {
+        out.PutInt32(change.first);
+        out.PutInt32(change.second);
+    }
+    out.PutString(a_record.m_output);
+    out.PutUInt64(Hash::Fnv1a(out.GetBytes().data(), out.GetBytes().size()));
+
+    uint64_t hash = PrefixHashes(a_record.m_input, a_record.m_input.size()).back();
+    string name = to_string(a_record.m_input.size()) + "-" + Hash::ToHex(hash) + "-" + to_string(a_record.m_steps);
+    fs::path path = fs::path(a_runDir) / (name + RECORD_EXTENSION);
+
+    FileAccess::WriteAtomically(path.string(), out.GetBytes());
+}
+
+/*
+NAME
+
+    RunMemo::LogOutcome - records the outcome of a lookup
+
+SYNOPSIS
+
+    void RunMemo::LogOutcome(char a_outcome);
+    a_outcome -> 'H' for a hit, 'P' for a partial hit, 'M' for a miss
+
+DESCRIPTION
+
+    Each lookup appends one character to the statistics log.  Single
+    byte appends do not interleave, so runs sharing the directory can
+    all log to it.
+
+*/
+void RunMemo::LogOutcome(char a_outcome)
+{
+    ofstream log((fs::path(m_dir) / STATS_FILE).string(), ios::out | ios::app | ios::binary);
+    log.put(a_outcome);
+}
+
+/*
+NAME
+
+    RunMemo::DisplayStats - reports the effectiveness of the memo
+
+SYNOPSIS
+
+    void RunMemo::DisplayStats();
+
+DESCRIPTION
+
+    This function displays how many lookups hit, partially hit and
+    missed, along with the number and total size of the recorded runs,
+    so the memo directory can be sized.
+
+*/
+void RunMemo::DisplayStats()
+{
+    long long hits = 0, partial = 0, misses = 0;
+    ifstream log((fs::path(m_dir) / STATS_FILE).string(), ios::in | ios::binary);
+    char outcome;
+    while (log.get(outcome)) {
+        if (outcome == 'H') hits++;
+        else if (outcome == 'P') partial++;
+        else if (outcome == 'M') misses++;
+    }
+
+    long long records = 0;
+    uintmax_t bytes = 0;
+    error_code ec;
+    for (fs::recursive_directory_iterator it(m_dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().extension() == RECORD_EXTENSION) {
+            error_code ignore;
+            records++;
+            bytes += fs::file_size(it->path(), ignore);
+        }
+    }
+
+    long long lookups = hits + partial + misses;
+    cout << "Run memo statistics:" << endl << endl;
+    cout << "Lookups        " << lookups << endl;
+    cout << "Hits           " << hits << endl;
+    cout << "Partial hits   " << partial << endl;
+    cout << "Misses         " << misses << endl;
+    cout << "Hit rate       " << fixed << setprecision(1) << (lookups ? 100.0 * hits / lookups : 0.0) << "%" << endl;
+    cout << "Recorded runs  " << records << " (" << bytes << " bytes)" << endl;
+    cout << "__________________________________________________________" << endl << endl << endl;
+}
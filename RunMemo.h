@@ -0,0 +1,55 @@
+//
+//		Class to memoize emulator runs.  The Quack3200 is deterministic, so a run
+//		is fully described by the initial memory and the input values it consumed.
+//
+#pragma once
+
+#include <stdint.h>
+#include "Emulator.h"
+
+class RunMemo {
+
+public:
+
+    RunMemo(const string& a_dir);
+    ~RunMemo() {};
+
+    // Runs the program in the emulator, reusing a recorded run where possible.
+    emulator::RunResult Run(emulator& a_emul, uint64_t a_imageHash, long long a_budget);
+
+    // Displays the hit rate and size of the memo directory.
+    void DisplayStats();
+
+private:
+
+    // A recorded run.
+    struct Record {
+        vector<int> m_input;                // The input values consumed.
+        emulator::RunResult m_result;       // Why the run stopped.
+        long long m_steps;                  // The instructions executed.
+        long long m_writes;                 // The WRITE instructions executed.
+        int m_pc;                           // The final location.
+        int m_reg[emulator::REGCOUNT];      // The final registers.
+        vector<pair<int, int>> m_changes;   // Memory words that differ from the initial memory.
+        string m_output;                    // Everything the run displayed.
+    };
+
+    // Outcomes of a lookup.
+    enum LookupResult {
+        LR_Miss,        // Nothing usable was recorded.
+        LR_Hit,         // A recorded run is the complete answer.
+        LR_Partial      // A recorded run is a prefix of this run and can be continued.
+    };
+
+    // Finds the recorded run of the program that best matches the input and budget.
+    LookupResult Lookup(const string& a_runDir, uint64_t a_imageHash, const vector<int>& a_input, long long a_budget, Record& a_record);
+
+    // Reads and writes record files.
+    bool ReadRecord(const string& a_path, uint64_t a_imageHash, Record& a_record);
+    void WriteRecord(const string& a_runDir, uint64_t a_imageHash, const Record& a_record);
+
+    // Appends the outcome of a lookup to the statistics log.
+    void LogOutcome(char a_outcome);
+
+    string m_dir;           // The memo directory.
+};
@@ -0,0 +1,348 @@
+//
+//		Implementation of the Scheduler class.
+//
+#include "stdafx.h"
+#include "Scheduler.h"
+#include <thread>
+
+/*
+NAME
+
+    Scheduler::Scheduler - prepares an empty scheduler
+
+SYNOPSIS
+
+    Scheduler::Scheduler(int a_workers, long long a_quantum, long long a_budget);
+    a_workers -> the number of threads that run guests
+    a_quantum -> the instructions a guest runs before yielding
+    a_budget -> the instructions each guest may run; negative for no limit
+
+*/
+Scheduler::Scheduler(int a_workers, long long a_quantum, long long a_budget) :
+    m_quantum(a_quantum > 0 ? a_quantum : 1), m_budget(a_budget)
+{
+    for (int i = 0; i < max(a_workers, 1); i++) {
+        m_queues.emplace_back(new WorkQueue);
+    }
+}
+
+/*
+NAME
+
+    Scheduler::AddGuest - adds a guest program
+
+SYNOPSIS
+
+    int Scheduler::AddGuest(const MemoryImage& a_image, const vector<long long>& a_input, bool a_moreToCome);
+    a_image -> the translation the guest runs
+    a_input -> the values for its READ instructions
+    a_moreToCome -> == true if more values will be provided while it runs
+
+DESCRIPTION
+
+    This function loads the translation into a new machine and queues
+    it to run.  Guests are spread over the workers in turn.  Guests
+    must all be added before Run is called.
+
+RETURNS
+
+    The id of the guest, or -1 if the translation does not fit in the
+    memory of the machine
+
+*/
+int Scheduler::AddGuest(const MemoryImage& a_image, const vector<long long>& a_input, bool a_moreToCome)
+{
+    unique_ptr<Guest> guest(new Guest);
+    if (!a_image.LoadInto(guest->m_machine)) {
+        return -1;
+    }
+    guest->m_machine.SetInput(a_input, a_moreToCome);
+    guest->m_machine.SetOutput(&guest->m_output);
+    guest->m_running = true;
+
+    int id = (int)m_guests.size();
+    m_guests.push_back(move(guest));
+    m_active++;
+    Schedule(id % (int)m_queues.size(), id);
+    return id;
+}
+
+/*
+NAME
+
+    Scheduler::ProvideInput - gives a value to a guest
+
+SYNOPSIS
+
+    void Scheduler::ProvideInput(int a_id, long long a_value);
+    a_id -> the id of the guest
+    a_value -> the value for its next READ
+
+DESCRIPTION
+
+    A guest waiting for input is woken up and queued again.  A running
+    guest receives the value when its quantum ends.
+
+*/
+void Scheduler::ProvideInput(int a_id, long long a_value)
+{
+    Guest& guest = *m_guests[a_id];
+    lock_guard<mutex> lock(guest.m_lock);
+    if (guest.m_running) {
+        guest.m_pending.push_back(a_value);
+        return;
+    }
+    guest.m_machine.AddInput((Machine::Word)a_value);
+    guest.m_running = true;
+    m_active++;
+    Schedule(a_id % (int)m_queues.size(), a_id);
+}
+
+/*
+NAME
+
+    Scheduler::CloseInput - marks the end of a guest's input
+
+SYNOPSIS
+
+    void Scheduler::CloseInput(int a_id);
+    a_id -> the id of the guest
+
+DESCRIPTION
+
+    A guest waiting for input is woken up so its READ can report that
+    there is no more input.
+
+*/
+void Scheduler::CloseInput(int a_id)
+{
+    Guest& guest = *m_guests[a_id];
+    lock_guard<mutex> lock(guest.m_lock);
+    if (guest.m_running) {
+        guest.m_closePending = true;
+        return;
+    }
+    guest.m_machine.CloseInput();
+    guest.m_running = true;
+    m_active++;
+    Schedule(a_id % (int)m_queues.size(), a_id);
+}
+
+/*
+NAME
+
+    Scheduler::Run - runs the guests
+
+SYNOPSIS
+
+    void Scheduler::Run();
+
+DESCRIPTION
+
+    This function starts the workers and waits until no guest is left
+    to run.  Guests waiting for input stay parked; Run may be called
+    again once input has been provided.
+
+*/
+void Scheduler::Run()
+{
+    vector<thread> workers;
+    for (int i = 1; i < (int)m_queues.size(); i++) {
+        workers.emplace_back(&Scheduler::Work, this, i);
+    }
+    Work(0);
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+/*
+NAME
+
+    Scheduler::Work - the loop of a worker
+
+SYNOPSIS
+
+    void Scheduler::Work(int a_worker);
+    a_worker -> the index of the worker
+
+DESCRIPTION
+
+    The worker runs guests from its own queue, stealing from the other
+    workers when its queue is empty, until no guest is queued or
+    running anywhere.  A worker that finds nothing to run sleeps until
+    a guest is queued or the last guest stops, so idle workers do not
+    hold on to a processor while a long guest finishes.
+
+*/
+void Scheduler::Work(int a_worker)
+{
+    while (m_active > 0) {
+        // Read before looking, so a guest queued after the look is not slept through.
+        long long queued = m_queued;
+        int id;
+        if (!Take(a_worker, id)) {
+            unique_lock<mutex> lock(m_idleLock);
+            m_idle.wait(lock, [&] { return m_queued != queued || m_active == 0; });
+            continue;
+        }
+        RunSlice(a_worker, id);
+    }
+}
+
+/*
+NAME
+
+    Scheduler::Take - finds a guest to run
+
+SYNOPSIS
+
+    bool Scheduler::Take(int a_worker, int& a_id);
+    a_worker -> the index of the worker
+    a_id -> receives the id of the guest
+
+DESCRIPTION
+
+    The most recently queued guest of the worker's own queue is taken
+    first, since its memory is most likely to still be in the cache.
+    Otherwise the oldest guest of another worker's queue is stolen.
+
+RETURNS
+
+    Whether a guest was found
+
+*/
+bool Scheduler::Take(int a_worker, int& a_id)
+{
+    int count = (int)m_queues.size();
+    for (int i = 0; i < count; i++) {
+        WorkQueue& queue = *m_queues[(a_worker + i) % count];
+        lock_guard<mutex> lock(queue.m_lock);
+        if (queue.m_ready.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            a_id = queue.m_ready.back();
+            queue.m_ready.pop_back();
+        }
+        else {
+            a_id = queue.m_ready.front();
+            queue.m_ready.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+/*
+NAME
+
+    Scheduler::Schedule - queues a ready guest
+
+SYNOPSIS
+
+    void Scheduler::Schedule(int a_worker, int a_id);
+    a_worker -> the worker whose queue receives the guest
+    a_id -> the id of the guest
+
+DESCRIPTION
+
+    An idle worker is woken up to run or steal the guest.
+
+*/
+void Scheduler::Schedule(int a_worker, int a_id)
+{
+    {
+        WorkQueue& queue = *m_queues[a_worker];
+        lock_guard<mutex> lock(queue.m_lock);
+        queue.m_ready.push_back(a_id);
+    }
+    {
+        lock_guard<mutex> lock(m_idleLock);
+        m_queued++;
+    }
+    m_idle.notify_one();
+}
+
+/*
+NAME
+
+    Scheduler::RunSlice - runs a guest for a quantum
+
+SYNOPSIS
+
+    void Scheduler::RunSlice(int a_worker, int a_id);
+    a_worker -> the index of the worker
+    a_id -> the id of the guest
+
+DESCRIPTION
+
+    This function runs the guest until its quantum or budget is used
+    up or it stops.  A guest that used up its quantum is queued again
+    at the front of the worker's queue, so the worker's other guests
+    run before it does again.  A guest waiting for input is parked
+    unless input arrived while it ran.
+
+*/
+void Scheduler::RunSlice(int a_worker, int a_id)
+{
+    Guest& guest = *m_guests[a_id];
+    Machine& machine = guest.m_machine;
+
+    long long quantum = m_quantum;
+    if (m_budget >= 0) {
+        quantum = min(quantum, m_budget - machine.GetSteps());
+    }
+    guest.m_result = machine.Execute(quantum);
+
+    lock_guard<mutex> lock(guest.m_lock);
+    DeliverPending(guest);
+
+    bool ready = false;
+    switch (guest.m_result) {
+    case EmulatorBase::RR_Budget:
+        ready = m_budget < 0 || machine.GetSteps() < m_budget;
+        break;
+    case EmulatorBase::RR_WaitingForInput:
+        ready = machine.IsInputReady();
+        break;
+    default:
+        break;
+    }
+
+    if (ready) {
+        WorkQueue& queue = *m_queues[a_worker];
+        lock_guard<mutex> queueLock(queue.m_lock);
+        queue.m_ready.push_front(a_id);
+        return;
+    }
+    guest.m_running = false;
+    if (--m_active == 0) {
+        // Wake the idle workers so they see that no guest is left.
+        lock_guard<mutex> idleLock(m_idleLock);
+        m_idle.notify_all();
+    }
+}
+
+/*
+NAME
+
+    Scheduler::DeliverPending - gives a guest the input that arrived while it ran
+
+SYNOPSIS
+
+    void Scheduler::DeliverPending(Guest& a_guest);
+    a_guest -> the guest, whose lock is held
+
+*/
+void Scheduler::DeliverPending(Guest& a_guest)
+{
+    for (long long value : a_guest.m_pending) {
+        a_guest.m_machine.AddInput((Machine::Word)value);
+    }
+    a_guest.m_pending.clear();
+    if (a_guest.m_closePending) {
+        a_guest.m_machine.CloseInput();
+        a_guest.m_closePending = false;
+    }
+}
@@ -0,0 +1,89 @@
+//
+//		Class to run many Quack3200 programs at once on a few threads.  Each
+//		guest runs for a quantum of instructions at a time; a guest whose READ
+//		finds no value is parked until input is provided.  Guests run on the
+//		small machine so that thousands of them fit in memory.
+//
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include "MemoryImage.h"
+
+class Scheduler {
+
+public:
+
+    typedef SmallEmulator Machine;      // The machine each guest runs on.
+
+    // a_workers threads run the guests a_quantum instructions at a time.  Each guest
+    // stops after a_budget instructions if a_budget is not negative.
+    Scheduler(int a_workers, long long a_quantum, long long a_budget);
+    ~Scheduler() {};
+
+    // Adds a guest running the translation.  If a_moreToCome, input can be provided
+    // while it runs.  Returns the guest's id, or -1 if the translation does not fit.
+    int AddGuest(const MemoryImage& a_image, const vector<long long>& a_input, bool a_moreToCome);
+
+    // Gives a value to a guest, or marks the end of its input.  May be called while the
+    // guests are running.
+    void ProvideInput(int a_id, long long a_value);
+    void CloseInput(int a_id);
+
+    // Runs the guests until each has stopped or is waiting for input.
+    void Run();
+
+    // Getter Functions
+    int GetGuestCount() const { return (int)m_guests.size(); }
+    EmulatorBase::RunResult GetResult(int a_id) const { return m_guests[a_id]->m_result; }
+    string GetOutput(int a_id) const { return m_guests[a_id]->m_output.str(); }
+    const Machine& GetMachine(int a_id) const { return m_guests[a_id]->m_machine; }
+
+private:
+
+    // A guest program and its state.
+    struct Guest {
+        Machine m_machine;                  // The guest's machine.
+        ostringstream m_output;             // Everything the guest displayed.
+        EmulatorBase::RunResult m_result = EmulatorBase::RR_Budget;  // Why the guest last stopped.
+        mutex m_lock;                       // Guards the members below.
+        vector<long long> m_pending;        // Input provided while the guest was running.
+        bool m_closePending = false;        // == true if the input was closed while the guest was running.
+        bool m_running = false;             // == true while the guest is queued or running.
+    };
+
+    // The guests ready to run on one worker.  The owner takes from the back and other
+    // workers steal from the front.
+    struct WorkQueue {
+        mutex m_lock;
+        deque<int> m_ready;
+    };
+
+    // The loop of a worker thread.
+    void Work(int a_worker);
+
+    // Takes a ready guest from the worker's queue, or steals one from another's.
+    bool Take(int a_worker, int& a_id);
+
+    // Queues a ready guest on a worker.
+    void Schedule(int a_worker, int a_id);
+
+    // Runs a guest for a quantum and decides what happens to it next.
+    void RunSlice(int a_worker, int a_id);
+
+    // Moves input provided while the guest was running into its machine.
+    void DeliverPending(Guest& a_guest);
+
+    long long m_quantum;                            // Instructions run before a guest yields.
+    long long m_budget;                             // Instructions each guest may run; negative for no limit.
+    vector<unique_ptr<Guest>> m_guests;             // All guests; the id is the index.
+    vector<unique_ptr<WorkQueue>> m_queues;         // The ready guests of each worker.
+    atomic<int> m_active{ 0 };                      // Guests queued or running.
+    mutex m_idleLock;                               // Guards the changes idle workers wait for.
+    condition_variable m_idle;                      // Signalled when a guest is queued or none is left.
+    atomic<long long> m_queued{ 0 };                // Guests queued by Schedule, changed under m_idleLock.
+};
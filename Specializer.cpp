@@ -0,0 +1,755 @@
+//
+//		Implementation of the Specializer class.
+//
+#include "stdafx.h"
+#include "Specializer.h"
+#include "OpCodes.h"
+#include <limits>
+
+/*
+NAME
+
+    Specializer::Specializer - lays the translation out for specializing
+
+SYNOPSIS
+
+    Specializer::Specializer(const MemoryImage& a_image, const vector<long long>& a_fixedInput);
+    a_image -> the translation
+    a_fixedInput -> the values of the first READs
+
+DESCRIPTION
+
+    The program is laid out in memory as the emulator would lay it out,
+    and everything starts out known: the memory and registers of the
+    Quack3200 start at zero, and a register that is zero already holds
+    its value when the residual program runs.
+
+*/
+Specializer::Specializer(const MemoryImage& a_image, const vector<long long>& a_fixedInput) :
+    m_image(a_image), m_fixedInput(a_fixedInput)
+{
+    m_memory.assign(emulator::MEMSZ, 0);
+    m_known.assign(emulator::MEMSZ, 1);
+    m_written.assign(emulator::MEMSZ, 0);
+    m_isCode.assign(emulator::MEMSZ, 0);
+    for (const MemoryImage::Word& word : m_image.GetWords()) {
+        if (word.m_loc >= 0 && word.m_loc < emulator::MEMSZ) {
+            m_memory[word.m_loc] = word.m_contents;
+            m_isCode[word.m_loc] = word.m_isCode;
+        }
+    }
+    m_original = m_memory;
+    m_originalWords = (int)m_image.GetWords().size();
+    for (int reg = 0; reg < REGCOUNT; reg++) {
+        m_reg[reg] = 0;
+        m_regKnown[reg] = true;
+        m_regSynced[reg] = true;
+    }
+}
+
+/*
+NAME
+
+    Specializer::Specialize - specializes the translation for the fixed input
+
+SYNOPSIS
+
+    bool Specializer::Specialize(long long a_maxSteps);
+    a_maxSteps -> the most instructions to trace; negative for the default
+
+DESCRIPTION
+
+    The program is traced from the origin until an instruction cannot be
+    followed or it halts.  Every fixed value must be read by then, since
+    the specialized program no longer reads them.  The residual program
+    then loads each known register that does not yet hold its value and
+    branches to where the trace stopped, and the translation is rebuilt
+    around it.
+
+RETURNS
+
+    Whether the translation was specialized
+
+*/
+bool Specializer::Specialize(long long a_maxSteps)
+{
+    if (a_maxSteps < 0) {
+        a_maxSteps = DEFAULT_STEPS;
+    }
+    for (long long steps = 0; ; steps++) {
+        if (steps >= a_maxSteps) {
+            m_stop = "the step limit was reached";
+            break;
+        }
+        StepResult result = Step();
+        if (result == SR_Stopped) {
+            break;
+        }
+        if (result == SR_Halted) {
+            m_halted = true;
+            break;
+        }
+        if (result == SR_Evaluated) {
+            m_evaluated++;
+        }
+    }
+    if (!m_refusal.empty()) {
+        return false;
+    }
+    if (m_inputPos < m_fixedInput.size()) {
+        m_refusal = "only " + to_string(m_inputPos) + " of the fixed values are read before " +
+            (m_halted ? "the program halts" : m_stop);
+        return false;
+    }
+    if (m_evaluated == 0) {
+        m_refusal = "no instruction could be evaluated";
+        return false;
+    }
+
+    if (!m_halted) {
+        for (int reg = 0; reg < REGCOUNT; reg++) {
+            Sync(reg);
+        }
+        Keep(9, 0, m_pc);
+    }
+    return Build();
+}
+
+/*
+NAME
+
+    Specializer::Step - evaluates or keeps an instruction
+
+SYNOPSIS
+
+    StepResult Specializer::Step();
+
+DESCRIPTION
+
+    The instruction at m_pc is evaluated if the values it uses are
+    known.  Otherwise, if it can be kept, it is appended to the residual
+    program with the known values it uses put in as immediates or
+    constants, and what it sets is no longer known.  The trace stops
+    before an instruction that can be neither, leaving m_pc at it, so
+    the original program takes over there.
+
+RETURNS
+
+    What was done with the instruction
+
+*/
+Specializer::StepResult Specializer::Step()
+{
+    if (m_pc < 0 || m_pc >= emulator::MEMSZ) {
+        m_refusal = "the program runs off the end of memory";
+        return SR_Stopped;
+    }
+    if (!m_known[m_pc]) {
+        m_stop = "the program executes a word read or computed at run time";
+        return SR_Stopped;
+    }
+    int opcode = emulator::Encoding::OpCode(m_memory[m_pc]);
+    int reg = emulator::Encoding::Register(m_memory[m_pc]);
+    int address = emulator::Encoding::Address(m_memory[m_pc]);
+    int source = address % REGCOUNT;
+    Word value;
+
+    switch (opcode) {
+    // ADD, SUB, MULT and DIV of a word of memory.
+    case 1: case 2: case 3: case 4:
+        if (m_regKnown[reg] && m_known[address]) {
+            if (!Evaluate(opcode, m_reg[reg], m_memory[address], value)) {
+                m_stop = "a DIV would fault";
+                return SR_Stopped;
+            }
+            Learn(reg, value);
+            break;
+        }
+        if (!CanKeep()) {
+            return SR_Stopped;
+        }
+        Sync(reg);
+        if (m_known[address]) {
+            KeepValue(opcode, reg, m_memory[address]);
+        }
+        else {
+            Keep(opcode, reg, address);
+        }
+        Forget(reg);
+        m_pc++;
+        return SR_Kept;
+
+    // LOAD, and CORE, which loads the same on a single Quack3200.
+    case 5: case 16:
+        if (m_known[address]) {
+            Learn(reg, m_memory[address]);
+            break;
+        }
+        if (!CanKeep()) {
+            return SR_Stopped;
+        }
+        Keep(opcode, reg, address);
+        Forget(reg);
+        m_pc++;
+        return SR_Kept;
+
+    case 6:
+        if (m_regKnown[reg]) {
+            if (!StoreKnown(address, m_reg[reg], reg)) {
+                return SR_Stopped;
+            }
+            break;
+        }
+        if (!CanKeep()) {
+            return SR_Stopped;
+        }
+        Keep(opcode, reg, address);
+        m_known[address] = 0;
+        m_written[address] = 1;
+        m_pc++;
+        return SR_Kept;
+
+    // A READ takes the next fixed value, or is kept once they are all read.
+    case 7:
+        if (m_inputPos < m_fixedInput.size()) {
+            if (!StoreKnown(address, (Word)m_fixedInput[m_inputPos], -1)) {
+                return SR_Stopped;
+            }
+            m_inputPos++;
+            break;
+        }
+        if (!CanKeep()) {
+            return SR_Stopped;
+        }
+        Keep(opcode, reg, address);
+        m_known[address] = 0;
+        m_written[address] = 1;
+        m_pc++;
+        return SR_Kept;
+
+    // Every WRITE is kept, so the output is in the same order.
+    case 8:
+        if (!CanKeep()) {
+            return SR_Stopped;
+        }
+        if (m_known[address]) {
+            Keep(opcode, reg, AddConstant(m_memory[address]), true);
+        }
+        else {
+            Keep(opcode, reg, address);
+        }
+        m_pc++;
+        return SR_Kept;
+
+    case 9:
+        m_pc = address;
+        return SR_Evaluated;
+
+    case 10: case 11: case 12:
+        if (!m_regKnown[reg]) {
+            m_stop = "a branch depends on a value not known";
+            return SR_Stopped;
+        }
+        value = m_reg[reg];
+        if ((opcode == 10 && value < 0) || (opcode == 11 && value == 0) || (opcode == 12 && value > 0)) {
+            m_pc = address;
+            return SR_Evaluated;
+        }
+        break;
+
+    case 13:
+        Keep(opcode, reg, address);
+        return SR_Halted;
+
+    // FAA, CAS and the block instructions are only evaluated, on known words that
+    // the residual program does not write.
+    case 14:
+        if (!m_regKnown[reg] || !m_known[address] || m_written[address]) {
+            m_stop = "FAA uses a value not known";
+            return SR_Stopped;
+        }
+        value = m_memory[address];
+        m_memory[address] = (Word)((unsigned)value + (unsigned)m_reg[reg]);
+        Learn(reg, value);
+        break;
+
+    case 15:
+        if (!m_regKnown[0] || !m_regKnown[reg] || !m_known[address] || m_written[address]) {
+            m_stop = "CAS uses a value not known";
+            return SR_Stopped;
+        }
+        value = m_memory[address];
+        if (value == m_reg[0]) {
+            m_memory[address] = m_reg[reg];
+        }
+        Learn(0, value);
+        break;
+
+    case 17: case 18: case 19: {
+        if (!m_regKnown[0] || (opcode == 17 && !m_regKnown[reg])) {
+            m_stop = "a block instruction uses a register not known";
+            return SR_Stopped;
+        }
+        int count = emulator::BlockLength(address, m_reg[0]);
+        Word from = opcode == 17 ? m_reg[reg] : address;
+        if (opcode == 17) {
+            count = min(count, emulator::BlockLength(from, m_reg[0]));
+        }
+        for (int i = 0; i < count; i++) {
+            if (!m_known[from + i] || (opcode != 19 && m_written[address + i])) {
+                m_stop = "a block instruction uses a word not known";
+                return SR_Stopped;
+            }
+        }
+        if (opcode == 17) {
+            vector<Word> block(m_memory.begin() + from, m_memory.begin() + from + count);
+            copy(block.begin(), block.end(), m_memory.begin() + address);
+        }
+        else if (opcode == 18) {
+            fill(m_memory.begin() + address, m_memory.begin() + address + count, m_reg[reg]);
+        }
+        else {
+            unsigned sum = 0;
+            for (int i = 0; i < count; i++) {
+                sum += (unsigned)m_memory[address + i];
+            }
+            Learn(reg, (Word)sum);
+        }
+        break;
+    }
+
+    // The immediate forms of ADD, SUB, MULT and DIV.
+    case 20: case 21: case 22: case 23:
+        if (m_regKnown[reg]) {
+            if (!Evaluate(opcode - OpCodes::IMMEDIATE_BASE + 1, m_reg[reg], address, value)) {
+                m_stop = "a DIV would fault";
+                return SR_Stopped;
+            }
+            Learn(reg, value);
+            break;
+        }
+        if (!CanKeep()) {
+            return SR_Stopped;
+        }
+        Keep(opcode, reg, address);
+        m_pc++;
+        return SR_Kept;
+
+    case 24:
+        Learn(reg, address);
+        break;
+
+    // The register forms of ADD, SUB, MULT and DIV.  A known source register is put
+    // in as a value, so it need not be loaded.
+    case 25: case 26: case 27: case 28:
+        if (m_regKnown[reg] && m_regKnown[source]) {
+            if (!Evaluate(opcode - OpCodes::REGISTER_BASE + 1, m_reg[reg], m_reg[source], value)) {
+                m_stop = "a DIV would fault";
+                return SR_Stopped;
+            }
+            Learn(reg, value);
+            break;
+        }
+        if (!CanKeep()) {
+            return SR_Stopped;
+        }
+        if (m_regKnown[source]) {
+            KeepValue(opcode - OpCodes::REGISTER_BASE + 1, reg, m_reg[source]);
+        }
+        else {
+            Sync(reg);
+            Keep(opcode, reg, address);
+        }
+        Forget(reg);
+        m_pc++;
+        return SR_Kept;
+
+    case 29:
+        if (m_regKnown[source]) {
+            Learn(reg, m_reg[source]);
+            break;
+        }
+        if (!CanKeep()) {
+            return SR_Stopped;
+        }
+        Keep(opcode, reg, address);
+        Forget(reg);
+        m_pc++;
+        return SR_Kept;
+
+    default:
+        m_stop = "an illegal op code";
+        return SR_Stopped;
+    }
+    m_pc++;
+    return SR_Evaluated;
+}
+
+/*
+NAME
+
+    Specializer::CanKeep - determines if an instruction may be kept
+
+SYNOPSIS
+
+    bool Specializer::CanKeep();
+
+DESCRIPTION
+
+    Once the fixed values are all read, an instruction is kept for each
+    location only once.  Keeping it a second time would unroll the loop
+    around it, which the original program does as well, so the trace
+    stops there instead.  Before then, loops are unrolled, since each
+    pass may read a fixed value.  Room is left for the instructions that
+    end the residual program.
+
+RETURNS
+
+    Whether an instruction may be kept for m_pc
+
+*/
+bool Specializer::CanKeep()
+{
+    if (m_residual.size() + 2 * REGCOUNT + 2 > (size_t)MAX_RESIDUAL) {
+        m_stop = "the residual program reached its limit";
+        return false;
+    }
+    if (m_inputPos < m_fixedInput.size()) {
+        return true;
+    }
+    if (!m_keptAt.insert(m_pc).second) {
+        m_stop = "an instruction would be kept a second time";
+        return false;
+    }
+    return true;
+}
+
+// Keeps an instruction of the residual program taking a known value.
+void Specializer::KeepValue(int a_opcode, int a_register, Word a_value)
+{
+    if (a_value >= 0 && a_value <= MAX_IMMEDIATE && !(a_opcode == 4 && a_value == 0)) {
+        Keep(OpCodes::IMMEDIATE_BASE + a_opcode - 1, a_register, a_value);
+    }
+    else {
+        Keep(a_opcode, a_register, AddConstant(a_value), true);
+    }
+}
+
+// Loads a known register in the residual program, unless it holds its value already.
+void Specializer::Sync(int a_register)
+{
+    if (m_regKnown[a_register] && !m_regSynced[a_register]) {
+        KeepValue(5, a_register, m_reg[a_register]);
+        m_regSynced[a_register] = true;
+    }
+}
+
+/*
+NAME
+
+    Specializer::StoreKnown - stores a known value
+
+SYNOPSIS
+
+    bool Specializer::StoreKnown(int a_address, Word a_value, int a_register);
+    a_address -> the word stored into
+    a_value -> the value stored
+    a_register -> the register holding the value; -1 if none does
+
+DESCRIPTION
+
+    A word the residual program has not written holds, when it runs,
+    the value it is left with at the end, which is the only value the
+    original program can read from it.  A word it has written must be
+    written for real, through a known register, since the original
+    program may read it.
+
+RETURNS
+
+    Whether the trace may go on
+
+*/
+bool Specializer::StoreKnown(int a_address, Word a_value, int a_register)
+{
+    if (m_written[a_address]) {
+        if (!CanKeep()) {
+            return false;
+        }
+        if (a_register < 0) {
+            for (int reg = 0; reg < REGCOUNT && a_register < 0; reg++) {
+                if (m_regKnown[reg]) {
+                    a_register = reg;
+                }
+            }
+            if (a_register < 0) {
+                m_stop = "no register is known to store a value through";
+                return false;
+            }
+            KeepValue(5, a_register, a_value);
+            m_regSynced[a_register] = m_reg[a_register] == a_value;
+        }
+        else {
+            Sync(a_register);
+        }
+        Keep(6, a_register, a_address);
+    }
+    m_memory[a_address] = a_value;
+    m_known[a_address] = 1;
+    return true;
+}
+
+// Returns the index of a constant of the residual program, adding it if need be.
+int Specializer::AddConstant(Word a_value)
+{
+    auto found = m_constantIndex.find(a_value);
+    if (found != m_constantIndex.end()) {
+        return found->second;
+    }
+    m_constants.push_back(a_value);
+    return m_constantIndex[a_value] = (int)m_constants.size() - 1;
+}
+
+/*
+NAME
+
+    Specializer::Evaluate - computes an arithmetic instruction
+
+SYNOPSIS
+
+    static bool Specializer::Evaluate(int a_opcode, Word a_left, Word a_right, Word& a_result);
+    a_opcode -> ADD, SUB, MULT or DIV
+    a_left -> the value of the register
+    a_right -> the operand
+    a_result <- the value the register is left with
+
+DESCRIPTION
+
+    Results wrap as the emulator's do.  A DIV by zero, or of the most
+    negative value by -1, faults in the emulator, so it is not evaluated.
+
+RETURNS
+
+    Whether the instruction could be evaluated
+
+*/
+bool Specializer::Evaluate(int a_opcode, Word a_left, Word a_right, Word& a_result)
+{
+    switch (a_opcode) {
+    case 1:
+        a_result = (Word)((unsigned)a_left + (unsigned)a_right);
+        return true;
+    case 2:
+        a_result = (Word)((unsigned)a_left - (unsigned)a_right);
+        return true;
+    case 3:
+        a_result = (Word)((unsigned)a_left * (unsigned)a_right);
+        return true;
+    default:
+        if (a_right == 0 || (a_left == (numeric_limits<Word>::min)() && a_right == -1)) {
+            return false;
+        }
+        a_result = a_left / a_right;
+        return true;
+    }
+}
+
+/*
+NAME
+
+    Specializer::FindUsed - finds the words the program may still use
+
+SYNOPSIS
+
+    bool Specializer::FindUsed(vector<char>& a_used) const;
+    a_used <- 1 for each instruction reachable from where the trace
+              stopped and each word one of them names
+
+DESCRIPTION
+
+    Every path of execution is followed from where the trace stopped.
+    If one could execute a word computed at run time, use a block, or
+    read or change an instruction, the program may use words that
+    cannot be found this way.
+
+RETURNS
+
+    Whether a_used holds every word the program may use
+
+*/
+bool Specializer::FindUsed(vector<char>& a_used) const
+{
+    a_used.assign(emulator::MEMSZ, 0);
+    if (m_halted) {
+        return true;
+    }
+
+    set<int> reachable;
+    vector<int> operands;
+    vector<int> pending = { m_pc };
+    bool complete = true;
+    while (!pending.empty()) {
+        int loc = pending.back();
+        pending.pop_back();
+        if (loc < 0 || loc >= emulator::MEMSZ) {
+            complete = false;
+            continue;
+        }
+        if (!reachable.insert(loc).second) {
+            continue;
+        }
+        a_used[loc] = 1;
+        if (!m_known[loc]) {
+            complete = false;
+            continue;
+        }
+
+        int opcode = emulator::Encoding::OpCode(m_memory[loc]);
+        int address = emulator::Encoding::Address(m_memory[loc]);
+        if ((opcode >= 1 && opcode <= 8) || (opcode >= 14 && opcode <= 19)) {
+            operands.push_back(address);
+            a_used[address] = 1;
+            complete = complete && opcode < 17;
+        }
+        if (opcode >= 9 && opcode <= 12) {
+            pending.push_back(address);
+        }
+        if (opcode >= 1 && opcode <= 29 && opcode != 9 && opcode != 13) {
+            pending.push_back(loc + 1);
+        }
+    }
+    for (int address : operands) {
+        complete = complete && !reachable.count(address);
+    }
+    return complete;
+}
+
+/*
+NAME
+
+    Specializer::Build - builds the specialized translation
+
+SYNOPSIS
+
+    bool Specializer::Build();
+
+DESCRIPTION
+
+    Each word the program may still use is kept with the value the
+    trace left in it; a word that is zero needs no translation.  If the
+    words it uses cannot all be found, every word is kept and the
+    residual program is placed after all of them.  The residual program
+    runs from the origin if it fits there; otherwise the origin, which
+    the program must no longer use, holds a branch to it.  Its constants follow it.
+
+RETURNS
+
+    Whether there was room for the residual program
+
+*/
+bool Specializer::Build()
+{
+    vector<char> used;
+    bool complete = FindUsed(used);
+
+    // With every word kept, the residual program goes above any location the
+    // program names.
+    int top = -1;
+    if (!complete) {
+        for (int loc = 0; loc < emulator::MEMSZ; loc++) {
+            if ((m_known[loc] && m_memory[loc] != 0) || m_written[loc]) {
+                top = loc;
+            }
+            if (m_isCode[loc]) {
+                top = max(top, emulator::Encoding::Address(m_original[loc]));
+            }
+        }
+    }
+    auto isFree = [&](int a_loc) {
+        return a_loc > top && !used[a_loc] && !m_written[a_loc];
+    };
+    bool originFree = !used[emulator::ORIGIN] && !m_written[emulator::ORIGIN];
+
+    int length = (int)(m_residual.size() + m_constants.size());
+    int start = -1;
+    int run = 0;
+    for (int loc = emulator::ORIGIN; loc < emulator::ORIGIN + length && loc < emulator::MEMSZ && isFree(loc); loc++) {
+        run++;
+    }
+    if (run == length) {
+        start = emulator::ORIGIN;
+    }
+    else if (originFree) {
+        run = 0;
+        for (int loc = 0; loc < emulator::MEMSZ && start < 0; loc++) {
+            run = loc != emulator::ORIGIN && isFree(loc) ? run + 1 : 0;
+            if (run == length) {
+                start = loc - length + 1;
+            }
+        }
+    }
+    if (start < 0) {
+        m_refusal = originFree ? "there is no room for the residual program" :
+            "the program still uses the origin";
+        return false;
+    }
+    m_codeStart = start;
+
+    m_result.Clear();
+    for (int loc = 0; loc < emulator::MEMSZ; loc++) {
+        bool replaced = loc == emulator::ORIGIN && start != emulator::ORIGIN;
+        if ((used[loc] || !complete) && !replaced && m_known[loc] && m_memory[loc] != 0) {
+            m_result.AddWord(loc, m_memory[loc], m_isCode[loc] && m_memory[loc] == m_original[loc]);
+        }
+    }
+    if (start != emulator::ORIGIN) {
+        m_result.AddWord(emulator::ORIGIN, emulator::Encoding::Encode(9, 0, start), true);
+    }
+    int constants = start + (int)m_residual.size();
+    for (size_t i = 0; i < m_residual.size(); i++) {
+        const Residual& inst = m_residual[i];
+        int address = inst.m_isConstant ? constants + inst.m_address : inst.m_address;
+        m_result.AddWord(start + (int)i, emulator::Encoding::Encode(inst.m_opcode, inst.m_register, address), true);
+    }
+    for (size_t i = 0; i < m_constants.size(); i++) {
+        m_result.AddWord(constants + (int)i, m_constants[i], false);
+    }
+    vector<MemoryImage::Word>& words = m_result.GetWords();
+    sort(words.begin(), words.end(), [](const MemoryImage::Word& a, const MemoryImage::Word& b) {
+        return a.m_loc < b.m_loc;
+    });
+    return true;
+}
+
+/*
+NAME
+
+    Specializer::DisplayReport - shows what the specializer did
+
+SYNOPSIS
+
+    void Specializer::DisplayReport() const;
+
+*/
+void Specializer::DisplayReport() const
+{
+    cout << "Specialization for the fixed input:" << endl << endl;
+    if (!m_refusal.empty()) {
+        cout << "Not specialized: " << m_refusal << "." << endl;
+    }
+    else {
+        cout << left << setw(40) << "Fixed values read" << m_inputPos << endl
+            << setw(40) << "Instructions evaluated" << m_evaluated << endl
+            << setw(40) << "Residual instructions" << m_residual.size() << endl
+            << setw(40) << "Residual constants" << m_constants.size() << endl
+            << setw(40) << "Residual program placed at" << m_codeStart << endl;
+        if (m_halted) {
+            cout << setw(40) << "Program halts in the residual program" << endl;
+        }
+        else {
+            cout << setw(40) << "Resumes at" << m_pc << " (" << m_stop << ")" << endl;
+        }
+        cout << setw(40) << "Words in the translation" << m_originalWords << " -> " << m_result.GetWords().size()
+            << right << endl;
+    }
+    cout << "__________________________________________________________" << endl << endl;
+}
@@ -0,0 +1,140 @@
+//
+//		Partial evaluator that specializes a translation for the first values it
+//		reads.  The program is executed from the origin with each word of memory and
+//		each register either known or not.  The fixed values are known; the rest of
+//		the input is not.  An instruction whose operands are all known is evaluated,
+//		and a conditional branch on a known register is decided.  An instruction
+//		that needs a value not known is kept, as a residual instruction, with the
+//		known values it uses put in as constants, and WRITEs are kept in order so
+//		the output is the same.
+//
+//		The trace stops where it can go no further: at a branch on a value not known,
+//		at the second pass through a kept instruction once the fixed values are read,
+//		which would unroll a loop, or at an instruction it cannot follow.  The specialized translation runs the
+//		residual instructions from the origin, loads the known registers and branches
+//		to where the trace stopped, with memory as the trace left it.  Only the code
+//		reachable from there, and the words it uses, are kept.
+//
+#pragma once
+
+#include <set>
+#include "MemoryImage.h"
+
+class Specializer {
+
+public:
+
+    Specializer(const MemoryImage& a_image, const vector<long long>& a_fixedInput);
+    ~Specializer() {};
+
+    // Specializes the translation, tracing at most a_maxSteps instructions, or
+    // DEFAULT_STEPS if it is negative.  Returns false, recording why, if it cannot be
+    // specialized.
+    bool Specialize(long long a_maxSteps);
+
+    // The specialized translation.
+    const MemoryImage& GetImage() const { return m_result; }
+
+    // Displays what was done, or why nothing was.
+    void DisplayReport() const;
+
+    // The instructions evaluated while specializing.
+    long long GetEvaluated() const { return m_evaluated; }
+
+private:
+
+    typedef emulator::Word Word;
+    typedef emulator::Encoding Encoding;
+
+    // An instruction of the residual program.  Its address field is a location, or
+    // the index of a constant, which is placed after the residual instructions.
+    struct Residual {
+        int m_opcode;
+        int m_register;
+        int m_address;
+        bool m_isConstant;      // == true if m_address is the index of a constant.
+    };
+
+    // What evaluating an instruction did.
+    enum StepResult { SR_Evaluated, SR_Kept, SR_Stopped, SR_Halted };
+
+    static const int MAX_RESIDUAL = 4096;               // The most residual instructions.
+    static const long long DEFAULT_STEPS = 10000000;    // The most instructions traced with no step limit.
+    static const int MAX_IMMEDIATE = 999;               // The largest immediate that fits every machine's address field.
+    static const int REGCOUNT = emulator::REGCOUNT;     // The registers of the Quack3200.
+
+    // Evaluates or keeps the instruction at m_pc.
+    StepResult Step();
+
+    // Determines if another residual instruction may be kept at m_pc, recording why
+    // not if it may not.
+    bool CanKeep();
+
+    // Keeps a residual instruction.
+    void Keep(int a_opcode, int a_register, int a_address, bool a_isConstant = false) {
+        m_residual.push_back({ a_opcode, a_register, a_address, a_isConstant });
+    }
+
+    // Keeps an ADD, SUB, MULT, DIV or LOAD of a known value, as an immediate if it fits.
+    void KeepValue(int a_opcode, int a_register, Word a_value);
+
+    // Keeps a LOAD of a known register's value, unless the register holds it already.
+    void Sync(int a_register);
+
+    // Records that a register holds a value not known.
+    void Forget(int a_register) { m_regKnown[a_register] = false; m_regSynced[a_register] = true; }
+
+    // Records that a register holds a known value, loaded only if it held another.
+    void Learn(int a_register, Word a_value) {
+        m_regSynced[a_register] = m_regKnown[a_register] && m_regSynced[a_register] && m_reg[a_register] == a_value;
+        m_reg[a_register] = a_value;
+        m_regKnown[a_register] = true;
+    }
+
+    // Stores a known value into a word.  A word that a residual instruction has
+    // written must be written for real, so its value is kept.  Returns false if no
+    // register is free to do it with.
+    bool StoreKnown(int a_address, Word a_value, int a_register);
+
+    // Returns the index of a constant, adding it if need be.
+    int AddConstant(Word a_value);
+
+    // Computes the result of ADD, SUB, MULT or DIV as the emulator does.  Returns false
+    // for a DIV that would fault.
+    static bool Evaluate(int a_opcode, Word a_left, Word a_right, Word& a_result);
+
+    // Builds the specialized translation from the residual instructions and the memory
+    // the trace left.  Returns false if there is no room for them.
+    bool Build();
+
+    // Finds the words the program may still use from where the trace stopped.  Returns
+    // false if it may use any of them.
+    bool FindUsed(vector<char>& a_used) const;
+
+    const MemoryImage& m_image;         // The translation being specialized.
+    vector<long long> m_fixedInput;     // The values of the first READs.
+
+    vector<Word> m_memory;              // The memory, where known.
+    vector<char> m_known;               // == 1 for each word whose value is known.
+    vector<char> m_written;             // == 1 for each word a residual instruction writes.
+    vector<char> m_isCode;              // == 1 for each word translated from an instruction.
+    vector<Word> m_original;            // The memory before specialization.
+    Word m_reg[REGCOUNT];               // The registers, where known.
+    bool m_regKnown[REGCOUNT];          // == true for each register whose value is known.
+    bool m_regSynced[REGCOUNT];         // == true for each register that holds its value when the residual program runs.
+    int m_pc = emulator::ORIGIN;        // The location of the next instruction.
+    size_t m_inputPos = 0;              // The fixed values read.
+
+    vector<Residual> m_residual;        // The residual instructions.
+    vector<Word> m_constants;           // The constants they use.
+    map<Word, int> m_constantIndex;     // The index of each constant.
+    set<int> m_keptAt;                  // The locations instructions were kept for once the fixed values were read.
+
+    MemoryImage m_result;               // The specialized translation.
+    bool m_halted = false;              // == true if the trace reached a HALT.
+    string m_stop;                      // Why the trace stopped.
+    string m_refusal;                   // Why the program was not specialized.
+    long long m_evaluated = 0;          // Instructions evaluated.
+    int m_originalWords = 0;            // Words of the translation.
+    int m_codeStart = 0;                // Where the residual instructions are placed.
+};
@@ -0,0 +1,230 @@
+//
+//		Implementation of the Stats class.
+//
+#include "stdafx.h"
+#include "Stats.h"
+#include <chrono>
+#include <fstream>
+
+#ifdef _WIN32
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+vector<Stats::Event> Stats::m_events;
+vector<pair<string, long long>> Stats::m_counters;
+
+namespace {
+
+    // The time the assembler started, which trace times are relative to.
+    const chrono::steady_clock::time_point START = chrono::steady_clock::now();
+}
+
+/*
+NAME
+
+    Stats::Now - reads the clock
+
+SYNOPSIS
+
+    long long Stats::Now();
+
+RETURNS
+
+    The microseconds since the assembler started
+
+*/
+long long Stats::Now()
+{
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - START).count();
+}
+
+/*
+NAME
+
+    Stats::SetCounter - records the value of a counter
+
+SYNOPSIS
+
+    void Stats::SetCounter(const string& a_name, long long a_value);
+    a_name -> the name of the counter
+    a_value -> its value
+
+*/
+void Stats::SetCounter(const string& a_name, long long a_value)
+{
+    for (auto& counter : m_counters) {
+        if (counter.first == a_name) {
+            counter.second = a_value;
+            return;
+        }
+    }
+    m_counters.push_back({ a_name, a_value });
+}
+
+/*
+NAME
+
+    Stats::AddCounter - adds to the value of a counter
+
+SYNOPSIS
+
+    void Stats::AddCounter(const string& a_name, long long a_value);
+    a_name -> the name of the counter
+    a_value -> the amount to add; a counter not yet set starts at 0
+
+*/
+void Stats::AddCounter(const string& a_name, long long a_value)
+{
+    for (auto& counter : m_counters) {
+        if (counter.first == a_name) {
+            counter.second += a_value;
+            return;
+        }
+    }
+    m_counters.push_back({ a_name, a_value });
+}
+
+/*
+NAME
+
+    Stats::WriteSummary - writes the statistics as JSON
+
+SYNOPSIS
+
+    bool Stats::WriteSummary(const string& a_fileName);
+    a_fileName -> the file to be written
+
+DESCRIPTION
+
+    This function writes an object with the duration of every phase in
+    milliseconds, every counter, and the peak memory of the process.  A
+    phase that ran more than once, as the passes do for each source
+    under --pack, is written once with its total duration, so that no
+    name appears twice in the object.
+
+RETURNS
+
+    Whether the file was written
+
+*/
+bool Stats::WriteSummary(const string& a_fileName)
+{
+    ofstream out(a_fileName);
+    if (!out) {
+        return false;
+    }
+
+    // Total the phases of each name, in the order they first completed.
+    vector<pair<string, long long>> phases;
+    for (const Event& event : m_events) {
+        auto phase = find_if(phases.begin(), phases.end(),
+            [&event](const pair<string, long long>& a_phase) { return a_phase.first == event.m_name; });
+        if (phase == phases.end()) {
+            phases.push_back({ event.m_name, event.m_duration });
+        }
+        else {
+            phase->second += event.m_duration;
+        }
+    }
+
+    out << "{" << endl << "  \"phases_ms\": {";
+    for (size_t i = 0; i < phases.size(); i++) {
+        out << (i == 0 ? "" : ",") << endl << "    \"" << phases[i].first << "\": "
+            << fixed << setprecision(3) << phases[i].second / 1000.0;
+    }
+    out << endl << "  }," << endl << "  \"counters\": {";
+    for (size_t i = 0; i < m_counters.size(); i++) {
+        out << (i == 0 ? "" : ",") << endl << "    \"" << m_counters[i].first << "\": " << m_counters[i].second;
+    }
+    out << endl << "  }," << endl;
+    out << "  \"peak_memory_kb\": " << PeakMemoryKB() << endl << "}" << endl;
+
+    out.close();
+    return !out.fail();
+}
+
+/*
+NAME
+
+    Stats::WriteTrace - writes the statistics as a trace timeline
+
+SYNOPSIS
+
+    bool Stats::WriteTrace(const string& a_fileName);
+    a_fileName -> the file to be written
+
+DESCRIPTION
+
+    This function writes the phases as complete events in the Chrome
+    trace event format, which chrome://tracing and Perfetto display as
+    a timeline.  Counters are written as counter events at the end of
+    the run.
+
+RETURNS
+
+    Whether the file was written
+
+*/
+bool Stats::WriteTrace(const string& a_fileName)
+{
+    ofstream out(a_fileName);
+    if (!out) {
+        return false;
+    }
+
+    long long end = Now();
+    out << "{\"traceEvents\":[" << endl;
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Assem\"}}";
+    for (const Event& event : m_events) {
+        out << "," << endl << "{\"name\":\"" << event.m_name << "\",\"cat\":\"phase\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":"
+            << event.m_start << ",\"dur\":" << event.m_duration << "}";
+    }
+    for (const auto& counter : m_counters) {
+        out << "," << endl << "{\"name\":\"" << counter.first << "\",\"ph\":\"C\",\"pid\":1,\"ts\":" << end
+            << ",\"args\":{\"value\":" << counter.second << "}}";
+    }
+    out << "," << endl << "{\"name\":\"peak_memory_kb\",\"ph\":\"C\",\"pid\":1,\"ts\":" << end
+        << ",\"args\":{\"value\":" << PeakMemoryKB() << "}}";
+    out << endl << "]}" << endl;
+
+    out.close();
+    return !out.fail();
+}
+
+/*
+NAME
+
+    Stats::PeakMemoryKB - gets the peak memory of the process
+
+SYNOPSIS
+
+    long long Stats::PeakMemoryKB();
+
+RETURNS
+
+    The largest resident set of the process so far, in kilobytes
+
+*/
+long long Stats::PeakMemoryKB()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return (long long)(counters.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
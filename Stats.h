@@ -0,0 +1,59 @@
+//
+//		Class to time the phases of the assembler and emulator and collect
+//		counters about a run.  Phases are timed as a whole, so the cost is a
+//		pair of clock readings per phase whether or not a report is asked for.
+//
+#pragma once
+
+#include <string>
+#include <vector>
+using namespace std;
+
+class Stats {
+
+public:
+
+    // Times a phase from construction to destruction.
+    class Phase {
+
+    public:
+
+        Phase(const char* a_name) : m_name(a_name), m_start(Now()) {}
+        ~Phase() { m_events.push_back({ m_name, m_start, Now() - m_start }); }
+
+    private:
+
+        const char* m_name;     // The name of the phase.
+        long long m_start;      // When the phase started, in microseconds.
+    };
+
+    // Records the value of a counter, replacing any earlier value.
+    static void SetCounter(const string& a_name, long long a_value);
+
+    // Adds to the value of a counter, for counts taken once per source.
+    static void AddCounter(const string& a_name, long long a_value);
+
+    // Writes the phases and counters as a JSON summary.
+    static bool WriteSummary(const string& a_fileName);
+
+    // Writes the phases and counters as a Chrome trace event file.
+    static bool WriteTrace(const string& a_fileName);
+
+    // Returns the most memory the process has used, in kilobytes.
+    static long long PeakMemoryKB();
+
+private:
+
+    // Returns the microseconds since the assembler started.
+    static long long Now();
+
+    // A completed phase.
+    struct Event {
+        const char* m_name;     // The name of the phase.
+        long long m_start;      // When the phase started, in microseconds.
+        long long m_duration;   // How long the phase took, in microseconds.
+    };
+
+    static vector<Event> m_events;                          // Phases in the order they completed.
+    static vector<pair<string, long long>> m_counters;      // Counters in the order they were first set.
+};
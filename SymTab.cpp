@@ -60,10 +60,39 @@ void SymbolTable::DisplaySymbolTable()
     // Displays the amount of symbols, symbol name, and location
     for (map<string, int>::iterator it = m_symbolTable.begin(); it != m_symbolTable.end(); it++) 
     {
+        // Looking up a missing or illegal operand enters it; it is not a label.
+        if (it->first.empty() || it->first == "?????") {
+            continue;
+        }
 
         cout << setw(2) << right << symbolCount << "         " << setw(6) << left << it->first << "  " << right << it->second << endl;
         symbolCount++;
     }
 
     cout << "__________________________________________________________" << endl << endl << endl;
-}
\ No newline at end of file
+}
+/*
+NAME
+
+    SymbolTable::Relocate - moves symbols to the new locations of their instructions
+
+SYNOPSIS
+
+    void SymbolTable::Relocate(const map<int, int>& a_relocation);
+    a_relocation -> the new location of each moved location; -1 if it was removed
+
+DESCRIPTION
+
+    Symbols of locations that were not moved, and of instructions that
+    were removed entirely, keep their locations.
+
+*/
+void SymbolTable::Relocate(const map<int, int>& a_relocation)
+{
+    for (auto& symbol : m_symbolTable) {
+        auto moved = a_relocation.find(symbol.second);
+        if (moved != a_relocation.end() && moved->second >= 0) {
+            symbol.second = moved->second;
+        }
+    }
+}
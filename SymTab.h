@@ -33,6 +33,12 @@ public:
         return m_symbolTable[a_symbol] == multiplyDefinedSymbol;
     }
 
+    // Returns every symbol and its location.
+    const map<string, int>& GetSymbols() const { return m_symbolTable; }
+
+    // Moves the symbols of relocated locations to their new locations.
+    void Relocate(const map<int, int>& a_relocation);
+
 private:
 
     // This is the actual symbol table.  The symbol is the key to the map.
@@ -0,0 +1,103 @@
+//
+//		Implementation of the TimingConfig class.  The timing models themselves are
+//		templates, in TimingModel.h.
+//
+#include "stdafx.h"
+#include "TimingModel.h"
+#include "OpCodes.h"
+#include <fstream>
+#include <sstream>
+
+/*
+NAME
+
+    TimingConfig::Load - reads a timing file
+
+SYNOPSIS
+
+    bool TimingConfig::Load(const string& a_fileName, string& a_error);
+    a_fileName -> the file to be read
+    a_error -> set to what is wrong with the file, if it cannot be used
+
+DESCRIPTION
+
+    Each line of the file is one of
+
+        default <cycles>                    every op code takes <cycles>
+        <op code> <cycles>                  the op code takes <cycles>
+        cache <sets> <ways> <words> <miss>  data accesses go through a cache
+
+    An op code given by name sets the cycles of its immediate and
+    register forms as well; one given by number sets just that code.
+    Later lines override earlier ones.  A ; starts a comment.  Without
+    a cache line, every access to memory costs nothing beyond the
+    cycles of its instruction.
+
+RETURNS
+
+    Whether the file was read
+
+*/
+bool TimingConfig::Load(const string& a_fileName, string& a_error)
+{
+    ifstream in(a_fileName);
+    if (!in) {
+        a_error = "Timing file " + a_fileName + " could not be read";
+        return false;
+    }
+
+    string line;
+    for (int number = 1; getline(in, line); number++) {
+        line = line.substr(0, line.find(';'));
+        istringstream fields(line);
+        string name;
+        if (!(fields >> name)) {
+            continue;
+        }
+        string where = a_fileName + " line " + to_string(number) + ": ";
+        string extra;
+
+        if (OpCodes::EqualNoCase(name, "cache")) {
+            if (!(fields >> m_sets >> m_ways >> m_lineWords >> m_missCycles) || fields >> extra) {
+                a_error = where + "expected cache <sets> <ways> <words per line> <miss cycles>";
+                return false;
+            }
+            if (m_sets <= 0 || m_ways <= 0 || m_lineWords <= 0 || m_missCycles < 0 || (long long)m_sets * m_ways > (1 << 20)) {
+                a_error = where + "the cache must have at least one set, way and word, and at most 1048576 lines";
+                return false;
+            }
+            continue;
+        }
+
+        long long cycles;
+        if (!(fields >> cycles) || fields >> extra || cycles < 0) {
+            a_error = where + "expected an op code and a number of cycles";
+            return false;
+        }
+        if (OpCodes::EqualNoCase(name, "default")) {
+            fill(m_cycles, m_cycles + MAX_OPCODE, cycles);
+            continue;
+        }
+        if (OpCodes::IsNumber(name) && name.find('.') == string::npos) {
+            int code = OpCodes::ToNumber(name);
+            if (code < 0 || code >= MAX_OPCODE) {
+                a_error = where + "op codes are 0 to 99";
+                return false;
+            }
+            m_cycles[code] = cycles;
+            continue;
+        }
+        int code = OpCodes::LookupMachine(name);
+        if (code == 0) {
+            a_error = where + "unknown op code " + name;
+            return false;
+        }
+        m_cycles[code] = cycles;
+        for (OpCodes::OperandMode mode : { OpCodes::OM_Immediate, OpCodes::OM_Register }) {
+            if (OpCodes::OperandForm(code, mode) != 0) {
+                m_cycles[OpCodes::OperandForm(code, mode)] = cycles;
+            }
+        }
+    }
+    return true;
+}
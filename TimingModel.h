@@ -0,0 +1,226 @@
+//
+//		Hooks for the emulator that estimate how long a program would take on a real
+//		Quack3200.  Each instruction costs the cycles given for its op code, and each
+//		word of memory it reads or writes goes through a model of a data cache, whose
+//		misses cost extra cycles.  The cache is a template parameter: NoCache costs
+//		nothing and compiles away, and a run without --timing has no timing hooks at
+//		all, so the plain emulator pays nothing for the model.
+//
+#pragma once
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "Emulator.h"
+#include "Stats.h"
+
+// The cycles of each op code and the shape of the cache, read from a timing file.
+struct TimingConfig {
+
+    static const int MAX_OPCODE = 100;      // Op codes are two digits.
+
+    long long m_cycles[MAX_OPCODE];         // The cycles of each op code.
+    int m_sets = 0;                         // Sets in the cache; 0 for no cache.
+    int m_ways = 0;                         // Lines in each set.
+    int m_lineWords = 0;                    // Words in each line.
+    long long m_missCycles = 0;             // Cycles added by each miss.
+
+    TimingConfig() { fill(m_cycles, m_cycles + MAX_OPCODE, 1LL); }
+
+    // Reads a timing file.  Returns false, with a message, if it cannot be used.
+    bool Load(const string& a_fileName, string& a_error);
+};
+
+// The cache of a machine with no cache: every access hits and costs nothing.
+class NoCache {
+
+public:
+
+    NoCache(const TimingConfig&) {}
+
+    bool Access(int) { return true; }
+};
+
+// A set associative cache with least recently used replacement.  Misses are
+// counted by the word that missed.
+class SetAssociativeCache {
+
+public:
+
+    SetAssociativeCache(const TimingConfig& a_config) :
+        m_sets(a_config.m_sets), m_ways(a_config.m_ways), m_lineWords(a_config.m_lineWords),
+        m_tags((size_t)a_config.m_sets * a_config.m_ways, -1), m_used((size_t)a_config.m_sets * a_config.m_ways, 0) {}
+
+    // Accesses a word.  Returns true if it was in the cache.
+    bool Access(int a_address) {
+        int line = a_address / m_lineWords;
+        size_t first = (size_t)(line % m_sets) * m_ways;
+        size_t victim = first;
+        m_clock++;
+        for (size_t way = first; way < first + m_ways; way++) {
+            if (m_tags[way] == line) {
+                m_used[way] = m_clock;
+                m_hits++;
+                return true;
+            }
+            if (m_used[way] < m_used[victim]) {
+                victim = way;
+            }
+        }
+        m_tags[victim] = line;
+        m_used[victim] = m_clock;
+        m_misses[a_address]++;
+        m_missCount++;
+        return false;
+    }
+
+    long long GetHits() const { return m_hits; }
+    long long GetMisses() const { return m_missCount; }
+    const unordered_map<int, long long>& GetMissesByAddress() const { return m_misses; }
+
+private:
+
+    int m_sets;                     // Sets in the cache.
+    int m_ways;                     // Lines in each set.
+    int m_lineWords;                // Words in each line.
+    vector<int> m_tags;             // The line held by each way; -1 if none.
+    vector<long long> m_used;       // When each way was last used.
+    long long m_clock = 0;          // Accesses so far, to order the uses.
+    long long m_hits = 0;           // Accesses that hit.
+    long long m_missCount = 0;      // Accesses that missed.
+    unordered_map<int, long long> m_misses;     // Misses of each word that missed.
+};
+
+template<typename Machine, typename Cache>
+class TimingModel : public EmulatorBase::NoHooks {
+
+public:
+
+    typedef typename Machine::Word Word;
+    typedef typename Machine::Encoding Encoding;
+
+    TimingModel(const TimingConfig& a_config) : m_config(a_config), m_cache(a_config) {}
+
+    // Charges the instruction about to be executed, and its accesses to memory.
+    bool BeforeInstruction(const Machine& a_machine, int a_loc, long long, EmulatorBase::RunResult&) {
+        Word contents = a_machine.GetMemory()[a_loc];
+        int opcode = Encoding::OpCode(contents);
+        int address = Encoding::Address(contents);
+        if (opcode < 0 || opcode >= TimingConfig::MAX_OPCODE) {
+            return false;
+        }
+        m_cycles += m_config.m_cycles[opcode];
+        m_instructions++;
+
+        const Word* reg = a_machine.GetRegisters();
+        switch (opcode) {
+        case 1: case 2: case 3: case 4: case 5: case 6: case 7: case 8:
+        case 14: case 15: case 16:
+            Access(address);
+            break;
+        case 17: {
+            // BCOPY reads the block at the register and writes the block at the address.
+            Word source = reg[Encoding::Register(contents)];
+            int count = min(Machine::BlockLength(source, reg[0]), Machine::BlockLength(address, reg[0]));
+            for (int i = 0; i < count; i++) {
+                Access((int)source + i);
+                Access(address + i);
+            }
+            break;
+        }
+        case 18: case 19:
+            for (int i = 0, count = Machine::BlockLength(address, reg[0]); i < count; i++) {
+                Access(address + i);
+            }
+            break;
+        }
+        return false;
+    }
+
+    // Displays the estimated cycles and, with a cache, its hit rate and the words
+    // that missed most, each with the nearest label at or before it.
+    void DisplayReport(const map<string, int>& a_symbols) const;
+
+private:
+
+    // Charges an access to a word of memory.
+    void Access(int a_address) {
+        m_accesses++;
+        if (!m_cache.Access(a_address)) {
+            m_cycles += m_config.m_missCycles;
+        }
+    }
+
+    // Displays what the cache did.  There is nothing to display without one.
+    void DisplayCache(const NoCache&, const map<string, int>&) const {}
+    void DisplayCache(const SetAssociativeCache& a_cache, const map<string, int>& a_symbols) const;
+
+    const TimingConfig& m_config;       // The cycles and the cache.
+    Cache m_cache;                      // The model of the cache.
+    long long m_cycles = 0;             // Cycles so far.
+    long long m_instructions = 0;       // Instructions charged.
+    long long m_accesses = 0;           // Words of memory read or written.
+};
+
+// Displays the estimated cycles.
+template<typename Machine, typename Cache>
+void TimingModel<Machine, Cache>::DisplayReport(const map<string, int>& a_symbols) const
+{
+    cout << endl << "Estimated time: " << m_cycles << " cycles for " << m_instructions << " instructions";
+    if (m_instructions > 0) {
+        cout << " (" << fixed << setprecision(2) << (double)m_cycles / m_instructions << " per instruction)";
+    }
+    cout << endl << "Memory accesses: " << m_accesses << endl;
+    DisplayCache(m_cache, a_symbols);
+    Stats::SetCounter("guest_cycles", m_cycles);
+}
+
+// Displays the hit rate of the cache and the words that missed most.
+template<typename Machine, typename Cache>
+void TimingModel<Machine, Cache>::DisplayCache(const SetAssociativeCache& a_cache, const map<string, int>& a_symbols) const
+{
+    const int HOTTEST = 10;     // The words that missed most to display.
+
+    long long accesses = a_cache.GetHits() + a_cache.GetMisses();
+    cout << "Cache: " << m_config.m_sets << " sets of " << m_config.m_ways << " lines of " << m_config.m_lineWords
+        << " words, " << m_config.m_missCycles << " cycles a miss" << endl;
+    cout << "Hits: " << a_cache.GetHits() << ", misses: " << a_cache.GetMisses();
+    if (accesses > 0) {
+        cout << " (" << fixed << setprecision(2) << 100.0 * a_cache.GetHits() / accesses << "% hit)";
+    }
+    cout << endl;
+    Stats::SetCounter("cache_hits", a_cache.GetHits());
+    Stats::SetCounter("cache_misses", a_cache.GetMisses());
+
+    const unordered_map<int, long long>& misses = a_cache.GetMissesByAddress();
+    vector<pair<int, long long>> missed(misses.begin(), misses.end());
+    int shown = min<int>(HOTTEST, (int)missed.size());
+    partial_sort(missed.begin(), missed.begin() + shown, missed.end(), [](const pair<int, long long>& a, const pair<int, long long>& b) {
+        return a.second > b.second || (a.second == b.second && a.first < b.first);
+    });
+    if (shown == 0) {
+        return;
+    }
+
+    // The labels by location, to find the one nearest each address.
+    map<int, string> labels;
+    for (const auto& symbol : a_symbols) {
+        if (symbol.second >= 0) {
+            labels[symbol.second] = symbol.first;
+        }
+    }
+
+    cout << "Addresses missing most:" << endl;
+    cout << "  " << left << setw(10) << "Misses" << setw(10) << "Location" << "Label" << endl;
+    for (int i = 0; i < shown; i++) {
+        int address = missed[i].first;
+        string label;
+        auto nearest = labels.upper_bound(address);
+        if (nearest != labels.begin()) {
+            --nearest;
+            label = nearest->second + (address == nearest->first ? "" : "+" + to_string(address - nearest->first));
+        }
+        cout << "  " << left << setw(10) << missed[i].second << setw(10) << address << label << endl;
+    }
+    cout << right;
+}
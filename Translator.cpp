@@ -0,0 +1,453 @@
+//
+//		Implementation of the Translator class.
+//
+#include "stdafx.h"
+#include <fstream>
+#include "Translator.h"
+
+namespace {
+
+    // Support code for every translation.  Results are reported exactly as the
+    // emulator reports them, so a translated program and an emulated one display
+    // the same thing.
+    const char* const RUNTIME = R"(
+// Prompts for and reads the value for a READ instruction.
+static bool readValue(int& a_value)
+{
+    cout << "? ";
+    return (bool)(cin >> a_value);
+}
+
+// Reports why the program stopped.
+static int halted()
+{
+    cout << endl << "End of emulation" << endl;
+    return 0;
+}
+
+static int noInput(int a_loc)
+{
+    cout << endl << "Emulation stopped at location " << a_loc << ": no more input" << endl;
+    return 0;
+}
+
+static int illegal()
+{
+    cerr << "Illegal opcode" << endl;
+    return 1;
+}
+
+// A DIV faults if it divides by zero or divides the most negative word by -1.
+static bool divideFaults(int a_left, int a_right)
+{
+    return a_right == 0 || (a_right == -1 && a_left == INT_MIN);
+}
+
+static int fault(int a_loc, const int* r)
+{
+    cout << endl << "Emulation stopped at location " << a_loc << ": division by zero or overflow" << endl;
+    cout << "Registers:";
+    for (int i = 0; i < REG_COUNT; i++) cout << " " << r[i];
+    cout << endl;
+    return 1;
+}
+
+// The block instructions, which act on the words of a block that are in memory.
+static int blockLength(int a_start, int a_count)
+{
+    if (a_start < 0 || a_start >= ADDR_RADIX || a_count <= 0) return 0;
+    return a_count < ADDR_RADIX - a_start ? a_count : ADDR_RADIX - a_start;
+}
+
+[[maybe_unused]] static void blockCopy(int a_to, int a_from, int a_count)
+{
+    int count = min(blockLength(a_from, a_count), blockLength(a_to, a_count));
+    memmove(m + a_to, m + a_from, count * sizeof(int));
+}
+
+[[maybe_unused]] static void blockFill(int a_to, int a_value, int a_count)
+{
+    fill(m + a_to, m + a_to + blockLength(a_to, a_count), a_value);
+}
+
+[[maybe_unused]] static int blockSum(int a_from, int a_count)
+{
+    int sum = 0;
+    for (int i = 0, count = blockLength(a_from, a_count); i < count; i++) sum += m[a_from + i];
+    return sum;
+}
+
+// Interprets the program from a_loc.  Used once an instruction may have been overwritten.
+[[maybe_unused]] static int interpret(int a_loc, int* r)
+{
+    while (true) {
+        int contents = m[a_loc];
+        int opcode = contents / (ADDR_RADIX * REG_COUNT);
+        int reg = contents / ADDR_RADIX % REG_COUNT;
+        int address = contents % ADDR_RADIX;
+        int value;
+
+        switch (opcode) {
+        case 1: r[reg] += m[address]; a_loc++; break;
+        case 2: r[reg] -= m[address]; a_loc++; break;
+        case 3: r[reg] *= m[address]; a_loc++; break;
+        case 4:
+            if (divideFaults(r[reg], m[address])) return fault(a_loc, r);
+            r[reg] /= m[address];
+            a_loc++;
+            break;
+        case 5: r[reg] = m[address]; a_loc++; break;
+        case 6: m[address] = r[reg]; a_loc++; break;
+        case 7:
+            if (!readValue(value)) return noInput(a_loc);
+            m[address] = value;
+            a_loc++;
+            break;
+        case 8: cout << m[address] << endl; a_loc++; break;
+        case 9: a_loc = address; break;
+        case 10: a_loc = r[reg] < 0 ? address : a_loc + 1; break;
+        case 11: a_loc = r[reg] == 0 ? address : a_loc + 1; break;
+        case 12: a_loc = r[reg] > 0 ? address : a_loc + 1; break;
+        case 13: return halted();
+        case 14: value = m[address]; m[address] += r[reg]; r[reg] = value; a_loc++; break;
+        case 15: value = m[address]; if (value == r[0]) m[address] = r[reg]; r[0] = value; a_loc++; break;
+        case 16: r[reg] = m[address]; a_loc++; break;
+        case 17: blockCopy(address, r[reg], r[0]); a_loc++; break;
+        case 18: blockFill(address, r[reg], r[0]); a_loc++; break;
+        case 19: r[reg] = blockSum(address, r[0]); a_loc++; break;
+        case 20: r[reg] += address; a_loc++; break;
+        case 21: r[reg] -= address; a_loc++; break;
+        case 22: r[reg] *= address; a_loc++; break;
+        case 23:
+            if (divideFaults(r[reg], address)) return fault(a_loc, r);
+            r[reg] /= address;
+            a_loc++;
+            break;
+        case 24: r[reg] = address; a_loc++; break;
+        case 25: r[reg] += r[address % REG_COUNT]; a_loc++; break;
+        case 26: r[reg] -= r[address % REG_COUNT]; a_loc++; break;
+        case 27: r[reg] *= r[address % REG_COUNT]; a_loc++; break;
+        case 28:
+            if (divideFaults(r[reg], r[address % REG_COUNT])) return fault(a_loc, r);
+            r[reg] /= r[address % REG_COUNT];
+            a_loc++;
+            break;
+        case 29: r[reg] = r[address % REG_COUNT]; a_loc++; break;
+        default: return illegal();
+        }
+    }
+}
+)";
+}
+
+/*
+NAME
+
+    Translator::Translator - prepares a program for translation
+
+SYNOPSIS
+
+    Translator::Translator(const MemoryImage& a_image);
+    a_image -> the translation of the program generated in Pass II
+
+DESCRIPTION
+
+    This constructor lays the program out in memory as the emulator
+    would and works out which instructions can be executed, which are
+    branched to and which may be overwritten by the program.
+
+*/
+Translator::Translator(const MemoryImage& a_image) : m_memory(emulator::MEMSZ, 0)
+{
+    for (const MemoryImage::Word& word : a_image.GetWords()) {
+        if (word.m_loc >= 0 && word.m_loc < emulator::MEMSZ) {
+            m_memory[word.m_loc] = word.m_contents;
+        }
+    }
+    FindReachable();
+}
+
+/*
+NAME
+
+    Translator::FindReachable - finds the instructions that may be executed
+
+SYNOPSIS
+
+    void Translator::FindReachable();
+
+DESCRIPTION
+
+    This function follows every path of execution from the origin.  Any
+    word reached is an instruction, whether or not it was translated
+    from one.  Reachable instructions that are the target of a STORE,
+    READ, FAA or CAS may change while the program runs, so they are
+    recorded as modified code.  The length of a block written by BCOPY
+    or BFILL is not known until it runs, so those are checked when the
+    instruction is translated.
+
+*/
+void Translator::FindReachable()
+{
+    vector<int> pending = { emulator::ORIGIN };
+    set<int> written;
+    m_targets.insert(emulator::ORIGIN);
+
+    while (!pending.empty()) {
+        int loc = pending.back();
+        pending.pop_back();
+        if (loc < 0 || loc >= emulator::MEMSZ || !m_reachable.insert(loc).second) {
+            continue;
+        }
+
+        int opcode = emulator::Encoding::OpCode(m_memory[loc]);
+        int address = emulator::Encoding::Address(m_memory[loc]);
+        switch (opcode) {
+        case 6:
+        case 7:
+        case 14:
+        case 15:
+            written.insert(address);
+            pending.push_back(loc + 1);
+            break;
+        case 9:
+            m_targets.insert(address);
+            pending.push_back(address);
+            break;
+        case 10:
+        case 11:
+        case 12:
+            m_targets.insert(address);
+            pending.push_back(address);
+            pending.push_back(loc + 1);
+            break;
+        case 13:
+            break;
+        default:
+            if ((opcode >= 1 && opcode <= 8) || (opcode >= 16 && opcode <= 29)) {
+                pending.push_back(loc + 1);
+            }
+            break;
+        }
+    }
+
+    for (int loc : written) {
+        if (m_reachable.count(loc)) {
+            m_modifiedCode.insert(loc);
+        }
+    }
+}
+
+/*
+NAME
+
+    Translator::EmitSource - writes the C++ translation of the program
+
+SYNOPSIS
+
+    bool Translator::EmitSource(const string& a_fileName, const string& a_sourceName);
+    a_fileName -> the file to receive the C++ source
+    a_sourceName -> the name of the assembly language source, for the heading
+
+DESCRIPTION
+
+    This function writes a complete C++ program.  Memory is a static
+    array initialized from the translation and each register is a local
+    variable.  Every reachable instruction becomes straight-line code,
+    with a label where it is branched to and a goto for each branch.  An
+    instruction that may overwrite an instruction hands the rest of
+    the run to an interpreter, so the native code never executes stale
+    instructions.
+
+RETURNS
+
+    Whether the file was written
+
+*/
+bool Translator::EmitSource(const string& a_fileName, const string& a_sourceName)
+{
+    ofstream out(a_fileName);
+    if (!out) {
+        return false;
+    }
+
+    out << "// C++ translation of " << a_sourceName << " generated by the Quack3200 assembler." << endl;
+    out << "// Compile with optimization, e.g. g++ -O2." << endl;
+    out << "#include <algorithm>" << endl;
+    out << "#include <climits>" << endl;
+    out << "#include <cstring>" << endl;
+    out << "#include <iostream>" << endl;
+    out << "using namespace std;" << endl << endl;
+    out << "static int m[" << emulator::MEMSZ << "];" << endl << endl;
+
+    // The instruction encoding, for the interpreter.
+    out << "static const int ADDR_RADIX = " << emulator::MEMSZ << ";" << endl;
+    out << "static const int REG_COUNT = " << emulator::REGCOUNT << ";" << endl << endl;
+
+    // Initial memory as location, contents pairs.
+    out << "static const int image[][2] = {" << endl;
+    bool any = false;
+    for (int loc = 0; loc < emulator::MEMSZ; loc++) {
+        if (m_memory[loc] != 0) {
+            out << "    { " << loc << ", " << m_memory[loc] << " }," << endl;
+            any = true;
+        }
+    }
+    if (!any) {
+        out << "    { 0, 0 }," << endl;
+    }
+    out << "};" << endl;
+    out << RUNTIME << endl;
+
+    out << "int main()" << endl << "{" << endl;
+    out << "    for (const auto& word : image) {" << endl;
+    out << "        m[word[0]] = word[1];" << endl;
+    out << "    }" << endl;
+    out << "    [[maybe_unused]] int " << RegisterList(" = 0") << ";" << endl << endl;
+    out << "    cout << \"Results from emulating program :\" << endl << endl;" << endl;
+    out << "    goto L" << emulator::ORIGIN << ";" << endl << endl;
+
+    for (int loc : m_reachable) {
+        EmitInstruction(out, loc);
+    }
+    out << "}" << endl;
+
+    out.close();
+    return !out.fail();
+}
+
+/*
+NAME
+
+    Translator::EmitInstruction - writes the code for one instruction
+
+SYNOPSIS
+
+    void Translator::EmitInstruction(ostream& a_out, int a_loc);
+    a_out -> the stream receiving the C++ source
+    a_loc -> the location of the instruction
+
+DESCRIPTION
+
+    This function writes the statements that carry out the instruction
+    at a_loc.  Instructions that continue with the next location fall
+    through to its code, which always follows since the next location
+    is reachable too.
+
+*/
+void Translator::EmitInstruction(ostream& a_out, int a_loc)
+{
+    int contents = m_memory[a_loc];
+    int opcode = emulator::Encoding::OpCode(contents);
+    int reg = emulator::Encoding::Register(contents);
+    int address = emulator::Encoding::Address(contents);
+    string r = "r" + to_string(reg);
+    string mem = "m[" + to_string(address) + "]";
+    string value = to_string(address);
+    string source = "r" + to_string(address % emulator::REGCOUNT);
+    string target = "goto L" + to_string(address) + ";";
+
+    if (m_targets.count(a_loc)) {
+        a_out << "L" << a_loc << ":" << endl;
+    }
+
+    switch (opcode) {
+    case 1: a_out << "    " << r << " += " << mem << ";" << endl; break;
+    case 2: a_out << "    " << r << " -= " << mem << ";" << endl; break;
+    case 3: a_out << "    " << r << " *= " << mem << ";" << endl; break;
+    case 4: EmitDivide(a_out, a_loc, r, mem); break;
+    case 5: a_out << "    " << r << " = " << mem << ";" << endl; break;
+    case 6: a_out << "    " << mem << " = " << r << ";" << endl; break;
+    case 7:
+        a_out << "    { int value; if (!readValue(value)) return noInput(" << a_loc << "); " << mem << " = value; }" << endl;
+        break;
+    case 8: a_out << "    cout << " << mem << " << endl;" << endl; break;
+    case 9: a_out << "    " << target << endl; return;
+    case 10: a_out << "    if (" << r << " < 0) " << target << endl; break;
+    case 11: a_out << "    if (" << r << " == 0) " << target << endl; break;
+    case 12: a_out << "    if (" << r << " > 0) " << target << endl; break;
+    case 13: a_out << "    return halted();" << endl; return;
+    case 14: a_out << "    { int old = " << mem << "; " << mem << " += " << r << "; " << r << " = old; }" << endl; break;
+    case 15: a_out << "    { int old = " << mem << "; if (old == r0) " << mem << " = " << r << "; r0 = old; }" << endl; break;
+    case 16: a_out << "    " << r << " = " << mem << ";" << endl; break;
+    case 17: a_out << "    blockCopy(" << address << ", " << r << ", r0);" << endl; break;
+    case 18: a_out << "    blockFill(" << address << ", " << r << ", r0);" << endl; break;
+    case 19: a_out << "    " << r << " = blockSum(" << address << ", r0);" << endl; break;
+    case 20: case 25: a_out << "    " << r << " += " << (opcode == 20 ? value : source) << ";" << endl; break;
+    case 21: case 26: a_out << "    " << r << " -= " << (opcode == 21 ? value : source) << ";" << endl; break;
+    case 22: case 27: a_out << "    " << r << " *= " << (opcode == 22 ? value : source) << ";" << endl; break;
+    case 23: case 28: EmitDivide(a_out, a_loc, r, opcode == 23 ? value : source); break;
+    case 24: case 29: a_out << "    " << r << " = " << (opcode == 24 ? value : source) << ";" << endl; break;
+    default: a_out << "    return illegal();" << endl; return;
+    }
+
+    // The rest of the run is interpreted once code may have been overwritten.
+    // A block written by BCOPY or BFILL may reach any later location.
+    bool modifiesCode = m_modifiedCode.count(address) > 0;
+    if (opcode == 17 || opcode == 18) {
+        modifiesCode = m_reachable.lower_bound(address) != m_reachable.end();
+    }
+    if ((opcode == 6 || opcode == 7 || opcode == 14 || opcode == 15 || opcode == 17 || opcode == 18) && modifiesCode) {
+        a_out << "    { int r[] = { " << RegisterList("") << " }; return interpret(" << a_loc + 1 << ", r); }" << endl;
+        return;
+    }
+
+    // Running off the end of memory is not a legal instruction.
+    if (a_loc + 1 >= emulator::MEMSZ) {
+        a_out << "    return illegal();" << endl;
+    }
+}
+
+/*
+NAME
+
+    Translator::EmitDivide - writes the code for a DIV
+
+SYNOPSIS
+
+    void Translator::EmitDivide(ostream& a_out, int a_loc, const string& a_register, const string& a_divisor);
+    a_out -> the stream receiving the C++ source
+    a_loc -> the location of the DIV
+    a_register -> the register divided
+    a_divisor -> the expression it is divided by
+
+DESCRIPTION
+
+    A division by zero or of the most negative word by -1 would crash
+    the translated program, so the divide is tested first and a DIV
+    that would fault stops the program with the emulator's report.  A
+    DIV by an immediate other than 0 cannot fault and is not tested.
+
+*/
+void Translator::EmitDivide(ostream& a_out, int a_loc, const string& a_register, const string& a_divisor)
+{
+    if (a_divisor == "0" || !isdigit((unsigned char)a_divisor[0])) {
+        a_out << "    if (divideFaults(" << a_register << ", " << a_divisor << ")) { int r[] = { "
+            << RegisterList("") << " }; return fault(" << a_loc << ", r); }" << endl;
+    }
+    a_out << "    " << a_register << " /= " << a_divisor << ";" << endl;
+}
+
+/*
+NAME
+
+    Translator::RegisterList - lists the register variables
+
+SYNOPSIS
+
+    string Translator::RegisterList(const string& a_suffix);
+    a_suffix -> text to follow each variable name
+
+RETURNS
+
+    The names of the register variables, separated by commas
+
+*/
+string Translator::RegisterList(const string& a_suffix)
+{
+    string list;
+    for (int reg = 0; reg < emulator::REGCOUNT; reg++) {
+        list += (reg == 0 ? "r" : ", r") + to_string(reg) + a_suffix;
+    }
+    return list;
+}
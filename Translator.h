@@ -0,0 +1,41 @@
+//
+//		Class to translate a Quack3200 program into C++ source code that can be
+//		compiled into a native executable.
+//
+#pragma once
+
+#include <set>
+#include "MemoryImage.h"
+
+class Translator {
+
+public:
+
+    Translator(const MemoryImage& a_image);
+    ~Translator() {};
+
+    // Writes the C++ translation of the program.  Returns false if the file could not be written.
+    bool EmitSource(const string& a_fileName, const string& a_sourceName);
+
+    // Returns true if a reachable instruction may be overwritten while the program runs.
+    bool IsSelfModifying() const { return !m_modifiedCode.empty(); }
+
+private:
+
+    // Finds the instructions that can be reached from the origin.
+    void FindReachable();
+
+    // Writes the statements for the instruction at a_loc.
+    void EmitInstruction(ostream& a_out, int a_loc);
+
+    // Writes the statements for a DIV, which stop the program if it would fault.
+    void EmitDivide(ostream& a_out, int a_loc, const string& a_register, const string& a_divisor);
+
+    // Returns the register variables separated by commas, each followed by a_suffix.
+    static string RegisterList(const string& a_suffix);
+
+    vector<int> m_memory;           // The initial memory of the program.
+    set<int> m_reachable;           // Locations of instructions that may be executed.
+    set<int> m_targets;             // Locations that are branched to.
+    set<int> m_modifiedCode;        // Locations of reachable instructions that may be overwritten.
+};
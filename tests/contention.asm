@@ -0,0 +1,40 @@
+; Four cores contend for one counter and one lock.  Run with --cores 4.
+; Each core adds 1 to count with FAA and adds 1 to guarded under a lock
+; taken and released with CAS 20000 times.  Core 0 waits for the others
+; and writes both totals; each must be 80000.
+         org 100
+         core 9,zero
+         load 1,iters
+loop     load 2,#1
+         faa 2,count
+lock     load 0,#0
+         load 3,#1
+         cas 3,mutex
+         bz 0,held
+         b lock
+held     load 4,guarded
+         add 4,#1
+         store 4,guarded
+         load 0,#1
+         load 3,#0
+         cas 3,mutex
+         sub 1,#1
+         bp 1,loop
+         load 2,#1
+         faa 2,done
+         bp 9,stop
+wait     load 2,#0
+         faa 2,done
+         sub 2,cores
+         bm 2,wait
+         write count
+         write guarded
+stop     halt
+zero     dc 0
+iters    dc 20000
+cores    dc 4
+count    dc 0
+guarded  dc 0
+mutex    dc 0
+done     dc 0
+         end
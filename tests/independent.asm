@@ -0,0 +1,13 @@
+; Each core counts down 40 times from 99999 in its own registers and halts,
+; so the cores share nothing but the program.  Run with any number of cores.
+         org 100
+         load 2,outers
+outer    load 1,iters
+loop     sub 1,#1
+         bp 1,loop
+         sub 2,#1
+         bp 2,outer
+         halt
+outers   dc 40
+iters    dc 99999
+         end
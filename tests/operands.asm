@@ -0,0 +1,14 @@
+; Uses each operand form added with op codes 20 to 29.
+        org 100
+        load 1,#6
+        add 1,#4
+        mult 1,#3
+        sub 1,#2
+        div 1,#4
+        load 2,$1
+        add 2,$1
+        store 2,res
+        write res
+        halt
+res     dc 0
+        end
@@ -0,0 +1,59 @@
+#!/bin/sh
+#
+#	Runs the test programs with the assembler named and checks the values they
+#	write.  Programs whose result depends on how threads interleave are run
+#	several times.  The cache is checked to miss entries written by an assembler
+#	whose op code table differed.
+#
+#	Usage: tests/run_tests.sh <Assem>
+#
+assem=${1:?usage: tests/run_tests.sh <Assem>}
+dir=$(dirname "$0")
+failures=0
+
+# check <program> <runs> "<expected values>" <options>...
+check() {
+    program=$1
+    runs=$2
+    expected=$3
+    shift 3
+    run=1
+    while [ $run -le $runs ]; do
+        actual=$("$assem" "$dir/$program" "$@" | sed -n '/^Results from emulating/,$p' | grep -E '^-?[0-9]+$' | tr '\n' ' ' | sed 's/ $//')
+        if [ "$actual" != "$expected" ]; then
+            echo "FAIL $program run $run: wrote \"$actual\", expected \"$expected\""
+            failures=$((failures + 1))
+            return
+        fi
+        run=$((run + 1))
+    done
+    echo "ok   $program"
+}
+
+# check_cache_miss <program> <cache> "<expected values>"
+# Assembles the program with a copy of the cache, which holds the entry an older
+# assembler would have made for it, and checks that the translation is made afresh.
+# The entry is named by the program's key, so it must be remade if the program is
+# edited.
+check_cache_miss() {
+    program=$1
+    cache=$(mktemp -d)
+    cp "$dir/$2"/*.qac "$cache"
+    expected=$3
+    output=$("$assem" "$dir/$program" --cache "$cache")
+    actual=$(echo "$output" | sed -n '/^Results from emulating/,$p' | grep -E '^-?[0-9]+$' | tr '\n' ' ' | sed 's/ $//')
+    entries=$(ls "$cache"/*.qac | wc -l)
+    rm -rf "$cache"
+    if echo "$output" | grep -q "Stale translation" || [ "$actual" != "$expected" ] || [ "$entries" -ne 2 ]; then
+        echo "FAIL $program with $2: wrote \"$actual\", expected \"$expected\" from a new cache entry"
+        failures=$((failures + 1))
+        return
+    fi
+    echo "ok   $program with $2"
+}
+
+check contention.asm 20 "80000 80000" --cores 4
+check operands.asm 1 "14"
+check_cache_miss operands.asm cache_1.6 "14"
+
+exit $failures
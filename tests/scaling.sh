@@ -0,0 +1,42 @@
+#!/bin/sh
+#
+#	Measures how the throughput of the multi-core emulator changes with the
+#	number of cores: independent.asm, whose cores share nothing, and
+#	contention.asm, whose cores contend for one counter and one lock.  Each is
+#	run on 1, 2, 4 and 8 cores, and the guest instructions executed by all the
+#	cores per second of emulation are displayed.  Cores waiting for the lock
+#	spin, so for contention.asm the loop iterations made per second, 20000 by
+#	each core, are displayed too.  contention.asm waits for as many cores as its
+#	cores constant says, so a copy is made for each count.
+#
+#	Usage: tests/scaling.sh <Assem>
+#
+assem=${1:?usage: tests/scaling.sh <Assem>}
+dir=$(dirname "$0")
+work=$(mktemp -d)
+
+# measure <program> <cores> [<iterations>]
+measure() {
+    "$assem" "$1" --cores "$2" --stats "$work/stats.json" > /dev/null
+    awk -v cores="$2" -v program="$(basename "$1")" -v iterations="${3:-0}" '
+        /"Emulation"/ { gsub(/[",]/, ""); ms = $2 }
+        /"guest_instructions"/ { gsub(/[",]/, ""); steps = $2 }
+        END {
+            printf "%-16s %2d cores %10d instructions %8.1f ms %7.1f million instructions/s", program, cores, steps, ms, steps / ms / 1000
+            if (iterations > 0) {
+                printf " %6.2f million iterations/s", iterations / ms / 1000
+            }
+            printf "\n"
+        }
+    ' "$work/stats.json"
+}
+
+echo "Host processors: $(getconf _NPROCESSORS_ONLN)"
+for cores in 1 2 4 8; do
+    measure "$dir/independent.asm" $cores
+done
+for cores in 1 2 4 8; do
+    sed "s/^cores    dc 4/cores    dc $cores/" "$dir/contention.asm" > "$work/contention.asm"
+    measure "$work/contention.asm" $cores $((cores * 20000))
+done
+rm -rf "$work"